@@ -0,0 +1,368 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "log.h"
+#include "abtest.h"
+#include "mab.h"
+#include "uncore.h"
+
+#define TAG "ABTEST"
+
+// In-daemon A/B comparison of the tuned policy against the MSR values read
+// at startup on the same machine and workload, so machine drift between
+// benchmark runs does not hide small effects.
+//
+// AB_TIME runs all modules with one configuration per slice. Slices come in
+// blocks of two, one per arm in random order, and the tuner is frozen while
+// the control runs. Each block gives one treatment / control ratio, so drift
+// slower than a block cancels out. AB_SPLIT keeps a random half of the
+// modules on the control for the whole run and takes the ratio of the halves
+// per slice, which assumes the work is spread evenly over the modules.
+// With uncore co-tuning AB_TIME runs the control at the uncore limits found
+// at startup, AB_SPLIT cannot split the package wide uncore and runs both
+// halves at the tuned ratio. Tuned P-cores follow the arm of the slice in
+// AB_TIME and are measured with the E-cores. AB_SPLIT has no half for them
+// and is refused with --pcores.
+//
+// The first intervals after a switch are not measured, IPC and instructions
+// per core second are summed per slice and the mean ratio is reported with a
+// 95% confidence interval once AB_MIN_SLICES ratios are recorded.
+
+#define CORES_PER_MODULE (4)
+
+struct ab_state_s ab_state = {
+	.mode = AB_OFF,
+	.slice_intervals = AB_SLICE_INTERVALS,
+};
+
+static unsigned int seed;
+static uint64_t last_time_ns;
+
+static const char *arm_names[2] = {"default", "tuned"};
+static const char *metric_names[AB_METRICS] = {"IPC", "throughput"};
+
+// Two sided 95% t quantiles for 1-30 degrees of freedom
+static const double t95[30] = {
+	12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+	2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+	2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+static double t_quantile(uint64_t df)
+{
+	if (df < 1)
+		return t95[0];
+	if (df > 30)
+		return 1.96;
+
+	return t95[df - 1];
+}
+
+static void stats_add(struct ab_stats_s *s, double x)
+{
+	double delta = x - s->mean;
+
+	s->n++;
+	s->mean += delta / s->n;
+	s->m2 += delta * (x - s->mean);
+}
+
+static double stats_var(struct ab_stats_s *s)
+{
+	return s->n > 1 ? s->m2 / (s->n - 1) : 0;
+}
+
+// Parse the --ab argument, "time" or "split" optionally followed by the
+// slice length in intervals, e.g. "time:20".
+// Returns 0 on success, -1 on failure
+int ab_parse(const char *arg)
+{
+	const char *len = strchr(arg, ':');
+	size_t n = len ? (size_t)(len - arg) : strlen(arg);
+
+	if (n == 4 && strncmp(arg, "time", n) == 0) {
+		ab_state.mode = AB_TIME;
+	} else if (n == 5 && strncmp(arg, "split", n) == 0) {
+		ab_state.mode = AB_SPLIT;
+	} else {
+		loge(TAG, "Unknown A/B mode %s, use time or split\n", arg);
+		return -1;
+	}
+
+	if (len) {
+		ab_state.slice_intervals = strtol(len + 1, NULL, 10);
+		if (ab_state.slice_intervals <= AB_SKIP_INTERVALS) {
+			loge(TAG, "A/B slice must be more than %d intervals\n",
+			     AB_SKIP_INTERVALS);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+// Pick the module halves for AB_SPLIT. The MAB reward is read from the
+// first module, so it always stays in the treatment half.
+static int split_modules(void)
+{
+	int treatment = (ab_state.num_modules + 1) / 2;
+
+	if (ab_state.num_modules < 2) {
+		loge(TAG, "A/B split needs at least 2 modules\n");
+		return -1;
+	}
+
+	for (int i = 0; i < ab_state.num_modules; i++)
+		ab_state.module_arm[i] = i < treatment ? AB_TREATMENT :
+							 AB_CONTROL;
+
+	for (int i = ab_state.num_modules - 1; i > 0; i--) {
+		int j = rand_r(&seed) % (i + 1);
+		int tmp = ab_state.module_arm[i];
+
+		ab_state.module_arm[i] = ab_state.module_arm[j];
+		ab_state.module_arm[j] = tmp;
+	}
+
+	for (int i = 1; ab_state.module_arm[0] != AB_TREATMENT; i++) {
+		if (ab_state.module_arm[i] == AB_TREATMENT) {
+			ab_state.module_arm[i] = AB_CONTROL;
+			ab_state.module_arm[0] = AB_TREATMENT;
+		}
+	}
+
+	for (int i = 0; i < ab_state.num_modules; i++)
+		logi(TAG, "Module %d (core %d-%d) runs %s\n", i,
+		     core_first + i * CORES_PER_MODULE,
+		     core_first + i * CORES_PER_MODULE + CORES_PER_MODULE - 1,
+		     arm_names[ab_state.module_arm[i]]);
+
+	return 0;
+}
+
+// Set the package wide uncore ratio of an AB_TIME arm, the control runs at
+// the limits found at startup and the treatment at the ratio of the arm
+// MAB picked
+static void apply_uncore(int arm)
+{
+	if (tunealg != MAB || mstate.num_uncore_ratios == 0)
+		return;
+
+	if (arm == AB_CONTROL)
+		uncore_set_ratio(UNCORE_RATIO_NONE);
+	else
+		uncore_set_ratio(arms.uncore_ratio[mstate.arm]);
+}
+
+// Set up the A/B mode selected by ab_parse() for num_cores tuned cores.
+// Returns 0 on success, -1 on failure
+int ab_init(int num_cores)
+{
+	if (ab_state.mode == AB_OFF)
+		return 0;
+
+	if (ab_state.mode == AB_SPLIT && PCORE_THREADS > 0) {
+		loge(TAG, "A/B split does not work with --pcores, use time\n");
+		return -1;
+	}
+
+	seed = time_ns();
+	ab_state.num_modules = (num_cores + CORES_PER_MODULE - 1) /
+			       CORES_PER_MODULE;
+	ab_state.module_arm = calloc(ab_state.num_modules, sizeof(int));
+	if (ab_state.module_arm == NULL) {
+		loge(TAG, "Could not allocate A/B state\n");
+		return -1;
+	}
+
+	if (ab_state.mode == AB_SPLIT && split_modules() < 0) {
+		free(ab_state.module_arm);
+		ab_state.module_arm = NULL;
+		return -1;
+	}
+
+	ab_state.block_first = rand_r(&seed) & 1;
+	ab_state.arm = ab_state.block_first;
+	if (ab_state.mode == AB_TIME)
+		apply_uncore(ab_state.arm);
+
+	logi(TAG, "A/B %s mode, %d intervals per slice\n",
+	     ab_state.mode == AB_TIME ? "time" : "split",
+	     ab_state.slice_intervals);
+
+	return 0;
+}
+
+// 1 if the module of thread runs the control configuration. thread is the
+// gtinfo index, P-core threads follow the E-core ones.
+int ab_control(int thread)
+{
+	if (ab_state.mode == AB_TIME)
+		return ab_state.arm == AB_CONTROL;
+	if (ab_state.mode == AB_SPLIT && thread < ACTIVE_THREADS)
+		return ab_state.module_arm[thread / CORES_PER_MODULE] ==
+		       AB_CONTROL;
+
+	return 0;
+}
+
+// Sum the interval just measured into the arm each module ran, the P-cores
+// included
+static void account_interval(double interval_s)
+{
+	for (int i = 0; i < ALL_THREADS; i++) {
+		int arm = ab_control(i) ? AB_CONTROL : AB_TREATMENT;
+
+		ab_state.instr[arm] += gtinfo[i].instructions_retired;
+		ab_state.cycles[arm] += gtinfo[i].cpu_cycles;
+		ab_state.core_s[arm] += interval_s;
+	}
+}
+
+static void log_effects(void)
+{
+	struct ab_effect_s e;
+
+	for (int m = 0; m < AB_METRICS; m++) {
+		if (ab_effect(m, &e) < 0)
+			continue;
+		logi(TAG, "%s %+.2f%% (95%% CI %+.2f%% .. %+.2f%%), "
+		     "%s %.4g, %s %.4g\n", metric_names[m], e.effect * 100,
+		     e.ci_low * 100, e.ci_high * 100, arm_names[AB_CONTROL],
+		     e.control, arm_names[AB_TREATMENT], e.treatment);
+	}
+}
+
+// Close the slice, record its values and pick the arm of the next one
+static void finish_slice(void)
+{
+	static double value[2][AB_METRICS]; //AB_TIME keeps the block's first
+	int measured[2];
+
+	for (int arm = 0; arm < 2; arm++) {
+		measured[arm] = ab_state.cycles[arm] > 0 &&
+				ab_state.core_s[arm] > 0;
+		if (!measured[arm])
+			continue;
+		value[arm][AB_IPC] = ab_state.instr[arm] / ab_state.cycles[arm];
+		value[arm][AB_IPS] = ab_state.instr[arm] / ab_state.core_s[arm];
+		for (int m = 0; m < AB_METRICS; m++)
+			stats_add(&ab_state.value[arm][m], value[arm][m]);
+		logv(TAG, "Slice %lu %s: IPC %.3f, %.4g instr/s per core\n",
+		     ab_state.slices, arm_names[arm], value[arm][AB_IPC],
+		     value[arm][AB_IPS]);
+	}
+
+	// AB_TIME has both arms measured at the end of a block
+	if (ab_state.mode == AB_TIME)
+		measured[!ab_state.arm] = ab_state.slices % 2 == 1;
+
+	if (measured[AB_CONTROL] && measured[AB_TREATMENT]) {
+		for (int m = 0; m < AB_METRICS; m++)
+			stats_add(&ab_state.ratio[m],
+				  value[AB_TREATMENT][m] /
+				  value[AB_CONTROL][m]);
+	}
+
+	memset(ab_state.instr, 0, sizeof(ab_state.instr));
+	memset(ab_state.cycles, 0, sizeof(ab_state.cycles));
+	memset(ab_state.core_s, 0, sizeof(ab_state.core_s));
+	ab_state.slices++;
+	ab_state.interval = 0;
+
+	log_effects();
+
+	if (ab_state.mode != AB_TIME)
+		return;
+
+	// every block of two slices runs both arms in random order
+	if (ab_state.slices % 2 == 0) {
+		ab_state.block_first = rand_r(&seed) & 1;
+		ab_state.arm = ab_state.block_first;
+	} else {
+		ab_state.arm = !ab_state.block_first;
+	}
+}
+
+// Called by the master core once per interval before the tuner. Accounts
+// the interval just measured to the configuration that ran it and advances
+// the slice, MSRs are rewritten on a switch.
+// Returns 1 if the tuner may run this interval
+int ab_interval(void)
+{
+	uint64_t now = time_ns();
+	int ran = ab_state.arm;
+
+	if (ab_state.mode == AB_OFF)
+		return 1;
+
+	// only AB_TIME switches MSRs at the start of a slice
+	if (last_time_ns && (ab_state.mode == AB_SPLIT ||
+			     ab_state.interval >= AB_SKIP_INTERVALS))
+		account_interval((now - last_time_ns) / 1e9);
+	last_time_ns = now;
+
+	if (++ab_state.interval < ab_state.slice_intervals)
+		return ab_state.mode == AB_SPLIT || ran == AB_TREATMENT;
+
+	finish_slice();
+
+	if (ab_state.mode == AB_SPLIT)
+		return 1;
+
+	if (ab_state.arm != ran) {
+		for (int i = 0; i < ALL_THREADS; i++)
+			gtinfo[i].hwpf_msr_dirty = 1;
+		apply_uncore(ab_state.arm);
+	}
+
+	// the tuner neither learns from the control nor decides for it
+	return ran == AB_TREATMENT && ab_state.arm == AB_TREATMENT;
+}
+
+// Effect of the tuned policy on metric (AB_IPC, AB_IPS) so far.
+// Returns 0 on success, -1 if there are not enough slices yet
+int ab_effect(int metric, struct ab_effect_s *e)
+{
+	struct ab_stats_s *c = &ab_state.value[AB_CONTROL][metric];
+	struct ab_stats_s *t = &ab_state.value[AB_TREATMENT][metric];
+	struct ab_stats_s *r = &ab_state.ratio[metric];
+	double se, h;
+
+	memset(e, 0, sizeof(*e));
+
+	if (ab_state.mode == AB_OFF)
+		return -1;
+
+	if (r->n < AB_MIN_SLICES)
+		return -1;
+
+	se = sqrt(stats_var(r) / r->n);
+	h = t_quantile(r->n - 1) * se;
+	e->control = c->mean;
+	e->treatment = t->mean;
+	e->effect = r->mean - 1;
+	e->ci_low = e->effect - h;
+	e->ci_high = e->effect + h;
+	e->valid = 1;
+
+	return 0;
+}
+
+// Log the final result
+void ab_deinit(void)
+{
+	if (ab_state.mode == AB_OFF)
+		return;
+
+	logi(TAG, "A/B result after %lu slices:\n", ab_state.slices);
+	if (ab_state.ratio[AB_IPC].n < AB_MIN_SLICES)
+		logi(TAG, "Not enough slices for an estimate\n");
+	log_effects();
+
+	free(ab_state.module_arm);
+	ab_state.module_arm = NULL;
+}
@@ -0,0 +1,544 @@
+#define _GNU_SOURCE
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Prefetcher sensitivity microbenchmarks, a small stand-in for SPEC when
+// checking tuner changes. Every thread runs the kernel on its own buffer
+// for a fixed time and the bandwidth, load latency and throughput of all
+// threads are reported per kernel.
+
+#define CACHE_LINE (64)
+#define DEFAULT_SIZE (64 << 20) //bytes per thread
+#define DEFAULT_SECONDS (2.0)
+#define DEFAULT_STRIDE (256) //bytes
+#define CHASE_CHUNK (1 << 20) //loads between time checks
+#define MAX_THREADS (256)
+
+struct node_s {
+	struct node_s *next;
+	char pad[CACHE_LINE - sizeof(struct node_s *)];
+};
+
+struct thread_s {
+	pthread_t thread;
+	int id;
+	int core; //-1 if not pinned
+	int failed; //buffers could not be allocated
+	int role; //kernel run by this thread, differs for mixed
+	size_t size;
+
+	double *data;
+	double *data2;
+	uint32_t *index;
+	struct node_s *nodes;
+	struct node_s *cursor; //chase position, continues across passes
+
+	// results
+	double seconds;
+	double bytes;
+	double accesses;
+	double loads; //dependent loads, for latency
+};
+
+struct kernel_s {
+	const char *name;
+	const char *desc;
+	int role;
+};
+
+// Kernel roles
+#define K_STREAM (0)
+#define K_STRIDE (1)
+#define K_CHASE (2)
+#define K_GATHER (3)
+#define K_STENCIL (4)
+#define K_MIXED (5)
+
+static const struct kernel_s kernels[] = {
+	{"stream", "sequential read", K_STREAM},
+	{"stride", "strided read", K_STRIDE},
+	{"chase", "random pointer chase", K_CHASE},
+	{"gather", "random independent loads", K_GATHER},
+	{"stencil", "2D 5-point stencil", K_STENCIL},
+	{"mixed", "streaming and pointer chase co-runners", K_MIXED},
+};
+
+#define NUM_KERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+static size_t size = DEFAULT_SIZE;
+static size_t stride = DEFAULT_STRIDE;
+static double duration = DEFAULT_SECONDS;
+static int num_threads = 1;
+static int core_first = -1;
+static pthread_barrier_t barrier;
+static volatile double sink;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// xorshift, good enough for shuffles and indices
+static uint64_t next_random(uint64_t *state)
+{
+	uint64_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	*state = x;
+
+	return x;
+}
+
+// Parse a size with an optional K, M or G suffix
+static size_t parse_size(const char *arg)
+{
+	char *end;
+	size_t value = strtoull(arg, &end, 10);
+
+	switch (*end) {
+	case 'k':
+	case 'K':
+		return value << 10;
+	case 'm':
+	case 'M':
+		return value << 20;
+	case 'g':
+	case 'G':
+		return value << 30;
+	}
+
+	return value;
+}
+
+static int setup_thread(struct thread_s *t)
+{
+	size_t n = t->size / sizeof(double);
+	size_t lines = t->size / CACHE_LINE;
+	uint64_t seed = 0x9e3779b97f4a7c15ULL * (t->id + 1);
+
+	switch (t->role) {
+	case K_STREAM:
+	case K_STRIDE:
+		t->data = aligned_alloc(CACHE_LINE, t->size);
+		if (!t->data)
+			return -1;
+		for (size_t i = 0; i < n; i++)
+			t->data[i] = i;
+		break;
+
+	case K_STENCIL:
+		t->data = aligned_alloc(CACHE_LINE, t->size / 2);
+		t->data2 = aligned_alloc(CACHE_LINE, t->size / 2);
+		if (!t->data || !t->data2)
+			return -1;
+		for (size_t i = 0; i < n / 2; i++)
+			t->data[i] = t->data2[i] = i;
+		break;
+
+	case K_GATHER:
+		// a quarter of the buffer for the indices
+		t->data = aligned_alloc(CACHE_LINE, t->size / 4 * 3);
+		t->index = malloc(n / 4 * sizeof(uint32_t));
+		if (!t->data || !t->index)
+			return -1;
+		for (size_t i = 0; i < n / 4 * 3; i++)
+			t->data[i] = i;
+		for (size_t i = 0; i < n / 4; i++)
+			t->index[i] = next_random(&seed) % (n / 4 * 3);
+		break;
+
+	case K_CHASE:
+		// one node per cache line in a single random cycle (Sattolo)
+		t->nodes = aligned_alloc(CACHE_LINE, lines * sizeof(struct node_s));
+		if (!t->nodes || lines < 2)
+			return -1;
+		{
+			size_t *order = malloc(lines * sizeof(size_t));
+
+			if (!order)
+				return -1;
+			for (size_t i = 0; i < lines; i++)
+				order[i] = i;
+			for (size_t i = lines - 1; i > 0; i--) {
+				size_t j = next_random(&seed) % i;
+				size_t tmp = order[i];
+
+				order[i] = order[j];
+				order[j] = tmp;
+			}
+			for (size_t i = 0; i < lines; i++)
+				t->nodes[order[i]].next =
+					&t->nodes[order[(i + 1) % lines]];
+			free(order);
+		}
+		t->cursor = t->nodes;
+		break;
+	}
+
+	return 0;
+}
+
+static void free_thread(struct thread_s *t)
+{
+	free(t->data);
+	free(t->data2);
+	free(t->index);
+	free(t->nodes);
+	t->data = t->data2 = NULL;
+	t->index = NULL;
+	t->nodes = NULL;
+}
+
+// One pass over the buffer, adds what it moved to the thread results
+static void run_pass(struct thread_s *t)
+{
+	size_t n = t->size / sizeof(double);
+	double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+
+	switch (t->role) {
+	case K_STREAM:
+		for (size_t i = 0; i + 3 < n; i += 4) {
+			s0 += t->data[i];
+			s1 += t->data[i + 1];
+			s2 += t->data[i + 2];
+			s3 += t->data[i + 3];
+		}
+		t->bytes += n * sizeof(double);
+		t->accesses += n;
+		break;
+
+	case K_STRIDE: {
+		size_t step = stride / sizeof(double);
+
+		for (size_t i = 0; i < n; i += step)
+			s0 += t->data[i];
+		// every access brings in at least a full line
+		t->bytes += (double)(n / step) *
+			    (stride < CACHE_LINE ? stride : CACHE_LINE);
+		t->accesses += n / step;
+		break;
+	}
+
+	case K_GATHER:
+		for (size_t i = 0; i < n / 4; i++)
+			s0 += t->data[t->index[i]];
+		t->bytes += (double)(n / 4) * (CACHE_LINE + sizeof(uint32_t));
+		t->accesses += n / 4;
+		break;
+
+	case K_STENCIL: {
+		size_t side = 1;
+		double *tmp;
+
+		while ((side + 1) * (side + 1) <= n / 2)
+			side++;
+		for (size_t y = 1; y + 1 < side; y++)
+			for (size_t x = 1; x + 1 < side; x++)
+				t->data2[y * side + x] = 0.2 *
+					(t->data[y * side + x] +
+					 t->data[(y - 1) * side + x] +
+					 t->data[(y + 1) * side + x] +
+					 t->data[y * side + x - 1] +
+					 t->data[y * side + x + 1]);
+		tmp = t->data;
+		t->data = t->data2;
+		t->data2 = tmp;
+		s0 = t->data[side + 1];
+		t->bytes += 2.0 * side * side * sizeof(double);
+		t->accesses += (double)(side - 2) * (side - 2);
+		break;
+	}
+
+	case K_CHASE: {
+		struct node_s *p = t->cursor;
+
+		for (int i = 0; i < CHASE_CHUNK; i++)
+			p = p->next;
+		t->cursor = p;
+		t->bytes += (double)CHASE_CHUNK * CACHE_LINE;
+		t->accesses += CHASE_CHUNK;
+		t->loads += CHASE_CHUNK;
+		break;
+	}
+	}
+
+	sink += s0 + s1 + s2 + s3;
+}
+
+static void *thread_main(void *arg)
+{
+	struct thread_s *t = arg;
+	double start, end;
+
+	if (t->core >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(t->core, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+
+	// allocate, first touch and warm up on the pinned core, not measured
+	t->failed = setup_thread(t) < 0;
+	if (!t->failed)
+		run_pass(t);
+	t->bytes = t->accesses = t->loads = 0;
+
+	pthread_barrier_wait(&barrier);
+	if (t->failed)
+		return NULL;
+
+	start = now();
+	do {
+		run_pass(t);
+		end = now();
+	} while (end - start < duration);
+	t->seconds = end - start;
+
+	return NULL;
+}
+
+struct result_s {
+	double seconds;
+	double bw_mbs;
+	double latency_ns; //0 if the kernel has no dependent loads
+	double mops; //million accesses per second
+};
+
+static int run_kernel(const struct kernel_s *k, struct result_s *r)
+{
+	struct thread_s *threads = calloc(num_threads, sizeof(*threads));
+	int chasers = 0;
+	int ret = 0;
+
+	if (!threads)
+		return -1;
+
+	memset(r, 0, sizeof(*r));
+	pthread_barrier_init(&barrier, NULL, num_threads);
+
+	for (int i = 0; i < num_threads; i++) {
+		struct thread_s *t = &threads[i];
+
+		t->id = i;
+		t->core = core_first >= 0 ? core_first + i : -1;
+		t->size = size;
+		// mixed runs streamers on even and pointer chasers on odd threads
+		t->role = k->role == K_MIXED ? (i % 2 ? K_CHASE : K_STREAM) :
+					       k->role;
+		pthread_create(&t->thread, NULL, thread_main, t);
+	}
+
+	for (int i = 0; i < num_threads; i++) {
+		struct thread_s *t = &threads[i];
+
+		pthread_join(t->thread, NULL);
+		if (t->failed) {
+			fprintf(stderr, "Could not allocate %zu bytes for %s\n",
+				size, k->name);
+			ret = -1;
+		}
+		if (t->seconds > r->seconds)
+			r->seconds = t->seconds;
+		if (t->seconds <= 0)
+			continue;
+
+		// streaming co-runners count for the bandwidth, chasers for
+		// the latency
+		if (k->role != K_MIXED || t->role == K_STREAM) {
+			r->bw_mbs += t->bytes / t->seconds / (1 << 20);
+			r->mops += t->accesses / t->seconds / 1e6;
+		}
+		if (t->loads) {
+			r->latency_ns += t->seconds / t->loads * 1e9;
+			chasers++;
+		}
+	}
+
+	// mean over the pointer chasing threads
+	if (chasers)
+		r->latency_ns /= chasers;
+
+	pthread_barrier_destroy(&barrier);
+	for (int i = 0; i < num_threads; i++)
+		free_thread(&threads[i]);
+	free(threads);
+
+	return ret;
+}
+
+static void print_usage(void)
+{
+	printf("Usage: microbench [options]\n");
+	printf(" -k --kernel - comma separated kernels to run, default all:\n");
+	for (int i = 0; i < NUM_KERNELS; i++)
+		printf("   %-8s %s\n", kernels[i].name, kernels[i].desc);
+	printf(" -s --size - buffer per thread with K, M or G suffix, default "
+	       "64M\n");
+	printf(" -T --threads - number of threads, default 1, mixed needs "
+	       "at least 2\n");
+	printf(" -c --core - pin threads to cores starting at this core id\n");
+	printf(" -d --duration - seconds per kernel, default %.0f\n",
+	       DEFAULT_SECONDS);
+	printf(" -S --stride - stride kernel step in bytes, default %d\n",
+	       DEFAULT_STRIDE);
+	printf(" -o --output - also write the results as CSV to this file\n");
+	printf(" -h --help - this help\n");
+}
+
+static int kernel_selected(const char *list, const char *name)
+{
+	size_t len = strlen(name);
+
+	if (!list)
+		return 1;
+
+	for (const char *p = list; p; p = strchr(p, ',')) {
+		if (*p == ',')
+			p++;
+		if (strncmp(p, name, len) == 0 &&
+		    (p[len] == ',' || p[len] == '\0'))
+			return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *selection = NULL;
+	const char *output = NULL;
+	FILE *csv = NULL;
+	int failed = 0;
+
+	static struct option long_options[] = {
+	    {"kernel", required_argument, 0, 'k'},
+	    {"size", required_argument, 0, 's'},
+	    {"threads", required_argument, 0, 'T'},
+	    {"core", required_argument, 0, 'c'},
+	    {"duration", required_argument, 0, 'd'},
+	    {"stride", required_argument, 0, 'S'},
+	    {"output", required_argument, 0, 'o'},
+	    {"help", no_argument, 0, 'h'},
+	    {NULL, no_argument, 0, 0},
+	};
+
+	while (1) {
+		int c = getopt_long(argc, argv, "k:s:T:c:d:S:o:h", long_options,
+				    NULL);
+
+		if (c == -1)
+			break;
+
+		switch (c) {
+		case 'k':
+			selection = optarg;
+			break;
+		case 's':
+			size = parse_size(optarg);
+			break;
+		case 'T':
+			num_threads = strtol(optarg, NULL, 10);
+			break;
+		case 'c':
+			core_first = strtol(optarg, NULL, 10);
+			break;
+		case 'd':
+			duration = strtod(optarg, NULL);
+			break;
+		case 'S':
+			stride = parse_size(optarg);
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'h':
+			print_usage();
+			return 0;
+		default:
+			print_usage();
+			return 1;
+		}
+	}
+
+	if (num_threads < 1 || num_threads > MAX_THREADS) {
+		fprintf(stderr, "Threads must be 1-%d\n", MAX_THREADS);
+		return 1;
+	}
+	// whole lines in every quarter of the buffer
+	size -= size % (4 * CACHE_LINE);
+	if (size < 16 * CACHE_LINE || stride < sizeof(double) ||
+	    stride >= size) {
+		fprintf(stderr, "Invalid size %zu or stride %zu\n", size,
+			stride);
+		return 1;
+	}
+
+	for (int i = 0; selection && i <= NUM_KERNELS; i++) {
+		if (i == NUM_KERNELS) {
+			fprintf(stderr, "Unknown kernel in %s\n", selection);
+			return 1;
+		}
+		if (kernel_selected(selection, kernels[i].name))
+			break;
+	}
+
+	if (output) {
+		csv = fopen(output, "w");
+		if (!csv) {
+			perror(output);
+			return 1;
+		}
+		fprintf(csv, "kernel,threads,size_kb,stride,seconds,bw_mbs,"
+			     "latency_ns,mops\n");
+	}
+
+	printf("%-8s %7s %10s %8s %10s %10s %10s\n", "kernel", "threads",
+	       "size_kb", "seconds", "bw_mb/s", "lat_ns", "mops");
+
+	for (int i = 0; i < NUM_KERNELS; i++) {
+		const struct kernel_s *k = &kernels[i];
+		struct result_s r;
+
+		if (!kernel_selected(selection, k->name))
+			continue;
+
+		if (k->role == K_MIXED && num_threads < 2) {
+			fprintf(stderr, "Skipping mixed, it needs 2 threads\n");
+			continue;
+		}
+
+		if (run_kernel(k, &r) < 0) {
+			failed = 1;
+			continue;
+		}
+
+		printf("%-8s %7d %10zu %8.2f %10.1f %10.1f %10.1f\n", k->name,
+		       num_threads, size >> 10, r.seconds, r.bw_mbs,
+		       r.latency_ns, r.mops);
+		fflush(stdout);
+
+		if (csv)
+			fprintf(csv, "%s,%d,%zu,%zu,%.3f,%.1f,%.2f,%.2f\n",
+				k->name, num_threads, size >> 10,
+				k->role == K_STRIDE ? stride : 0, r.seconds,
+				r.bw_mbs, r.latency_ns, r.mops);
+	}
+
+	if (csv)
+		fclose(csv);
+
+	return failed;
+}
@@ -141,6 +141,12 @@ MAB PARAMETERS:
     Arm Configuration:   $ARM_CONFIGURATION
     Reward Type:         $REWARD
 
+RATE MODE:
+    Copies:              ${RATE_COPIES:-0}
+    Module Size:         ${RATE_MODULE_SIZE:-4}
+    Perf Stat:           ${PERF_STAT:-1}
+    Perf Events:         ${PERF_EVENTS:-"(default)"}
+
 Configuration loaded from: $config_file
 EOF
     else
@@ -164,10 +170,14 @@ OPTIONS:
     --full                 Run full suite (1 iteration across all benchmarks) - this is the default
     --quick                Run development test (1 iteration across xalancbmk only)
     --benchmark BENCHMARK  Run single benchmark (specify benchmark name)
+    --micro                Run the bundled microbenchmarks (no SPEC needed)
     --iterations N         Number of iterations for single benchmark (default: 5)
+    --copies N             Rate mode: N parallel copies on whole modules with perf counters
     --note TEXT           Add annotation to benchmark run (reflected in directory/file names)
     --dpf                  Add dpf analysis to any mode
     --verbose              Enable verbose output
+    --threshold PCT        Regression threshold for the performance verdict (default: REGRESSION_THRESHOLD)
+    --no-gate              Skip the pass/fail performance verdict after the run
     -l, --list             List available benchmarks
     --config               Show current configuration parameters
     --set-baseline         Set the most recent run as reference baseline
@@ -191,6 +201,10 @@ MODES:
                          * Estimated time: 1-3 hours per benchmark
                          * Purpose: Individual benchmark testing
 
+    --micro              MICROBENCHMARK MODE: stream, stride, chase, gather, stencil, mixed
+                         * Estimated time: 5 minutes
+                         * Purpose: Regression set for tuner changes, no SPEC needed
+
 FLAGS:
     --dpf                Add DPF configuration analysis to any mode 
                          * Runs baseline + DPF configuration + comparison
@@ -203,12 +217,14 @@ EXAMPLES:
     $0 --quick                # Development: 1 iteration across xalancbmk only (5 minutes)
     $0 --benchmark 602.gcc    # Single benchmark: GCC (5 iterations, 1-3 hours)
     $0 --benchmark 623.xalancbmk --iterations 3  # Single benchmark with custom iterations
+    $0 --benchmark 605.mcf --copies 8 --dpf  # 8 copies on two modules, baseline + DPF
     $0 --quick --note L2Q_val4_XQ_val5  # Quick test with annotation
     $0 --baseline --note stable_config  # Baseline with annotation
     $0 --dpf                  # Full suite + dpf analysis
     $0 --baseline --dpf       # Comprehensive + dpf analysis
     $0 --quick --dpf          # Quick test + dpf analysis
     $0 --benchmark 641.leela --dpf  # Single benchmark with DPF analysis
+    $0 --micro --dpf          # Microbenchmarks with and without DPF
     $0 --list                 # List available benchmarks
     $0 --verbose              # Full suite with detailed output
 
@@ -495,6 +511,10 @@ run_single_benchmark() {
         cmd="$cmd --dpf"
     fi
     
+    if [ -n "$RATE_COPIES_ARG" ]; then
+        cmd="$cmd --copies $RATE_COPIES_ARG"
+    fi
+    
     if [ "$VERBOSE" = true ]; then
         cmd="$cmd --verbose"
     fi
@@ -525,84 +545,47 @@ run_single_benchmark() {
 }
 
 generate_analysis() {
-    if [[ "$VERBOSE" == true ]]; then
-        print_section "Generating Performance Analysis and Visualizations"
-    fi
-    
-    # Always perform comparison if we have baseline data - regardless of DPF mode
-    # Current configuration (DPF or baseline) should be compared against reference baseline
-    if [ ! -f "$DATA_DIR/baseline/aggregated.csv" ]; then
-        print_error "Comparative analysis requires baseline data"
-        return 1
-    fi
+    print_section "Performance Verdict"
     
     cd "$PROJECT_ROOT"
     
-    # ALL comparisons are against baseline reference
-    local baseline_file="$DATA_DIR/baseline/aggregated.csv"
-    local current_file
-    local current_label
-    
-    if [ "$RUN_MODE" = "baseline" ]; then
-        # Baseline mode: No comparison needed (this IS the reference)
-        print_info "Baseline reference established - no comparison needed"
+    # The latest run is tested against REFERENCE_BASELINE (or the first run)
+    local run_count=$(find "${RESULTS_DIR}/reports" -mindepth 1 -maxdepth 1 -type d 2>/dev/null | wc -l)
+    if [ "$run_count" -lt 2 ]; then
+        print_info "No baseline run to compare against - skipping verdict"
         return 0
-    elif [ "$DPF_ENABLED" = true ]; then
-        # DPF mode: Compare baseline vs DPF
-        current_file="$DATA_DIR/dpf/aggregated.csv"
-        current_label="dpf"
-        print_info "Comparison mode: Baseline vs DPF"
-    else
-        # Default mode: Compare baseline vs current configuration
-        current_file="$DATA_DIR/current/aggregated.csv"
-        current_label="current"
-        print_info "Comparison mode: Baseline vs Current Configuration"
     fi
     
-    # Verify baseline reference exists
-    if [ ! -f "$baseline_file" ]; then
-        print_error "Baseline reference not found at $baseline_file"
-        print_error "Please run with --baseline first to establish reference point"
-        return 1
-    fi
-    
-    # Verify current data exists
-    if [ ! -f "$current_file" ]; then
-        print_error "Current configuration data not found at $current_file"
-        return 1
-    fi
+    local analysis_args=(--gate --no-trace)
+    [ -n "$REGRESSION_THRESHOLD_ARG" ] && analysis_args+=(--threshold "$REGRESSION_THRESHOLD_ARG")
     
-    # Provide explicit arguments for reliable comparison  
+    local exit_code
     if [ "$VERBOSE" = true ]; then
-        python3 "$SCRIPT_DIR/scripts/analysis/compare_performance.py" \
-            --baseline-file "$baseline_file" \
-            --current-file "$current_file" \
-            --baseline-type "baseline" \
-            --current-type "$current_label" 2>&1 | tee -a "$LOG_FILE"
-    else
-        python3 "$SCRIPT_DIR/scripts/analysis/compare_performance.py" \
-            --baseline-file "$baseline_file" \
-            --current-file "$current_file" \
-            --baseline-type "baseline" \
-            --current-type "$current_label" >> "$LOG_FILE" 2>&1
-    fi
-    
-    local exit_code=${PIPESTATUS[0]}
-    if [ $exit_code -eq 0 ]; then
-        print_success "Performance analysis completed"
+        python3 "$SCRIPT_DIR/scripts/analysis/compare_performance.py" "${analysis_args[@]}" 2>&1 | tee -a "$LOG_FILE"
+        exit_code=${PIPESTATUS[0]}
     else
-        print_error "Performance analysis failed"
-        return 1
+        python3 "$SCRIPT_DIR/scripts/analysis/compare_performance.py" "${analysis_args[@]}" >> "$LOG_FILE" 2>&1
+        exit_code=$?
+        # Show the significance table and verdict from the log
+        sed -n '/^SIGNIFICANCE:/,/^VERDICT:/p' "$LOG_FILE" | tail -n 50
     fi
     
-    # Verify output files
-    if [ -f "results/performance_comparison.png" ]; then
-        print_success "Performance visualization created"
-    fi
+    case $exit_code in
+        0)
+            print_success "Performance verdict: PASS"
+            ;;
+        3)
+            print_error "Performance verdict: FAIL - significant regression against the baseline"
+            ;;
+        4)
+            print_error "Performance verdict: FAIL - no candidate results to compare"
+            ;;
+        *)
+            print_warning "Performance analysis failed (exit code: $exit_code)"
+            ;;
+    esac
     
-    if [ -f "$DATA_DIR/comparison/performance_comparison.csv" ]; then
-        print_success "Performance comparison CSV created"
-    fi
+    return $exit_code
 }
 
 show_results_summary() {
@@ -640,6 +623,7 @@ cleanup_on_error() {
 
 # Parse command line arguments
 RUN_MODE="full"    # Default to full mode (1 iteration × all benchmarks)
+GATE_ENABLED=true
 DPF_ENABLED=false
 VERBOSE=false
 SINGLE_BENCHMARK=""
@@ -662,6 +646,10 @@ while [[ $# -gt 0 ]]; do
             RUN_MODE="quick"
             shift
             ;;
+        --micro)
+            RUN_MODE="micro"
+            shift
+            ;;
         --benchmark)
             if [ -z "$2" ]; then
                 print_error "--benchmark requires a benchmark name"
@@ -679,6 +667,15 @@ while [[ $# -gt 0 ]]; do
             BENCHMARK_ITERATIONS="$2"
             shift 2
             ;;
+        --copies)
+            if [ -z "$2" ] || ! [[ "$2" =~ ^[0-9]+$ ]]; then
+                print_error "--copies requires a positive number"
+                exit 1
+            fi
+            # exported for the suite scripts
+            export RATE_COPIES_ARG="$2"
+            shift 2
+            ;;
         --note)
             if [ -z "$2" ]; then
                 print_error "--note requires an annotation string"
@@ -695,6 +692,18 @@ while [[ $# -gt 0 ]]; do
             VERBOSE=true
             shift
             ;;
+        --threshold)
+            if [ -z "$2" ] || ! [[ "$2" =~ ^[0-9]+(\.[0-9]+)?$ ]]; then
+                print_error "--threshold requires a percentage"
+                exit 1
+            fi
+            REGRESSION_THRESHOLD_ARG="$2"
+            shift 2
+            ;;
+        --no-gate)
+            GATE_ENABLED=false
+            shift
+            ;;
         -l|--list)
             SHOW_LIST=true
             shift
@@ -798,6 +807,16 @@ else
     exit 1
 fi
 
+# Microbenchmarks need neither SPEC nor the suite prerequisites
+if [[ "$RUN_MODE" == "micro" ]]; then
+    micro_args=()
+    [[ "$DPF_ENABLED" == true ]] && micro_args+=(--dpf)
+    [[ -n "$NOTE" ]] && micro_args+=(--note "$NOTE")
+    cd "$PROJECT_ROOT"
+    sudo -E "$PROJECT_ROOT/scripts/execution/run_microbench.sh" "${micro_args[@]}"
+    exit $?
+fi
+
 # Validate single benchmark selection if specified
 if [[ -n "$SINGLE_BENCHMARK" ]]; then
     # Export command line suite override if specified
@@ -1010,8 +1029,18 @@ fi
 
 show_results_summary
 
+# Pass/fail verdict of this run against the baseline, a regression fails the run
+verdict_status=0
+if [ "$GATE_ENABLED" = true ] && [ "${REGRESSION_GATE:-1}" = 1 ] && [ "$RUN_MODE" != "baseline" ]; then
+    generate_analysis || verdict_status=$?
+fi
+
 log_and_print "Completed at: $(date)"
 
 # Determine final completion status and exit appropriately
-determine_completion_status "$RUN_MODE" "$baseline_success" "$dpf_success" "$current_config_success" "$PROJECT_ROOT" "$LOG_FILE"
-exit $?
\ No newline at end of file
+completion_status=0
+determine_completion_status "$RUN_MODE" "$baseline_success" "$dpf_success" "$current_config_success" "$PROJECT_ROOT" "$LOG_FILE" || completion_status=$?
+if [ $completion_status -eq 0 ] && { [ $verdict_status -eq 3 ] || [ $verdict_status -eq 4 ]; }; then
+    exit $verdict_status
+fi
+exit $completion_status
\ No newline at end of file
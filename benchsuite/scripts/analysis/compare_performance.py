@@ -5,12 +5,24 @@ Extracts performance data from benchmark runs and provides comprehensive compari
 Automatically processes all available runs and compares against configured baseline.
 """
 import re
+import math
+import numpy as np
 import pandas as pd
 import argparse
 from pathlib import Path
 import sys
 from datetime import datetime
 
+try:
+    from scipy import stats as scipy_stats
+except ImportError:
+    scipy_stats = None
+
+# Exit codes of --gate when the candidate run regressed, or has no results
+# to test against the baseline
+REGRESSION_EXIT_CODE = 3
+MISSING_EXIT_CODE = 4
+
 def load_config():
     """Load configuration from benchsuite.conf"""
     config_file = Path(__file__).parent.parent.parent / 'config' / 'benchsuite.conf'
@@ -479,16 +491,179 @@ def save_comparison_csv(comparison_df, output_file):
     comparison_df.to_csv(output_path, index=False)
     print(f"\nDetailed comparison saved to: {output_path}")
 
-def run_comparison_analysis(results_dir, config):
-    """Run comprehensive comparison analysis of all available runs"""
+def config_number(config, key, default):
+    """Numeric config value without its trailing comment"""
+    value = config.get(key, '').split('#')[0].strip()
+    try:
+        return float(value)
+    except ValueError:
+        return default
+
+def remove_outliers(samples):
+    """Drop samples outside the Tukey fences (1.5 IQR), needs 4 or more samples"""
+    samples = np.asarray(samples, dtype=float)
+    if len(samples) < 4:
+        return samples
+    
+    q1, q3 = np.percentile(samples, [25, 75])
+    iqr = q3 - q1
+    keep = (samples >= q1 - 1.5 * iqr) & (samples <= q3 + 1.5 * iqr)
+    return samples[keep]
+
+def welch_test(a, b):
+    """Two sided Welch t-test p-value, normal approximation without scipy"""
+    if len(a) < 2 or len(b) < 2:
+        return None
+    if scipy_stats is not None:
+        p = scipy_stats.ttest_ind(a, b, equal_var=False).pvalue
+        return None if np.isnan(p) else float(p)
+    
+    se = math.sqrt(np.var(a, ddof=1) / len(a) + np.var(b, ddof=1) / len(b))
+    if se == 0:
+        return 1.0 if np.mean(a) == np.mean(b) else 0.0
+    t = (np.mean(a) - np.mean(b)) / se
+    return math.erfc(abs(t) / math.sqrt(2))
+
+def mann_whitney_test(a, b):
+    """Two sided Mann-Whitney U p-value, normal approximation without scipy"""
+    if len(a) < 2 or len(b) < 2:
+        return None
+    if scipy_stats is not None:
+        return float(scipy_stats.mannwhitneyu(a, b, alternative='two-sided').pvalue)
+    
+    ranks = pd.Series(np.concatenate([a, b])).rank().values
+    u = ranks[:len(a)].sum() - len(a) * (len(a) + 1) / 2
+    mu = len(a) * len(b) / 2
+    sigma = math.sqrt(len(a) * len(b) * (len(a) + len(b) + 1) / 12)
+    if sigma == 0:
+        return 1.0
+    z = (abs(u - mu) - 0.5) / sigma
+    return min(1.0, math.erfc(max(z, 0) / math.sqrt(2)))
+
+def bootstrap_speedups(base, run, n_boot, rng):
+    """Bootstrap distribution of the speedup (baseline mean / run mean)"""
+    base_means = rng.choice(base, (n_boot, len(base))).mean(axis=1)
+    run_means = rng.choice(run, (n_boot, len(run))).mean(axis=1)
+    return base_means / run_means
+
+def run_significance_analysis(combined_df, baseline_id, candidate_id, config, args):
+    """Test every benchmark of the candidate run against the baseline run and
+    aggregate the speedups by geometric mean. Returns the gate exit code, 0,
+    REGRESSION_EXIT_CODE or MISSING_EXIT_CODE"""
+    threshold = args.threshold if args.threshold is not None else config_number(config, 'REGRESSION_THRESHOLD', 2)
+    alpha = args.alpha if args.alpha is not None else config_number(config, 'SIGNIFICANCE_ALPHA', 0.05)
+    n_boot = int(config_number(config, 'BOOTSTRAP_SAMPLES', 2000))
+    rng = np.random.default_rng(0)
+    limit = 1 - threshold / 100
+    
+    results = []
+    boot = []
+    for benchmark in sorted(combined_df['benchmark'].unique()):
+        bench = combined_df[combined_df['benchmark'] == benchmark]
+        base = remove_outliers(bench[bench['run_id'] == baseline_id]['elapsed_seconds'])
+        run = remove_outliers(bench[bench['run_id'] == candidate_id]['elapsed_seconds'])
+        if len(base) == 0 or len(run) == 0:
+            continue
+        
+        speedup = base.mean() / run.mean()
+        speedups = bootstrap_speedups(base, run, n_boot, rng)
+        ci_low, ci_high = np.percentile(speedups, [100 * alpha / 2, 100 * (1 - alpha / 2)])
+        p_welch = welch_test(base, run)
+        p_mw = mann_whitney_test(base, run)
+        
+        # Significant when the bootstrap interval excludes no change and
+        # Welch agrees, Mann-Whitney is reported as the rank based check.
+        # Welch needs two samples per side, one is not "no change".
+        significant = (ci_low > 1 or ci_high < 1) and p_welch is not None and p_welch < alpha
+        if p_welch is None:
+            verdict = 'insufficient samples'
+        elif significant and speedup < limit:
+            verdict = 'REGRESSION'
+        elif significant and speedup > 1:
+            verdict = 'improvement'
+        else:
+            verdict = 'no change'
+        
+        results.append({
+            'benchmark': benchmark,
+            'baseline_run_id': baseline_id,
+            'run_id': candidate_id,
+            'baseline_samples': len(base),
+            'run_samples': len(run),
+            'baseline_time_sec': base.mean(),
+            'run_time_sec': run.mean(),
+            'speedup': speedup,
+            'speedup_ci_low': ci_low,
+            'speedup_ci_high': ci_high,
+            'p_welch': p_welch,
+            'p_mann_whitney': p_mw,
+            'verdict': verdict,
+        })
+        boot.append(np.log(speedups))
+    
+    if not results:
+        print(f"\nNo benchmarks in common between {baseline_id} and {candidate_id}")
+        print("VERDICT: FAIL - no candidate results")
+        return MISSING_EXIT_CODE
+    
+    sig_df = pd.DataFrame(results)
+    geomean = math.exp(np.log(sig_df['speedup']).mean())
+    geo_boot = np.exp(np.mean(boot, axis=0))
+    geo_low, geo_high = np.percentile(geo_boot, [100 * alpha / 2, 100 * (1 - alpha / 2)])
+    geo_regression = geomean < limit and geo_high < 1
+    regression = geo_regression or (sig_df['verdict'] == 'REGRESSION').any()
+    
+    print(f"\n{'='*80}")
+    print(f"SIGNIFICANCE: {candidate_id} vs {baseline_id}")
+    print(f"Regression threshold {threshold:g}%, alpha {alpha:g}, {n_boot} bootstrap samples"
+          f"{'' if scipy_stats is not None else ', normal approximations (scipy not installed)'}")
+    print(f"{'='*80}")
+    for _, row in sig_df.iterrows():
+        p_welch = f"{row['p_welch']:.3f}" if pd.notna(row['p_welch']) else '-'
+        p_mw = f"{row['p_mann_whitney']:.3f}" if pd.notna(row['p_mann_whitney']) else '-'
+        print(f"{row['benchmark']:<20} Speedup: {row['speedup']:.3f}x "
+              f"[{row['speedup_ci_low']:.3f}, {row['speedup_ci_high']:.3f}] | "
+              f"n={row['baseline_samples']}/{row['run_samples']} | "
+              f"Welch p={p_welch} | MW p={p_mw} | {row['verdict']}")
+    print(f"\nGeomean speedup: {geomean:.3f}x [{geo_low:.3f}, {geo_high:.3f}]")
+    insufficient = (sig_df['verdict'] == 'insufficient samples').sum()
+    if insufficient:
+        print(f"{insufficient} of {len(sig_df)} benchmarks have fewer than 2 samples per run, "
+              f"run more iterations to test them")
+    print(f"VERDICT: {'FAIL' if regression else 'PASS'}")
+    
+    sig_df = pd.concat([sig_df, pd.DataFrame([{
+        'benchmark': 'geomean',
+        'baseline_run_id': baseline_id,
+        'run_id': candidate_id,
+        'speedup': geomean,
+        'speedup_ci_low': geo_low,
+        'speedup_ci_high': geo_high,
+        'verdict': 'REGRESSION' if geo_regression else 'no change',
+    }])], ignore_index=True)
+    
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    output_path = Path(args.results_dir) / 'csv' / f'significance_{timestamp}.csv'
+    output_path.parent.mkdir(parents=True, exist_ok=True)
+    sig_df.round(4).to_csv(output_path, index=False)
+    print(f"Significance results saved to: {output_path}")
+    
+    return REGRESSION_EXIT_CODE if regression else 0
+
+def run_comparison_analysis(results_dir, config, args=None):
+    """Run comprehensive comparison analysis of all available runs.
+    Returns the gate exit code: 0, REGRESSION_EXIT_CODE if the candidate run
+    regressed against the baseline, MISSING_EXIT_CODE if it has no results.
+    Without args there is no candidate and it returns 0"""
     baseline_id = config.get('REFERENCE_BASELINE', '')
     reports_dir = Path(results_dir) / 'reports'
+    missing = MISSING_EXIT_CODE if args is not None else 0
     
     # Find all available runs
     all_runs = find_all_runs(reports_dir)
     if len(all_runs) < 1:
         print("No benchmark runs found for comparison analysis.")
-        return
+        return missing
     
     print(f"\nFound {len(all_runs)} benchmark runs")
     
@@ -512,7 +687,7 @@ def run_comparison_analysis(results_dir, config):
     if len(all_runs) < 2:
         print(f"Only one run found ({baseline_id}). No comparison possible.")
         print("Run more benchmarks to enable comparison analysis.")
-        return
+        return missing
     
     # Extract data from all runs
     all_data = []
@@ -525,7 +700,7 @@ def run_comparison_analysis(results_dir, config):
     
     if not all_data:
         print("No valid benchmark data found for comparison")
-        return
+        return missing
     
     # Combine all data
     combined_df = pd.concat(all_data, ignore_index=True)
@@ -535,7 +710,7 @@ def run_comparison_analysis(results_dir, config):
     baseline_data = aggregated_df[aggregated_df['run_id'] == baseline_id]
     if baseline_data.empty:
         print(f"No data found for baseline: {baseline_id}")
-        return
+        return missing
     
     # Compare all runs to baseline
     comparison_df = compare_runs_to_baseline(aggregated_df, baseline_data)
@@ -547,6 +722,317 @@ def run_comparison_analysis(results_dir, config):
     timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
     output_file = Path(results_dir) / 'csv' / f'performance_comparison_{timestamp}.csv'
     save_comparison_csv(comparison_df, output_file)
+    
+    if args is None:
+        return 0
+    
+    # The candidate defaults to the latest run that is not the baseline
+    candidate_id = args.candidate or sorted(r for r in all_runs if r != baseline_id)[-1]
+    if candidate_id not in all_runs or candidate_id == baseline_id:
+        print(f"ERROR: Candidate run '{candidate_id}' not found or same as baseline")
+        print("VERDICT: FAIL - no candidate results")
+        return MISSING_EXIT_CODE
+    args.results_dir = results_dir
+    return run_significance_analysis(combined_df, baseline_id, candidate_id, config, args)
+
+def extract_trace_data(run_dir):
+    """Summarize the DPF decision traces (dpf_*.trace.csv) of a single run directory"""
+    data = []
+    benchmark_speed_dir = Path(run_dir) / 'benchmark_speed'
+    
+    if not benchmark_speed_dir.exists():
+        return pd.DataFrame()
+    
+    for benchmark_dir in sorted(benchmark_speed_dir.iterdir()):
+        ref_dir = benchmark_dir / 'ref'
+        benchmark_match = re.match(r'(\d+)\.(.+)', benchmark_dir.name)
+        if not ref_dir.is_dir() or not benchmark_match:
+            continue
+        
+        for trace_file in sorted(ref_dir.glob('dpf_*.trace.csv')):
+            try:
+                trace = pd.read_csv(trace_file)
+            except Exception as e:
+                print(f"Could not read trace {trace_file}: {e}")
+                continue
+            if trace.empty:
+                continue
+            
+            row = {
+                'run_id': Path(run_dir).name,
+                'benchmark': benchmark_match.group(2),
+                'trace': trace_file.name,
+                'intervals': len(trace),
+                'mean_decision_us': trace['decision_ns'].mean() / 1000,
+                'max_decision_us': trace['decision_ns'].max() / 1000,
+                'msr_changes': int(trace['msr_changes'].sum()),
+                'mean_ddr_rd_mbs': trace['ddr_rd_bw'].mean() / (1024 * 1024),
+                'mean_ddr_wr_mbs': trace['ddr_wr_bw'].mean() / (1024 * 1024),
+            }
+            
+            # Arm selection, only MAB intervals have an arm
+            mab = trace[trace['arm'] >= 0]
+            if not mab.empty:
+                arm_share = mab['arm'].value_counts(normalize=True)
+                row['top_arm'] = int(arm_share.index[0])
+                row['top_arm_share_pct'] = arm_share.iloc[0] * 100
+                row['arm_switches'] = int((mab['arm'].diff().fillna(0) != 0).sum())
+                row['mean_reward'] = mab['reward'].mean()
+                row['mean_norm_reward'] = mab['norm_reward'].mean()
+                row['sleep_pct'] = (mab['mode'] == 'SLEEP').mean() * 100
+            data.append(row)
+    
+    return pd.DataFrame(data)
+
+def run_trace_analysis(results_dir):
+    """Summarize the DPF decision traces of all available runs"""
+    reports_dir = Path(results_dir) / 'reports'
+    
+    all_data = []
+    for run_id in find_all_runs(reports_dir):
+        trace_data = extract_trace_data(reports_dir / run_id)
+        if not trace_data.empty:
+            all_data.append(trace_data)
+    
+    if not all_data:
+        print("\nNo DPF decision traces found (enable LOG_ARMS, LOG_IPC or LOG_BW).")
+        return
+    
+    summary_df = pd.concat(all_data, ignore_index=True).round(3)
+    
+    print(f"\n" + "=" * 60)
+    print("DPF TUNING SUMMARY")
+    print("=" * 60)
+    columns = [c for c in ['run_id', 'benchmark', 'intervals', 'top_arm', 'top_arm_share_pct',
+                           'arm_switches', 'mean_reward', 'mean_ddr_rd_mbs', 'mean_decision_us']
+               if c in summary_df.columns]
+    print(summary_df[columns].to_string(index=False))
+    
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    output_path = Path(results_dir) / 'csv' / f'tuning_summary_{timestamp}.csv'
+    output_path.parent.mkdir(parents=True, exist_ok=True)
+    summary_df.to_csv(output_path, index=False)
+    print(f"\nTuning summary saved to: {output_path}")
+
+def extract_rate_data(run_dir):
+    """Read the rate mode CSVs (<timestamp>.rate.csv) of a single run directory"""
+    data = []
+    benchmark_speed_dir = Path(run_dir) / 'benchmark_speed'
+    
+    if not benchmark_speed_dir.exists():
+        return pd.DataFrame()
+    
+    for rate_file in sorted(benchmark_speed_dir.glob('*/ref/*.rate.csv')):
+        try:
+            rate = pd.read_csv(rate_file)
+        except Exception as e:
+            print(f"Could not read rate results {rate_file}: {e}")
+            continue
+        if rate.empty:
+            continue
+        
+        rate['run_id'] = Path(run_dir).name
+        data.append(rate)
+    
+    if not data:
+        return pd.DataFrame()
+    
+    return pd.concat(data, ignore_index=True)
+
+def attribute_rate_change(row):
+    """Short note on where a rate mode speedup or slowdown comes from"""
+    notes = []
+    
+    if pd.notna(row.get('ipc_change_pct')) and abs(row['ipc_change_pct']) >= 1:
+        notes.append(f"IPC {row['ipc_change_pct']:+.1f}%")
+    if pd.notna(row.get('llc_miss_change_pct')) and abs(row['llc_miss_change_pct']) >= 1:
+        notes.append(f"LLC miss ratio {row['llc_miss_change_pct']:+.1f}%")
+    if pd.notna(row.get('dram_demand_load_change_pct')) and abs(row['dram_demand_load_change_pct']) >= 1:
+        notes.append(f"DRAM demand loads {row['dram_demand_load_change_pct']:+.1f}%")
+    
+    if not notes:
+        return 'no counter change'
+    
+    # Fewer misses is prefetching working, more demand loads from DRAM with
+    # lower IPC points at bandwidth contention. Prefetch and writeback
+    # traffic is not in the demand load rate
+    speedup = row['speedup']
+    llc_miss = row.get('llc_miss_change_pct') or 0
+    dram_loads = row.get('dram_demand_load_change_pct') or 0
+    ipc = row.get('ipc_change_pct') or 0
+    if speedup > 1.01 and llc_miss < -1:
+        notes.append('fewer demand misses')
+    elif speedup < 0.99 and dram_loads > 1 and ipc < -1:
+        notes.append('bandwidth contention')
+    
+    return ', '.join(notes)
+
+def run_rate_analysis(results_dir, config):
+    """Compare rate mode runs against the baseline with per copy perf counters"""
+    reports_dir = Path(results_dir) / 'reports'
+    all_runs = find_all_runs(reports_dir)
+    
+    all_data = []
+    for run_id in all_runs:
+        rate_data = extract_rate_data(reports_dir / run_id)
+        if not rate_data.empty:
+            all_data.append(rate_data)
+    
+    if not all_data:
+        return
+    
+    combined_df = pd.concat(all_data, ignore_index=True)
+    combined_df = combined_df[combined_df['exit_status'].fillna(1) == 0]
+    if combined_df.empty:
+        print("\nNo successful rate mode copies found.")
+        return
+    
+    # Mean over copies and iterations, throughput over copies per iteration
+    agg_df = combined_df.groupby(['run_id', 'benchmark', 'mode']).agg(
+        copies=('copies', 'max'),
+        elapsed_s=('elapsed_s', 'mean'),
+        ipc=('ipc', 'mean'),
+        llc_miss_ratio=('llc_miss_ratio', 'mean'),
+        dram_demand_load_mbs=('dram_demand_load_mbs', 'sum'),
+        iterations=('iteration', 'nunique'),
+    ).reset_index()
+    agg_df['dram_demand_load_mbs'] = agg_df['dram_demand_load_mbs'] / agg_df['iterations']
+    
+    baseline_id = config.get('REFERENCE_BASELINE', '')
+    rate_runs = sorted(agg_df['run_id'].unique())
+    if baseline_id not in rate_runs:
+        baseline_id = rate_runs[0]
+    baseline = agg_df[agg_df['run_id'] == baseline_id]
+    
+    def change_pct(value, base):
+        if pd.isna(value) or pd.isna(base) or base == 0:
+            return None
+        return (value - base) / base * 100
+    
+    results = []
+    for _, row in agg_df.iterrows():
+        base = baseline[(baseline['benchmark'] == row['benchmark']) &
+                        (baseline['copies'] == row['copies'])]
+        if base.empty:
+            continue
+        base = base.iloc[0]
+        
+        result = {
+            'benchmark': row['benchmark'],
+            'run_id': row['run_id'],
+            'mode': row['mode'],
+            'copies': int(row['copies']),
+            'baseline_time_sec': base['elapsed_s'],
+            'run_time_sec': row['elapsed_s'],
+            'speedup': base['elapsed_s'] / row['elapsed_s'] if row['elapsed_s'] > 0 else 0,
+            'ipc': row['ipc'],
+            'ipc_change_pct': change_pct(row['ipc'], base['ipc']),
+            'llc_miss_ratio': row['llc_miss_ratio'],
+            'llc_miss_change_pct': change_pct(row['llc_miss_ratio'], base['llc_miss_ratio']),
+            'dram_demand_load_mbs': row['dram_demand_load_mbs'],
+            'dram_demand_load_change_pct': change_pct(row['dram_demand_load_mbs'], base['dram_demand_load_mbs']),
+        }
+        result['attribution'] = attribute_rate_change(result)
+        results.append(result)
+    
+    rate_df = pd.DataFrame(results).round(3)
+    
+    print(f"\n" + "=" * 60)
+    print(f"RATE MODE COMPARISON vs BASELINE: {baseline_id}")
+    print("=" * 60)
+    for benchmark in sorted(rate_df['benchmark'].unique()):
+        print(f"\n{benchmark.upper()}")
+        print(f"{'-'*60}")
+        for _, row in rate_df[rate_df['benchmark'] == benchmark].sort_values('run_id').iterrows():
+            print(f"{row['run_id']:<25} {row['mode']:<8} | {row['copies']} copies | "
+                  f"Time: {row['run_time_sec']:.3f}s | Speedup: {row['speedup']:.3f}x | "
+                  f"{row['attribution']}")
+    
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    output_path = Path(results_dir) / 'csv' / f'rate_comparison_{timestamp}.csv'
+    output_path.parent.mkdir(parents=True, exist_ok=True)
+    rate_df.to_csv(output_path, index=False)
+    print(f"\nRate mode comparison saved to: {output_path}")
+
+def run_micro_analysis(results_dir):
+    """Compare microbenchmark runs (results/micro/) against their baseline"""
+    micro_dir = Path(results_dir) / 'micro'
+    if not micro_dir.exists():
+        return False
+    
+    all_data = []
+    for run_dir in sorted(micro_dir.iterdir()):
+        match = re.match(r'^(20\d{6}-\d{6})_(baseline|dpf)', run_dir.name)
+        if not run_dir.is_dir() or not match:
+            continue
+        for csv_file in sorted(run_dir.glob('microbench_*.csv')):
+            try:
+                micro = pd.read_csv(csv_file)
+            except Exception as e:
+                print(f"Could not read microbenchmark results {csv_file}: {e}")
+                continue
+            micro['run_id'] = run_dir.name
+            micro['timestamp'] = match.group(1)
+            micro['mode'] = match.group(2)
+            all_data.append(micro)
+    
+    if not all_data:
+        return False
+    
+    combined_df = pd.concat(all_data, ignore_index=True)
+    agg_df = combined_df.groupby(['run_id', 'timestamp', 'mode', 'kernel', 'threads', 'size_kb']).agg(
+        iterations=('bw_mbs', 'count'),
+        bw_mbs=('bw_mbs', 'mean'),
+        bw_std=('bw_mbs', 'std'),
+        latency_ns=('latency_ns', 'mean'),
+        mops=('mops', 'mean'),
+    ).reset_index()
+    
+    # A DPF run is compared with the baseline of the same invocation,
+    # otherwise with the latest earlier baseline of the same shape
+    results = []
+    baselines = agg_df[agg_df['mode'] == 'baseline']
+    for _, row in agg_df[agg_df['mode'] == 'dpf'].iterrows():
+        base = baselines[(baselines['kernel'] == row['kernel']) &
+                         (baselines['threads'] == row['threads']) &
+                         (baselines['size_kb'] == row['size_kb']) &
+                         (baselines['timestamp'] <= row['timestamp'])]
+        if base.empty:
+            continue
+        base = base.sort_values('timestamp').iloc[-1]
+        
+        results.append({
+            'kernel': row['kernel'],
+            'run_id': row['run_id'],
+            'baseline_run_id': base['run_id'],
+            'threads': int(row['threads']),
+            'size_kb': int(row['size_kb']),
+            'baseline_bw_mbs': base['bw_mbs'],
+            'bw_mbs': row['bw_mbs'],
+            'bw_change_pct': (row['bw_mbs'] - base['bw_mbs']) / base['bw_mbs'] * 100 if base['bw_mbs'] > 0 else None,
+            'baseline_latency_ns': base['latency_ns'],
+            'latency_ns': row['latency_ns'],
+            'latency_change_pct': (row['latency_ns'] - base['latency_ns']) / base['latency_ns'] * 100 if base['latency_ns'] > 0 else None,
+            'throughput_change_pct': (row['mops'] - base['mops']) / base['mops'] * 100 if base['mops'] > 0 else None,
+        })
+    
+    print(f"\n" + "=" * 60)
+    print("MICROBENCHMARKS")
+    print("=" * 60)
+    if not results:
+        print(agg_df[['run_id', 'kernel', 'threads', 'bw_mbs', 'latency_ns', 'mops']].round(1).to_string(index=False))
+        return True
+    
+    micro_df = pd.DataFrame(results).round(2)
+    print(micro_df[['run_id', 'kernel', 'bw_mbs', 'bw_change_pct', 'latency_ns',
+                    'latency_change_pct', 'throughput_change_pct']].to_string(index=False))
+    
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    output_path = Path(results_dir) / 'csv' / f'micro_comparison_{timestamp}.csv'
+    output_path.parent.mkdir(parents=True, exist_ok=True)
+    micro_df.to_csv(output_path, index=False)
+    print(f"\nMicrobenchmark comparison saved to: {output_path}")
+    return True
 
 def main():
     """Main performance comparison and analysis function."""
@@ -557,6 +1043,21 @@ def main():
                         help='Output directory for CSV files (default: data)')
     parser.add_argument('--no-comparison', action='store_true',
                         help='Skip comprehensive comparison analysis')
+    parser.add_argument('--no-trace', action='store_true',
+                        help='Skip the DPF decision trace summary')
+    parser.add_argument('--no-rate', action='store_true',
+                        help='Skip the rate mode comparison')
+    parser.add_argument('--no-micro', action='store_true',
+                        help='Skip the microbenchmark comparison')
+    parser.add_argument('--candidate', default=None,
+                        help='Run to test against the baseline (default: latest run)')
+    parser.add_argument('--threshold', type=float, default=None,
+                        help='Regression threshold in percent (default: REGRESSION_THRESHOLD or 2)')
+    parser.add_argument('--alpha', type=float, default=None,
+                        help='Significance level (default: SIGNIFICANCE_ALPHA or 0.05)')
+    parser.add_argument('--gate', action='store_true',
+                        help=f'Exit with {REGRESSION_EXIT_CODE} if the candidate run regressed, '
+                             f'{MISSING_EXIT_CODE} if it has no results')
     
     args = parser.parse_args()
     
@@ -578,6 +1079,9 @@ def main():
     
     if detailed_df.empty:
         print("No data found!")
+        # microbenchmark only setups have no SPEC results
+        if not args.no_micro and run_micro_analysis(results_dir):
+            sys.exit(0)
         sys.exit(1)
     
     print(f"\n" + "=" * 60)
@@ -600,8 +1104,21 @@ def main():
     print("\nExtraction complete!")
     
     # Run comprehensive comparison analysis (unless disabled)
+    gate_code = 0
     if not args.no_comparison:
-        run_comparison_analysis(results_dir, config)
+        gate_code = run_comparison_analysis(results_dir, config, args)
+    
+    if not args.no_trace:
+        run_trace_analysis(results_dir)
+    
+    if not args.no_rate:
+        run_rate_analysis(results_dir, config)
+    
+    if not args.no_micro:
+        run_micro_analysis(results_dir)
+    
+    if args.gate and gate_code:
+        sys.exit(gate_code)
 
 if __name__ == "__main__":
     main()
@@ -0,0 +1,203 @@
+#!/bin/bash
+
+#################################################################################
+# Microbenchmark Runner
+#
+# Purpose: Runs the bundled prefetcher sensitivity microbenchmarks, without
+#          and optionally with DPF, as a quick regression set that needs no
+#          SPEC CPU installation
+#
+# Usage: ./run_microbench.sh [OPTIONS]
+#################################################################################
+
+source "scripts/utils/dpf_management.sh" 2>/dev/null || source "./scripts/utils/dpf_management.sh" 2>/dev/null
+
+DPF_PID=""
+
+cleanup() {
+    if [[ -n "$DPF_PID" ]] && kill -0 "$DPF_PID" 2>/dev/null; then
+        echo "Stopping DPF process $DPF_PID"
+        sudo kill -SIGINT "$DPF_PID" 2>/dev/null
+        wait "$DPF_PID" 2>/dev/null
+    fi
+}
+
+trap cleanup EXIT
+trap 'echo "WARNING: Interrupted by user"; exit 130' INT
+trap 'echo "WARNING: Terminated"; exit 143' TERM
+
+show_help() {
+    cat << EOF
+Usage: $0 [OPTIONS]
+
+Run the bundled microbenchmarks (stream, stride, chase, gather, stencil and
+mixed) pinned from the first core of CORE_IDS, first without DPF and with
+--dpf a second time with DPF tuning the same cores.
+
+OPTIONS:
+    --dpf                 Also run with DPF and compare
+    --kernels LIST        Comma separated kernels (default: MICRO_KERNELS or all)
+    --size SIZE           Buffer per thread, e.g. 64M (default: MICRO_SIZE)
+    --threads N           Threads (default: MICRO_THREADS)
+    --duration SECONDS    Seconds per kernel (default: MICRO_DURATION)
+    --iterations N        Iterations per configuration (default: MICRO_ITERATIONS)
+    --note TEXT           Add annotation to the results directory name
+    -h, --help            Show this help message
+
+EXAMPLES:
+    $0                                # Baseline only, all kernels
+    $0 --dpf                          # Baseline and DPF
+    $0 --dpf --kernels stream,chase --threads 4 --size 256M
+
+Results are written to results/micro/<timestamp>_<baseline|dpf>/ with one
+microbench_<iteration>.csv per iteration. Compare with
+scripts/analysis/compare_performance.py.
+EOF
+}
+
+DPF_ENABLED=false
+CUSTOM_KERNELS=""
+CUSTOM_SIZE=""
+CUSTOM_THREADS=""
+CUSTOM_DURATION=""
+CUSTOM_ITERATIONS=""
+
+while [[ $# -gt 0 ]]; do
+    case "$1" in
+        --dpf)
+            DPF_ENABLED=true
+            shift
+            ;;
+        --kernels)
+            CUSTOM_KERNELS="$2"
+            shift 2
+            ;;
+        --size)
+            CUSTOM_SIZE="$2"
+            shift 2
+            ;;
+        --threads)
+            CUSTOM_THREADS="$2"
+            shift 2
+            ;;
+        --duration)
+            CUSTOM_DURATION="$2"
+            shift 2
+            ;;
+        --iterations)
+            CUSTOM_ITERATIONS="$2"
+            shift 2
+            ;;
+        --note)
+            NOTE="$2"
+            shift 2
+            ;;
+        -h|--help)
+            show_help
+            exit 0
+            ;;
+        *)
+            echo "ERROR: Unknown option: $1"
+            show_help
+            exit 1
+            ;;
+    esac
+done
+
+#### Configuration Loading ##################################################
+find_config_file() {
+    local current_dir=$(pwd)
+    while [[ "$current_dir" != "/" ]]; do
+        if [ -f "$current_dir/config/benchsuite.conf" ]; then
+            echo "$current_dir/config/benchsuite.conf"
+            return 0
+        fi
+        current_dir=$(dirname "$current_dir")
+    done
+
+    echo "Error: benchsuite.conf not found in any parent directory."
+    exit 1
+}
+
+config_file_path=$(find_config_file)
+source "$config_file_path"
+
+BENCHSUITE_ROOT="$(dirname "$(dirname "$config_file_path")")"
+MICRO_DIR="${BENCHSUITE_ROOT}/microbench"
+MICRO_BINARY="${MICRO_DIR}/microbench"
+
+kernels="${CUSTOM_KERNELS:-$MICRO_KERNELS}"
+size="${CUSTOM_SIZE:-${MICRO_SIZE:-64M}}"
+threads="${CUSTOM_THREADS:-${MICRO_THREADS:-2}}"
+duration="${CUSTOM_DURATION:-${MICRO_DURATION:-5}}"
+iterations="${CUSTOM_ITERATIONS:-${MICRO_ITERATIONS:-3}}"
+
+if ! [[ "$threads" =~ ^[0-9]+$ && "$iterations" =~ ^[0-9]+$ ]] || (( threads < 1 || iterations < 1 )); then
+    echo "ERROR: --threads and --iterations require a positive number"
+    exit 1
+fi
+
+if [[ "$DPF_ENABLED" == true && ! -f "$DPF_BINARY" ]]; then
+    echo "ERROR: DPF binary not found at: $DPF_BINARY"
+    exit 1
+fi
+
+# Threads are pinned to consecutive cores from the first configured core
+read -r -a core_ids <<< "$CORE_IDS"
+first_core="${core_ids[0]:-0}"
+core_range="${first_core}-$((first_core + threads - 1))"
+
+if ! make -s -C "$MICRO_DIR"; then
+    echo "ERROR: Failed to build $MICRO_BINARY"
+    exit 1
+fi
+
+timestamp=$(date +"%Y%m%d-%H%M%S")
+micro_args=(-c "$first_core" -T "$threads" -s "$size" -d "$duration")
+[[ -n "$kernels" ]] && micro_args+=(-k "$kernels")
+
+#### Execution ##############################################################
+run_configuration() {
+    local mode="$1"
+    local results_dir="${RESULTS_DIR}/micro/${timestamp}_${mode}"
+
+    [[ -n "$NOTE" ]] && results_dir="${results_dir}_${NOTE}"
+    if ! mkdir -p "$results_dir"; then
+        echo "ERROR: Failed to create results directory: $results_dir"
+        return 1
+    fi
+
+    echo "=== Microbenchmarks: $mode on cores $core_range ==="
+
+    if [[ "$mode" == dpf ]]; then
+        DPF_PID=$(start_dpf_process "$DPF_BINARY" "$core_range" "${results_dir}/dpf_${timestamp}.log" false | tail -1)
+        # let the tuner settle before measuring
+        sleep 2
+    fi
+
+    local status=0
+    for ((i = 1; i <= iterations; i++)); do
+        echo "--- Iteration $i/$iterations"
+        if ! "$MICRO_BINARY" "${micro_args[@]}" -o "${results_dir}/microbench_${i}.csv" \
+            | tee "${results_dir}/microbench_${i}.log"; then
+            echo "WARNING: Iteration $i failed"
+            status=1
+        fi
+    done
+
+    if [[ "$mode" == dpf ]]; then
+        stop_dpf_process "$DPF_PID" false
+        DPF_PID=""
+    fi
+
+    echo "Results: $results_dir"
+    return $status
+}
+
+exit_code=0
+run_configuration baseline || exit_code=1
+if [[ "$DPF_ENABLED" == true ]]; then
+    run_configuration dpf || exit_code=1
+fi
+
+exit $exit_code
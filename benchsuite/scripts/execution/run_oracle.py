@@ -0,0 +1,294 @@
+#!/usr/bin/env python3
+"""
+Static Configuration Oracle
+Runs every benchmark under each arm of an arm configuration held static
+(pinned_arm in mab_config.json), and under the tuners to evaluate. Reports
+the best static arm per benchmark (oracle-best), an estimate of switching
+to the best arm per phase (oracle-per-phase) from the decision traces, and
+how far each tuner is from both. Runtimes are taken relative to the
+baseline that ran in the same wave, next to the same co-runners.
+"""
+import argparse
+import json
+import math
+import os
+import re
+import subprocess
+import sys
+from pathlib import Path
+
+import numpy as np
+import pandas as pd
+
+from run_sweep import (BASELINE_ID, BENCHSUITE_ROOT, RESULT_COLUMNS, SKIPPED_METRIC,
+                       core_range, detect_groups, expand_cpu_list, load_config,
+                       pending_waves, plan_waves, run_job, run_waves)
+
+ORACLE_COLUMNS = ['benchmark'] + RESULT_COLUMNS
+
+def arm_params(spec):
+    """mab_config.json settings that define the arms"""
+    params = {'arm_configuration': spec.get('arm_configuration', 0)}
+    if spec.get('uncore_ratios'):
+        params['uncore_ratios'] = spec['uncore_ratios']
+    return params
+
+def count_arms(dpf_binary, base_config, spec, work_dir):
+    """Arms of the arm configuration on this CPU, from dpf --arms. Arms
+    that are the same here are removed, so there can be fewer than
+    create_arms() in tuners/mab_setup.c builds. Uncore co-tuning multiplies
+    the arms, every arm at every uncore ratio"""
+    work_dir.mkdir(parents=True, exist_ok=True)
+    with open(work_dir / 'mab_config.json', 'w') as f:
+        json.dump(dict(base_config, **arm_params(spec)), f, indent=2)
+    out = subprocess.run([dpf_binary, '--arms'], cwd=work_dir, capture_output=True,
+                         text=True, timeout=60)
+    arms = re.search(r'^Arms: (\d+)$', out.stdout, re.MULTILINE)
+    if not arms:
+        raise RuntimeError(f"dpf --arms printed no arm count: {(out.stdout + out.stderr).strip()}")
+    return int(arms.group(1))
+
+def generate_configs(spec, arms):
+    """One static configuration per arm plus one per tuner, by config id"""
+    base = arm_params(spec)
+    configs = {}
+    for arm in range(arms):
+        configs[f'arm{arm}'] = dict(base, pinned_arm=arm)
+    for name, params in spec.get('tuners', {'mab': {}}).items():
+        configs[f'tuner_{name}'] = dict(base, **params)
+    return configs
+
+def runtime(value, higher_is_better):
+    """Runtime or its equivalent for throughput metrics, lower is better"""
+    return 1.0 / value if higher_is_better else value
+
+def phase_times(trace_file, phases):
+    """Time spent in each of phases equal slices of the retired instructions"""
+    try:
+        trace = pd.read_csv(trace_file, usecols=['time_ns', 'instructions'])
+    except (OSError, ValueError, pd.errors.EmptyDataError):
+        return None
+    trace = trace.dropna()
+    total = trace['instructions'].sum()
+    if total <= 0:
+        return None
+
+    # Instructions before the workload started (settle time) count to phase 0
+    cumulative = trace['instructions'].cumsum().to_numpy() / total
+    times = trace['time_ns'].to_numpy() / 1e9
+    first = int(np.argmax(cumulative > 0))
+    xp = np.concatenate(([0.0], cumulative[first:]))
+    fp = np.concatenate(([times[max(first - 1, 0)]], times[first:]))
+    keep = np.concatenate(([True], np.diff(xp) > 0))
+    bounds = np.interp(np.linspace(0, 1, phases + 1), xp[keep], fp[keep])
+    return np.diff(bounds)
+
+def oracle_per_phase(bench_dir, arms, results, phases):
+    """Sum over phases of the fastest arm, scaled to the measured best runtime.
+    Needs fixed work workloads, fixed duration ones retire different amounts."""
+    per_arm = {}
+    for arm in arms:
+        runs = []
+        for iteration in results[results['config_id'] == arm]['iteration'].unique():
+            times = phase_times(bench_dir / arm / f'iter{iteration}' / 'trace.csv', phases)
+            if times is not None:
+                runs.append(times)
+        if runs:
+            per_arm[arm] = np.mean(runs, axis=0)
+    if len(per_arm) < 2:
+        return None
+
+    traced = pd.DataFrame(per_arm)
+    best_static = traced.sum().min()
+    if best_static <= 0:
+        return None
+    return traced.min(axis=1).sum() / best_static
+
+def summarize(oracle_dir, configs, phases):
+    """Oracle-best and oracle-per-phase per benchmark metric and the tuner gaps"""
+    results_file = oracle_dir / 'results.csv'
+    if not results_file.exists():
+        print("No results yet")
+        return None
+
+    results = pd.read_csv(results_file)
+    results = results[results['metric'] != SKIPPED_METRIC].copy()
+    results['runtime'] = [runtime(v, h) for v, h in zip(results['value'], results['higher_is_better'])]
+
+    # Runtime over the baseline of the same wave, in mean baseline runtimes,
+    # so configurations that ran next to different co-runners compare
+    baseline = results[results['config_id'] == BASELINE_ID]
+    wave_base = baseline.groupby(['benchmark', 'metric', 'wave'])['runtime'].mean().rename('wave_base')
+    mean_base = baseline.groupby(['benchmark', 'metric'])['runtime'].mean().rename('mean_base')
+    results = results.join(wave_base, on=['benchmark', 'metric', 'wave'])
+    results = results.join(mean_base, on=['benchmark', 'metric'])
+    results['runtime'] = results['runtime'] / results['wave_base'] * results['mean_base']
+    results = results.dropna(subset=['runtime'])
+
+    arms = [c for c in configs if c.startswith('arm')]
+    tuners = [c for c in configs if c.startswith('tuner_')]
+
+    rows = []
+    for (bench, metric), group in results.groupby(['benchmark', 'metric']):
+        mean = group.groupby('config_id')['runtime'].mean()
+        measured = [a for a in arms if a in mean]
+        if not measured:
+            continue
+
+        best_arm = mean[measured].idxmin()
+        best = mean[best_arm]
+        row = {
+            'benchmark': bench,
+            'metric': metric,
+            'best_arm': best_arm,
+            'worst_arm': mean[measured].idxmax(),
+            'arm_spread_pct': (mean[measured].max() / best - 1) * 100,
+            'baseline_vs_best_pct': (mean[BASELINE_ID] / best - 1) * 100 if BASELINE_ID in mean else None,
+        }
+
+        # runtime based phases only, fixed duration metrics have no fixed work
+        per_phase = None
+        if not group['higher_is_better'].iloc[0]:
+            ratio = oracle_per_phase(oracle_dir / bench, measured, group, phases)
+            if ratio is not None:
+                per_phase = best * ratio
+                row['per_phase_gain_pct'] = (1 - ratio) * 100
+
+        for tuner in tuners:
+            if tuner not in mean:
+                continue
+            name = tuner[len('tuner_'):]
+            row[f'{name}_gap_best_pct'] = (mean[tuner] / best - 1) * 100
+            if per_phase:
+                row[f'{name}_gap_phase_pct'] = (mean[tuner] / per_phase - 1) * 100
+        rows.append(row)
+
+    if not rows:
+        print("No arm results yet")
+        return None
+
+    summary = pd.DataFrame(rows).round(3)
+    summary.to_csv(oracle_dir / 'summary.csv', index=False)
+
+    print(f"\n{'='*80}")
+    print(f"ORACLE SUMMARY: {oracle_dir.name} ({len(arms)} arms, {len(summary)} metrics)")
+    print(f"{'='*80}")
+    print(summary.to_string(index=False))
+
+    # Geomean gap over all metrics, positive means slower than the oracle
+    for column in [c for c in summary.columns if c.endswith('_gap_best_pct') or c.endswith('_gap_phase_pct')]:
+        gaps = summary[column].dropna()
+        if gaps.empty:
+            continue
+        geomean = math.exp(sum(math.log(1 + g / 100) for g in gaps) / len(gaps))
+        print(f"  {column}: geomean {(geomean - 1) * 100:+.2f}% over {len(gaps)} metrics")
+    print(f"\nSummary saved to: {oracle_dir / 'summary.csv'}")
+    return summary
+
+def main():
+    parser = argparse.ArgumentParser(description='Run benchmarks under every static arm and compare tuners to the oracle')
+    parser.add_argument('spec', help='Oracle spec (JSON), see config/oracle_example.json')
+    parser.add_argument('--groups', default=None,
+                        help='Space separated core groups, e.g. "4-7 8-11" (default: spec or auto)')
+    parser.add_argument('--phases', type=int, default=None,
+                        help='Instruction slices for the per-phase oracle (default: spec or 20)')
+    parser.add_argument('--dry-run', action='store_true', help='List the configurations and jobs only')
+    parser.add_argument('--report', action='store_true', help='Summarize the results so far only')
+    args = parser.parse_args()
+
+    with open(args.spec) as f:
+        spec = json.load(f)
+    config = load_config()
+
+    results_dir = Path(config.get('RESULTS_DIR') or BENCHSUITE_ROOT / 'results')
+    oracle_dir = results_dir / 'oracle' / spec.get('name', Path(args.spec).stem)
+    oracle_dir.mkdir(parents=True, exist_ok=True)
+    phases = args.phases or spec.get('phases', 20)
+
+    # The arms come from DPF on this CPU, a report elsewhere uses the
+    # configurations of the run
+    configs_file = oracle_dir / 'configs.json'
+    if args.report and configs_file.exists():
+        with open(configs_file) as f:
+            configs = json.load(f)
+        summarize(oracle_dir, configs, phases)
+        return
+
+    dpf_binary = config.get('DPF_BINARY', '')
+    if not Path(dpf_binary).is_file():
+        print(f"ERROR: DPF binary not found at: {dpf_binary}")
+        sys.exit(1)
+    with open(Path(dpf_binary).parent / 'mab_config.json') as f:
+        base_config = json.load(f)
+    base_config.pop('pinned_arm', None)
+
+    arms = count_arms(dpf_binary, base_config, spec, oracle_dir / 'arms')
+    configs = generate_configs(spec, arms)
+    with open(configs_file, 'w') as f:
+        json.dump(configs, f, indent=2, sort_keys=True)
+
+    if args.report:
+        summarize(oracle_dir, configs, phases)
+        return
+
+    groups = args.groups or spec.get('groups', 'auto')
+    if groups == 'auto':
+        groups = detect_groups(int(config.get('RATE_MODULE_SIZE', 4)))
+    else:
+        if isinstance(groups, str):
+            groups = groups.split()
+        groups = [expand_cpu_list(g) for g in groups]
+
+    # Iteration major, then benchmark, so every arm of a benchmark runs
+    # close in time to the others. Each wave runs the baseline of its
+    # benchmark next to the arms and tuners
+    benchmarks = {b['name']: b for b in spec['benchmarks']}
+    iterations = spec.get('iterations', 1)
+    waves = []
+    for i in range(iterations):
+        for bench in benchmarks:
+            first = len(waves)
+            plan_waves(configs, i, len(groups), waves)
+            waves[first:] = [(wave, [(bench, job) for job in jobs]) for wave, jobs in waves[first:]]
+
+    results_file = oracle_dir / 'results.csv'
+    pending = pending_waves(waves, results_file, lambda bench_job: bench_job[1][0])
+
+    print(f"Oracle {oracle_dir.name}: {len(benchmarks)} benchmarks, {arms} arms, {len(configs)} configurations, "
+          f"{iterations} iterations, {len(pending)}/{len(waves)} waves pending on {len(groups)} groups")
+    print(f"Groups: {' '.join(core_range(g) for g in groups)}")
+    print(f"Results: {oracle_dir}")
+
+    if args.dry_run:
+        for cfg_id, params in configs.items():
+            print(f"  {cfg_id}: {json.dumps(params, sort_keys=True)}")
+        return
+
+    if os.geteuid() != 0:
+        print("ERROR: Root privileges required to run DPF")
+        sys.exit(1)
+
+    if any(b.get('type') == 'micro' for b in benchmarks.values()):
+        subprocess.run(['make', '-s', '-C', str(BENCHSUITE_ROOT / 'microbench')], check=True)
+
+    def run(bench_job, cores):
+        bench, job = bench_job
+        rows = run_job(dict(spec, workload=benchmarks[bench]), dpf_binary, base_config,
+                       job, cores, oracle_dir / bench)
+        return [dict(r, benchmark=bench) for r in rows]
+
+    def save(rows):
+        write_header = not results_file.exists()
+        pd.DataFrame(rows, columns=ORACLE_COLUMNS).to_csv(
+            results_file, mode='a', header=write_header, index=False)
+
+    failures = run_waves(pending, groups, run, lambda bench_job: f"{bench_job[0]}/{bench_job[1][0]}", save)
+
+    summarize(oracle_dir, configs, phases)
+
+    if failures:
+        print(f"\n{len(failures)} jobs failed, rerun to retry them")
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
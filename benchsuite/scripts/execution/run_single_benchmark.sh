@@ -3,6 +3,7 @@
 # Source utility functions for reduced complexity
 source "scripts/utils/benchmark_validation.sh" 2>/dev/null || source "./scripts/utils/benchmark_validation.sh" 2>/dev/null
 source "scripts/utils/dpf_management.sh" 2>/dev/null || source "./scripts/utils/dpf_management.sh" 2>/dev/null
+source "scripts/utils/rate_harness.sh" 2>/dev/null || source "./scripts/utils/rate_harness.sh" 2>/dev/null
 
 # Global variables for cleanup
 declare -a BENCHMARK_PIDS=()
@@ -71,6 +72,8 @@ OPTIONS:
     -b, --benchmark BENCHMARK    Specify which benchmark to run (baseline)
     --dpf                        Add to a benchmark to run it with DPF
     --iterations N               Number of iterations to run (default: 5)
+    --copies N                   Rate mode: run N copies on whole modules with perf stat
+                                 counters (default: RATE_COPIES from config, 0 = off)
     -v, --verbose                Enable verbose output
     -h, --help                   Show this help message
     -l, --list                   List available benchmarks
@@ -93,11 +96,13 @@ EXAMPLES:
     $0 -b 602.gcc                      # Run GCC benchmark in baseline mode
     $0 --benchmark 625.x264 --dpf      # Run x264 with DPF enabled
     $0 -b 623.xalancbmk --iterations 3 # Run xalancbmk with 3 iterations (custom)
+    $0 -b 605.mcf --copies 8 --dpf     # Run 8 copies of mcf on two modules with DPF
 
 OUTPUT:
     Results are saved to timestamped directory under results/reports/
     Standard mode results saved with mode suffix (e.g., '_quick', '_standard')
     DPF mode results saved with '_dpf' suffix
+    Rate mode adds <timestamp>.rate.csv per iteration with per copy time and counters
     
 EOF
 }
@@ -105,6 +110,7 @@ EOF
 # Parse command line arguments
 BASELINE_MODE=true  # Default to baseline mode (DPF disabled)
 CUSTOM_ITERATIONS=""
+CUSTOM_COPIES=""
 VERBOSE=false
 SHOW_LIST=false
 
@@ -122,6 +128,10 @@ while [[ $# -gt 0 ]]; do
             CUSTOM_ITERATIONS="$2"
             shift 2
             ;;
+        --copies)
+            CUSTOM_COPIES="$2"
+            shift 2
+            ;;
         -v|--verbose)
             VERBOSE=true
             shift
@@ -315,6 +325,21 @@ else
     core_ids=(6 7 8)
 fi
 
+# Rate mode replaces the core list with whole modules for N copies
+rate_copies="${CUSTOM_COPIES:-${RATE_COPIES:-0}}"
+if ! [[ "$rate_copies" =~ ^[0-9]+$ ]]; then
+    echo "ERROR: --copies requires a number, got: $rate_copies"
+    exit 1
+fi
+if (( rate_copies > 0 )); then
+    mapfile -t core_ids < <(rate_select_cores "$rate_copies" "${core_ids[0]}")
+    if [[ ${#core_ids[@]} -eq 0 ]]; then
+        echo "ERROR: No cores available for rate mode"
+        exit 1
+    fi
+    echo "Rate mode: ${#core_ids[@]} copies on cores ${core_ids[*]}"
+fi
+
 #### 7. Helper Functions ####################################################
 
 # DPF execution with graceful handling
@@ -331,7 +356,14 @@ start_dpf() {
     echo "Baseline mode: $baseline" >&2
     echo "Config file: $config_file" >&2
     
-    (cd "$dpf_dir" && sudo "$dpf_binary" --core "$core_range" --intervall 1 --ddrbw-set 46000 -l 5 -t 2 > "$dpf_log" 2>&1) &
+    # Per-interval decision trace next to the log, read by compare_performance.py
+    local trace_args=()
+    if [[ "${LOG_ARMS:-0}" == 1 || "${LOG_IPC:-0}" == 1 || "${LOG_BW:-0}" == 1 ]]; then
+        trace_args=(--trace "${dpf_log%.log}.trace.csv")
+        echo "DPF trace file: ${dpf_log%.log}.trace.csv" >&2
+    fi
+
+    (cd "$dpf_dir" && sudo "$dpf_binary" --core "$core_range" --intervall 1 --ddrbw-set 46000 -l 5 -t 2 "${trace_args[@]}" > "$dpf_log" 2>&1) &
     local dpf_pid=$!
     
     # Give DPF a moment to initialize
@@ -539,8 +571,13 @@ run_benchmark() {
                     echo "Command: $full_binary_path ${core_command}"
                     
                     # Execute with proper working directory
-                    taskset -c "$core_id" /usr/bin/time -v \
-                    /bin/bash -lc "cd '$execution_input_dir' && $full_binary_path ${core_command}"
+                    if (( rate_copies > 0 )); then
+                        rate_run_copy "$core_id" "$execution_input_dir" \
+                            "$full_binary_path ${core_command}" "${log_file}.perf${core_id}"
+                    else
+                        taskset -c "$core_id" /usr/bin/time -v \
+                        /bin/bash -lc "cd '$execution_input_dir' && $full_binary_path ${core_command}"
+                    fi
                     
                     # Tell DPF we're done on this core
                     if [[ "$BASELINE_MODE" == false && -n "$DPF_PID" ]]; then
@@ -605,6 +642,14 @@ run_benchmark() {
             if [[ "$iteration_failed" == true ]]; then
                 echo "  Iteration $((i+1)) had failures but continuing..."
             fi
+
+            # One tidy CSV per iteration, read by compare_performance.py
+            if (( rate_copies > 0 )); then
+                rate_write_csv "${dir}/${iter_timestamp}.rate.csv" "$benchmark_key" \
+                    "$([[ "$BASELINE_MODE" == true ]] && echo baseline || echo dpf)" \
+                    "$((i+1))" "$log_file" "${core_ids[@]}"
+                echo "Rate results: ${dir}/${iter_timestamp}.rate.csv"
+            fi
             
             echo "Completed iteration $((i+1))/$iterations"
             sleep 5
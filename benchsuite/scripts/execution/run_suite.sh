@@ -147,6 +147,11 @@ for benchmark in "${BENCHMARK_LIST[@]}"; do
         single_benchmark_cmd="$single_benchmark_cmd --benchmark $benchmark --iterations 1"
     fi
     
+    # Rate mode copies from run_all.sh --copies
+    if [ -n "$RATE_COPIES_ARG" ]; then
+        single_benchmark_cmd="$single_benchmark_cmd --copies $RATE_COPIES_ARG"
+    fi
+    
     # Add verbose flag if enabled
     if [ "$VERBOSE" = true ]; then
         single_benchmark_cmd="$single_benchmark_cmd --verbose"
@@ -0,0 +1,455 @@
+#!/usr/bin/env python3
+"""
+Sweep Driver for DPF Tuner Hyperparameters
+Generates mab_config.json variants from a grid or random search spec, runs
+them in parallel on separate module groups, each wave of parallel jobs next
+to its own baseline, resumes after interruption and reports the per
+configuration geomean speedup and the Pareto front of speedup versus DPF
+overhead.
+"""
+import argparse
+import hashlib
+import itertools
+import json
+import math
+import os
+import random
+import re
+import shlex
+import signal
+import subprocess
+import sys
+import threading
+import time
+from pathlib import Path
+
+import pandas as pd
+
+SCRIPT_DIR = Path(__file__).parent
+BENCHSUITE_ROOT = SCRIPT_DIR.parent.parent
+BASELINE_ID = 'baseline'
+SETTLE_SECONDS = 2  # DPF start before the workload
+SKIPPED_METRIC = 'skipped'  # row of a job DPF refused, it has no value
+
+RESULT_COLUMNS = ['config_id', 'iteration', 'wave', 'group', 'corunners', 'metric', 'value',
+                  'higher_is_better', 'wall_s', 'dpf_cpu_s', 'overhead_pct']
+
+def load_config():
+    """Load configuration from benchsuite.conf"""
+    config_file = BENCHSUITE_ROOT / 'config' / 'benchsuite.conf'
+    config = {}
+
+    if config_file.exists():
+        with open(config_file, 'r') as f:
+            for line in f:
+                line = line.split('#')[0].strip()
+                if line and '=' in line:
+                    key, value = line.split('=', 1)
+                    config[key.strip()] = os.path.expanduser(value.strip().strip('"'))
+
+    return config
+
+def expand_cpu_list(cpu_list):
+    """Expand a sysfs cpu list ("4-7" or "4,5,8-9") to a list of cpu ids"""
+    cpus = []
+    for part in cpu_list.strip().split(','):
+        if '-' in part:
+            first, last = part.split('-')
+            cpus.extend(range(int(first), int(last) + 1))
+        elif part:
+            cpus.append(int(part))
+    return cpus
+
+def detect_groups(module_size):
+    """Module groups (L2 clusters) from sysfs, or module_size aligned groups.
+    The module of core 0 is left for the OS when there are others"""
+    cpus = sorted(int(p.name[3:]) for p in Path('/sys/devices/system/cpu').glob('cpu[0-9]*'))
+    groups = []
+    seen = set()
+
+    for cpu in cpus:
+        if cpu in seen:
+            continue
+        cluster = Path(f'/sys/devices/system/cpu/cpu{cpu}/topology/cluster_cpus_list')
+        if cluster.exists():
+            members = expand_cpu_list(cluster.read_text())
+        else:
+            first = cpu - cpu % module_size
+            members = list(range(first, first + module_size))
+        members = [c for c in members if c in cpus]
+        seen.update(members)
+        groups.append(members)
+
+    if len(groups) > 1:
+        groups = [g for g in groups if 0 not in g]
+    return groups
+
+def config_id(params):
+    """Stable short id of a parameter set, so resumed sweeps match up"""
+    text = json.dumps(params, sort_keys=True)
+    return hashlib.sha1(text.encode()).hexdigest()[:10]
+
+def generate_configs(spec):
+    """Parameter sets of the sweep, grid or random search"""
+    parameters = spec['parameters']
+    names = sorted(parameters)
+    configs = []
+
+    if spec.get('search', 'grid') == 'grid':
+        values = []
+        for name in names:
+            p = parameters[name]
+            values.append(p['grid'] if isinstance(p, dict) else p)
+        for combination in itertools.product(*values):
+            configs.append(dict(zip(names, combination)))
+    else:
+        rng = random.Random(spec.get('seed', 1))
+        for _ in range(spec.get('samples', 16)):
+            params = {}
+            for name in names:
+                p = parameters[name]
+                if isinstance(p, list):
+                    params[name] = rng.choice(p)
+                elif p.get('log'):
+                    params[name] = math.exp(rng.uniform(math.log(p['min']), math.log(p['max'])))
+                else:
+                    params[name] = rng.uniform(p['min'], p['max'])
+                if isinstance(params[name], float):
+                    params[name] = float(f"{params[name]:.4g}")
+            configs.append(params)
+
+    # drop duplicates, keep the order
+    unique = {}
+    for params in configs:
+        unique.setdefault(config_id(params), params)
+    return unique
+
+def core_range(cores):
+    return f"{cores[0]}-{cores[-1]}" if cores == list(range(cores[0], cores[-1] + 1)) \
+        else ','.join(str(c) for c in cores)
+
+def process_cpu_seconds(pid):
+    """User and system CPU time of a process from /proc"""
+    try:
+        fields = Path(f'/proc/{pid}/stat').read_text().rsplit(')', 1)[1].split()
+        return (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+    except (OSError, IndexError, ValueError):
+        return None
+
+def run_workload(workload, cores, job_dir):
+    """Run the workload pinned to cores, returns [(metric, value, higher_is_better)]"""
+    if workload['type'] == 'micro':
+        binary = BENCHSUITE_ROOT / 'microbench' / 'microbench'
+        csv_file = job_dir / 'microbench.csv'
+        cmd = [str(binary), '-c', str(cores[0]), '-T', str(workload.get('threads', len(cores))),
+               '-s', str(workload.get('size', '64M')), '-d', str(workload.get('duration', 5)),
+               '-o', str(csv_file)]
+        if workload.get('kernels'):
+            cmd += ['-k', workload['kernels']]
+        with open(job_dir / 'workload.log', 'w') as log:
+            subprocess.run(cmd, stdout=log, stderr=subprocess.STDOUT, check=True)
+        micro = pd.read_csv(csv_file)
+        return [(row['kernel'], row['mops'], True) for _, row in micro.iterrows()]
+
+    # any command, pinned with taskset and measured by wall time
+    command = workload['command'].replace('{cores}', core_range(cores))
+    start = time.time()
+    with open(job_dir / 'workload.log', 'w') as log:
+        subprocess.run(['taskset', '-c', core_range(cores), '/bin/bash', '-c', command],
+                       cwd=workload.get('cwd'), stdout=log, stderr=subprocess.STDOUT, check=True)
+    return [(workload.get('name', 'command'), time.time() - start, False)]
+
+def run_job(spec, dpf_binary, base_config, job, cores, sweep_dir):
+    """Run one configuration and iteration on a module group"""
+    cfg_id, params, iteration, wave = job
+    job_dir = sweep_dir / cfg_id / f'iter{iteration}'
+    if cfg_id == BASELINE_ID:
+        # one baseline per wave
+        job_dir = job_dir / f'wave{wave}'
+    job_dir.mkdir(parents=True, exist_ok=True)
+    dpf = None
+
+    if cfg_id != BASELINE_ID:
+        # DPF reads mab_config.json from its working directory
+        mab_config = dict(base_config, **params)
+        with open(job_dir / 'mab_config.json', 'w') as f:
+            json.dump(mab_config, f, indent=2)
+
+        # modules are contiguous, --core takes a range
+        cmd = [dpf_binary, '--core', f"{cores[0]}-{cores[-1]}", '--trace', str(job_dir / 'trace.csv')]
+        cmd += shlex.split(spec.get('dpf_args', '--intervall 1 --ddrbw-set 46000 -l 3'))
+        dpf_log = open(job_dir / 'dpf.log', 'w')
+        dpf = subprocess.Popen(cmd, cwd=job_dir, stdout=dpf_log, stderr=subprocess.STDOUT)
+        time.sleep(SETTLE_SECONDS)
+        if dpf.poll() is not None:
+            dpf_log.close()
+            # an arm this SKU does not have fails on every run, record it
+            # as skipped so reruns do not repeat it
+            invalid = re.search(r'Invalid pinned arm.*', (job_dir / 'dpf.log').read_text())
+            if invalid:
+                print(f"SKIPPED {cfg_id}: {invalid.group(0)}", flush=True)
+                return [{
+                    'config_id': cfg_id,
+                    'iteration': iteration,
+                    'wave': wave,
+                    'group': core_range(cores),
+                    'metric': SKIPPED_METRIC,
+                }]
+            raise RuntimeError(f"DPF exited with {dpf.returncode}, see {job_dir / 'dpf.log'}")
+
+    start = time.time()
+    try:
+        metrics = run_workload(spec['workload'], cores, job_dir)
+        wall = time.time() - start
+        dpf_cpu = process_cpu_seconds(dpf.pid) if dpf else None
+    finally:
+        if dpf:
+            dpf.send_signal(signal.SIGINT)
+            try:
+                dpf.wait(timeout=10)
+            except subprocess.TimeoutExpired:
+                dpf.kill()
+            dpf_log.close()
+
+    # DPF cost in percent of one core over the workload (includes the settle time)
+    overhead = dpf_cpu / (wall + SETTLE_SECONDS) * 100 if dpf_cpu is not None else 0.0
+    return [{
+        'config_id': cfg_id,
+        'iteration': iteration,
+        'wave': wave,
+        'group': core_range(cores),
+        'metric': metric,
+        'value': value,
+        'higher_is_better': higher,
+        'wall_s': round(wall, 3),
+        'dpf_cpu_s': dpf_cpu,
+        'overhead_pct': round(overhead, 4),
+    } for metric, value, higher in metrics]
+
+def plan_waves(configs, iteration, group_count, waves):
+    """Append the waves of one iteration to waves. A wave is a list of jobs
+    that run at the same time, one per module group. Every wave runs the
+    baseline next to up to group_count - 1 configurations, so each
+    configuration is compared against a baseline that shared the memory
+    system with the same co-runners"""
+    items = list(configs.items())
+    per_wave = max(group_count - 1, 1)
+
+    for start in range(0, len(items), per_wave):
+        wave = len(waves)
+        jobs = [(BASELINE_ID, {}, iteration, wave)]
+        jobs += [(cfg_id, params, iteration, wave) for cfg_id, params in items[start:start + per_wave]]
+        waves.append((wave, jobs))
+
+def run_waves(waves, groups, run, name, done):
+    """Run the waves one after the other and the jobs of a wave in parallel,
+    on groups rotated per wave so the baseline moves between modules. With
+    fewer groups than jobs the jobs of a group run one after the other.
+    run(job, cores) returns the result rows of a job, name(job) its config
+    id for the co-runner list. done(rows) gets the rows of the jobs of each
+    wave that finished, a rerun repeats only the failed ones.
+    Returns the labels of the failed jobs"""
+    failures = []
+
+    for wave, jobs in waves:
+        names = [name(job) for job in jobs]
+        slots = [(i + wave) % len(groups) for i in range(len(jobs))]
+        rows = []
+        lock = threading.Lock()
+
+        def worker(slot):
+            cores = groups[slot]
+            for i in [i for i in range(len(jobs)) if slots[i] == slot]:
+                label = f"{names[i]} wave {wave} on cores {core_range(cores)}"
+                print(f"Running {label}", flush=True)
+                try:
+                    job_rows = run(jobs[i], cores)
+                except Exception as e:
+                    print(f"FAILED {label}: {e}", flush=True)
+                    with lock:
+                        failures.append(label)
+                    continue
+                # what ran at the same time on the other groups
+                corunners = ';'.join(names[j] for j in range(len(jobs)) if slots[j] != slot)
+                with lock:
+                    rows.extend(dict(r, corunners=corunners) for r in job_rows)
+
+        threads = [threading.Thread(target=worker, args=(slot,)) for slot in sorted(set(slots))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+
+        if rows:
+            done(rows)
+
+    return failures
+
+def pending_waves(waves, results_file, config_of):
+    """The waves with only the jobs results_file has no rows of, by wave and
+    config id. config_of(job) is the config id of a job"""
+    if not results_file.exists():
+        return waves
+    previous = pd.read_csv(results_file)
+    if 'wave' not in previous.columns:
+        print(f"ERROR: {results_file} has no baseline per wave, use a new name")
+        sys.exit(1)
+    finished = set(zip(previous['wave'], previous['config_id']))
+
+    pending = []
+    for wave, jobs in waves:
+        jobs = [job for job in jobs if (wave, config_of(job)) not in finished]
+        if jobs:
+            pending.append((wave, jobs))
+    return pending
+
+def pareto_front(df):
+    """Flag configurations no other configuration beats on both speedup and overhead"""
+    front = []
+    for _, row in df.iterrows():
+        dominated = ((df['geomean_speedup'] >= row['geomean_speedup']) &
+                     (df['overhead_pct'] <= row['overhead_pct']) &
+                     ((df['geomean_speedup'] > row['geomean_speedup']) |
+                      (df['overhead_pct'] < row['overhead_pct']))).any()
+        front.append(not dominated)
+    return front
+
+def summarize(sweep_dir, configs):
+    """Per configuration geomean speedup against the baseline of the same
+    wave and Pareto front"""
+    results_file = sweep_dir / 'results.csv'
+    if not results_file.exists():
+        print("No results yet")
+        return None
+
+    results = pd.read_csv(results_file)
+    results = results[results['metric'] != SKIPPED_METRIC]
+    baseline = results[results['config_id'] == BASELINE_ID].groupby(['wave', 'metric'])['value'].mean()
+    if baseline.empty:
+        print("No baseline results yet")
+        return None
+
+    rows = []
+    for cfg_id, group in results[results['config_id'] != BASELINE_ID].groupby('config_id'):
+        ratios = []
+        for _, row in group.iterrows():
+            base = baseline.get((row['wave'], row['metric']))
+            if base is None or base <= 0 or row['value'] <= 0:
+                continue
+            ratios.append(row['value'] / base if row['higher_is_better'] else base / row['value'])
+        if not ratios:
+            continue
+        runs = results[results['config_id'] == cfg_id]
+        rows.append({
+            'config_id': cfg_id,
+            **configs.get(cfg_id, {}),
+            'iterations': runs['iteration'].nunique(),
+            'geomean_speedup': math.exp(sum(math.log(r) for r in ratios) / len(ratios)),
+            'overhead_pct': runs.groupby('iteration')['overhead_pct'].first().mean(),
+        })
+
+    if not rows:
+        print("No configuration results yet")
+        return None
+
+    summary = pd.DataFrame(rows)
+    summary['pareto'] = pareto_front(summary)
+    summary = summary.sort_values('geomean_speedup', ascending=False).round(4)
+    summary.to_csv(sweep_dir / 'summary.csv', index=False)
+
+    print(f"\n{'='*80}")
+    print(f"SWEEP SUMMARY: {sweep_dir.name} ({len(summary)} configurations)")
+    print(f"{'='*80}")
+    print(summary.to_string(index=False))
+    print(f"\nPareto front (speedup vs overhead):")
+    print(summary[summary['pareto']].sort_values('overhead_pct').to_string(index=False))
+    print(f"\nSummary saved to: {sweep_dir / 'summary.csv'}")
+    return summary
+
+def main():
+    parser = argparse.ArgumentParser(description='Sweep DPF tuner hyperparameters and arm configurations')
+    parser.add_argument('spec', help='Sweep spec (JSON), see config/sweep_example.json')
+    parser.add_argument('--groups', default=None,
+                        help='Space separated core groups, e.g. "4-7 8-11" (default: spec or auto)')
+    parser.add_argument('--dry-run', action='store_true', help='List the configurations and jobs only')
+    parser.add_argument('--report', action='store_true', help='Summarize the results so far only')
+    args = parser.parse_args()
+
+    with open(args.spec) as f:
+        spec = json.load(f)
+    config = load_config()
+
+    results_dir = Path(config.get('RESULTS_DIR') or BENCHSUITE_ROOT / 'results')
+    sweep_dir = results_dir / 'sweeps' / spec.get('name', Path(args.spec).stem)
+    sweep_dir.mkdir(parents=True, exist_ok=True)
+
+    configs = generate_configs(spec)
+    with open(sweep_dir / 'configs.json', 'w') as f:
+        json.dump(configs, f, indent=2, sort_keys=True)
+
+    if args.report:
+        summarize(sweep_dir, configs)
+        return
+
+    # Module groups, each runs one job at a time
+    groups = args.groups or spec.get('groups', 'auto')
+    if groups == 'auto':
+        groups = detect_groups(int(config.get('RATE_MODULE_SIZE', 4)))
+    else:
+        if isinstance(groups, str):
+            groups = groups.split()
+        groups = [expand_cpu_list(g) for g in groups]
+
+    # Iteration major, each wave pairs configurations with a baseline that
+    # runs at the same time next to the same co-runners
+    iterations = spec.get('iterations', 3)
+    waves = []
+    for i in range(iterations):
+        plan_waves(configs, i, len(groups), waves)
+
+    # Resume: skip the jobs results.csv already has
+    results_file = sweep_dir / 'results.csv'
+    pending = pending_waves(waves, results_file, lambda job: job[0])
+
+    print(f"Sweep {sweep_dir.name}: {len(configs)} configurations, {iterations} iterations, "
+          f"{len(pending)}/{len(waves)} waves pending on {len(groups)} groups")
+    print(f"Groups: {' '.join(core_range(g) for g in groups)}")
+    print(f"Results: {sweep_dir}")
+
+    if args.dry_run:
+        for cfg_id, params in configs.items():
+            print(f"  {cfg_id}: {json.dumps(params, sort_keys=True)}")
+        return
+
+    if os.geteuid() != 0:
+        print("ERROR: Root privileges required to run DPF")
+        sys.exit(1)
+
+    dpf_binary = config.get('DPF_BINARY', '')
+    if not Path(dpf_binary).is_file():
+        print(f"ERROR: DPF binary not found at: {dpf_binary}")
+        sys.exit(1)
+    base_config_file = Path(dpf_binary).parent / 'mab_config.json'
+    with open(base_config_file) as f:
+        base_config = json.load(f)
+
+    if spec['workload']['type'] == 'micro':
+        subprocess.run(['make', '-s', '-C', str(BENCHSUITE_ROOT / 'microbench')], check=True)
+
+    def save(rows):
+        write_header = not results_file.exists()
+        pd.DataFrame(rows, columns=RESULT_COLUMNS).to_csv(
+            results_file, mode='a', header=write_header, index=False)
+
+    failures = run_waves(pending, groups,
+                         lambda job, cores: run_job(spec, dpf_binary, base_config, job, cores, sweep_dir),
+                         lambda job: job[0], save)
+
+    summarize(sweep_dir, configs)
+
+    if failures:
+        print(f"\n{len(failures)} jobs failed, rerun to retry them")
+        sys.exit(1)
+
+if __name__ == "__main__":
+    main()
@@ -20,7 +20,14 @@ start_dpf_process() {
         echo "Baseline mode: $baseline" >&2
         echo "Config file: $config_file" >&2
         
-        (cd "$dpf_dir" && sudo "$dpf_binary" --core "$core_range" --intervall 1 --ddrbw-set 46000 -l 5 -t 2 > "$dpf_log" 2>&1) &
+        # Per-interval decision trace next to the log, read by compare_performance.py
+        local trace_args=()
+        if [[ "${LOG_ARMS:-0}" == 1 || "${LOG_IPC:-0}" == 1 || "${LOG_BW:-0}" == 1 ]]; then
+            trace_args=(--trace "${dpf_log%.log}.trace.csv")
+            echo "DPF trace file: ${dpf_log%.log}.trace.csv" >&2
+        fi
+
+        (cd "$dpf_dir" && sudo "$dpf_binary" --core "$core_range" --intervall 1 --ddrbw-set 46000 -l 5 -t 2 "${trace_args[@]}" > "$dpf_log" 2>&1) &
         local dpf_pid=$!
         
         # Give DPF a moment to initialize
@@ -0,0 +1,170 @@
+#!/bin/bash
+# Rate mode utilities: N copies of a benchmark on whole modules, each with
+# perf stat counters, summarized in one CSV per iteration
+
+# Expand a sysfs cpu list ("4-7" or "4,5,8-9") to one cpu id per line
+expand_cpu_list() {
+    local list="$1"
+    local part
+
+    for part in ${list//,/ }; do
+        if [[ "$part" == *-* ]]; then
+            seq "${part%-*}" "${part#*-}"
+        else
+            echo "$part"
+        fi
+    done
+}
+
+# Cores sharing the module (L2 cluster) of a core, from sysfs or by
+# RATE_MODULE_SIZE aligned groups when the kernel has no cluster info
+module_cores() {
+    local cpu="$1"
+    local size="${RATE_MODULE_SIZE:-4}"
+    local cluster="/sys/devices/system/cpu/cpu${cpu}/topology/cluster_cpus_list"
+
+    if [[ -r "$cluster" ]]; then
+        expand_cpu_list "$(cat "$cluster")"
+    else
+        local first=$(( cpu - cpu % size ))
+        seq "$first" $(( first + size - 1 ))
+    fi
+}
+
+# Module id of a core, as reported by sysfs or by RATE_MODULE_SIZE
+module_id() {
+    local cpu="$1"
+    local cluster="/sys/devices/system/cpu/cpu${cpu}/topology/cluster_id"
+
+    if [[ -r "$cluster" ]]; then
+        cat "$cluster"
+    else
+        echo $(( cpu / ${RATE_MODULE_SIZE:-4} ))
+    fi
+}
+
+# Pick cores for N copies in whole modules, starting with the module of
+# first_core, so copies contend for L2 and memory like a real rate run.
+# N is rounded up to fill the last module. Prints one core id per line.
+rate_select_cores() {
+    local copies="$1"
+    local first_core="$2"
+    local max_cpu=$(( $(nproc --all) - 1 ))
+    local cpu="$first_core"
+    local -a cores=()
+    local core
+
+    while (( ${#cores[@]} < copies && cpu <= max_cpu )); do
+        local -a module=($(module_cores "$cpu"))
+
+        for core in "${module[@]}"; do
+            if (( core >= cpu && core <= max_cpu )) && [[ -d "/sys/devices/system/cpu/cpu${core}" ]]; then
+                cores+=("$core")
+            fi
+        done
+        cpu=$(( ${module[-1]} + 1 ))
+    done
+
+    if (( ${#cores[@]} < copies )); then
+        echo "WARNING: Only ${#cores[@]} cores available from core $first_core for $copies copies" >&2
+    elif (( ${#cores[@]} > copies )); then
+        echo "Rate mode: $copies copies rounded up to ${#cores[@]} to fill whole modules" >&2
+    fi
+
+    printf '%s\n' "${cores[@]}"
+}
+
+# Run one copy pinned to a core under /usr/bin/time -v and, with
+# PERF_STAT=1, perf stat writing CSV counters to perf_file
+rate_run_copy() {
+    local core_id="$1"
+    local exec_dir="$2"
+    local command_line="$3"
+    local perf_file="$4"
+    local -a perf_cmd=()
+
+    if [[ "${PERF_STAT:-1}" == 1 ]]; then
+        if command -v perf >/dev/null 2>&1; then
+            perf_cmd=(perf stat -x, -o "$perf_file" -e "${PERF_EVENTS:-instructions,cycles,LLC-loads,LLC-load-misses,r80d1}" --)
+        else
+            echo "WARNING: perf not found, running without counters"
+        fi
+    fi
+
+    taskset -c "$core_id" /usr/bin/time -v "${perf_cmd[@]}" \
+        /bin/bash -lc "cd '$exec_dir' && $command_line"
+}
+
+# Sum a perf stat -x, file into event=value lines, hybrid PMU prefixes
+# (cpu_atom/instructions/) are dropped and uncounted events skipped
+perf_counters() {
+    local perf_file="$1"
+
+    [[ -f "$perf_file" ]] || return 0
+    awk -F, '
+        /^#/ || NF < 3 { next }
+        $1 ~ /^</ { next }
+        {
+            event = $3
+            sub(/^[a-z_]+\//, "", event)
+            sub(/\/.*$/, "", event)
+            sum[event] += $1
+        }
+        END { for (e in sum) printf "%s=%.0f\n", e, sum[e] }
+    ' "$perf_file"
+}
+
+# Write the tidy per copy CSV of one iteration. Reads the time -v output
+# from <log_prefix>.core<id> and the counters from <log_prefix>.perf<id>.
+rate_write_csv() {
+    local csv_file="$1"
+    local benchmark="$2"
+    local mode="$3"
+    local iteration="$4"
+    local log_prefix="$5"
+    shift 5
+    local -a cores=("$@")
+    local copy=0
+    local core_id
+
+    echo "benchmark,mode,iteration,copies,copy,core,module,exit_status,elapsed_s,max_rss_kb,instructions,cycles,ipc,llc_loads,llc_misses,llc_miss_ratio,dram_loads,dram_demand_load_mbs" > "$csv_file"
+
+    for core_id in "${cores[@]}"; do
+        local log="${log_prefix}.core${core_id}"
+        local elapsed="" rss="" status=""
+
+        if [[ -f "$log" ]]; then
+            elapsed=$(awk -F': ' '/Elapsed \(wall clock\) time/ {
+                n = split($2, t, ":"); s = 0
+                for (i = 1; i <= n; i++) s = s * 60 + t[i]
+                print s }' "$log")
+            rss=$(awk -F': ' '/Maximum resident set size/ { print $2 }' "$log")
+            status=$(awk -F': ' '/Exit status/ { print $2 }' "$log")
+        fi
+
+        declare -A counter=()
+        local line value
+        while IFS='=' read -r line value; do
+            [[ -n "$line" ]] && counter[$line]="$value"
+        done < <(perf_counters "${log_prefix}.perf${core_id}")
+
+        # r80d1 is MEM_LOAD_UOPS_RETIRED.DRAM_HIT on Atom, one line per retired
+        # demand load served from DRAM. Prefetches, writebacks and stores are
+        # not counted, so this is a demand load rate and not the DRAM bandwidth,
+        # which only the IMC uncore counters see
+        awk -v b="$benchmark" -v m="$mode" -v it="$iteration" -v n="${#cores[@]}" \
+            -v c="$copy" -v core="$core_id" -v mod="$(module_id "$core_id")" \
+            -v st="$status" -v el="$elapsed" -v rss="$rss" \
+            -v ins="${counter[instructions]}" -v cyc="${counter[cycles]}" \
+            -v ll="${counter[LLC-loads]}" -v lm="${counter[LLC-load-misses]}" \
+            -v dr="${counter[r80d1]}" 'BEGIN {
+                ipc = (cyc > 0) ? sprintf("%.4f", ins / cyc) : ""
+                mr = (ll > 0) ? sprintf("%.4f", lm / ll) : ""
+                bw = (el > 0 && dr != "") ? sprintf("%.1f", dr * 64 / el / 1048576) : ""
+                printf "%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s,%s\n",
+                    b, m, it, n, c, core, mod, st, el, rss, ins, cyc, ipc, ll, lm, mr, dr, bw
+            }' >> "$csv_file"
+        unset counter
+        copy=$((copy + 1))
+    done
+}
@@ -0,0 +1,760 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <math.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+#include "cJSON.h"
+#include "common.h"
+#include "mab.h"
+#include "user_api.h"
+#include "ctrl_socket.h"
+
+#define TAG "CTRL"
+
+// Runtime control of a running dPF over a Unix domain socket.
+//
+// The protocol is JSON lines, one request object per line and one response
+// object per line, e.g. with socat:
+//   echo '{"cmd":"status"}' | socat - UNIX-CONNECT:/run/dpf.sock
+//
+// Requests that change the tuning are only validated here and posted as
+// pending. They are picked up by ctrl_apply() at a safe point, by the master
+// core between intervals in user mode and by the main loop in kernel mode,
+// so the tuned cores never wait on the socket.
+//
+// Replies are built from a snapshot the master core copies once per interval
+// (ctrl_publish()), never from the tuner's own state while it changes. The
+// master only tries the lock and skips the copy while a reply holds it.
+
+struct ctrl_state_s ctrl_state;
+
+struct ctrl_request_s {
+	int pause; //CTRL_NO_CHANGE, 0 resume, 1 pause
+	int tunealg;
+	float time_intervall;
+	float aggr;
+	int pin; //set if arm or profile below should be applied
+	int pin_arm;
+	int pin_profile;
+};
+
+struct ctrl_client_s {
+	int fd;
+	size_t len;
+	char buf[CTRL_LINE_MAX];
+};
+
+// Tuner state of one interval for the replies, user mode only
+struct ctrl_core_s {
+	uint64_t instructions;
+	uint64_t cycles;
+	uint64_t pmu[PMU_MAX_EVENTS];
+	float pmu_duty[PMU_MAX_EVENTS];
+	struct pf_metrics_s pf;
+	union msr_u msr[HWPF_MSR_FIELDS];
+};
+
+struct ctrl_snapshot_s {
+	struct overhead_total_s ovh;
+	int mab; //tunealg was MAB
+	int mode;
+	size_t arm;
+	int pinned_arm;
+	size_t num_arms;
+	size_t iterations;
+	float rewards[MAX_ARMS];
+	int num_cores;
+	struct ctrl_core_s core[];
+};
+
+static struct ctrl_request_s pending;
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int pending_flag;
+
+static struct ctrl_snapshot_s *snap;
+static size_t snap_size;
+static pthread_mutex_t snap_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct ctrl_client_s clients[CTRL_MAX_CLIENTS];
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static int listen_fd = -1;
+static int epoll_fd = -1;
+static int ctrl_kernel_mode;
+static volatile int ctrl_running;
+static pthread_t ctrl_thread;
+
+extern volatile int quitflag;
+
+static void pending_reset(struct ctrl_request_s *req)
+{
+	req->pause = CTRL_NO_CHANGE;
+	req->tunealg = CTRL_NO_CHANGE;
+	req->time_intervall = CTRL_NO_CHANGE;
+	req->aggr = CTRL_NO_CHANGE;
+	req->pin = 0;
+	req->pin_arm = CTRL_PIN_NONE;
+	req->pin_profile = CTRL_PROFILE_NONE;
+}
+
+static void pending_post(struct ctrl_request_s *req)
+{
+	pthread_mutex_lock(&pending_lock);
+
+	if (req->pause != CTRL_NO_CHANGE)
+		pending.pause = req->pause;
+	if (req->tunealg != CTRL_NO_CHANGE)
+		pending.tunealg = req->tunealg;
+	if (req->time_intervall >= 0)
+		pending.time_intervall = req->time_intervall;
+	if (req->aggr >= 0)
+		pending.aggr = req->aggr;
+	if (req->pin) {
+		pending.pin = 1;
+		pending.pin_arm = req->pin_arm;
+		pending.pin_profile = req->pin_profile;
+	}
+
+	atomic_store(&pending_flag, 1);
+	pthread_mutex_unlock(&pending_lock);
+}
+
+// Mark all module primaries to rewrite their MSRs on the next interval
+static void mark_all_dirty(void)
+{
+	for (int i = 0; i < ACTIVE_THREADS; i++)
+		gtinfo[i].hwpf_msr_dirty = 1;
+}
+
+static void apply_profile(int profile)
+{
+	if (profile == CTRL_PROFILE_DEFAULT) {
+		for (int i = 0; i < ACTIVE_THREADS; i++)
+			memcpy(gtinfo[i].hwpf_msr_value, gtinfo[i].hwpf_msr_boot,
+			       sizeof(gtinfo[i].hwpf_msr_value));
+		ctrl_state.paused = 1;
+	}
+
+	ctrl_state.profile = profile;
+	mark_all_dirty();
+}
+
+static void apply_user(struct ctrl_request_s *req)
+{
+	if (req->tunealg != CTRL_NO_CHANGE && req->tunealg != tunealg) {
+		if (req->tunealg == MAB && mstate.num_threads == 0)
+			mab_init(&mstate, ACTIVE_THREADS);
+		tunealg = req->tunealg;
+		// PMU deltas of the first interval are taken with the
+		// previous algorithm's counter setup
+		ctrl_state.settle = 1;
+		mark_all_dirty();
+		logi(TAG, "Switched to algorithm %d\n", tunealg);
+	}
+
+	if (req->pin) {
+		if (req->pin_profile != CTRL_PROFILE_NONE) {
+			apply_profile(req->pin_profile);
+			logi(TAG, "Pinned profile %d\n", req->pin_profile);
+		} else {
+			if (ctrl_state.profile != CTRL_PROFILE_NONE)
+				apply_profile(CTRL_PROFILE_NONE);
+			mstate.pinned_arm = req->pin_arm;
+			logi(TAG, "Pinned arm %d\n", req->pin_arm);
+		}
+	}
+
+	if (req->pause == 0 && ctrl_state.profile != CTRL_PROFILE_NONE)
+		apply_profile(CTRL_PROFILE_NONE);
+}
+
+static void apply_kernel(struct ctrl_request_s *req)
+{
+	int changed = 0;
+
+	if (req->tunealg != CTRL_NO_CHANGE && req->tunealg != tunealg) {
+		tunealg = req->tunealg;
+		changed = 1;
+	}
+	if (req->aggr >= 0)
+		changed = 1;
+
+	if (req->pause == 1)
+		kernel_tuning_control(0, tunealg, aggr);
+	else if (req->pause == 0 || (changed && !ctrl_state.paused))
+		kernel_tuning_control(1, tunealg, aggr);
+}
+
+// Apply changes posted through the control socket. Must be called from the
+// thread that owns the tuning state, the master core in user mode or the
+// main loop in kernel mode.
+// Returns 1 if anything was applied, 0 otherwise
+int ctrl_apply(void)
+{
+	struct ctrl_request_s req;
+
+	if (atomic_load(&pending_flag) == 0)
+		return 0;
+
+	pthread_mutex_lock(&pending_lock);
+	req = pending;
+	pending_reset(&pending);
+	atomic_store(&pending_flag, 0);
+	pthread_mutex_unlock(&pending_lock);
+
+	if (req.time_intervall >= 0)
+		time_intervall = req.time_intervall;
+	if (req.aggr >= 0)
+		aggr = req.aggr;
+
+	if (ctrl_kernel_mode)
+		apply_kernel(&req);
+	else
+		apply_user(&req);
+
+	if (req.pause != CTRL_NO_CHANGE)
+		ctrl_state.paused = req.pause;
+
+	logv(TAG, "Applied request: paused %d, alg %d, intervall %.4f, aggr %.1f\n",
+	     ctrl_state.paused, tunealg, time_intervall, aggr);
+
+	return 1;
+}
+
+// Copy the tuner state the replies use. Called by the master core once per
+// interval after calculate_settings()
+void ctrl_publish(void)
+{
+	if (snap == NULL || pthread_mutex_trylock(&snap_lock) != 0)
+		return;
+
+	snap->ovh = ovh_last;
+	snap->mab = tunealg == MAB;
+	if (snap->mab) {
+		snap->mode = mstate.mode;
+		snap->arm = mstate.arm;
+		snap->pinned_arm = mstate.pinned_arm;
+		snap->num_arms = mstate.num_arms;
+		snap->iterations = mstate.iterations;
+		memcpy(snap->rewards, arms.rewards,
+		       sizeof(float) * snap->num_arms);
+	}
+
+	for (int i = 0; i < snap->num_cores; i++) {
+		struct ctrl_core_s *c = &snap->core[i];
+		struct thread_state *ts = &gtinfo[i];
+
+		c->instructions = ts->instructions_retired;
+		c->cycles = ts->cpu_cycles;
+		memcpy(c->pmu, ts->pmu_result, sizeof(c->pmu));
+		memcpy(c->pmu_duty, ts->pmu_duty, sizeof(c->pmu_duty));
+		c->pf = ts->pf;
+		if (snap->mab && ctrl_state.profile == CTRL_PROFILE_NONE)
+			memcpy(c->msr, arms.hwpf_msr_values[mstate.arm],
+			       sizeof(c->msr));
+		else
+			memcpy(c->msr, ts->hwpf_msr_value, sizeof(c->msr));
+	}
+
+	pthread_mutex_unlock(&snap_lock);
+}
+
+// Private copy of the snapshot for one reply, NULL in kernel mode
+static struct ctrl_snapshot_s *snapshot_get(void)
+{
+	struct ctrl_snapshot_s *s;
+
+	if (snap == NULL)
+		return NULL;
+	s = malloc(snap_size);
+	if (s == NULL)
+		return NULL;
+
+	pthread_mutex_lock(&snap_lock);
+	memcpy(s, snap, snap_size);
+	pthread_mutex_unlock(&snap_lock);
+
+	return s;
+}
+
+// Derived prefetch metrics are NAN when their events are not programmed
+static void add_pf_metric(cJSON *obj, const char *name, float v)
+{
+	if (!isnan(v))
+		cJSON_AddNumberToObject(obj, name, v);
+}
+
+static void add_msr_values(cJSON *obj, const char *name, union msr_u msr[])
+{
+	cJSON *arr = cJSON_AddArrayToObject(obj, name);
+	char hex[24];
+
+	for (int i = 0; i < HWPF_MSR_FIELDS; i++) {
+		snprintf(hex, sizeof(hex), "0x%016lx", msr[i].v);
+		cJSON_AddItemToArray(arr, cJSON_CreateString(hex));
+	}
+}
+
+static void reply_status(cJSON *resp)
+{
+	struct ctrl_snapshot_s *s = snapshot_get();
+
+	cJSON_AddStringToObject(resp, "mode", ctrl_kernel_mode ? "kernel" : "user");
+	cJSON_AddBoolToObject(resp, "paused", ctrl_state.paused);
+	cJSON_AddNumberToObject(resp, "alg", tunealg);
+	cJSON_AddNumberToObject(resp, "intervall", time_intervall);
+	cJSON_AddNumberToObject(resp, "aggr", aggr);
+	cJSON_AddNumberToObject(resp, "core_first", core_first);
+	cJSON_AddNumberToObject(resp, "core_last", core_last);
+	cJSON_AddNumberToObject(resp, "ddr_bw_target", ddr_bw_target);
+	if (s != NULL) {
+		cJSON *ovh = cJSON_AddObjectToObject(resp, "overhead");
+
+		cJSON_AddNumberToObject(ovh, "core_pct", s->ovh.core_pct);
+		cJSON_AddNumberToObject(ovh, "cap_pct", ovh_cap_pct);
+		cJSON_AddNumberToObject(ovh, "syscalls", s->ovh.sum.syscalls);
+		cJSON_AddNumberToObject(ovh, "msr_ops", s->ovh.sum.msr_ops);
+		cJSON_AddNumberToObject(ovh, "ctx_switches",
+					s->ovh.sum.ctx_switches);
+		cJSON_AddNumberToObject(ovh, "decision_us",
+					s->ovh.decision_ns / 1000);
+	}
+	cJSON_AddStringToObject(resp, "profile",
+		ctrl_state.profile == CTRL_PROFILE_DEFAULT ? "default" : "none");
+
+	if (s != NULL && s->mab) {
+		cJSON *mab = cJSON_AddObjectToObject(resp, "mab");
+		cJSON *rewards;
+
+		cJSON_AddNumberToObject(mab, "mode", s->mode);
+		cJSON_AddNumberToObject(mab, "arm", s->arm);
+		cJSON_AddNumberToObject(mab, "pinned_arm", s->pinned_arm);
+		cJSON_AddNumberToObject(mab, "num_arms", s->num_arms);
+		cJSON_AddNumberToObject(mab, "iterations", s->iterations);
+		rewards = cJSON_AddArrayToObject(mab, "rewards");
+		for (size_t i = 0; i < s->num_arms; i++)
+			cJSON_AddItemToArray(rewards,
+					     cJSON_CreateNumber(s->rewards[i]));
+	}
+
+	free(s);
+}
+
+static void reply_metrics(cJSON *resp)
+{
+	struct ctrl_snapshot_s *s = snapshot_get();
+	cJSON *cores;
+
+	if (!ctrl_kernel_mode) {
+		cJSON *events = cJSON_AddArrayToObject(resp, "pmu_events");
+
+		for (int j = 0; j < pmu_num_events; j++)
+			cJSON_AddItemToArray(events,
+				cJSON_CreateString(pmu_events[j].name));
+	}
+
+	cores = cJSON_AddArrayToObject(resp, "cores");
+
+	for (int i = 0; i < ACTIVE_THREADS; i++) {
+		cJSON *core = cJSON_CreateObject();
+		cJSON *pmu;
+		int core_id = core_first + i;
+
+		cJSON_AddNumberToObject(core, "core", core_id);
+
+		if (ctrl_kernel_mode) {
+			uint64_t pmu_values[PMU_COUNTERS] = {0};
+			union msr_u msr_values[HWPF_MSR_FIELDS] = {0};
+
+			kernel_pmu_read(core_id, pmu_values);
+			kernel_msr_read(core_id, (uint64_t *)msr_values);
+			pmu = cJSON_AddArrayToObject(core, "pmu");
+			for (int j = 0; j < PMU_COUNTERS; j++)
+				cJSON_AddItemToArray(pmu,
+					cJSON_CreateNumber(pmu_values[j]));
+			add_msr_values(core, "msr", msr_values);
+		} else if (s != NULL) {
+			struct ctrl_core_s *ts = &s->core[i];
+
+			if (ts->cycles)
+				cJSON_AddNumberToObject(core, "ipc",
+					(double)ts->instructions / ts->cycles);
+			pmu = cJSON_AddArrayToObject(core, "pmu");
+			for (int j = 0; j < pmu_num_events; j++)
+				cJSON_AddItemToArray(pmu,
+					cJSON_CreateNumber(ts->pmu[j]));
+			pmu = cJSON_AddArrayToObject(core, "pmu_duty");
+			for (int j = 0; j < pmu_num_events; j++)
+				cJSON_AddItemToArray(pmu,
+					cJSON_CreateNumber(ts->pmu_duty[j]));
+			add_pf_metric(core, "pf_accuracy", ts->pf.accuracy);
+			add_pf_metric(core, "pf_coverage", ts->pf.coverage);
+			add_pf_metric(core, "pf_lateness", ts->pf.lateness);
+			add_pf_metric(core, "xq_pressure", ts->pf.xq_pressure);
+			add_pf_metric(core, "mem_bound", ts->pf.mem_bound);
+			add_pf_metric(core, "l2_stall", ts->pf.l2_stall);
+			add_pf_metric(core, "l3_stall", ts->pf.l3_stall);
+			add_pf_metric(core, "dram_stall", ts->pf.dram_stall);
+			add_pf_metric(core, "mem_sched", ts->pf.mem_sched);
+			add_msr_values(core, "msr", ts->msr);
+		}
+
+		cJSON_AddItemToArray(cores, core);
+	}
+
+	free(s);
+}
+
+// Validate a request and post it. Returns NULL on success or an error
+// string for the response.
+static const char *handle_request(cJSON *req, cJSON *resp)
+{
+	struct ctrl_request_s change;
+	cJSON *cmd = cJSON_GetObjectItem(req, "cmd");
+	cJSON *value = cJSON_GetObjectItem(req, "value");
+	const char *name;
+
+	if (!cJSON_IsString(cmd))
+		return "missing cmd";
+	name = cmd->valuestring;
+
+	pending_reset(&change);
+
+	if (strcmp(name, "status") == 0) {
+		reply_status(resp);
+		return NULL;
+	} else if (strcmp(name, "metrics") == 0) {
+		reply_metrics(resp);
+		return NULL;
+	} else if (strcmp(name, "pause") == 0) {
+		change.pause = 1;
+	} else if (strcmp(name, "resume") == 0) {
+		change.pause = 0;
+	} else if (strcmp(name, "alg") == 0) {
+		if (!cJSON_IsNumber(value))
+			return "alg needs a numeric value";
+		if (value->valueint != 0 && value->valueint != 1 &&
+		    value->valueint != MAB)
+			return "unknown algorithm";
+		if (ctrl_kernel_mode && value->valueint == MAB)
+			return "MAB is not available in kernel mode";
+		change.tunealg = value->valueint;
+	} else if (strcmp(name, "intervall") == 0) {
+		if (!cJSON_IsNumber(value))
+			return "intervall needs a numeric value";
+		if (ctrl_kernel_mode)
+			return "intervall is fixed in kernel mode";
+		if (value->valuedouble < 0.0001 || value->valuedouble > 60.0)
+			return "intervall out of range (0.0001-60)";
+		change.time_intervall = value->valuedouble;
+	} else if (strcmp(name, "aggr") == 0) {
+		if (!cJSON_IsNumber(value))
+			return "aggr needs a numeric value";
+		if (value->valuedouble < 0.1 || value->valuedouble > 5.0)
+			return "aggr out of range (0.1-5.0)";
+		change.aggr = value->valuedouble;
+	} else if (strcmp(name, "pin") == 0) {
+		cJSON *arm = cJSON_GetObjectItem(req, "arm");
+		cJSON *profile = cJSON_GetObjectItem(req, "profile");
+
+		if (ctrl_kernel_mode)
+			return "pin is not available in kernel mode";
+		change.pin = 1;
+		if (cJSON_IsNumber(arm)) {
+			struct ctrl_snapshot_s *s = snapshot_get();
+			size_t num_arms = s != NULL && s->mab ? s->num_arms : 0;
+
+			free(s);
+			if (tunealg != MAB)
+				return "arms can only be pinned with MAB";
+			if (arm->valueint < 0 || (size_t)arm->valueint >= num_arms)
+				return "arm out of range";
+			change.pin_arm = arm->valueint;
+		} else if (cJSON_IsString(profile) &&
+			   strcmp(profile->valuestring, "default") == 0) {
+			change.pin_profile = CTRL_PROFILE_DEFAULT;
+		} else {
+			return "pin needs an arm or profile \"default\"";
+		}
+	} else if (strcmp(name, "unpin") == 0) {
+		if (ctrl_kernel_mode)
+			return "pin is not available in kernel mode";
+		change.pin = 1;
+		change.pause = 0;
+	} else if (strcmp(name, "quit") == 0) {
+		quitflag = 1;
+		return NULL;
+	} else {
+		return "unknown cmd";
+	}
+
+	pending_post(&change);
+
+	return NULL;
+}
+
+static void client_close(struct ctrl_client_s *cl)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, cl->fd, NULL);
+	close(cl->fd);
+	cl->fd = -1;
+	cl->len = 0;
+}
+
+// Parse one request line and send the response line back.
+// Returns 0 on success, -1 if the client should be dropped
+static int client_line(struct ctrl_client_s *cl, char *line)
+{
+	cJSON *req = cJSON_Parse(line);
+	cJSON *resp = cJSON_CreateObject();
+	const char *err;
+	char *out;
+	ssize_t ret;
+
+	if (req == NULL)
+		err = "malformed JSON";
+	else
+		err = handle_request(req, resp);
+
+	if (err) {
+		cJSON_Delete(resp);
+		resp = cJSON_CreateObject();
+		cJSON_AddBoolToObject(resp, "ok", 0);
+		cJSON_AddStringToObject(resp, "error", err);
+	} else {
+		cJSON_AddBoolToObject(resp, "ok", 1);
+	}
+
+	out = cJSON_PrintUnformatted(resp);
+	cJSON_Delete(resp);
+	cJSON_Delete(req);
+	if (out == NULL)
+		return -1;
+
+	// Responses are small, a client that can't take one is dropped rather
+	// than buffered for
+	ret = send(cl->fd, out, strlen(out), MSG_NOSIGNAL | MSG_DONTWAIT);
+	if (ret >= 0)
+		ret = send(cl->fd, "\n", 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+	free(out);
+
+	return ret < 0 ? -1 : 0;
+}
+
+static void client_read(struct ctrl_client_s *cl)
+{
+	ssize_t n;
+	char *nl;
+
+	n = read(cl->fd, cl->buf + cl->len, sizeof(cl->buf) - cl->len - 1);
+	if (n <= 0) {
+		if (n < 0 && (errno == EAGAIN || errno == EINTR))
+			return;
+		client_close(cl);
+		return;
+	}
+	cl->len += n;
+	cl->buf[cl->len] = '\0';
+
+	while ((nl = strchr(cl->buf, '\n')) != NULL) {
+		*nl = '\0';
+		if (client_line(cl, cl->buf) < 0) {
+			client_close(cl);
+			return;
+		}
+		cl->len -= nl + 1 - cl->buf;
+		memmove(cl->buf, nl + 1, cl->len + 1);
+	}
+
+	if (cl->len == sizeof(cl->buf) - 1) {
+		loge(TAG, "Request line too long, dropping client\n");
+		client_close(cl);
+	}
+}
+
+static void client_accept(void)
+{
+	struct epoll_event ev;
+	int fd;
+
+	while ((fd = accept4(listen_fd, NULL, NULL,
+			     SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		int slot = -1;
+
+		for (int i = 0; i < CTRL_MAX_CLIENTS; i++) {
+			if (clients[i].fd == -1) {
+				slot = i;
+				break;
+			}
+		}
+		if (slot == -1) {
+			logi(TAG, "Too many control clients\n");
+			close(fd);
+			continue;
+		}
+
+		clients[slot].fd = fd;
+		clients[slot].len = 0;
+		ev.events = EPOLLIN;
+		ev.data.ptr = &clients[slot];
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+			close(fd);
+			clients[slot].fd = -1;
+		}
+	}
+}
+
+static void *ctrl_thread_start(void *arg)
+{
+	struct epoll_event events[CTRL_MAX_CLIENTS + 1];
+	int hk_core = *(int *)arg;
+
+	free(arg);
+
+	if (hk_core >= 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(hk_core, &cpuset);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset),
+					   &cpuset) != 0)
+			loge(TAG, "Could not pin control thread to core %d\n",
+			     hk_core);
+	}
+
+	while (ctrl_running && quitflag == 0) {
+		int n = epoll_wait(epoll_fd, events, CTRL_MAX_CLIENTS + 1,
+				   CTRL_POLL_MS);
+
+		overhead_helper_sample();
+
+		for (int i = 0; i < n; i++) {
+			if (events[i].data.ptr == NULL)
+				client_accept();
+			else
+				client_read(events[i].data.ptr);
+		}
+	}
+
+	return NULL;
+}
+
+// Open the control socket and start serving it from a thread on the
+// housekeeping core hk_core (-1 to leave it unpinned).
+// Returns 0 on success, -1 on failure
+int ctrl_socket_start(const char *path, int hk_core, int kernel_mode)
+{
+	struct sockaddr_un addr = {0};
+	struct epoll_event ev;
+	int *arg;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		loge(TAG, "Control socket path too long: %s\n", path);
+		return -1;
+	}
+
+	ctrl_kernel_mode = kernel_mode;
+	pending_reset(&pending);
+	if (!kernel_mode) {
+		snap_size = sizeof(*snap) +
+			    ACTIVE_THREADS * sizeof(struct ctrl_core_s);
+		snap = calloc(1, snap_size);
+		if (snap == NULL) {
+			loge(TAG, "Could not allocate the control snapshot\n");
+			return -1;
+		}
+		snap->num_cores = ACTIVE_THREADS;
+	}
+	for (int i = 0; i < CTRL_MAX_CLIENTS; i++)
+		clients[i].fd = -1;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listen_fd < 0) {
+		loge(TAG, "Could not create control socket: %s\n", strerror(errno));
+		free(snap);
+		snap = NULL;
+		return -1;
+	}
+
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	strcpy(socket_path, path);
+	unlink(path);
+
+	if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(listen_fd, CTRL_MAX_CLIENTS) < 0) {
+		loge(TAG, "Could not bind control socket %s: %s\n", path,
+		     strerror(errno));
+		goto err_close;
+	}
+	chmod(path, 0660);
+
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		goto err_unlink;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL; //NULL marks the listening socket
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) < 0)
+		goto err_epoll;
+
+	arg = malloc(sizeof(*arg));
+	if (arg == NULL)
+		goto err_epoll;
+	*arg = hk_core;
+
+	ctrl_running = 1;
+	if (pthread_create(&ctrl_thread, NULL, &ctrl_thread_start, arg) != 0) {
+		ctrl_running = 0;
+		free(arg);
+		goto err_epoll;
+	}
+
+	logi(TAG, "Control socket listening on %s (core %d)\n", path, hk_core);
+
+	return 0;
+
+err_epoll:
+	close(epoll_fd);
+	epoll_fd = -1;
+err_unlink:
+	unlink(path);
+err_close:
+	close(listen_fd);
+	listen_fd = -1;
+	free(snap);
+	snap = NULL;
+
+	return -1;
+}
+
+void ctrl_socket_stop(void)
+{
+	if (!ctrl_running)
+		return;
+
+	ctrl_running = 0;
+	pthread_join(ctrl_thread, NULL);
+
+	for (int i = 0; i < CTRL_MAX_CLIENTS; i++) {
+		if (clients[i].fd != -1)
+			client_close(&clients[i]);
+	}
+	close(epoll_fd);
+	close(listen_fd);
+	unlink(socket_path);
+	epoll_fd = -1;
+	listen_fd = -1;
+	free(snap);
+	snap = NULL;
+}
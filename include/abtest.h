@@ -0,0 +1,69 @@
+#ifndef __ABTEST_H
+#define __ABTEST_H
+
+#include <stdint.h>
+
+#define AB_SLICE_INTERVALS (10) //default intervals per slice
+#define AB_SKIP_INTERVALS (1) //intervals not measured after a switch
+#define AB_MIN_SLICES (2) //ratios needed before an effect is reported
+
+// A/B modes
+#define AB_OFF (0)
+#define AB_TIME (1) //all modules alternate in randomized time slices
+#define AB_SPLIT (2) //modules split into a control and a treatment half
+
+// Arms
+#define AB_CONTROL (0) //MSR values read at startup
+#define AB_TREATMENT (1) //tuned policy
+
+// Measured metrics
+#define AB_IPC (0)
+#define AB_IPS (1) //instructions per second and core
+#define AB_METRICS (2)
+
+// Running mean and variance (Welford)
+struct ab_stats_s {
+	uint64_t n;
+	double mean;
+	double m2;
+};
+
+// Effect of the treatment relative to the control, e.g. 0.02 is +2%
+struct ab_effect_s {
+	int valid; //0 until enough slices are recorded
+	double control; //mean per slice
+	double treatment;
+	double effect;
+	double ci_low; //95% confidence interval of effect
+	double ci_high;
+};
+
+struct ab_state_s {
+	int mode;
+	int slice_intervals;
+	int arm; //AB_TIME: arm running the current slice
+	int block_first; //AB_TIME: arm of the first slice in the block of two
+	int interval; //intervals into the current slice
+	uint64_t slices;
+	int num_modules;
+	int *module_arm; //AB_SPLIT: arm per module
+
+	// sums over the measured intervals of the current slice, per arm
+	double instr[2];
+	double cycles[2];
+	double core_s[2]; //core seconds
+
+	struct ab_stats_s value[2][AB_METRICS]; //per slice and arm
+	struct ab_stats_s ratio[AB_METRICS]; //treatment / control per block or slice
+};
+
+extern struct ab_state_s ab_state;
+
+int ab_parse(const char *arg);
+int ab_init(int num_cores);
+int ab_interval(void);
+int ab_control(int thread);
+int ab_effect(int metric, struct ab_effect_s *e);
+void ab_deinit(void);
+
+#endif
@@ -10,12 +10,6 @@
 #include <stdlib.h>
 #endif
 
-#define L2MAXDIST_MAX (31)
-#define L3MAXDIST_MAX (63)
-#define L2XQ_MAX (31)
-#define L3XQ_MAX (31)
-#define LOW_DMDDENS_L2L3XQ_MAX (63)
-
 struct msr1320_s{
 	uint64_t L2_STREAM_AMP_XQ_THRESHOLD : 5;
 	uint64_t pad0 : 15;
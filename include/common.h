@@ -9,6 +9,7 @@
 #include "msr.h"
 #include "pmu_core.h"
 #include "log.h"
+#include "overhead.h"
 
 #define MAX_THREADS (1024)
 #define DEFAULT_PRIORITY (50)
@@ -18,23 +19,35 @@
 
 #define CORE_IN_MODULE ((tstate->core_id - core_first) % 4)
 #define ACTIVE_THREADS (core_last - core_first + 1)
+// P-core threads come after the E-core ones in gtinfo
+#define PCORE_THREADS (pcore_first < 0 ? 0 : pcore_last - pcore_first + 1)
+#define ALL_THREADS (ACTIVE_THREADS + PCORE_THREADS)
 
 struct thread_state {
 	pthread_t thread_id; // from pthread_create()
 	int core_id;
+	int pcore; //1 on a P-core of a hybrid client, 0x1A4 only
 	int hwpf_msr_dirty; //0 not updated, 1 updated
 	union msr_u hwpf_msr_value[HWPF_MSR_FIELDS]; //0... -> 0x1320...
-	uint64_t pmu_result[PMU_COUNTERS]; //delta since last read
+	union msr_u hwpf_msr_boot[HWPF_MSR_FIELDS]; //values found at startup
+	union msr_u hwpf_msr_written[HWPF_MSR_FIELDS]; //last written to the core
+	uint64_t pmu_result[PMU_MAX_EVENTS]; //delta since last read
+	float pmu_duty[PMU_MAX_EVENTS]; //share of the interval each event was counted
     uint64_t instructions_retired; // delta since last read
-    uint64_t cpu_cycles; // delta since last read
+    uint64_t cpu_cycles; // unhalted core cycles, delta since last read
+	struct pf_metrics_s pf; // prefetch quality derived from pmu_result
+	struct overhead_s ovh; // dPF's own cost during the last interval
 };
 
 uint64_t time_ms(void);
+uint64_t time_ns(void);
 
 
 extern struct thread_state gtinfo[MAX_THREADS]; //global thread state
 extern int core_last;
 extern int core_first;
+extern int pcore_first; //-1 when the P-cores are not tuned
+extern int pcore_last;
 extern int tunealg;
 extern float time_intervall;
 
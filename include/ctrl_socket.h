@@ -0,0 +1,33 @@
+#ifndef __CTRL_SOCKET_H
+#define __CTRL_SOCKET_H
+
+#define CTRL_SOCKET_PATH "/run/dpf.sock"
+#define CTRL_MAX_CLIENTS (8)
+#define CTRL_LINE_MAX (1024)
+#define CTRL_POLL_MS (200)
+
+// Request fields that are not set
+#define CTRL_NO_CHANGE (-1)
+
+// Pin values, anything >= 0 is a MAB arm
+#define CTRL_PIN_NONE (-1)
+
+// Fixed MSR profiles that can be pinned instead of an arm
+#define CTRL_PROFILE_NONE (0)
+#define CTRL_PROFILE_DEFAULT (1) //MSR values read at startup
+
+// Runtime state changed through the control socket
+struct ctrl_state_s {
+	volatile int paused; //1 tuning is frozen, MSRs keep their values
+	volatile int profile; //CTRL_PROFILE_*
+	volatile int settle; //intervals to skip after an algorithm switch
+};
+
+extern struct ctrl_state_s ctrl_state;
+
+int ctrl_socket_start(const char *path, int hk_core, int kernel_mode);
+void ctrl_socket_stop(void);
+int ctrl_apply(void);
+void ctrl_publish(void);
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef __L2CAT_H
+#define __L2CAT_H
+
+#include <stdint.h>
+
+#define L2CAT_MSR_MASK_BASE (0xD10) //IA32_L2_QOS_MASK_0, L2 (module) scoped
+#define L2CAT_MAX_MODULES (128)
+#define L2CAT_CORES_PER_MODULE (4) //most cores sharing one L2
+
+// A core streams when it causes at least half of its module's DRAM hits
+// with a low L2 hit rate, and stops when it falls clearly below that
+#define L2CAT_STREAM_DDR_SHARE (0.50)
+#define L2CAT_STREAM_L2_HITR (0.50)
+#define L2CAT_RELEASE_DDR_SHARE (0.25)
+#define L2CAT_RELEASE_L2_HITR (0.70)
+
+// Per module L2 partition state. A module is the tuned cores sharing one L2
+// by the sysfs cluster_id, they need not be aligned to core_first.
+struct l2cat_module_s {
+	int cores[L2CAT_CORES_PER_MODULE]; //tuned cores, from 0
+	int num_cores;
+	int streamers; //bit per entry of cores confined to the stream COS
+	int ways; //ways of the stream partition, 0 when not partitioned
+};
+
+struct l2cat_s {
+	int cbm_len; //ways of the L2
+	int max_ways; //largest stream partition, set by --l2cat
+	int cos_stream; //class of the streaming cores
+	int cos_shared; //class of their neighbours, the other ways
+	struct l2cat_module_s module[L2CAT_MAX_MODULES];
+};
+
+extern struct l2cat_s l2cat;
+
+int l2cat_support_check(void);
+int l2cat_init(int max_ways);
+void l2cat_tune(int tunealg);
+void l2cat_deinit(void);
+
+#endif
@@ -5,7 +5,26 @@
 #include <stdarg.h>
 #include <string.h>
 
+#define LOG_LEVELS (5)
+#define LOG_TAG_MAX (64)
+#define LOG_MSG_MAX (256)
+#define LOG_ARGS_MAX (16) //arguments of a message formatted by the writer
+#define LOG_SPEC_MAX (32) //longest conversion, e.g. "%-10.3lu"
+#define LOG_RING_SIZE (256) //records per thread
+#define LOG_MAX_RINGS (1100) //tuning threads plus helpers
+#define LOG_FLUSH_MS (10)
+
+#define LOG_FMT_TEXT (0)
+#define LOG_FMT_KV (1) //key=value per line
+
+#define LOG_TS_WALL (0)
+#define LOG_TS_MONO (1) //CLOCK_MONOTONIC ns
+
 int log_setlevel(int level);
+void log_setformat(int format, int timestamp);
+void log_setrate(unsigned int per_sec);
+int log_async_start(int core, void (*wakeup)(void));
+void log_async_stop(void);
 char * mergetags(char *t, char *f, int l);
 int loglevel(int level, char *tag, const char * format, ...);
 
@@ -3,6 +3,7 @@
 
 #include "msr.h"
 #include "atom_msr.h"
+#include "uncore.h"
 
 #define MAB_CONFIG_FILE "mab_config.json"
 
@@ -36,6 +37,11 @@
 #define ON (1)
 #define STEP (2)
 
+// Reward variants
+#define REWARD_IPC (0) //IPC of the first tuned module
+#define REWARD_IPJ (1) //instructions of all tuned cores per package joule
+#define REWARD_MEM_BOUND (2) //cycles of the tuned E-cores not stalled on memory
+
 #define MAX_TIME_INTERVAL (0.1)
 #define MIN_TIME_INTERVAL (0.01)
 
@@ -64,6 +70,11 @@ typedef struct mab_state {
     next_arm_strategy_t next_arm_func;
     update_strategy_t update_func;
     size_t iterations;
+    int pinned_arm; // arm held by the control socket, -1 if none
+    float last_reward; // raw reward of the latest evaluation
+    int reward; // REWARD_IPC, REWARD_IPJ or REWARD_MEM_BOUND
+    int uncore_ratios[UNCORE_MAX_RATIOS]; // each prefetch arm runs at each of them
+    size_t num_uncore_ratios; // 0 leaves the uncore alone
 
     int dynamic_sd;
     float *ipc_buffer;  // Circular buffer to store the recent IPC values
@@ -85,6 +96,7 @@ typedef struct mab_state {
 
 typedef struct arms {
     union msr_u hwpf_msr_values[MAX_ARMS][HWPF_MSR_FIELDS];
+    int uncore_ratio[MAX_ARMS]; // UNCORE_RATIO_NONE if not co-tuned
     float rewards[MAX_ARMS];
     float ipcs[MAX_ARMS];
     float nums[MAX_ARMS];
@@ -93,6 +105,7 @@ typedef struct arms {
 extern arms_t arms;
 
 void mab_init(mab_state *mstate, size_t active_threads);
+size_t mab_count_arms(void);
 int mab(mab_state *mstate);
 void print_arm_details(union msr_u msr[]);
 void setup_mab_state_from_json(mab_state* mstate, const char* config_file);
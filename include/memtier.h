@@ -0,0 +1,59 @@
+#ifndef __MEMTIER_H
+#define __MEMTIER_H
+
+#include <stdint.h>
+
+#define MEMTIER_SYSFS "/sys/devices/virtual/memory_tiering"
+#define MEMTIER_NODE_SYSFS "/sys/devices/system/node"
+#define MEMTIER_CXL_SYSFS "/sys/bus/cxl/devices"
+#define MEMTIER_DAX_SYSFS "/sys/bus/dax/devices"
+#define MEMTIER_PMU_SYSFS "/sys/bus/event_source/devices"
+
+#define MEMTIER_MAX_NODES (64)
+#define MEMTIER_MAX_TIERS (8)
+#define MEMTIER_MAX_PMUS (32)
+#define MEMTIER_DEVICE_LEN (64)
+
+// A module counts as using a tier from this share of its memory loads on
+// (cxl_hit out of dram_hit)
+#define MEMTIER_MIN_SHARE (0.10)
+
+// CXL.mem data flits, 64 bytes each, from the CXL PMU of a memdev
+#define MEMTIER_CXL_RD_EVENT "s2m_drs_memdata"
+#define MEMTIER_CXL_WR_EVENT "m2s_rwd_memwr"
+
+struct memtier_node_s {
+	int node;
+	int tier; //index into memtier.tier
+	int cpuless; //1 without CPUs
+	int cxl; //1 when backed by CXL memory expanders
+	char device[MEMTIER_DEVICE_LEN]; //"ddr" or the CXL memdevs, e.g. "mem0 mem1"
+};
+
+struct memtier_tier_s {
+	int id; //kernel memory tier, -1 if grouped by dPF
+	int cxl;
+	int target; //MB/s, 0 when unknown (not throttled on)
+	int num_pmus; //CXL PMUs counting this tier
+	double rd_percent; //read bandwidth of the last interval out of target
+	uint64_t rd_bytes; //last interval
+	uint64_t wr_bytes;
+};
+
+struct memtier_s {
+	int num_nodes;
+	int num_tiers; //tiering is off with less than 2
+	int ddr_tier; //tier of the nodes with CPUs, counted by pmu_ddr
+	int cxl_hit; //index of the cxl_hit core event, -1 if not programmed
+	struct memtier_node_s node[MEMTIER_MAX_NODES];
+	struct memtier_tier_s tier[MEMTIER_MAX_TIERS];
+};
+
+extern struct memtier_s memtier;
+
+int memtier_init(const char *targets, float utilization);
+void memtier_sample(double ddr_rd_percent, float time_delta);
+double memtier_core_percent(int thread, double ddr_rd_percent);
+void memtier_deinit(void);
+
+#endif
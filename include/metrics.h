@@ -0,0 +1,57 @@
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "msr.h"
+#include "pmu_core.h"
+#include "mab.h"
+#include "overhead.h"
+#include "abtest.h"
+
+#define METRICS_PATH "/var/lib/node_exporter/textfile_collector/dpf.prom"
+#define METRICS_PERIOD_MS (1000) //how often the metrics file is rewritten
+
+struct metrics_core_s {
+	int core_id;
+	uint64_t instructions; //delta over the interval
+	uint64_t cycles; //unhalted core cycles over the interval
+	uint64_t pmu[PMU_MAX_EVENTS]; //delta over the interval, alg 0/1 or --events
+	float pmu_duty[PMU_MAX_EVENTS];
+	struct pf_metrics_s pf;
+	union msr_u msr[HWPF_MSR_FIELDS];
+	struct overhead_s ovh;
+};
+
+// One interval of tuner state. Two of these are kept, the master core fills
+// the one not published while the exporter reads the other.
+struct metrics_snapshot_s {
+	atomic_uint seq; //odd while being written
+	uint64_t time_ns;
+	uint64_t intervals;
+	int tunealg;
+	int paused;
+	float intervall; //configured, seconds
+	double interval_s; //measured
+	double jitter_max_s;
+	double ddr_rd_bw; //bytes/s, < 0 if not available
+	double ddr_wr_bw;
+	double decision_s; //time spent in calculate_settings()
+	float overhead_pct; //dPF CPU time in percent of one core
+	int arm;
+	int num_arms;
+	float rewards[MAX_ARMS];
+	float nums[MAX_ARMS];
+	int ab_mode; //AB_OFF if --ab is not used
+	uint64_t ab_slices;
+	struct ab_effect_s ab[AB_METRICS];
+	int num_cores;
+	struct metrics_core_s core[];
+};
+
+int metrics_init(const char *path, int hk_core, int num_cores);
+void metrics_publish(uint64_t decision_ns);
+void metrics_deinit(void);
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdint.h>
 
 #include "atom_msr.h"
+#include "msr_layout.h"
 
 #define HWPF_MSR_FIELDS (6)
 #define HWPF_MSR_BASE (0x1320)
@@ -13,47 +14,6 @@
 #define MSR_FIXED_CTR1 0x30A // CPU_CLK_UNHALTED.CORE
 #define IA32_FIXED_CTR_CTRL 0x38D
 
-// Default prefetcher settings. The settings below are for the 12th generation Intel Alderlake chip 
-
-// Default msr1320 settings
-#define L2_STREAM_AMP_XQ_THRESHOLD_1320 4
-#define L2_STREAM_MAX_DISTANCE_1320 16
-#define L2_AMP_DISABLE_RECURSION_1320 1
-#define LLC_STREAM_MAX_DISTANCE_1320 63
-#define LLC_STREAM_DISABLE_1320 0
-#define LLC_STREAM_XQ_THRESHOLD_1320 4
-
-// Default msr1321 settings
-#define L2_STREAM_AMP_CREATE_IL1_1321 1
-#define L2_STREAM_DEMAND_DENSITY_1321 16
-#define L2_STREAM_DEMAND_DENSITY_OVR_1321 9
-#define L2_DISABLE_NEXT_LINE_PREFETCH_1321 1
-#define L2_LLC_STREAM_AMP_XQ_THRESHOLD_1321 18
-
-// Default msr1322 settings
-#define LLC_STREAM_DEMAND_DENSITY_1322 320
-#define LLC_STREAM_DEMAND_DENSITY_OVR_1322 9
-#define L2_AMP_CONFIDENCE_DPT0_1322 1
-#define L2_AMP_CONFIDENCE_DPT1_1322 3
-#define L2_AMP_CONFIDENCE_DPT2_1322 5
-#define L2_AMP_CONFIDENCE_DPT3_1322 7
-#define L2_LLC_STREAM_DEMAND_DENSITY_XQ_1322 5
-
-// Default msr1323 settings
-#define L2_STREAM_AMP_CREATE_SWPFRFO_1323 1
-#define L2_STREAM_AMP_CREATE_SWPFRD_1323 1
-#define L2_STREAM_AMP_CREATE_HWPFD_1323 0
-#define L2_STREAM_AMP_CREATE_DRFO_1323 1
-#define STABILIZE_PREF_ON_SWPFRFO_1323 1
-#define STABILIZE_PREF_ON_SWPFRD_1323 1
-#define STABILIZE_PREF_ON_IL1_1323 0
-#define STABILIZE_PREF_ON_HWPFD_1323 1
-#define STABILIZE_PREF_ON_DRFO_1323 1
-#define L2_STREAM_AMP_CREATE_PFNPP_1323 1
-#define L2_STREAM_AMP_CREATE_PFIPP_1323 1
-#define STABILIZE_PREF_ON_PFNPP_1323 1
-#define STABILIZE_PREF_ON_PFIPP_1323 1
-
 #define MAX_NUM_CORES (512)
 
 /**
@@ -88,16 +48,45 @@
 #define PQOS_MSR_MON_QMC_UNAVAILABLE (1ULL << 62)
 
 extern volatile int msr_file_id[MAX_NUM_CORES];
+extern const struct msr_layout_s *msr_layout; //field layout for this SKU
+extern const struct msr_layout_s *msr_pcore_layout; //and for its P-cores
 
 int msr_corepmu_setup(int msr_file, int nr_events, uint64_t *event);
 int msr_corepmu_read(int msr_file, int nr_events, uint64_t *result, uint64_t *inst_retired, uint64_t *cpu_cycles);
 int msr_open(int core);
 int msr_init(int core, union msr_u msr[]);
 int msr_hwpf_write(int msr_file, union msr_u msr[]);
+int msr_hwpf_write_changed(int msr_file, union msr_u msr[],
+			   union msr_u written[]);
 
 int msr_fixed_int(int core);
 int msr_enable_fixed(int msr_file);
 
+// Prefetcher fields, checked against the layout of this SKU
+void msr_layout_init(void);
+int msr_field_set(union msr_u msr[], int field, int value);
+int msr_field_get(union msr_u msr[], int field);
+int msr_field_supported(int field);
+int msr_field_max(int field);
+void msr_set_defaults(union msr_u msr[]);
+int msr_fields_apply(union msr_u msr[], const struct hwpf_setting_s *set,
+		     int n);
+int msr_fields_diff(const union msr_u old[], const union msr_u new[],
+		    struct hwpf_setting_s *out, int max);
+
+// P-cores of hybrid clients, 0x1A4 only, checked against msr_pcore_layout
+int msr_pcore_init(int core, union msr_u msr[]);
+int msr_pcore_field_set(union msr_u msr[], int field, int value);
+int msr_pcore_field_get(union msr_u msr[], int field);
+int msr_set_pcore_l2_disable(union msr_u msr[], int value);
+int msr_get_pcore_l2_disable(union msr_u msr[]);
+int msr_set_pcore_l2_adjacent_disable(union msr_u msr[], int value);
+int msr_get_pcore_l2_adjacent_disable(union msr_u msr[]);
+int msr_set_pcore_dcu_disable(union msr_u msr[], int value);
+int msr_get_pcore_dcu_disable(union msr_u msr[]);
+int msr_set_pcore_dcu_ip_disable(union msr_u msr[], int value);
+int msr_get_pcore_dcu_ip_disable(union msr_u msr[]);
+
 // Declarations for msr1A4_s
 int msr_set_l1_data_disable(union msr_u msr[], int value);
 int msr_set_l1_instruction_disable(union msr_u msr[], int value);
@@ -163,7 +152,7 @@ int msr_get_ampcswpfrd(union msr_u msr[]);
 int msr_set_ampchwpfd(union msr_u msr[], int value);
 int msr_get_ampchwpfd(union msr_u msr[]);
 int msr_set_ampcdrfo(union msr_u msr[], int value);
-int msr_get_ampcdrwo(union msr_u msr[]);
+int msr_get_ampcdrfo(union msr_u msr[]);
 
 int msr_set_stabswpfrfo(union msr_u msr[], int value);
 int msr_get_stabswpfrfo(union msr_u msr[]);
@@ -191,11 +180,6 @@ int msr_get_stabpfipp(union msr_u msr[]);
 int msr_set_l1ht(union msr_u msr[], int value);
 int msr_get_l1ht(union msr_u msr[]);
 
-void populate_msr1320(union msr_u msr[]);
-void populate_msr1321(union msr_u msr[]);
-void populate_msr1322(union msr_u msr[]);
-void populate_msr1323(union msr_u msr[]);
-
 int msr_get_rmid(int core, uint64_t *val);
 
 /* Set RMID on Allocation & Monitoring association MSR */
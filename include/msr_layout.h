@@ -0,0 +1,274 @@
+#ifndef __MSR_LAYOUT_H
+#define __MSR_LAYOUT_H
+
+// Prefetcher MSR field layout, valid range and default per SKU, shared by
+// the daemon, the kernel module and the tools. The fields are listed in
+// msr/hwpf_fields.def, one data file per SKU in msr/<sku>.def gives where
+// they are. The msr_u bitfields in atom_msr.h match the Gracemont layout.
+// The P-cores of the hybrid clients have a layout of their own, selected by
+// core type rather than by model.
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stdint.h>
+#endif
+
+#include "atom_msr.h"
+
+enum hwpf_field {
+#define HWPF_NAME(id) HWPF_##id,
+#include "msr/hwpf_fields.def"
+#undef HWPF_NAME
+	HWPF_NUM_FIELDS
+};
+
+// Fields before this one are E-core fields, the rest P-core fields
+#define HWPF_FIRST_PCORE_FIELD HWPF_L2_HW_PREFETCHER_DISABLE
+
+static const char *const hwpf_field_names[HWPF_NUM_FIELDS] = {
+#define HWPF_NAME(id) [HWPF_##id] = #id,
+#include "msr/hwpf_fields.def"
+#undef HWPF_NAME
+};
+
+#define HWPF_MSR_REGS (6) //0x1320-0x1324 and 0x1A4
+
+struct hwpf_field_s {
+	uint8_t reg; //index in the msr_u array, 0x1320-0x1324 then 0x1A4
+	uint8_t shift;
+	uint8_t width; //0 when the field is not on this SKU
+	uint16_t max;
+	int16_t def; //-1 to leave the field as it is
+};
+
+// cpus is family << 8 | model, 0 terminated
+struct msr_layout_s {
+	const char *sku;
+	const uint16_t *cpus;
+	struct hwpf_field_s field[HWPF_NUM_FIELDS];
+};
+
+#define HWPF_FIELD(id, reg, shift, width, max, def)
+#define HWPF_CPU(family, model) ((family) << 8 | (model)),
+static const uint16_t msr_cpus_gracemont[] = {
+#include "msr/gracemont.def"
+	0
+};
+static const uint16_t msr_cpus_crestmont[] = {
+#include "msr/crestmont.def"
+	0
+};
+static const uint16_t msr_cpus_grandridge[] = {
+#include "msr/grandridge.def"
+	0
+};
+static const uint16_t msr_cpus_goldencove[] = {
+#include "msr/goldencove.def"
+	0
+};
+#undef HWPF_CPU
+#undef HWPF_FIELD
+
+#define HWPF_CPU(family, model)
+#define HWPF_FIELD(id, reg, shift, width, max, def) \
+	[HWPF_##id] = {reg, shift, width, max, def},
+// The first entry is the fallback for models not listed
+static const struct msr_layout_s msr_layouts[] = {
+	{"gracemont", msr_cpus_gracemont, {
+#include "msr/gracemont.def"
+	}},
+	{"crestmont", msr_cpus_crestmont, {
+#include "msr/crestmont.def"
+	}},
+	{"grandridge", msr_cpus_grandridge, {
+#include "msr/grandridge.def"
+	}},
+};
+
+// P-core layouts, the first entry is the fallback here too
+static const struct msr_layout_s msr_pcore_layouts[] = {
+	{"goldencove", msr_cpus_goldencove, {
+#include "msr/goldencove.def"
+	}},
+};
+#undef HWPF_FIELD
+#undef HWPF_CPU
+
+#define MSR_NUM_LAYOUTS (sizeof(msr_layouts) / sizeof(msr_layouts[0]))
+#define MSR_NUM_PCORE_LAYOUTS \
+	(sizeof(msr_pcore_layouts) / sizeof(msr_pcore_layouts[0]))
+
+static inline const struct msr_layout_s *
+msr_layout_lookup(const struct msr_layout_s *table, unsigned int n,
+		  unsigned int family, unsigned int model)
+{
+	for (unsigned int i = 0; i < n; i++) {
+		for (const uint16_t *cpu = table[i].cpus; *cpu; cpu++) {
+			if (*cpu == (family << 8 | model))
+				return &table[i];
+		}
+	}
+
+	return NULL;
+}
+
+// Layout for a CPUID family/model, NULL if the model is not listed
+static inline const struct msr_layout_s *msr_layout_find(unsigned int family,
+							  unsigned int model)
+{
+	return msr_layout_lookup(msr_layouts, MSR_NUM_LAYOUTS, family, model);
+}
+
+// P-core layout for a CPUID family/model, NULL if the model has no P-cores
+// dPF knows
+static inline const struct msr_layout_s *
+msr_pcore_layout_find(unsigned int family, unsigned int model)
+{
+	return msr_layout_lookup(msr_pcore_layouts, MSR_NUM_PCORE_LAYOUTS,
+				 family, model);
+}
+
+// Field value, -1 if the field is not on this SKU
+static inline int hwpf_field_get(const struct msr_layout_s *layout,
+				 const union msr_u msr[], int f)
+{
+	const struct hwpf_field_s *d = &layout->field[f];
+
+	if (d->width == 0)
+		return -1;
+
+	return (msr[d->reg].v >> d->shift) & ((1ULL << d->width) - 1);
+}
+
+// Set a field, -1 if it is not on this SKU or value is out of range
+static inline int hwpf_field_set(const struct msr_layout_s *layout,
+				 union msr_u msr[], int f, int value)
+{
+	const struct hwpf_field_s *d = &layout->field[f];
+	uint64_t mask;
+
+	if (d->width == 0 || value < 0 || value > d->max)
+		return -1;
+
+	mask = ((1ULL << d->width) - 1) << d->shift;
+	msr[d->reg].v = (msr[d->reg].v & ~mask) | ((uint64_t)value << d->shift);
+
+	return 0;
+}
+
+// Set every field that has a default
+static inline void hwpf_set_defaults(const struct msr_layout_s *layout,
+				     union msr_u msr[])
+{
+	for (int f = 0; f < HWPF_NUM_FIELDS; f++) {
+		if (layout->field[f].def >= 0)
+			hwpf_field_set(layout, msr, f, layout->field[f].def);
+	}
+}
+
+// A field value, a set of them describes an arm or a change
+struct hwpf_setting_s {
+	uint8_t field;
+	int16_t value;
+};
+
+// A set of field values compiled to per register masks, applied to an MSR
+// image with one and/or per register
+struct hwpf_mask_s {
+	uint64_t clear[HWPF_MSR_REGS];
+	uint64_t set[HWPF_MSR_REGS];
+};
+
+static inline void hwpf_mask_init(struct hwpf_mask_s *m)
+{
+	for (int r = 0; r < HWPF_MSR_REGS; r++) {
+		m->clear[r] = 0;
+		m->set[r] = 0;
+	}
+}
+
+// Add settings to a mask, later settings of a field replace earlier ones.
+// Settings of fields not on this SKU or out of range are left out.
+// Returns how many were left out.
+static inline int hwpf_mask_add(const struct msr_layout_s *layout,
+				struct hwpf_mask_s *m,
+				const struct hwpf_setting_s *s, int n)
+{
+	int rejected = 0;
+
+	for (int i = 0; i < n; i++) {
+		const struct hwpf_field_s *d;
+		uint64_t mask;
+
+		if (s[i].field >= HWPF_NUM_FIELDS) {
+			rejected++;
+			continue;
+		}
+		d = &layout->field[s[i].field];
+		if (d->width == 0 || s[i].value < 0 || s[i].value > d->max) {
+			rejected++;
+			continue;
+		}
+
+		mask = ((1ULL << d->width) - 1) << d->shift;
+		m->clear[d->reg] |= mask;
+		m->set[d->reg] = (m->set[d->reg] & ~mask) |
+			((uint64_t)s[i].value << d->shift);
+	}
+
+	return rejected;
+}
+
+static inline void hwpf_mask_apply(const struct hwpf_mask_s *m,
+				   union msr_u msr[])
+{
+	for (int r = 0; r < HWPF_MSR_REGS; r++)
+		msr[r].v = (msr[r].v & ~m->clear[r]) | m->set[r];
+}
+
+// Bit r set for each register that differs between a and b
+static inline unsigned int hwpf_diff_regs(const union msr_u a[],
+					  const union msr_u b[])
+{
+	unsigned int regs = 0;
+
+	for (int r = 0; r < HWPF_MSR_REGS; r++)
+		regs |= (unsigned int)(a[r].v != b[r].v) << r;
+
+	return regs;
+}
+
+// Fields that differ between a and b, with their values in b. Registers
+// that are equal are skipped. Returns the number of fields that differ,
+// at most max are stored in out.
+static inline int hwpf_diff(const struct msr_layout_s *layout,
+			    const union msr_u a[], const union msr_u b[],
+			    struct hwpf_setting_s *out, int max)
+{
+	unsigned int regs = hwpf_diff_regs(a, b);
+	int n = 0;
+
+	if (regs == 0)
+		return 0;
+
+	for (int f = 0; f < HWPF_NUM_FIELDS; f++) {
+		const struct hwpf_field_s *d = &layout->field[f];
+		uint64_t mask;
+
+		if (d->width == 0 || !(regs & (1U << d->reg)))
+			continue;
+		mask = ((1ULL << d->width) - 1) << d->shift;
+		if (((a[d->reg].v ^ b[d->reg].v) & mask) == 0)
+			continue;
+		if (n < max) {
+			out[n].field = f;
+			out[n].value = (b[d->reg].v & mask) >> d->shift;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+#endif // __MSR_LAYOUT_H
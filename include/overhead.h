@@ -0,0 +1,45 @@
+#ifndef __OVERHEAD_H
+#define __OVERHEAD_H
+
+#include <stdint.h>
+
+#define OVH_CAP_OFF (0.0f)
+#define OVH_BACKOFF (1.5f) //interval multiplier when over the cap
+#define OVH_MAX_INTERVALL (60.0f)
+#define OVH_MAX_HELPERS (8) //log writer, control socket, metrics, trace
+
+// dPF's own cost during one interval on one thread
+struct overhead_s {
+	uint64_t cpu_ns; //CLOCK_THREAD_CPUTIME_ID delta
+	uint64_t syscalls; //counted syscalls, MSR operations included
+	uint64_t msr_ops; //MSR reads and writes through /dev/cpu/N/msr
+	uint64_t wakeups; //returns from a sleep, one per slice
+	uint64_t ctx_switches; //voluntary + involuntary
+	uint64_t cpu_total_ns; //CLOCK_THREAD_CPUTIME_ID since the thread started
+};
+
+// Per interval totals over all threads, tuning and helper
+struct overhead_total_s {
+	struct overhead_s sum;
+	struct overhead_s helpers; //of sum, the threads on the housekeeping core
+	uint64_t wall_ns; //length of the interval
+	uint64_t decision_ns; //time spent in calculate_settings()
+	float core_pct; //sum.cpu_ns relative to one core, in percent
+};
+
+extern __thread uint64_t ovh_syscalls;
+extern __thread uint64_t ovh_msr_ops;
+extern __thread uint64_t ovh_wakeups;
+extern struct overhead_total_s ovh_last;
+extern float ovh_cap_pct;
+
+#define OVH_SYSCALL(n) (ovh_syscalls += (n))
+#define OVH_MSR_OP() do { ovh_msr_ops++; ovh_syscalls++; } while (0)
+// After every sleep, the sleep itself is a syscall
+#define OVH_WAKEUP() do { ovh_wakeups++; ovh_syscalls++; } while (0)
+
+void overhead_thread_sample(struct overhead_s *ovh);
+void overhead_helper_sample(void);
+void overhead_account(uint64_t decision_ns);
+
+#endif
@@ -7,8 +7,13 @@
 #include <stdio.h>
 #include <sys/types.h>
 
+#include "pmu_events.h"
+
 // Define PMU Constants
 #define PMU_COUNTERS (7)
+#define PMU_GP_COUNTERS (6) //programmable counters on Atom cores, for multiplexing
+#define PMU_MAX_EVENTS (20) //with more than PMU_GP_COUNTERS they are multiplexed
+#define PMU_MAX_GROUPS ((PMU_MAX_EVENTS + PMU_GP_COUNTERS - 3) / (PMU_GP_COUNTERS - 1))
 #define PMU_PERF (0)
 #define PMU_RAW (1)
 
@@ -16,17 +21,21 @@
 #define PERF_EVENT_CYCLES PERF_COUNT_HW_CPU_CYCLES
 #define PERF_EVENT_INSTRUCTIONS PERF_COUNT_HW_INSTRUCTIONS
 
-// Event Indices for perf events
+// Event Indices for perf events, the five base events come first, then
+// the ones added with --events, then cycles and instructions
+
+#define PERF_INDEX_EVENT_MEM_UOPS_RETIRED_ALL_LOADS (PMU_EV_ALL_LOADS)
+#define PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_L2_HIT (PMU_EV_L2_HIT)
+#define PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_L3_HIT (PMU_EV_L3_HIT)
+#define PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT (PMU_EV_DRAM_HIT)
+#define PERF_INDEX_EVENT_XQ_PROMOTION_ALL (PMU_EV_XQ_PROMOTION)
+#define PERF_INDEX_EVENT_CYCLES (pmu_num_events)
+#define PERF_INDEX_EVENT_INSTRUCTIONS (pmu_num_events + 1)
 
-#define PERF_INDEX_EVENT_MEM_UOPS_RETIRED_ALL_LOADS (0)
-#define PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_L2_HIT (1)
-#define PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_L3_HIT (2)
-#define PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT (3)
-#define PERF_INDEX_EVENT_XQ_PROMOTION_ALL (4)
-#define PERF_INDEX_EVENT_CYCLES (5)
-#define PERF_INDEX_EVENT_INSTRUCTIONS (6)
+#define PMU_CORE_EVENT_COUNT (PMU_EV_CYCLES) //base events, always programmed
+#define PMU_EVENT_NAME_LEN (24)
  
-#define MAX_EVENTS (8)
+#define MAX_EVENTS (PMU_MAX_EVENTS + 2)
 #define MAX_CORES (8)
 
 // PMU PMC Registers (Performance Monitoring Counters)
@@ -45,37 +54,75 @@
 #define PMU_PERFEVTSEL4 (0x18a)
 #define PMU_PERFEVTSEL5 (0x18b)
 
-// Event types for PMU configuration (event codes for various counters)
-// Full 64-bit event codes including config bits
-#define EVENT_CPU_CLK_UNHALTED_THREAD (0x00000000004300c0)
-#define EVENT_INST_RETIRED_ANY_P (0x00000000004300c2)
-#define EVENT_MEM_UOPS_RETIRED_ALL_LOADS (0x00000000004381d0)
-#define EVENT_MEM_LOAD_UOPS_RETIRED_L2_HIT (0x00000000004302d1)
-#define EVENT_MEM_LOAD_UOPS_RETIRED_L3_HIT (0x00000000004304d1)
-#define EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT (0x00000000004380d1)
-#define EVENT_XQ_PROMOTION_ALL (0x00000000004300f4)
-
-
-#define PERF_CPU_CLK_UNHALTED_THREAD (0x00c0)
-#define PERF_INST_RETIRED_ANY_P (0x00c2)
-#define PERF_MEM_UOPS_RETIRED_ALL_LOADS (0x81d0)
-#define PERF_MEM_LOAD_UOPS_RETIRED_L2_HIT (0x02d1)
-#define PERF_MEM_LOAD_UOPS_RETIRED_L3_HIT (0x04d1)
-#define PERF_MEM_LOAD_UOPS_RETIRED_DRAM_HIT (0x80d1)
-#define PERF_XQ_PROMOTION_ALL (0x00f4)
+// Event codes come from the catalog for the CPU model, see pmu_events.h
+#define EVENT_USR_OS_EN (0x0000000000430000) //count user+kernel, enable
+
+// A programmed core event, code is umask << 8 | event like perf raw events
+struct pmu_event_s {
+	char name[PMU_EVENT_NAME_LEN];
+	uint64_t code;
+};
+
+// Prefetch quality and memory-bound stalls per interval, derived from the
+// programmed events. NAN when the events needed are not in the set (see
+// pmu_derive())
+struct pf_metrics_s {
+	float accuracy; //useful out of issued L2 prefetches
+	float coverage; //L2 demand misses removed by prefetching
+	float lateness; //prefetches that had not arrived when demanded
+	float xq_pressure; //L2 requests rejected by a full XQ per cycle
+	float mem_bound; //cycles stalled on a load that missed the L1
+	float l2_stall; //of those, cycles waiting on the L2
+	float l3_stall; //on the L3
+	float dram_stall; //on memory
+	float mem_sched; //issue slots lost to a full memory scheduler
+};
+
+// Per core multiplexing state. Raw mode rotates event groups over the
+// counters once per slice and scales each event by the time it was counted,
+// perf mode lets the kernel rotate and scales by time enabled/running.
+struct pmu_mux_s {
+	int group; //group on the counters now
+	uint64_t start_ns; //when the group was programmed
+	uint64_t interval_start_ns;
+	uint64_t count[PMU_MAX_EVENTS]; //counted this interval, unscaled
+	uint64_t enabled_ns[PMU_MAX_EVENTS]; //time counted this interval
+	uint64_t total[MAX_EVENTS]; //scaled since start
+	uint64_t perf_enabled[MAX_EVENTS]; //perf time enabled/running at last read
+	uint64_t perf_running[MAX_EVENTS];
+	float duty[MAX_EVENTS]; //share of the last interval counted, 0-1
+};
+
+extern struct pmu_event_s pmu_events[PMU_MAX_EVENTS];
+extern int pmu_num_events;
+extern int pmu_derived; //read the events also when tuning with MAB
+extern const struct pmu_catalog_s *pmu_catalog; //encodings for this CPU
+extern const struct pmu_catalog_s *pmu_pcore_catalog; //and for its P-cores
 
 // Function declarations for PMU configuration and interaction
 // MSR-based PMU functions
-int pmu_core_config(int msr_file);
-int pmu_core_read(int msr_file, uint64_t *result_p, uint64_t *inst_retired, uint64_t *cpu_cycles);
+int pmu_core_config(int msr_file, struct pmu_mux_s *mux);
+int pmu_core_read(int msr_file, struct pmu_mux_s *mux, uint64_t *result_p,
+		  uint64_t *inst_retired, uint64_t *cpu_cycles);
+int pmu_core_rotate(int msr_file, struct pmu_mux_s *mux);
 int pmu_core_clear(int msr_file);
+int pmu_mux_groups(void);
+int pmu_pcore_config(int msr_file);
+int pmu_pcore_read(int msr_file, uint64_t *result_p, uint64_t *inst_retired,
+		   uint64_t *cpu_cycles);
+
+// Event set and derived metrics
+int pmu_events_parse(const char *list);
+int pmu_event_index(const char *name);
+int pmu_mem_bound_events(void);
+void pmu_derive(const uint64_t *delta, uint64_t cycles, struct pf_metrics_s *pf);
 
 // Perf event configuration and interaction
 int perf_configure_events(struct perf_event_attr *event_attrs, int *num_events);
 int perf_init(struct perf_event_attr *event_attrs, int event_fds[MAX_EVENTS],
 	      int num_events, int core_id);
 int perf_read(int event_fds[MAX_EVENTS], uint64_t *event_counts,
-	      int num_events);
+	      int num_events, struct pmu_mux_s *mux);
 int perf_deinit(int event_fds[MAX_EVENTS], int num_events);
 
 #endif // PMU_CORE_H
@@ -41,6 +41,7 @@ struct ddr_s {
 
 int pmu_ddr_init(struct ddr_s *ddr, int kernel_mode);
 uint64_t pmu_ddr(struct ddr_s *ddr, int type);
+uint64_t pmu_ddr_total(struct ddr_s *ddr, int type);
 
 
 #endif
@@ -0,0 +1,155 @@
+#ifndef __PMU_EVENTS_H
+#define __PMU_EVENTS_H
+
+// Core PMU event catalog, shared by the daemon, the kernel module and the
+// tools. The events and their order come from events/pmu_events.def, the
+// encodings per microarchitecture from events/<uarch>.def. Adding a model
+// or an event is a data file change only.
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stdint.h>
+#include <string.h>
+#endif
+
+enum pmu_event_id {
+#define PMU_EVENT(id, name, label) PMU_EV_##id,
+#include "events/pmu_events.def"
+#undef PMU_EVENT
+	PMU_EV_COUNT
+};
+
+// The kernel module counts the events up to and including instructions
+#define PMU_EV_BASE_COUNT (PMU_EV_INSTRUCTIONS + 1)
+
+static const char *const pmu_event_names[PMU_EV_COUNT] = {
+#define PMU_EVENT(id, name, label) [PMU_EV_##id] = name,
+#include "events/pmu_events.def"
+#undef PMU_EVENT
+};
+
+static const char *const pmu_event_labels[PMU_EV_COUNT] = {
+#define PMU_EVENT(id, name, label) [PMU_EV_##id] = label,
+#include "events/pmu_events.def"
+#undef PMU_EVENT
+};
+
+// Encodings of one microarchitecture, code is umask << 8 | event like perf
+// raw events, 0 when the event is not on this model. Base events with code
+// 0 are not programmed and read as zero. cpus is
+// family << 8 | model, 0 terminated. slots is the allocation width, the
+// top-down events count in issue slots.
+struct pmu_catalog_s {
+	const char *uarch;
+	int slots;
+	const uint16_t *cpus;
+	uint16_t code[PMU_EV_COUNT];
+};
+
+#define PMU_CODE(id, event, umask)
+#define PMU_CPU(family, model) ((family) << 8 | (model)),
+static const uint16_t pmu_cpus_gracemont[] = {
+#include "events/gracemont.def"
+	0
+};
+static const uint16_t pmu_cpus_crestmont[] = {
+#include "events/crestmont.def"
+	0
+};
+static const uint16_t pmu_cpus_grandridge[] = {
+#include "events/grandridge.def"
+	0
+};
+static const uint16_t pmu_cpus_skymont[] = {
+#include "events/skymont.def"
+	0
+};
+static const uint16_t pmu_cpus_goldencove[] = {
+#include "events/goldencove.def"
+	0
+};
+#undef PMU_CPU
+#undef PMU_CODE
+
+#define PMU_CPU(family, model)
+#define PMU_CODE(id, event, umask) [PMU_EV_##id] = ((umask) << 8 | (event)),
+// The first entry is the fallback for models not listed
+static const struct pmu_catalog_s pmu_catalogs[] = {
+	{"gracemont", 5, pmu_cpus_gracemont, {
+#include "events/gracemont.def"
+	}},
+	{"crestmont", 6, pmu_cpus_crestmont, {
+#include "events/crestmont.def"
+	}},
+	{"grandridge", 6, pmu_cpus_grandridge, {
+#include "events/grandridge.def"
+	}},
+	{"skymont", 8, pmu_cpus_skymont, {
+#include "events/skymont.def"
+	}},
+};
+
+// P-cores of the hybrid clients, selected by core type rather than by
+// model. The first entry is the fallback here too.
+static const struct pmu_catalog_s pmu_pcore_catalogs[] = {
+	{"goldencove", 6, pmu_cpus_goldencove, {
+#include "events/goldencove.def"
+	}},
+};
+#undef PMU_CODE
+#undef PMU_CPU
+
+#define PMU_NUM_CATALOGS (sizeof(pmu_catalogs) / sizeof(pmu_catalogs[0]))
+#define PMU_NUM_PCORE_CATALOGS \
+	(sizeof(pmu_pcore_catalogs) / sizeof(pmu_pcore_catalogs[0]))
+
+static inline const struct pmu_catalog_s *
+pmu_catalog_lookup(const struct pmu_catalog_s *table, unsigned int n,
+		   unsigned int family, unsigned int model)
+{
+	for (unsigned int i = 0; i < n; i++) {
+		for (const uint16_t *cpu = table[i].cpus; *cpu; cpu++) {
+			if (*cpu == (family << 8 | model))
+				return &table[i];
+		}
+	}
+
+	return NULL;
+}
+
+// Catalog for a CPUID family/model, NULL if the model is not listed
+static inline const struct pmu_catalog_s *pmu_catalog_find(unsigned int family,
+							    unsigned int model)
+{
+	return pmu_catalog_lookup(pmu_catalogs, PMU_NUM_CATALOGS, family, model);
+}
+
+// P-core catalog for a CPUID family/model, NULL if the model has no P-cores
+// dPF knows
+static inline const struct pmu_catalog_s *
+pmu_pcore_catalog_find(unsigned int family, unsigned int model)
+{
+	return pmu_catalog_lookup(pmu_pcore_catalogs, PMU_NUM_PCORE_CATALOGS,
+				  family, model);
+}
+
+// Index of an event name, -1 if not in the catalog
+static inline int pmu_event_lookup(const char *name)
+{
+	for (int i = 0; i < PMU_EV_COUNT; i++) {
+		if (strcmp(pmu_event_names[i], name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+static inline const char *pmu_event_name(int index)
+{
+	return (index >= 0 && index < PMU_EV_COUNT) ?
+		pmu_event_names[index] : "unknown";
+}
+
+#endif // __PMU_EVENTS_H
@@ -11,6 +11,7 @@
 #define DMI_TYPE17_VERSION_SIX (92)
 
 #define MEGABYTE (1024 * 1024)
+#define MODULE_CORES (4) //cores sharing an L2, for kernels without cluster_id
 #define BWTEST_ARRAY_SIZE ((150 * 1024 * 1024) / 8) //150 MB
 #define NTIMES (10)
 
@@ -22,6 +23,12 @@ struct e_cores_layout_s {
 	int last_efficiency_core;
 };
 
+// Struct to return first and last P-cores of a hybrid client.
+struct p_cores_layout_s {
+	int first_performance_core;
+	int last_performance_core;
+};
+
 struct dmi_type_header_s {
 	uint8_t type;
 	uint8_t length;
@@ -76,6 +83,10 @@ struct __attribute__((packed)) type17_s {
 
 
 struct e_cores_layout_s get_efficient_core_ids(void);
+struct p_cores_layout_s get_performance_core_ids(void);
+int cpu_family_model(unsigned int *family, unsigned int *model);
+int get_housekeeping_core(int first, int last, int pfirst, int plast);
+int get_core_modules(int first, int count, int *module);
 int dmi_get_bandwidth(void);
 int ddrmembw_init(void);
 int ddrmembw_deinit(void);
@@ -0,0 +1,50 @@
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_BUF_RECORDS (512) //records per buffer, two buffers are used
+#define TRACE_FLUSH_MS (1000) //longest time a record waits for the file
+#define TRACE_MAX_DIFFS (32) //MSR changes kept per record
+
+// Trace modes besides the MAB modes in mab.h
+#define TRACE_MODE_BASIC (-1) //alg 0/1
+#define TRACE_MODE_PAUSED (-2)
+#define TRACE_MODE_SETTLE (-3)
+#define TRACE_MODE_AB_CONTROL (-4) //--ab time slice on the startup MSRs
+
+// One MSR of one module that changed during the interval
+struct trace_diff_s {
+	int core_id; //primary core of the module
+	int field; //index into the hwpf MSR image
+	uint64_t old_value;
+	uint64_t new_value;
+};
+
+// One tuning interval
+struct trace_rec_s {
+	uint64_t time_ns;
+	uint64_t interval;
+	int tunealg;
+	int mode;
+	int arm; //-1 if not MAB
+	float reward; //raw reward (IPC) of the last evaluation
+	float norm_reward; //reward relative to the average arm
+	float sd_mean; //dynamic SD filter state
+	double ddr_rd_bw; //bytes/s, < 0 if not available
+	double ddr_wr_bw;
+	uint64_t instructions; //retired on the tuned cores this interval
+	uint64_t cycles;
+	int uncore_ratio; //-1 if the uncore is not co-tuned
+	double pkg_joules; //package energy this interval, < 0 if not measured
+	uint64_t decision_ns; //time spent in calculate_settings()
+	int num_diffs;
+	int diffs_dropped; //changes that did not fit in diff[]
+	struct trace_diff_s diff[TRACE_MAX_DIFFS];
+};
+
+int trace_init(const char *path, int hk_core, int num_cores);
+void trace_record(uint64_t decision_ns);
+void trace_deinit(void);
+
+#endif
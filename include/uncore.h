@@ -0,0 +1,40 @@
+#ifndef __UNCORE_H
+#define __UNCORE_H
+
+#include <stdint.h>
+
+#define MSR_RAPL_POWER_UNIT (0x606)
+#define MSR_PKG_ENERGY_STATUS (0x611) //32 bit, wraps
+#define MSR_UNCORE_RATIO_LIMIT (0x620) //6:0 max ratio, 14:8 min ratio
+
+#define UNCORE_SYSFS "/sys/devices/system/cpu/intel_uncore_frequency"
+#define UNCORE_MAX_PACKAGES (16)
+#define UNCORE_MAX_RATIOS (32)
+#define UNCORE_RATIO_KHZ (100000) //one ratio step is 100 MHz
+#define UNCORE_RATIO_NONE (-1) //leave the uncore limits as found at startup
+
+// Uncore frequency of the packages of the tuned cores, through the
+// intel_uncore_frequency sysfs driver when loaded, MSR 0x620 otherwise,
+// and their package energy from RAPL
+struct uncore_s {
+	int sysfs; //1 intel_uncore_frequency, 0 MSR 0x620
+	int num_packages;
+	int package_core[UNCORE_MAX_PACKAGES]; //first tuned core per package
+	int msr_file[UNCORE_MAX_PACKAGES];
+	uint64_t ratio_boot[UNCORE_MAX_PACKAGES]; //0x620 found at startup
+	int min_ratio; //lowest ratio allowed on all packages
+	int max_ratio;
+	int ratio; //current, UNCORE_RATIO_NONE if the boot limits
+	double energy_unit; //joules per RAPL count
+	uint32_t energy_old[UNCORE_MAX_PACKAGES];
+	double joules; //all packages, during the last sampled interval
+};
+
+extern struct uncore_s uncore;
+
+int uncore_init(int first, int last);
+int uncore_set_ratio(int ratio);
+double uncore_energy_sample(void);
+void uncore_deinit(void);
+
+#endif
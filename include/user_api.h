@@ -5,6 +5,8 @@
 #define PROC_DEVICE "/proc/dynamicPrefetch"
 
 struct ddr_s;
+struct dpf_resp_snapshot_read_s;
+struct dpf_ddr_channels_s;
 
 int kernel_mode_init(void);
 int kernel_core_range(uint32_t start, uint32_t end);
@@ -15,10 +17,17 @@ int kernel_msr_read(uint32_t core_id, uint64_t *msr_values);
 int kernel_pmu_read(uint32_t core_id, uint64_t *pmu_values);
 int kernel_msr_read(uint32_t core_id, uint64_t *msr_values);
 int kernel_pmu_read(uint32_t core_id, uint64_t *pmu_values);
+int kernel_pmu_mux_read(uint32_t core_id, uint64_t *pmu_values,
+			uint32_t *duty_pct, uint32_t *groups);
 int kernel_log_msr_values(uint32_t core_id);
 int kernel_log_pmu_values(uint32_t core_id);
 int kernel_set_ddr_config(struct ddr_s *ddr);
 int kernel_log_ddr_bw();
+int kernel_ddr_bw_read(uint64_t *read_bytes, uint64_t *write_bytes);
+int kernel_ddr_channels_read(struct dpf_ddr_channels_s *channels,
+			     uint64_t *read_bytes, uint64_t *write_bytes);
+int kernel_snapshot_read(uint32_t core_start, uint32_t core_count,
+			 struct dpf_resp_snapshot_read_s *resp);
 
 // PMU logging functions
 int kernel_pmu_log_start(size_t buffer_size, int reset);
@@ -5,6 +5,7 @@
 #include <linux/cpumask.h>
 #include <linux/hrtimer.h>
 #include <linux/ktime.h>
+#include <linux/smp.h>
 
 // Global variables for PMU logging
 char *pmu_log_buffer = NULL;
@@ -24,6 +25,7 @@ bool pmu_logging_active = false;
 extern bool keep_running;
 extern struct hrtimer monitor_timer;
 extern ktime_t kt_period;
+ktime_t monitor_slice_period(void);
 extern char *proc_buffer;
 extern size_t proc_buffer_size;
 extern __u64 ddr_bar_address;
@@ -229,7 +231,7 @@ int api_tuning(struct dpf_req_tuning_s *req_data)
 			}
 		}
 		keep_running = true;
-		hrtimer_start(&monitor_timer, kt_period, HRTIMER_MODE_REL);
+		hrtimer_start(&monitor_timer, monitor_slice_period(), HRTIMER_MODE_REL);
 		pr_info("Monitoring enabled\n");
 	} else {
 		keep_running = false;
@@ -311,6 +313,41 @@ int api_msr_read(struct dpf_msr_read_s *req_data)
 	return 0;
 }
 
+// Handles a multiplexed PMU read request, returns the values of the last
+// tuning interval for every event of a core with their duty cycle
+// returns 0 on success, -ENOMEM on failure, -EINVAL on invalid input
+int api_pmu_mux_read(struct dpf_pmu_mux_read_s *req_data)
+{
+	struct dpf_pmu_mux_read_s *req = req_data;
+	struct dpf_resp_pmu_mux_read_s *resp;
+	struct core_state_s *cs;
+
+	if (req->core_id >= MAX_NUM_CORES || corestate[req->core_id].core_disabled) {
+		pr_err("Invalid or disabled core %u\n", req->core_id);
+		return -EINVAL;
+	}
+
+	resp = kzalloc(sizeof(struct dpf_resp_pmu_mux_read_s), GFP_KERNEL);
+	if (!resp)
+		return -ENOMEM;
+
+	cs = &corestate[req->core_id];
+	resp->header.type = DPF_MSG_PMU_MUX_READ;
+	resp->header.payload_size = sizeof(struct dpf_resp_pmu_mux_read_s);
+	resp->num_events = pmu_num_events;
+	resp->groups = pmu_mux_groups;
+	for (int i = 0; i < pmu_num_events; i++) {
+		resp->pmu_values[i] = cs->pmu_raw[i];
+		resp->duty_pct[i] = cs->pmu_duty[i];
+	}
+
+	kfree(proc_buffer);
+	proc_buffer = (char *)resp;
+	proc_buffer_size = sizeof(struct dpf_resp_pmu_mux_read_s);
+
+	return 0;
+}
+
 // Handles PMU read request, retrieves PMU counter values for a core
 // returns 0 on success, -ENOMEM on failure
 int api_pmu_read(struct dpf_pmu_read_s *req_data)
@@ -332,7 +369,9 @@ int api_pmu_read(struct dpf_pmu_read_s *req_data)
 	resp->header.type = DPF_MSG_PMU_READ;
 	resp->header.payload_size = sizeof(struct dpf_resp_pmu_read_s);
 
-	pmu_update(req->core_id);
+	// rotating the groups from here would touch the counters of this core
+	if (pmu_mux_groups == 1)
+		pmu_update(req->core_id);
 
 	for (int i = 0; i < PMU_COUNTERS; i++) {
 		resp->pmu_values[i] = corestate[req->core_id].pmu_raw[i];
@@ -354,6 +393,7 @@ int api_ddr_config(struct dpf_ddr_config_s *req_data)
 {
 	struct dpf_ddr_config_s *req = req_data;
 	struct dpf_resp_ddr_config_s *resp;
+	void __iomem *mapping[MAX_NUM_DDR_CONTROLLERS];
 	int ret;
 
 	pr_info("Received BAR=0x%llx, CPU type=%u\n", req->bar_address, req->cpu_type);
@@ -374,13 +414,13 @@ int api_ddr_config(struct dpf_ddr_config_s *req_data)
 		return -ENOMEM;
 
 	// Clean up prior mappings
+	kernel_pmu_ddr_detach(mapping);
 	for (int i = 0; i < MAX_NUM_DDR_CONTROLLERS; i++) {
-		if (ddr.mmap[i]) {
-			iounmap((void __iomem *)ddr.mmap[i]);
+		if (mapping[i]) {
+			iounmap(mapping[i]);
 			release_mem_region(ddr.bar_address +
 					       (ddr_cpu_type == DDR_CLIENT ? (i == 0 ? CLIENT_DDR0_OFFSET : CLIENT_DDR1_OFFSET) : GRR_SRF_MC_ADDRESS(i) + GRR_SRF_FREE_RUN_CNTR_READ),
 					       ddr_cpu_type == DDR_CLIENT ? CLIENT_DDR_RANGE : GRR_SRF_DDR_RANGE);
-			ddr.mmap[i] = NULL;
 		}
 	}
 
@@ -421,12 +461,32 @@ int api_ddr_config(struct dpf_ddr_config_s *req_data)
 	return 0;
 }
 
-// Handles DDR bandwidth read request, retrieves read_bw and write_bw
+// Reads the free running DDR counters into the totals and the per
+// controller split of channels, all zero if DDR is not configured
+static void read_ddr_to_channels(struct dpf_ddr_channels_s *channels,
+				 uint64_t *read_bytes, uint64_t *write_bytes)
+{
+	int n;
+
+	BUILD_BUG_ON(DPF_DDR_CHANNELS != MAX_NUM_DDR_CONTROLLERS);
+
+	n = read_ddr_channels(read_bytes, write_bytes, channels->read_bytes,
+			      channels->write_bytes);
+	if (n < 0)
+		n = 0;
+
+	channels->timestamp = ktime_get_ns();
+	channels->num_channels = n;
+	channels->bw_target = ddr_bw_target;
+}
+
+// Handles DDR bandwidth read request, retrieves the bytes read and written
+// in total and per controller with the time of the read
 // returns 0 on success, -ENOMEM on failure
 int api_ddr_bw_read(struct dpf_ddr_bw_read_s *req_data)
 {
 	struct dpf_resp_ddr_bw_read_s *resp;
-	uint64_t read_bw, write_bw;
+	uint64_t read_bytes, write_bytes;
 
 	pr_info("%s: Reading DDR bandwidth\n", __func__);
 
@@ -434,19 +494,95 @@ int api_ddr_bw_read(struct dpf_ddr_bw_read_s *req_data)
 	if (!resp)
 		return -ENOMEM;
 
-	read_ddr_counters(&read_bw, &write_bw);
+	read_ddr_to_channels(&resp->channels, &read_bytes, &write_bytes);
 
 	resp->header.type = DPF_MSG_DDR_BW_READ;
 	resp->header.payload_size = sizeof(struct dpf_resp_ddr_bw_read_s);
-	resp->read_bw = read_bw;
-	resp->write_bw = write_bw;
+	resp->read_bytes = read_bytes;
+	resp->write_bytes = write_bytes;
 
 	kfree(proc_buffer);
 	proc_buffer = (char *)resp;
 	proc_buffer_size = sizeof(struct dpf_resp_ddr_bw_read_s);
 
 	pr_info("%s: Retrieved DDR bandwidth: Read=%llu bytes, Write=%llu bytes\n",
-	       __func__, resp->read_bw, resp->write_bw);
+	       __func__, resp->read_bytes, resp->write_bytes);
+	return 0;
+}
+
+
+// Samples PMU counters and prefetch MSRs on the calling core, run on every
+// enabled core through on_each_cpu_mask()
+static void snapshot_core_work(void *info)
+{
+	int core_id = smp_processor_id();
+
+	pmu_update(core_id);
+	msr_load(core_id);
+}
+
+// Handles a snapshot read request, retrieves PMU and MSR values of all
+// enabled cores in the requested range and the DDR bandwidth in one response.
+// While tuning runs the values collected by the tuning timer are returned so
+// the PMU deltas of the tune algorithm are not disturbed.
+// returns 0 on success, -ENOMEM on failure, -EINVAL on invalid input
+int api_snapshot_read(struct dpf_snapshot_read_s *req_data)
+{
+	struct dpf_snapshot_read_s *req = req_data;
+	struct dpf_resp_snapshot_read_s *resp;
+	uint64_t read_bytes, write_bytes;
+	size_t resp_size;
+	__u32 core_end;
+	__u32 n = 0;
+
+	if (req->core_start >= MAX_NUM_CORES || req->core_count == 0) {
+		pr_err("%s: Invalid range start=%u count=%u\n", __func__,
+		       req->core_start, req->core_count);
+		return -EINVAL;
+	}
+
+	core_end = min_t(__u32, req->core_start + req->core_count,
+			 MAX_NUM_CORES);
+
+	resp_size = DPF_SNAPSHOT_SIZE(core_end - req->core_start);
+	resp = kmalloc(resp_size, GFP_KERNEL);
+	if (!resp)
+		return -ENOMEM;
+
+	if (!keep_running && !cpumask_empty(&enabled_cpus))
+		on_each_cpu_mask(&enabled_cpus, snapshot_core_work, NULL, true);
+
+	for (__u32 core_id = req->core_start; core_id < core_end; core_id++) {
+		if (corestate[core_id].core_disabled)
+			continue;
+
+		resp->cores[n].core_id = core_id;
+		resp->cores[n].reserved = 0;
+		for (int i = 0; i < PMU_COUNTERS; i++)
+			resp->cores[n].pmu_values[i] =
+				corestate[core_id].pmu_raw[i];
+		for (int i = 0; i < NR_OF_MSR; i++)
+			resp->cores[n].msr_values[i] =
+				corestate[core_id].pf_msr[i].v;
+		n++;
+	}
+
+	read_ddr_to_channels(&resp->ddr, &read_bytes, &write_bytes);
+
+	resp_size = DPF_SNAPSHOT_SIZE(n);
+	resp->header.type = DPF_MSG_SNAPSHOT_READ;
+	resp->header.payload_size = resp_size;
+	resp->timestamp = ktime_get_ns();
+	resp->read_bytes = read_bytes;
+	resp->write_bytes = write_bytes;
+	resp->tuning = keep_running;
+	resp->core_count = n;
+
+	kfree(proc_buffer);
+	proc_buffer = (char *)resp;
+	proc_buffer_size = resp_size;
+
+	pr_debug("%s: Snapshot of %u cores\n", __func__, n);
 	return 0;
 }
 
@@ -533,7 +669,7 @@ int api_pmu_log_control(struct dpf_pmu_log_control_s *req_data)
 	if (!keep_running) {
 		keep_running = true;
 		kt_period = ktime_set(0, TIMER_INTERVAL_SEC * NSEC_PER_SEC);
-		hrtimer_start(&monitor_timer, kt_period, HRTIMER_MODE_REL);
+		hrtimer_start(&monitor_timer, monitor_slice_period(), HRTIMER_MODE_REL);
 	}
 
 	// Enable logging
@@ -125,6 +125,18 @@ struct dpf_resp_ddr_config_s {
 	__u32 confirmed_type; // Confirmed CPU type
 };
 
+#define DPF_DDR_CHANNELS (16) // same as MAX_NUM_DDR_CONTROLLERS
+
+// DDR traffic per controller, free running byte counts. The rate of a
+// controller is the difference of two reads over their timestamps.
+struct dpf_ddr_channels_s {
+	__u64 timestamp;    // ktime_get_ns() when the counters were read
+	__u32 num_channels; // Number of valid entries below
+	__u32 bw_target;    // ddr_bw_target in MB/s, 0 if not set
+	__u64 read_bytes[DPF_DDR_CHANNELS]; // since the counters started
+	__u64 write_bytes[DPF_DDR_CHANNELS];
+};
+
 // Request structure for reading DDR bandwidth
 struct dpf_ddr_bw_read_s {
 	struct dpf_msg_header_s header;
@@ -133,8 +145,9 @@ struct dpf_ddr_bw_read_s {
 // Response structure for reading DDR bandwidth
 struct dpf_resp_ddr_bw_read_s {
 	struct dpf_msg_header_s header;
-	uint64_t read_bw;
-	uint64_t write_bw;
+	uint64_t read_bytes;  // DDR bytes read since the counters started
+	uint64_t write_bytes; // DDR bytes written since the counters started
+	struct dpf_ddr_channels_s channels; // read_bytes and write_bytes per controller
 };
 
 
@@ -177,6 +190,52 @@ struct dpf_resp_pmu_log_read_s {
 	__u8 data[];        // Flexible array for the actual PMU metrics data
 };
 
+// One core in a snapshot response
+struct dpf_snapshot_core_s {
+	__u32 core_id;
+	__u32 reserved;
+	__u64 pmu_values[PMU_COUNTERS]; // Raw PMU counter values
+	__u64 msr_values[NR_OF_MSR];    // Prefetch MSR values
+};
+
+// Request structure for a whole system snapshot
+struct dpf_snapshot_read_s {
+	struct dpf_msg_header_s header;
+	__u32 core_start;   // First core to include
+	__u32 core_count;   // Maximum number of cores to include
+};
+
+// Response structure for a whole system snapshot, everything a monitor
+// needs per refresh in one read
+struct dpf_resp_snapshot_read_s {
+	struct dpf_msg_header_s header;
+	__u64 timestamp;    // ktime_get_ns() when the snapshot was taken
+	__u64 read_bytes;   // DDR bytes read since the counters started
+	__u64 write_bytes;  // DDR bytes written since the counters started
+	__u32 tuning;       // 1 if kernel tuning is running
+	__u32 core_count;   // Number of entries in cores[]
+	struct dpf_ddr_channels_s ddr; // read_bytes and write_bytes per controller
+	struct dpf_snapshot_core_s cores[]; // Enabled cores in the range
+};
+
+// Request structure for reading all PMU events of a core
+struct dpf_pmu_mux_read_s {
+	struct dpf_msg_header_s header;
+	__u32 core_id;      // Core ID to read PMU from
+};
+
+// Response structure with every event, base set first, scaled to the whole
+// interval when multiplexed, and the share of the interval it was counted
+struct dpf_resp_pmu_mux_read_s {
+	struct dpf_msg_header_s header;
+	__u32 num_events;   // Valid entries in pmu_values and duty_pct
+	__u32 groups;       // Multiplexed groups, 1 when not multiplexing
+	__u64 pmu_values[PMU_MAX_EVENTS];
+	__u32 duty_pct[PMU_MAX_EVENTS];
+};
+
+#define DPF_SNAPSHOT_SIZE(cores) (sizeof(struct dpf_resp_snapshot_read_s) + \
+	(cores) * sizeof(struct dpf_snapshot_core_s))
 
 // Global tuning algorithm settings, these should be set through
 // the dpf_tuning_control API.
@@ -203,4 +262,6 @@ int api_pmu_log_control(struct dpf_pmu_log_control_s *req_data);
 int api_pmu_log_stop(struct dpf_pmu_log_stop_s *req_data);
 int api_pmu_log_read(struct dpf_pmu_log_read_s *req_data);
 int api_pmu_log_append_data(void *data, size_t data_size);
+int api_snapshot_read(struct dpf_snapshot_read_s *req_data);
+int api_pmu_mux_read(struct dpf_pmu_mux_read_s *req_data);
 #endif // __KERNEL_API_H__
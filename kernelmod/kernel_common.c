@@ -1,6 +1,11 @@
 #define _GNU_SOURCE
 
 #include <linux/timekeeping.h>
+#include <linux/math64.h>
+#include <linux/string.h>
+#include <linux/build_bug.h>
+#include <asm/msr.h>
+#include <asm/processor.h>
 
 //#include "../include/atom_msr.h"
 #include "kernel_common.h"
@@ -12,18 +17,177 @@ struct core_state_s corestate[MAX_NUM_CORES];
 int ddr_bw_target;
 
 
+int pmu_num_events = PMU_COUNTERS; //base events plus extra_events
+int pmu_mux_groups = 1; //1 when all events fit the counters
+
+// Event select values, mapped to pmu_metrics and then extra_events
+uint64_t pmu_event_codes[PMU_MAX_EVENTS];
+static_assert(PMU_COUNTERS == PMU_EV_BASE_COUNT,
+	      "base PMU events and the event catalog differ");
+
+const struct msr_layout_s *msr_layout = &msr_layouts[0];
+
+// Select the prefetcher MSR layout for the CPU model, models not in the
+// table get the first one
+void msr_layout_setup(void)
+{
+	const struct msr_layout_s *layout;
+
+	layout = msr_layout_find(boot_cpu_data.x86, boot_cpu_data.x86_model);
+	if (!layout)
+		pr_warn("CPU family %u model 0x%x not in the MSR layout table, using %s\n",
+			boot_cpu_data.x86, boot_cpu_data.x86_model, msr_layout->sku);
+	else
+		msr_layout = layout;
+	pr_info("MSR layout %s\n", msr_layout->sku);
+}
+
+// Fill the base event selects from the catalog for the CPU model, models
+// not in the catalog get the first one
+void pmu_catalog_setup(void)
+{
+	const struct pmu_catalog_s *cat;
+
+	cat = pmu_catalog_find(boot_cpu_data.x86, boot_cpu_data.x86_model);
+	if (!cat) {
+		cat = &pmu_catalogs[0];
+		pr_warn("CPU family %u model 0x%x not in the event catalog, using %s events\n",
+			boot_cpu_data.x86, boot_cpu_data.x86_model, cat->uarch);
+	} else {
+		pr_info("PMU events for %s\n", cat->uarch);
+	}
+
+	// events not on this model stay off and read as zero
+	for (int i = 0; i < PMU_COUNTERS; i++)
+		pmu_event_codes[i] = cat->code[i] ?
+			cat->code[i] | EVENT_USR_OS_EN : 0;
+}
+
+// Events on PMC0-2 for good and per group on PMC3-6, -1 if unused
+static const int pmu_resident[PMU_RESIDENT] = {
+	PERF_MEM_LOAD_UOPS_RETIRED_DRAM_HIT,
+	PERF_CPU_CLK_UNHALTED_THREAD,
+	PERF_INST_RETIRED_ANY_P,
+};
+static int pmu_mux_event[PMU_MAX_GROUPS][PMU_MUX_SLOTS];
+
+// Add extra events (umask << 8 | event) after the base set and split the
+// ones not resident into groups for PMC3-6
+void pmu_mux_setup(const unsigned long *extra, int num_extra)
+{
+	int n = 0;
+
+	if (num_extra > PMU_MAX_EVENTS - PMU_COUNTERS)
+		num_extra = PMU_MAX_EVENTS - PMU_COUNTERS;
+
+	for (int i = 0; i < num_extra; i++)
+		pmu_event_codes[PMU_COUNTERS + i] = extra[i] | EVENT_USR_OS_EN;
+	pmu_num_events = PMU_COUNTERS + num_extra;
+
+	if (num_extra == 0) {
+		pmu_mux_groups = 1;
+		return;
+	}
+
+	memset(pmu_mux_event, -1, sizeof(pmu_mux_event));
+	for (int i = 0; i < pmu_num_events; i++) {
+		if (i == PERF_MEM_LOAD_UOPS_RETIRED_DRAM_HIT ||
+		    i == PERF_CPU_CLK_UNHALTED_THREAD ||
+		    i == PERF_INST_RETIRED_ANY_P)
+			continue;
+		pmu_mux_event[n / PMU_MUX_SLOTS][n % PMU_MUX_SLOTS] = i;
+		n++;
+	}
+	pmu_mux_groups = (n + PMU_MUX_SLOTS - 1) / PMU_MUX_SLOTS;
+
+	pr_info("%d PMU events multiplexed in %d groups\n", pmu_num_events,
+		pmu_mux_groups);
+}
+
+static inline void pmu_write_evtsel(int pmc, uint64_t event)
+{
+	native_write_msr(MSR_IA32_PERFEVTSEL0 + pmc, event & MSR_LOW_MASK,
+			 event >> 32);
+}
+
+// Program the resident events and the current group of the calling core and
+// restart the counters from zero.
+// IMPORTANT: This has to be the core with core_id that calls this function
+void pmu_mux_program(int core_id)
+{
+	int g = corestate[core_id].mux_group;
+
+	for (int k = 0; k < PMU_RESIDENT; k++)
+		pmu_write_evtsel(k, pmu_event_codes[pmu_resident[k]]);
+	for (int k = 0; k < PMU_MUX_SLOTS; k++) {
+		int e = pmu_mux_event[g][k];
+
+		pmu_write_evtsel(PMU_RESIDENT + k, e < 0 ? 0 : pmu_event_codes[e]);
+	}
+	for (int k = 0; k < PMU_COUNTERS; k++)
+		native_write_msr(MSR_IA32_PMC0 + k, 0, 0);
+}
+
+// Collect the slice that just ended and move the next group onto PMC3-6
+// IMPORTANT: This has to be the core with core_id that calls this function
+void pmu_mux_rotate(int core_id)
+{
+	struct core_state_s *cs = &corestate[core_id];
+	int g = cs->mux_group;
+
+	if (pmu_mux_groups == 1 || cs->core_disabled)
+		return;
+
+	for (int k = 0; k < PMU_RESIDENT; k++) {
+		cs->mux_count[pmu_resident[k]] += native_read_pmc(k);
+		cs->mux_slices_on[pmu_resident[k]]++;
+	}
+	for (int k = 0; k < PMU_MUX_SLOTS; k++) {
+		int e = pmu_mux_event[g][k];
+
+		if (e < 0)
+			continue;
+		cs->mux_count[e] += native_read_pmc(PMU_RESIDENT + k);
+		cs->mux_slices_on[e]++;
+	}
+	cs->mux_slices++;
+
+	cs->mux_group = (g + 1) % pmu_mux_groups;
+	pmu_mux_program(core_id);
+}
+
 //update the pmu field in the corestate struct for the given core.
 // IMPORTANT: This has to be the core with core_id that calls this function or incorrect state will be updated
 
 int pmu_update(int core_id)
 {
+	struct core_state_s *cs;
+
 	if (core_id < 0 || core_id >= MAX_NUM_CORES || corestate[core_id].core_disabled)
 		return -EINVAL;
 
-	for(int i = 0; i < PMU_COUNTERS; i++) {
+	cs = &corestate[core_id];
+	for(int i = 0; i < pmu_num_events; i++) {
 		corestate[core_id].pmu_old[i] = corestate[core_id].pmu_raw[i];
 	}
 
+	if (pmu_mux_groups > 1) {
+		// Close the last slice and scale each event to the whole interval
+		pmu_mux_rotate(core_id);
+		for (int i = 0; i < pmu_num_events; i++) {
+			if (cs->mux_slices_on[i])
+				cs->pmu_raw[i] += div_u64(cs->mux_count[i] *
+					cs->mux_slices, cs->mux_slices_on[i]);
+			cs->pmu_duty[i] = cs->mux_slices_on[i] * 100 /
+				cs->mux_slices;
+			cs->mux_count[i] = 0;
+			cs->mux_slices_on[i] = 0;
+		}
+		cs->mux_slices = 0;
+
+		return 0;
+	}
+
 	// Update PMU counters using the defined indices from kernel_common.h
 	corestate[core_id].pmu_raw[PERF_MEM_UOPS_RETIRED_ALL_LOADS] = native_read_pmc(0);
 	corestate[core_id].pmu_raw[PERF_MEM_LOAD_UOPS_RETIRED_L2_HIT] = native_read_pmc(1);
@@ -32,6 +196,8 @@ int pmu_update(int core_id)
 	corestate[core_id].pmu_raw[PERF_XQ_PROMOTION_ALL] = native_read_pmc(4);
 	corestate[core_id].pmu_raw[PERF_CPU_CLK_UNHALTED_THREAD] = native_read_pmc(5);
 	corestate[core_id].pmu_raw[PERF_INST_RETIRED_ANY_P] = native_read_pmc(6);
+	for (int i = 0; i < PMU_COUNTERS; i++)
+		cs->pmu_duty[i] = 100;
 
 	return 0;
 }
@@ -51,58 +217,64 @@ int inline msr_set_dirty(int core_id)
 }
 
 
+static const u32 pf_msr_addr[NR_OF_MSR] = {
+	0x1320, 0x1321, 0x1322, 0x1323, 0x1324, 0x1a4
+};
+
 //Loads MSR values into the corestate msr field
 // IMPORTANT: This has to be the core with core_id that calls this function or incorrect state will be updated
 int msr_load(int core_id)
 {
-	corestate[core_id].pf_msr[MSR_1320_INDEX].v = __rdmsr(0x1320);
-	corestate[core_id].pf_msr[MSR_1321_INDEX].v = __rdmsr(0x1321);
-	corestate[core_id].pf_msr[MSR_1322_INDEX].v = __rdmsr(0x1322);
-	corestate[core_id].pf_msr[MSR_1323_INDEX].v = __rdmsr(0x1323);
-	corestate[core_id].pf_msr[MSR_1324_INDEX].v = __rdmsr(0x1324);
-	corestate[core_id].pf_msr[MSR_1A4_INDEX].v = __rdmsr(0x1a4);
+	for (int i = 0; i < NR_OF_MSR; i++)
+		corestate[core_id].pf_msr[i].v = __rdmsr(pf_msr_addr[i]);
+	memcpy(corestate[core_id].pf_msr_hw, corestate[core_id].pf_msr,
+	       sizeof(corestate[core_id].pf_msr_hw));
 
 	return 0;
 }
 
-//Update MSR values from corestate msr field if the msr dirty bit has been set for this core
+//Update the MSRs that differ from the last values loaded or written
 // IMPORTANT: This has to be the core with core_id that calls this function or incorrect state will be updated
 int msr_update(int core_id)
 {
-	corestate[core_id].pf_msr_dirty = 1; //reset msr state
+	struct core_state_s *cs = &corestate[core_id];
+	unsigned int regs = hwpf_diff_regs(cs->pf_msr_hw, cs->pf_msr);
 
-	__wrmsr(0x1320, (u32)corestate[core_id].pf_msr[MSR_1320_INDEX].v, (u32) (corestate[core_id].pf_msr[MSR_1320_INDEX].v >> 32));
-	__wrmsr(0x1321, (u32)corestate[core_id].pf_msr[MSR_1321_INDEX].v, (u32) (corestate[core_id].pf_msr[MSR_1321_INDEX].v >> 32));
-	__wrmsr(0x1322, (u32)corestate[core_id].pf_msr[MSR_1322_INDEX].v, (u32) (corestate[core_id].pf_msr[MSR_1322_INDEX].v >> 32));
-	__wrmsr(0x1323, (u32)corestate[core_id].pf_msr[MSR_1323_INDEX].v, (u32) (corestate[core_id].pf_msr[MSR_1323_INDEX].v >> 32));
-	__wrmsr(0x1324, (u32)corestate[core_id].pf_msr[MSR_1324_INDEX].v, (u32) (corestate[core_id].pf_msr[MSR_1324_INDEX].v >> 32));
-	__wrmsr(0x1a4, (u32)corestate[core_id].pf_msr[MSR_1A4_INDEX].v, (u32) (corestate[core_id].pf_msr[MSR_1A4_INDEX].v >> 32));
+	cs->pf_msr_dirty = 1; //reset msr state
+
+	for (int i = 0; regs; i++, regs >>= 1) {
+		if (!(regs & 1))
+			continue;
+		__wrmsr(pf_msr_addr[i], (u32)cs->pf_msr[i].v,
+			(u32)(cs->pf_msr[i].v >> 32));
+		cs->pf_msr_hw[i] = cs->pf_msr[i];
+	}
 
 	return 0;
 }
 
-// Set value in MSR table
+// Set value in MSR table, -1 if not valid on this SKU
 int msr_set_l2xq(int core_id, int value)
 {
-	corestate[core_id].pf_msr[MSR_1320_INDEX].msr1320.L2_STREAM_AMP_XQ_THRESHOLD = value;
-
-	return 0;
+	return hwpf_field_set(msr_layout, corestate[core_id].pf_msr,
+			      HWPF_L2_STREAM_AMP_XQ_THRESHOLD, value);
 }
 
 int msr_get_l2xq(int core_id)
 {
-	return corestate[core_id].pf_msr[MSR_1320_INDEX].msr1320.L2_STREAM_AMP_XQ_THRESHOLD;
+	return hwpf_field_get(msr_layout, corestate[core_id].pf_msr,
+			      HWPF_L2_STREAM_AMP_XQ_THRESHOLD);
 }
 
-// Set value in MSR table
+// Set value in MSR table, -1 if not valid on this SKU
 int msr_set_l3xq(int core_id, int value)
 {
-	corestate[core_id].pf_msr[MSR_1320_INDEX].msr1320.LLC_STREAM_XQ_THRESHOLD = value;
-
-	return 0;
+	return hwpf_field_set(msr_layout, corestate[core_id].pf_msr,
+			      HWPF_LLC_STREAM_XQ_THRESHOLD, value);
 }
 
 int msr_get_l3xq(int core_id)
 {
-	return corestate[core_id].pf_msr[MSR_1320_INDEX].msr1320.LLC_STREAM_XQ_THRESHOLD;
+	return hwpf_field_get(msr_layout, corestate[core_id].pf_msr,
+			      HWPF_LLC_STREAM_XQ_THRESHOLD);
 }
@@ -2,6 +2,8 @@
 #define __KERNEL_COMMON_H__
 
 #include "../include/atom_msr.h"
+#include "../include/pmu_events.h"
+#include "../include/msr_layout.h"
 #include <linux/types.h>
 
 #define MAX_NUM_CORES (512)
@@ -17,6 +19,14 @@
 // PMU counters: 7 total (cycles, instructions, and 5 additional events)
 #define PMU_COUNTERS (7)
 
+// PMU multiplexing: with extra_events loaded, PMC0-2 keep DRAM hits, cycles
+// and instructions and the other events take turns on PMC3-6, one group per
+// timer slice. Counts are scaled by the slices each event was counted.
+#define PMU_MAX_EVENTS (20)
+#define PMU_RESIDENT (3)
+#define PMU_MUX_SLOTS (PMU_COUNTERS - PMU_RESIDENT)
+#define PMU_MAX_GROUPS ((PMU_MAX_EVENTS - PMU_RESIDENT + PMU_MUX_SLOTS - 1) / PMU_MUX_SLOTS)
+
 // MSR definitions: 6 MSRs monitored
 #define NR_OF_MSR (6)
 #define MSR_1320_INDEX (0)  // Index for MSR 0x1320 (e.g., L2_STREAM_AMP_XQ_THRESHOLD)
@@ -34,6 +44,8 @@
 #define MSR_IA32_PERFEVTSEL4        0x18A
 #define MSR_IA32_PERFEVTSEL5        0x18B
 #define MSR_IA32_PERFEVTSEL6        0x18C
+#define MSR_IA32_PMC0               0xC1
+#define EVENT_USR_OS_EN             (0x0000000000430000ULL) // Count user+kernel, enable
 #define MSR_IA32_PERF_GLOBAL_STATUS 0x38D
 #define MSR_IA32_PERF_GLOBAL_CTRL   0x38F
 
@@ -50,24 +62,16 @@ typedef struct {
 
 #define PMU_ENTRY_SIZE_BYTES sizeof(dpf_pmu_log_entry_t)
 
-// Event types for PMU configuration (64-bit event codes including config bits)
-#define EVENT_CPU_CLK_UNHALTED_THREAD       (0x00000000004300c0ULL) // Event 0x00, UMask 0xc0, Enable
-#define EVENT_INST_RETIRED_ANY_P            (0x00000000004300c2ULL) // Event 0x00, UMask 0xc2, Enable
-#define EVENT_MEM_UOPS_RETIRED_ALL_LOADS    (0x00000000004381d0ULL) // Event 0x81, UMask 0xd0, Enable
-#define EVENT_MEM_LOAD_UOPS_RETIRED_L2_HIT  (0x00000000004302d1ULL) // Event 0x02, UMask 0xd1, Enable
-#define EVENT_MEM_LOAD_UOPS_RETIRED_L3_HIT  (0x00000000004304d1ULL) // Event 0x04, UMask 0xd1, Enable
-#define EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT (0x00000000004380d1ULL) // Event 0x80, UMask 0xd1, Enable
-#define EVENT_XQ_PROMOTION_ALL              (0x00000000004300f4ULL) // Event 0x00, UMask 0xf4, Enable (custom)
-
-// Enum for PMU metrics (mapped to pmu_result[] indices and event codes)
+// Enum for PMU metrics (mapped to pmu_result[] indices), the indexes are
+// the ones of the shared event catalog, see include/events/pmu_events.def
 enum pmu_metrics {
-    PERF_MEM_UOPS_RETIRED_ALL_LOADS = 0,    // Index 0: All load uops retired
-    PERF_MEM_LOAD_UOPS_RETIRED_L2_HIT,      // Index 1: Load uops retired hitting L2 cache
-    PERF_MEM_LOAD_UOPS_RETIRED_L3_HIT,      // Index 2: Load uops retired hitting L3 cache
-    PERF_MEM_LOAD_UOPS_RETIRED_DRAM_HIT,    // Index 3: Load uops retired hitting DRAM
-    PERF_XQ_PROMOTION_ALL,                  // Index 4: XQ promotion events (hardware-specific)
-    PERF_CPU_CLK_UNHALTED_THREAD,           // Index 5: CPU cycles when thread is not halted
-    PERF_INST_RETIRED_ANY_P                 // Index 6: Instructions retired
+    PERF_MEM_UOPS_RETIRED_ALL_LOADS = PMU_EV_ALL_LOADS,
+    PERF_MEM_LOAD_UOPS_RETIRED_L2_HIT = PMU_EV_L2_HIT,
+    PERF_MEM_LOAD_UOPS_RETIRED_L3_HIT = PMU_EV_L3_HIT,
+    PERF_MEM_LOAD_UOPS_RETIRED_DRAM_HIT = PMU_EV_DRAM_HIT,
+    PERF_XQ_PROMOTION_ALL = PMU_EV_XQ_PROMOTION,
+    PERF_CPU_CLK_UNHALTED_THREAD = PMU_EV_CYCLES,
+    PERF_INST_RETIRED_ANY_P = PMU_EV_INSTRUCTIONS
 };
 
 // Constants
@@ -90,7 +94,9 @@ enum dpf_msg_type {
 	DPF_MSG_DDR_BW_READ = 8,	 //DDR BW READ
 	DPF_MSG_PMU_LOG_CONTROL = 9, // PMU logging control
 	DPF_MSG_PMU_LOG_STOP = 10,   // Stop PMU logging
-	DPF_MSG_PMU_LOG_READ = 11    // Read PMU log buffer
+	DPF_MSG_PMU_LOG_READ = 11,   // Read PMU log buffer
+	DPF_MSG_SNAPSHOT_READ = 12,  // Read PMU, MSR and DDR state of all cores
+	DPF_MSG_PMU_MUX_READ = 13    // Read all PMU events of a core with duty cycle
 };
 
 // Note: Struct definitions have been moved to kernel_api.h
@@ -120,12 +126,22 @@ struct dpf_pmu_log_stop_s;
 struct dpf_resp_pmu_log_stop_s;
 struct dpf_pmu_log_read_s;
 struct dpf_resp_pmu_log_read_s;
+struct dpf_snapshot_read_s;
+struct dpf_resp_snapshot_read_s;
+struct dpf_pmu_mux_read_s;
+struct dpf_resp_pmu_mux_read_s;
 
 // Core state structure
 struct core_state_s {
-    uint64_t pmu_raw[PMU_COUNTERS]; 	// Raw value from last PMU read (mapped to pmu_metrics)
-    uint64_t pmu_old[PMU_COUNTERS];	// Prev. raw last PMU read (mapped to pmu_metrics)
+    uint64_t pmu_raw[PMU_MAX_EVENTS]; 	// Raw value from last PMU read (mapped to pmu_metrics), scaled when multiplexed
+    uint64_t pmu_old[PMU_MAX_EVENTS];	// Prev. raw last PMU read (mapped to pmu_metrics)
+    uint64_t mux_count[PMU_MAX_EVENTS];	// Counted this interval, unscaled
+    uint32_t mux_slices_on[PMU_MAX_EVENTS]; // Slices counted this interval
+    uint32_t mux_slices;		// Slices this interval
+    uint32_t pmu_duty[PMU_MAX_EVENTS];	// Percent of the last interval counted
+    int mux_group;			// Group on PMC3-6 now
     union msr_u pf_msr[NR_OF_MSR];	// MSR values (0x1320...0x1A4)
+    union msr_u pf_msr_hw[NR_OF_MSR];	// Last loaded from or written to the core
     int pf_msr_dirty;			// 0 = no update needed, 1 = update needed
     int core_disabled;			// 1 = core disabled, 0 = enabled
 };
@@ -152,6 +168,10 @@ static inline int module_id(int core_id) {
 // External declarations
 extern struct core_state_s corestate[MAX_NUM_CORES];
 extern int ddr_bw_target;
+extern int pmu_num_events;
+extern int pmu_mux_groups;
+extern uint64_t pmu_event_codes[PMU_MAX_EVENTS];
+extern const struct msr_layout_s *msr_layout;
 
 // Function prototypes
 int is_msr_dirty(int core_id);
@@ -159,6 +179,11 @@ int msr_set_dirty(int core_id);
 int msr_load(int core_id);
 int msr_update(int core_id);
 int pmu_update(int core_id);
+void pmu_catalog_setup(void);
+void msr_layout_setup(void);
+void pmu_mux_setup(const unsigned long *extra, int num_extra);
+void pmu_mux_program(int core_id);
+void pmu_mux_rotate(int core_id);
 
 // Functions for reading and writing MSRs
 int msr_set_l2xq(int core_id, int value);
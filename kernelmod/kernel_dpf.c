@@ -38,6 +38,13 @@ __u64 ddr_bar_address;
 static DEFINE_MUTEX(dpf_mutex);
 cpumask_t enabled_cpus;
 
+// Extra core PMU events (umask << 8 | event), multiplexed with the base set
+static unsigned long extra_events[PMU_MAX_EVENTS - PMU_COUNTERS];
+static int num_extra_events;
+module_param_array(extra_events, ulong, &num_extra_events, 0444);
+MODULE_PARM_DESC(extra_events, "Extra core PMU events as umask<<8|event, multiplexed with the base set");
+static int mux_tick;
+
 // Workqueue for deferring SMP calls from timer to task context
 static struct work_struct monitor_work;
 
@@ -50,29 +57,27 @@ int aggr;
 // core_id: The CPU core to configure
 static void configure_pmu_on_core(void *info)
 {
+	int core_id = smp_processor_id();
+
+	if (pmu_mux_groups > 1) {
+		struct core_state_s *cs = &corestate[core_id];
+
+		cs->mux_group = 0;
+		cs->mux_slices = 0;
+		memset(cs->mux_count, 0, sizeof(cs->mux_count));
+		memset(cs->mux_slices_on, 0, sizeof(cs->mux_slices_on));
+		pmu_mux_program(core_id);
+
+		native_write_msr(MSR_IA32_PERF_GLOBAL_STATUS, 0, 0);
+		native_write_msr(MSR_IA32_PERF_GLOBAL_CTRL, PMC_ENABLE_ALL, 0);
+		return;
+	}
 
 	// Configure Performance Event Select registers (PERFEVTSELx MSRs)
-	native_write_msr(MSR_IA32_PERFEVTSEL0,
-		EVENT_MEM_UOPS_RETIRED_ALL_LOADS & MSR_LOW_MASK,
-		EVENT_MEM_UOPS_RETIRED_ALL_LOADS >> 32);
-	native_write_msr(MSR_IA32_PERFEVTSEL1,
-		EVENT_MEM_LOAD_UOPS_RETIRED_L2_HIT & MSR_LOW_MASK,
-		EVENT_MEM_LOAD_UOPS_RETIRED_L2_HIT >> 32);
-	native_write_msr(MSR_IA32_PERFEVTSEL2,
-		EVENT_MEM_LOAD_UOPS_RETIRED_L3_HIT & MSR_LOW_MASK,
-		EVENT_MEM_LOAD_UOPS_RETIRED_L3_HIT >> 32);
-	native_write_msr(MSR_IA32_PERFEVTSEL3,
-		EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT & MSR_LOW_MASK,
-		EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT >> 32);
-	native_write_msr(MSR_IA32_PERFEVTSEL4,
-		EVENT_XQ_PROMOTION_ALL & MSR_LOW_MASK,
-		EVENT_XQ_PROMOTION_ALL >> 32);
-	native_write_msr(MSR_IA32_PERFEVTSEL5,
-		EVENT_CPU_CLK_UNHALTED_THREAD & MSR_LOW_MASK,
-		EVENT_CPU_CLK_UNHALTED_THREAD >> 32);
-	native_write_msr(MSR_IA32_PERFEVTSEL6,
-		EVENT_INST_RETIRED_ANY_P & MSR_LOW_MASK,
-		EVENT_INST_RETIRED_ANY_P >> 32);
+	for (int i = 0; i < PMU_COUNTERS; i++)
+		native_write_msr(MSR_IA32_PERFEVTSEL0 + i,
+			pmu_event_codes[i] & MSR_LOW_MASK,
+			pmu_event_codes[i] >> 32);
 
 	// Reset the performance counter control register first
 	native_write_msr(MSR_IA32_PERF_GLOBAL_STATUS, 0, 0); // Clear performance counters status
@@ -219,6 +224,12 @@ static ssize_t dpf_proc_write(struct file *file, const char __user *buffer,
 	case DPF_MSG_PMU_LOG_READ:
 		ret = api_pmu_log_read(msg_data);
 		break;
+	case DPF_MSG_SNAPSHOT_READ:
+		ret = api_snapshot_read(msg_data);
+		break;
+	case DPF_MSG_PMU_MUX_READ:
+		ret = api_pmu_mux_read(msg_data);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -291,6 +302,19 @@ static void per_core_work(void *info)
 	}
 }
 
+// Rotates the multiplexed PMU events on a slice that is not the end of an
+// interval
+static void mux_core_work(void *info)
+{
+	pmu_mux_rotate(smp_processor_id());
+}
+
+// Timer period, the interval split in one slice per multiplexed group
+ktime_t monitor_slice_period(void)
+{
+	return ktime_divns(kt_period, pmu_mux_groups);
+}
+
 // Workqueue function that executes per-core work in task context
 // This runs in a kworker thread, satisfying in_task() requirement
 static void monitor_work_func(struct work_struct *work)
@@ -304,6 +328,13 @@ static void monitor_work_func(struct work_struct *work)
 	if (!keep_running)
 		return;
 
+	if (pmu_mux_groups > 1 && ++mux_tick % pmu_mux_groups != 0) {
+		if (!cpumask_empty(&enabled_cpus))
+			on_each_cpu_mask(&enabled_cpus, mux_core_work, NULL,
+					 true);
+		return;
+	}
+
 	if (!cpumask_empty(&enabled_cpus)) {
 		// Execute work on local CPU first
 		per_core_work(NULL);
@@ -325,7 +356,7 @@ static enum hrtimer_restart monitor_callback(struct hrtimer *timer)
 	// schedule_work() is safe from IRQ context and prevents duplicate queuing
 	schedule_work(&monitor_work);
 
-	hrtimer_forward_now(timer, kt_period);
+	hrtimer_forward_now(timer, monitor_slice_period());
 	return HRTIMER_RESTART;
 }
 
@@ -354,6 +385,9 @@ static int __init dpf_module_init(void)
 	INIT_WORK(&monitor_work, monitor_work_func);
 
 	kt_period = ktime_set(TIMER_INTERVAL_SEC, 0);
+	pmu_catalog_setup();
+	msr_layout_setup();
+	pmu_mux_setup(extra_events, num_extra_events);
 	hrtimer_init(&monitor_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
 	monitor_timer.function = monitor_callback;
 
@@ -362,6 +396,8 @@ static int __init dpf_module_init(void)
 
 // Module cleanup
 static void __exit dpf_module_exit(void) {
+	void __iomem *ddr_mapping[MAX_NUM_DDR_CONTROLLERS];
+
 	pr_info("Stopping dPF monitor thread\n");
 
 	// Stop timer and prevent further work
@@ -385,12 +421,11 @@ static void __exit dpf_module_exit(void) {
 	}
 
 	// Cleanup DDR mappings
+	kernel_pmu_ddr_detach(ddr_mapping);
 	for (int i = 0; i < MAX_NUM_DDR_CONTROLLERS; i++) {
-		if (ddr.mmap[i]) {
+		if (ddr_mapping[i]) {
 			pr_info("Unmapping DDR memory for controller %d\n", i);
-			iounmap((void __iomem *)ddr.mmap[i]);
-                        
-			ddr.mmap[i] = NULL;
+			iounmap(ddr_mapping[i]);
 		}
 	}
 
@@ -3,6 +3,7 @@
 #include <linux/ioport.h>
 #include <linux/printk.h>
 #include <linux/proc_fs.h>
+#include <linux/spinlock.h>
 #include <linux/string.h>
 #include <linux/types.h>
 
@@ -13,6 +14,9 @@ __u32 ddr_cpu_type = DDR_NONE;
 __u32 num_ddr_controllers = 0;
 struct ddr_s ddr = {0};
 
+// Serializes all access to ddr, the tuner reads it from IPI context
+static DEFINE_SPINLOCK(ddr_lock);
+
 // Reads DDR performance counters for Sierra Forest and Grandridge CPUs
 // Accepts: pointer to ddr_s struct (ddr) and type of counter
 // Returns: total bandwidth in bytes , updates ddr_s struct
@@ -123,10 +127,10 @@ static uint64_t kernel_pmu_ddr_client(struct ddr_s *ddr, int type)
 	return final_result;
 }
 
-// Reads DDR performance counters based on CPU type
+// Reads DDR performance counters based on CPU type, ddr_lock held
 // Accepts: pointer to ddr_s struct (ddr) and type of counter
 // Returns: total bandwidth in bytes, or -EINVAL on error
-uint64_t kernel_pmu_ddr(struct ddr_s *ddr, int type)
+static uint64_t __kernel_pmu_ddr(struct ddr_s *ddr, int type)
 {
 	uint64_t result;
 
@@ -144,6 +148,57 @@ uint64_t kernel_pmu_ddr(struct ddr_s *ddr, int type)
 	return -EINVAL;
 }
 
+// Reads DDR performance counters based on CPU type
+// Accepts: pointer to ddr_s struct (ddr) and type of counter
+// Returns: bandwidth in bytes since the previous call, or -EINVAL on error
+uint64_t kernel_pmu_ddr(struct ddr_s *ddr, int type)
+{
+	unsigned long flags;
+	uint64_t result;
+
+	spin_lock_irqsave(&ddr_lock, flags);
+	result = __kernel_pmu_ddr(ddr, type);
+	spin_unlock_irqrestore(&ddr_lock, flags);
+
+	return result;
+}
+
+// Takes the controller mappings out of ddr so they can be unmapped
+// Accepts: array of MAX_NUM_DDR_CONTROLLERS entries for the mappings
+void kernel_pmu_ddr_detach(void __iomem **mapping)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&ddr_lock, flags);
+	for (i = 0; i < MAX_NUM_DDR_CONTROLLERS; i++) {
+		mapping[i] = (void __iomem *)ddr.mmap[i];
+		ddr.mmap[i] = NULL;
+	}
+	spin_unlock_irqrestore(&ddr_lock, flags);
+}
+
+// Publishes new controller mappings in ddr and primes the delta state
+// Accepts: pointer to ddr_s struct (ddr), interface type, base address for
+// DDR BAR (ddr_bar) and the mappings of num_ddr_controllers controllers
+static void kernel_pmu_ddr_attach(struct ddr_s *ddr, int type,
+				  uint64_t ddr_bar, void __iomem **mapping)
+{
+	unsigned long flags;
+	int i;
+
+	spin_lock_irqsave(&ddr_lock, flags);
+	memset(ddr, 0, sizeof(struct ddr_s));
+	ddr->ddr_interface_type = type;
+	ddr->bar_address = ddr_bar;
+	for (i = 0; i < num_ddr_controllers; i++)
+		ddr->mmap[i] = (char *)mapping[i];
+
+	__kernel_pmu_ddr(ddr, DDR_PMU_RD);
+	__kernel_pmu_ddr(ddr, DDR_PMU_WR);
+	spin_unlock_irqrestore(&ddr_lock, flags);
+}
+
 // Initializes DDR performance monitoring for Sierra Forest and Grandridge CPUs
 // Accepts: pointer to ddr_s struct (ddr) and base address for DDR BAR (ddr_bar)
 // Returns: 0 on success, -ENODEV if no controllers, -ENOMEM on mapping failure
@@ -158,10 +213,6 @@ int kernel_pmu_ddr_init_grr_srf(struct ddr_s *ddr, uint64_t ddr_bar)
 		num_ddr_controllers = MAX_NUM_DDR_CONTROLLERS;
 	}
 
-	memset(ddr, 0, sizeof(struct ddr_s));
-	ddr->ddr_interface_type = DDR_GRR_SRF;
-	ddr->bar_address = ddr_bar;
-
 	if (num_ddr_controllers <= 0) {
 		pr_err("No controllers configured (%d)\n",
 		       num_ddr_controllers);
@@ -179,12 +230,9 @@ int kernel_pmu_ddr_init_grr_srf(struct ddr_s *ddr, uint64_t ddr_bar)
 			release_mem_region(reg_base, GRR_SRF_DDR_RANGE);
 			goto cleanup;
 		}
-
-		ddr->mmap[i] = (char *)mapping[i];
 	}
 
-	kernel_pmu_ddr(ddr, DDR_PMU_RD);
-	kernel_pmu_ddr(ddr, DDR_PMU_WR);
+	kernel_pmu_ddr_attach(ddr, DDR_GRR_SRF, ddr_bar, mapping);
 
 	return 0;
 
@@ -195,8 +243,6 @@ cleanup:
 			release_mem_region(ddr_bar + GRR_SRF_MC_ADDRESS(i) +
 					       GRR_SRF_FREE_RUN_CNTR_READ,
 					   GRR_SRF_DDR_RANGE);
-
-			ddr->mmap[i] = NULL;
 		}
 	}
 
@@ -214,10 +260,6 @@ int kernel_pmu_ddr_init_client(struct ddr_s *ddr, uint64_t ddr_bar)
 	void __iomem *mapping[2] = {NULL};
 	const uint64_t offsets[2] = {CLIENT_DDR0_OFFSET, CLIENT_DDR1_OFFSET};
 
-	memset(ddr, 0, sizeof(struct ddr_s));
-	ddr->ddr_interface_type = DDR_CLIENT;
-	ddr->bar_address = ddr_bar;
-
 	for (i = 0; i < num_ddr_controllers; i++) {
 		uint64_t reg_base = ddr_bar + offsets[i];
 
@@ -228,12 +270,9 @@ int kernel_pmu_ddr_init_client(struct ddr_s *ddr, uint64_t ddr_bar)
 			release_mem_region(reg_base, CLIENT_DDR_RANGE);
 			goto cleanup;
 		}
-
-		ddr->mmap[i] = (char *)mapping[i];
 	}
 
-	kernel_pmu_ddr(ddr, DDR_PMU_RD);
-	kernel_pmu_ddr(ddr, DDR_PMU_WR);
+	kernel_pmu_ddr_attach(ddr, DDR_CLIENT, ddr_bar, mapping);
 
 	return 0;
 
@@ -243,7 +282,6 @@ cleanup:
 			iounmap(mapping[i]);
 			release_mem_region(ddr_bar + offsets[i],
 					   CLIENT_DDR_RANGE);
-			ddr->mmap[i] = NULL;
 		}
 	}
 
@@ -252,39 +290,53 @@ cleanup:
 	return -ENOMEM;
 }
 
-// Reads DDR read and write bandwidth counters
-// Accepts: pointers to store read bandwidth and write bandwidth
-// Returns: 0 on success, -ENOMEM if DDR not initialized or no controllers
-int read_ddr_counters(uint64_t *read_bw, uint64_t *write_bw)
+// Reads the free running counter of one controller
+// Accepts: controller index and type of counter
+// Returns: count of 64 byte lines, 0 if the controller is unmapped
+static uint64_t ddr_channel_count(int i, int type)
 {
-	if (ddr_cpu_type != DDR_GRR_SRF && ddr_cpu_type != DDR_CLIENT) {
-		pr_err("%s: DDR not initialized (type %d)\n",
-		       __func__, ddr_cpu_type);
-		*read_bw = 0;
-		*write_bw = 0;
+	void __iomem *addr;
 
-		return -ENOMEM;
-	}
-
-	if (num_ddr_controllers <= 0) {
-		pr_err("No controllers configured for type %d\n", ddr_cpu_type);
-		*read_bw = 0;
-		*write_bw = 0;
+	if (!ddr.mmap[i])
+		return 0;
 
-		return -ENOMEM;
-	}
+	addr = (void __iomem *)ddr.mmap[i];
+	if (ddr_cpu_type == DDR_CLIENT)
+		addr += type == DDR_PMU_RD ? CLIENT_DDR_RD_BW : CLIENT_DDR_WR_BW;
+	else if (type == DDR_PMU_WR)
+		addr += GRR_SRF_FREE_RUN_CNTR_WRITE - GRR_SRF_FREE_RUN_CNTR_READ;
 
-	*read_bw = kernel_pmu_ddr(&ddr, DDR_PMU_RD);
+	return readq(addr);
+}
 
-	*write_bw = kernel_pmu_ddr(&ddr, DDR_PMU_WR);
+// Reads the free running DDR counters in total and of each controller,
+// without moving the delta state the tuner reads through kernel_pmu_ddr()
+// Accepts: pointers to store the total bytes read and written and arrays
+// of MAX_NUM_DDR_CONTROLLERS entries for the bytes of each controller, all
+// counted since the counters started
+// Returns: number of controllers on success, -ENOMEM if DDR not initialized
+int read_ddr_channels(uint64_t *read_total, uint64_t *write_total,
+		      uint64_t *rd_channel, uint64_t *wr_channel)
+{
+	unsigned long flags;
+	int i;
 
-	if (*read_bw == (uint64_t)-EINVAL || *write_bw == (uint64_t)-EINVAL) {
-		pr_err("Failed to read counters for type %d\n", ddr_cpu_type);
-		*read_bw = 0;
-		*write_bw = 0;
+	*read_total = 0;
+	*write_total = 0;
+	memset(rd_channel, 0, MAX_NUM_DDR_CONTROLLERS * sizeof(uint64_t));
+	memset(wr_channel, 0, MAX_NUM_DDR_CONTROLLERS * sizeof(uint64_t));
 
+	if (ddr_cpu_type != DDR_GRR_SRF && ddr_cpu_type != DDR_CLIENT)
 		return -ENOMEM;
+
+	spin_lock_irqsave(&ddr_lock, flags);
+	for (i = 0; i < num_ddr_controllers; i++) {
+		rd_channel[i] = ddr_channel_count(i, DDR_PMU_RD) * 64;
+		wr_channel[i] = ddr_channel_count(i, DDR_PMU_WR) * 64;
+		*read_total += rd_channel[i];
+		*write_total += wr_channel[i];
 	}
+	spin_unlock_irqrestore(&ddr_lock, flags);
 
-	return 0;
+	return num_ddr_controllers;
 }
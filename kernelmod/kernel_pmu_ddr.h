@@ -19,6 +19,8 @@ extern struct ddr_s ddr;
 uint64_t kernel_pmu_ddr(struct ddr_s *ddr, int type);
 int kernel_pmu_ddr_init_grr_srf(struct ddr_s *ddr, uint64_t ddr_bar);
 int kernel_pmu_ddr_init_client(struct ddr_s *ddr, uint64_t ddr_bar);
-int read_ddr_counters(uint64_t *read_bw, uint64_t *write_bw);
+void kernel_pmu_ddr_detach(void __iomem **mapping);
+int read_ddr_channels(uint64_t *read_total, uint64_t *write_total,
+		      uint64_t *rd_channel, uint64_t *wr_channel);
 
 #endif /* __KERNEL_PMU_DDR_H__ */
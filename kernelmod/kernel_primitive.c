@@ -196,8 +196,8 @@ int kernel_basicalg(int tunealg, int aggr)
 			//jamdle overflow / underflow scnearios
 			if (l2xq <= 0)
 				l2xq = 1;
-			if (l2xq > L2XQ_MAX)
-				l2xq = L2XQ_MAX;
+			if (l2xq > msr_layout->field[HWPF_L2_STREAM_AMP_XQ_THRESHOLD].max)
+				l2xq = msr_layout->field[HWPF_L2_STREAM_AMP_XQ_THRESHOLD].max;
 
 			//should we update the MSR?
 			if (old_l2xq != l2xq) {
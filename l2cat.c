@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <math.h>
+#include <cpuid.h>
+
+#include "common.h"
+#include "msr.h"
+#include "log.h"
+#include "sysdetect.h"
+#include "l2cat.h"
+
+#define TAG "L2CAT"
+
+#define EAX (0)
+#define EBX (1)
+#define ECX (2)
+#define EDX (3)
+
+// L2 cache allocation per module. A core that streams out of DRAM is moved
+// to a class of service that may only allocate in a few L2 ways, its
+// neighbours in the module to a class that allocates in the others, so the
+// stream prefetches of one core do not evict the working sets of the rest.
+// The partition grows with how deep the module prefetches, more lines in
+// flight need more ways, and shrinks again when the tuner throttles.
+
+struct l2cat_s l2cat;
+
+static int msr_fd[MAX_THREADS]; //own, the tuning threads close theirs on exit
+static uint64_t boot_assoc[MAX_THREADS]; //PQOS_MSR_ASSOC found at startup
+static uint64_t boot_mask[L2CAT_MAX_MODULES][2]; //stream, shared COS
+static int num_modules;
+
+int l2cat_support_check(void)
+{
+	unsigned int reg[4];
+
+	__cpuid_count(0x10, 0x00, reg[EAX], reg[EBX], reg[ECX], reg[EDX]);
+	if (!(reg[EBX] & (1 << 2))) {
+		logd(TAG, "CPUID.0x10.0: L2 CAT not supported!\n");
+		return -1;
+	}
+
+	__cpuid_count(0x10, 0x02, reg[EAX], reg[EBX], reg[ECX], reg[EDX]);
+	l2cat.cbm_len = (reg[EAX] & 0x1f) + 1;
+	l2cat.cos_stream = reg[EDX] & 0xffff;
+	l2cat.cos_shared = l2cat.cos_stream - 1;
+	logd(TAG, "L2 CAT: %d ways, COS 0-%d\n", l2cat.cbm_len,
+	     l2cat.cos_stream);
+
+	// COS 0 stays the default class of everything else
+	if (l2cat.cos_shared < 1) {
+		loge(TAG, "CPUID.0x10.2: Too few L2 classes of service\n");
+		l2cat.cbm_len = 0;
+		return -2;
+	}
+
+	return 0;
+}
+
+// i is the tuned core, from 0
+static int reg_read(int i, uint32_t reg, uint64_t *val)
+{
+	OVH_MSR_OP();
+	if (pread(msr_fd[i], val, 8, reg) != 8) {
+		loge(TAG, "Could not read MSR 0x%x on core %d\n", reg,
+		     core_first + i);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int reg_write(int i, uint32_t reg, uint64_t val)
+{
+	OVH_MSR_OP();
+	if (pwrite(msr_fd[i], &val, 8, reg) != 8) {
+		loge(TAG, "Could not write MSR 0x%x = 0x%lx on core %d\n", reg,
+		     val, core_first + i);
+		return -1;
+	}
+
+	return 0;
+}
+
+// Set the class of service of a core, the RMID bits are kept
+static int cos_set(int i, uint64_t cos)
+{
+	uint64_t val;
+
+	if (reg_read(i, PQOS_MSR_ASSOC, &val) < 0)
+		return -1;
+	val &= ~PQOS_MSR_ASSOC_QECOS_MASK;
+	val |= cos << PQOS_MSR_ASSOC_QECOS_SHIFT;
+
+	return reg_write(i, PQOS_MSR_ASSOC, val);
+}
+
+int l2cat_init(int max_ways)
+{
+	int module_of[MAX_THREADS];
+
+	if (l2cat_support_check() < 0)
+		return -1;
+
+	if (max_ways < 1 || max_ways >= l2cat.cbm_len) {
+		loge(TAG, "Invalid stream partition of %d ways, the L2 has "
+			  "%d\n", max_ways, l2cat.cbm_len);
+		l2cat.cbm_len = 0;
+		return -1;
+	}
+	l2cat.max_ways = max_ways;
+
+	// Modules by the L2 the cores share, the tuned range need not start
+	// on a module boundary
+	num_modules = get_core_modules(core_first, ACTIVE_THREADS, module_of);
+	if (num_modules > L2CAT_MAX_MODULES) {
+		loge(TAG, "Too many modules, max is %d\n", L2CAT_MAX_MODULES);
+		l2cat.cbm_len = 0;
+		return -1;
+	}
+	for (int m = 0; m < num_modules; m++)
+		l2cat.module[m].num_cores = 0;
+	for (int i = 0; i < ACTIVE_THREADS; i++) {
+		struct l2cat_module_s *mod = &l2cat.module[module_of[i]];
+
+		if (mod->num_cores == L2CAT_CORES_PER_MODULE) {
+			loge(TAG, "More than %d cores share the L2 of core %d\n",
+			     L2CAT_CORES_PER_MODULE, core_first + i);
+			l2cat.cbm_len = 0;
+			return -1;
+		}
+		mod->cores[mod->num_cores++] = i;
+	}
+
+	for (int i = 0; i < ACTIVE_THREADS; i++) {
+		msr_fd[i] = msr_open(core_first + i);
+		if (reg_read(i, PQOS_MSR_ASSOC, &boot_assoc[i]) < 0) {
+			l2cat.cbm_len = 0;
+			return -1;
+		}
+	}
+
+	// The masks are per L2, read and written on the first core of a module
+	for (int m = 0; m < num_modules; m++) {
+		int i = l2cat.module[m].cores[0];
+
+		if (reg_read(i, L2CAT_MSR_MASK_BASE + l2cat.cos_stream,
+			     &boot_mask[m][0]) < 0 ||
+		    reg_read(i, L2CAT_MSR_MASK_BASE + l2cat.cos_shared,
+			     &boot_mask[m][1]) < 0) {
+			l2cat.cbm_len = 0;
+			return -1;
+		}
+		l2cat.module[m].streamers = 0;
+		l2cat.module[m].ways = 0;
+	}
+
+	logi(TAG, "L2 CAT on %d modules, streaming cores get 1-%d of %d ways "
+		  "(COS %d), their neighbours the rest (COS %d)\n", num_modules,
+	     l2cat.max_ways, l2cat.cbm_len, l2cat.cos_stream,
+	     l2cat.cos_shared);
+
+	return 0;
+}
+
+// Share of the stream partition the module's prefetch depth asks for, from
+// the knob the tuner moves: alg 0 raises the XQ threshold to throttle, alg 1
+// lowers the L2 max distance
+static float prefetch_depth(int tunealg, union msr_u msr[])
+{
+	if (tunealg == 0)
+		return 1.0f - (float)msr_get_l2xq(msr) /
+			msr_field_max(HWPF_L2_STREAM_AMP_XQ_THRESHOLD);
+
+	return (float)msr_get_l2maxdist(msr) /
+		msr_field_max(HWPF_L2_STREAM_MAX_DISTANCE);
+}
+
+// Which cores of a module stream, with hysteresis
+static int find_streamers(struct l2cat_module_s *mod, int streamers)
+{
+	uint64_t module_ddr = 0;
+
+	for (int c = 0; c < mod->num_cores; c++)
+		module_ddr += gtinfo[mod->cores[c]].pmu_result[PMU_EV_DRAM_HIT];
+	if (module_ddr == 0)
+		return 0;
+
+	for (int c = 0; c < mod->num_cores; c++) {
+		uint64_t *r = gtinfo[mod->cores[c]].pmu_result;
+		uint64_t demand = r[PMU_EV_L2_HIT] + r[PMU_EV_L3_HIT] +
+				  r[PMU_EV_DRAM_HIT];
+		float share = (float)r[PMU_EV_DRAM_HIT] / module_ddr;
+		float l2_hitr = demand ? (float)r[PMU_EV_L2_HIT] / demand : 1;
+
+		if (share >= L2CAT_STREAM_DDR_SHARE &&
+		    l2_hitr < L2CAT_STREAM_L2_HITR)
+			streamers |= 1 << c;
+		else if (share < L2CAT_RELEASE_DDR_SHARE ||
+			 l2_hitr > L2CAT_RELEASE_L2_HITR)
+			streamers &= ~(1 << c);
+	}
+
+	return streamers;
+}
+
+// Partition the L2 of each module between its streaming cores and the rest,
+// called by the primitive tuners after they set the prefetchers
+void l2cat_tune(int tunealg)
+{
+	if (l2cat.cbm_len == 0)
+		return;
+
+	for (int m = 0; m < num_modules; m++) {
+		struct l2cat_module_s *mod = &l2cat.module[m];
+		int first = mod->cores[0];
+		int n = mod->num_cores;
+		int streamers, ways = 0;
+
+		// Nothing to protect without a neighbour that does not stream
+		streamers = find_streamers(mod, mod->streamers);
+		if (streamers == (1 << n) - 1)
+			streamers = 0;
+
+		if (streamers) {
+			float depth = prefetch_depth(tunealg,
+						     gtinfo[first].hwpf_msr_value);
+
+			ways = 1 + lround(depth * (l2cat.max_ways - 1));
+			if (ways < 1)
+				ways = 1;
+			if (ways > l2cat.max_ways)
+				ways = l2cat.max_ways;
+		}
+
+		if (ways == mod->ways && streamers == mod->streamers)
+			continue;
+
+		// Masks before the cores move in, cores back before the masks
+		// are left behind
+		if (ways && ways != mod->ways) {
+			uint64_t full = (1ULL << l2cat.cbm_len) - 1;
+			uint64_t stream = (1ULL << ways) - 1;
+
+			reg_write(first, L2CAT_MSR_MASK_BASE + l2cat.cos_stream,
+				  stream);
+			reg_write(first, L2CAT_MSR_MASK_BASE + l2cat.cos_shared,
+				  full & ~stream);
+		}
+
+		for (int c = 0; c < n; c++) {
+			int i = mod->cores[c];
+
+			if (streamers & (1 << c))
+				cos_set(i, l2cat.cos_stream);
+			else if (streamers)
+				cos_set(i, l2cat.cos_shared);
+			else
+				cos_set(i, boot_assoc[i] >>
+					PQOS_MSR_ASSOC_QECOS_SHIFT);
+		}
+
+		logv(TAG, "Module %d: streaming cores 0x%x in %d of %d ways\n",
+		     m, streamers, ways, l2cat.cbm_len);
+		mod->streamers = streamers;
+		mod->ways = ways;
+	}
+}
+
+// Classes and masks back as found at startup
+void l2cat_deinit(void)
+{
+	if (l2cat.cbm_len == 0)
+		return;
+
+	for (int i = 0; i < ACTIVE_THREADS; i++)
+		cos_set(i, boot_assoc[i] >> PQOS_MSR_ASSOC_QECOS_SHIFT);
+
+	for (int m = 0; m < num_modules; m++) {
+		int i = l2cat.module[m].cores[0];
+
+		reg_write(i, L2CAT_MSR_MASK_BASE + l2cat.cos_stream,
+			  boot_mask[m][0]);
+		reg_write(i, L2CAT_MSR_MASK_BASE + l2cat.cos_shared,
+			  boot_mask[m][1]);
+	}
+
+	for (int i = 0; i < ACTIVE_THREADS; i++)
+		close(msr_fd[i]);
+
+	l2cat.cbm_len = 0;
+}
@@ -1,10 +1,81 @@
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include "log.h"
 
+// Logging is synchronous until log_async_start() is called. After that each
+// thread copies the format and its arguments into its own single producer
+// ring and returns, formatting and terminal I/O is done by a writer thread
+// that merges all rings in time order. Formats are string literals, only
+// the %s strings are copied. A format the writer cannot replay (%m, %n,
+// long double, too many arguments) is formatted on the calling thread. A full
+// ring or a level over its rate limit drops the message and counts it, a
+// logging thread never waits.
+
+union log_arg_u {
+	long long i; //all integer conversions, cast back by the format
+	double d;
+	const void *p;
+	int str; //offset of a %s string in msg, -1 for NULL
+};
+
+struct log_rec_s {
+	uint64_t mono_ns;
+	uint64_t real_ns;
+	int level;
+	char tag[LOG_TAG_MAX];
+	const char *fmt; //to format on the writer, NULL when msg is formatted
+	union log_arg_u args[LOG_ARGS_MAX];
+	char msg[LOG_MSG_MAX]; //the message, or the %s strings of fmt
+};
+
+// Length modifiers of a conversion
+enum { LEN_NONE, LEN_HH, LEN_H, LEN_L, LEN_LL, LEN_Z, LEN_J, LEN_T, LEN_BIG_L };
+
+// One conversion of a format, from the '%' to the conversion character
+struct log_spec_s {
+	int stars; //'*' width and precision, each takes an int argument
+	int len;
+	char conv;
+};
+
+struct log_ring_s {
+	atomic_uint head; //written by the owning thread
+	atomic_uint tail; //written by the writer thread
+	atomic_uint dropped;
+	uint64_t rate_window_ns; //start of the current rate limit second
+	unsigned int rate_count[LOG_LEVELS + 1];
+	struct log_rec_s rec[LOG_RING_SIZE];
+};
+
 static int runtime_loglevel = 5;
+static int log_format = LOG_FMT_TEXT;
+static int log_timestamp = LOG_TS_WALL;
+static unsigned int log_rate[LOG_LEVELS + 1]; //messages/s, 0 unlimited
+
+static _Atomic(struct log_ring_s *) rings[LOG_MAX_RINGS];
+static atomic_int num_rings;
+static volatile int async_running;
+static pthread_t writer_thread;
+static int writer_core = -1;
+static void (*writer_wakeup)(void); //called after each sleep, may be NULL
+
+static __thread struct log_ring_s *my_ring;
+static __thread int my_ring_failed;
+
+static const char *level_names[LOG_LEVELS + 1] = {
+	"", "alert", "error", "info", "verbose", "debug"
+};
 
 int log_setlevel(int level)
 {
@@ -14,30 +85,491 @@ int log_setlevel(int level)
 	return level;
 }
 
+// Select text or key/value output and wall clock or monotonic timestamps
+void log_setformat(int format, int timestamp)
+{
+	log_format = format;
+	log_timestamp = timestamp;
+}
+
+// Limit all levels above error to per_sec messages per second and thread.
+// Alerts and errors are never limited. 0 removes the limit.
+void log_setrate(unsigned int per_sec)
+{
+	for (int i = 3; i <= LOG_LEVELS; i++)
+		log_rate[i] = per_sec;
+}
+
 char * mergetags(char *t, char *f, int l)
 {
-	static char taggbuff[180];
+	static __thread char taggbuff[180];
 
-	sprintf(taggbuff, "%s %s+%d", t, f, l);
+	snprintf(taggbuff, sizeof(taggbuff), "%s %s+%d", t, f, l);
 
 	return taggbuff;
 }
 
+static uint64_t clock_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Parse the conversion after a '%', returns the character after it
+static const char *log_spec(const char *p, struct log_spec_s *sp)
+{
+	sp->stars = 0;
+	sp->len = LEN_NONE;
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	if (*p == '*') {
+		sp->stars++;
+		p++;
+	}
+	while (isdigit((unsigned char)*p))
+		p++;
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			sp->stars++;
+			p++;
+		}
+		while (isdigit((unsigned char)*p))
+			p++;
+	}
+
+	switch (*p) {
+	case 'h':
+		sp->len = p[1] == 'h' ? LEN_HH : LEN_H;
+		break;
+	case 'l':
+		sp->len = p[1] == 'l' ? LEN_LL : LEN_L;
+		break;
+	case 'z':
+		sp->len = LEN_Z;
+		break;
+	case 'j':
+		sp->len = LEN_J;
+		break;
+	case 't':
+		sp->len = LEN_T;
+		break;
+	case 'L':
+		sp->len = LEN_BIG_L;
+		break;
+	}
+	if (sp->len != LEN_NONE)
+		p += sp->len == LEN_HH || sp->len == LEN_LL ? 2 : 1;
+
+	sp->conv = *p;
+
+	return *p ? p + 1 : p;
+}
+
+// Copy the arguments of format into r on the logging thread.
+// Returns 0, or -1 if the writer could not replay the format.
+static int log_capture(struct log_rec_s *r, const char *format, va_list args)
+{
+	const char *p = format;
+	int n = 0, strs = 0;
+
+	while ((p = strchr(p, '%')) != NULL) {
+		struct log_spec_s sp;
+		const char *end = log_spec(p + 1, &sp);
+
+		if (end - p >= LOG_SPEC_MAX)
+			return -1;
+		p = end;
+		if (sp.conv == '%')
+			continue;
+		if (n + sp.stars + 1 > LOG_ARGS_MAX)
+			return -1;
+		for (int s = 0; s < sp.stars; s++)
+			r->args[n++].i = va_arg(args, int);
+
+		if (strchr("diouxXc", sp.conv) != NULL) {
+			switch (sp.len) {
+			case LEN_L:
+				r->args[n++].i = va_arg(args, long);
+				break;
+			case LEN_LL:
+				r->args[n++].i = va_arg(args, long long);
+				break;
+			case LEN_Z:
+				r->args[n++].i = va_arg(args, size_t);
+				break;
+			case LEN_J:
+				r->args[n++].i = va_arg(args, intmax_t);
+				break;
+			case LEN_T:
+				r->args[n++].i = va_arg(args, ptrdiff_t);
+				break;
+			case LEN_BIG_L:
+				return -1;
+			default:
+				r->args[n++].i = va_arg(args, int);
+			}
+		} else if (strchr("eEfFgGaA", sp.conv) != NULL &&
+			   sp.len != LEN_BIG_L) {
+			r->args[n++].d = va_arg(args, double);
+		} else if (sp.conv == 'p') {
+			r->args[n++].p = va_arg(args, void *);
+		} else if (sp.conv == 's' && sp.len == LEN_NONE) {
+			const char *s = va_arg(args, const char *);
+			size_t len;
+
+			if (s == NULL) {
+				r->args[n++].str = -1;
+				continue;
+			}
+			len = strlen(s);
+			if (strs + len + 1 > LOG_MSG_MAX)
+				return -1;
+			memcpy(r->msg + strs, s, len + 1);
+			r->args[n++].str = strs;
+			strs += len + 1;
+		} else {
+			return -1; //%m, %n, wide strings
+		}
+	}
+
+	r->fmt = format;
+
+	return 0;
+}
+
+// Format a captured record into msg, on the writer thread. Each conversion
+// is formatted on its own with the argument cast back to its type.
+static void log_render(const struct log_rec_s *r, char *msg, size_t size)
+{
+	const char *f = r->fmt;
+	size_t pos = 0;
+	int n = 0;
+
+	while (*f && pos < size - 1) {
+		const char *pct = strchr(f, '%');
+		char spec[LOG_SPEC_MAX], *out;
+		struct log_spec_s sp;
+		const char *end;
+		size_t left, lit;
+		int w[2] = {0, 0}, len = 0;
+
+		lit = pct ? (size_t)(pct - f) : strlen(f);
+		if (lit > size - 1 - pos)
+			lit = size - 1 - pos;
+		memcpy(msg + pos, f, lit);
+		pos += lit;
+		if (pct == NULL || pos >= size - 1)
+			break;
+
+		end = log_spec(pct + 1, &sp);
+		memcpy(spec, pct, end - pct);
+		spec[end - pct] = '\0';
+		f = end;
+		for (int s = 0; s < sp.stars; s++)
+			w[s] = r->args[n++].i;
+		out = msg + pos;
+		left = size - pos;
+
+#define LOG_PUT(v) (sp.stars == 0 ? snprintf(out, left, spec, v) :		\
+		    sp.stars == 1 ? snprintf(out, left, spec, w[0], v) :	\
+		    snprintf(out, left, spec, w[0], w[1], v))
+
+		if (sp.conv == '%') {
+			len = snprintf(out, left, "%%");
+		} else if (strchr("diouxXc", sp.conv) != NULL) {
+			long long v = r->args[n++].i;
+
+			switch (sp.len) {
+			case LEN_L:
+				len = LOG_PUT((long)v);
+				break;
+			case LEN_LL:
+				len = LOG_PUT(v);
+				break;
+			case LEN_Z:
+				len = LOG_PUT((size_t)v);
+				break;
+			case LEN_J:
+				len = LOG_PUT((intmax_t)v);
+				break;
+			case LEN_T:
+				len = LOG_PUT((ptrdiff_t)v);
+				break;
+			default:
+				len = LOG_PUT((int)v);
+			}
+		} else if (sp.conv == 'p') {
+			len = LOG_PUT(r->args[n++].p);
+		} else if (sp.conv == 's') {
+			int str = r->args[n++].str;
+
+			len = LOG_PUT(str < 0 ? NULL : r->msg + str);
+		} else {
+			len = LOG_PUT(r->args[n++].d);
+		}
+#undef LOG_PUT
+
+		if (len < 0)
+			break;
+		pos += (size_t)len < left ? (size_t)len : left - 1;
+	}
+
+	msg[pos] = '\0';
+}
+
+static void log_emit(FILE *out, struct log_rec_s *r)
+{
+	char timestr[32], msg[LOG_MSG_MAX];
+
+	if (log_timestamp == LOG_TS_MONO) {
+		snprintf(timestr, sizeof(timestr), "%lu", r->mono_ns);
+	} else {
+		time_t now = r->real_ns / 1000000000ull;
+		struct tm tm;
+
+		localtime_r(&now, &tm);
+		strftime(timestr, sizeof(timestr), "%a %b %e %H:%M:%S %Y", &tm);
+	}
+
+	if (r->fmt)
+		log_render(r, msg, sizeof(msg));
+	else
+		snprintf(msg, sizeof(msg), "%s", r->msg);
+
+	if (log_format == LOG_FMT_KV) {
+		size_t len = strlen(msg);
+
+		if (len && msg[len - 1] == '\n')
+			msg[--len] = '\0';
+		for (size_t i = 0; i < len; i++) {
+			if (msg[i] == '"')
+				msg[i] = '\'';
+			else if (msg[i] == '\n')
+				msg[i] = ' ';
+		}
+		fprintf(out, "ts=\"%s\" level=%s tag=\"%s\" msg=\"%s\"\n", timestr,
+			level_names[r->level], r->tag, msg);
+	} else {
+		fprintf(out, "%d %s %s|%s", r->level, timestr, r->tag, msg);
+	}
+}
+
+static struct log_ring_s *ring_get(void)
+{
+	int idx;
+
+	if (my_ring || my_ring_failed)
+		return my_ring;
+
+	idx = atomic_fetch_add(&num_rings, 1);
+	if (idx >= LOG_MAX_RINGS) {
+		atomic_fetch_sub(&num_rings, 1);
+		my_ring_failed = 1;
+		return NULL;
+	}
+
+	my_ring = calloc(1, sizeof(*my_ring));
+	if (my_ring == NULL)
+		my_ring_failed = 1;
+	//publish after the ring is set up, the writer skips NULL slots
+	atomic_store(&rings[idx], my_ring);
+
+	return my_ring;
+}
+
+// Returns 1 if the message should be dropped due to the rate limit
+static int ring_ratelimit(struct log_ring_s *ring, int level, uint64_t now)
+{
+	if (log_rate[level] == 0)
+		return 0;
+
+	if (now - ring->rate_window_ns >= 1000000000ull) {
+		ring->rate_window_ns = now;
+		memset(ring->rate_count, 0, sizeof(ring->rate_count));
+	}
+
+	return ++ring->rate_count[level] > log_rate[level];
+}
+
 int loglevel(int level, char *tag, const char * format, ...)
 {
+	struct log_rec_s rec, *r = &rec;
+	struct log_ring_s *ring = NULL;
+	unsigned int head = 0;
+	uint64_t now;
+	va_list args, copy;
+	int len = 0;
+
 	if(level > runtime_loglevel)return 0;
 
-	time_t now = time(NULL);
-	char * timestr = ctime(&now);
-	timestr[strlen(timestr)-1] = '\0'; //remove newline
+	now = clock_ns(CLOCK_MONOTONIC);
+
+	if (async_running)
+		ring = ring_get();
+
+	if (ring) {
+		head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+		if (ring_ratelimit(ring, level, now) ||
+		    head - atomic_load_explicit(&ring->tail,
+						memory_order_acquire) >= LOG_RING_SIZE) {
+			atomic_fetch_add_explicit(&ring->dropped, 1,
+						  memory_order_relaxed);
+			return 0;
+		}
+		r = &ring->rec[head % LOG_RING_SIZE];
+	}
 
-	printf("%d %s %s|", level, timestr, tag);
-	va_list args;
+	r->mono_ns = now;
+	r->real_ns = clock_ns(CLOCK_REALTIME);
+	r->level = level;
+	strncpy(r->tag, tag, LOG_TAG_MAX - 1);
+	r->tag[LOG_TAG_MAX - 1] = '\0';
+	r->fmt = NULL;
 	va_start (args, format);
-	int r = vprintf (format, args);
+	va_copy(copy, args);
+	if (ring == NULL || log_capture(r, format, args) < 0) {
+		len = vsnprintf(r->msg, LOG_MSG_MAX, format, copy);
+	}
+	va_end(copy);
 	va_end (args);
 
-	return r;
+	if (ring)
+		atomic_store_explicit(&ring->head, head + 1,
+				      memory_order_release);
+	else
+		log_emit(stdout, r);
+
+	return len;
+}
+
+// Write everything queued so far, oldest first over all rings.
+// Returns number of records written
+static int log_drain(void)
+{
+	int n = atomic_load(&num_rings);
+	int written = 0;
+
+	for (int i = 0; i < n; i++) {
+		struct log_ring_s *ring = rings[i];
+		unsigned int dropped;
+
+		if (ring == NULL)
+			continue;
+		dropped = atomic_exchange_explicit(&ring->dropped, 0,
+						   memory_order_relaxed);
+		if (dropped) {
+			struct log_rec_s r = {
+				.mono_ns = clock_ns(CLOCK_MONOTONIC),
+				.real_ns = clock_ns(CLOCK_REALTIME),
+				.level = 2,
+				.tag = "LOG",
+				.fmt = NULL,
+			};
+
+			snprintf(r.msg, sizeof(r.msg), "%u messages dropped\n",
+				 dropped);
+			log_emit(stdout, &r);
+		}
+	}
+
+	while (1) {
+		struct log_ring_s *oldest = NULL;
+		struct log_rec_s *oldest_rec = NULL;
+
+		for (int i = 0; i < n; i++) {
+			struct log_ring_s *ring = rings[i];
+			unsigned int tail;
+
+			if (ring == NULL)
+				continue;
+			tail = atomic_load_explicit(&ring->tail,
+						    memory_order_relaxed);
+			if (tail == atomic_load_explicit(&ring->head,
+							 memory_order_acquire))
+				continue;
+			if (oldest_rec == NULL ||
+			    ring->rec[tail % LOG_RING_SIZE].mono_ns <
+			    oldest_rec->mono_ns) {
+				oldest = ring;
+				oldest_rec = &ring->rec[tail % LOG_RING_SIZE];
+			}
+		}
+
+		if (oldest == NULL)
+			break;
+
+		log_emit(stdout, oldest_rec);
+		atomic_fetch_add_explicit(&oldest->tail, 1,
+					  memory_order_release);
+		written++;
+	}
+
+	if (written)
+		fflush(stdout);
+
+	return written;
+}
+
+static void *log_writer_start(void *arg)
+{
+	struct timespec period = {0, LOG_FLUSH_MS * 1000000L};
+
+	(void)arg;
+
+	if (writer_core >= 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(writer_core, &cpuset);
+		pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+	}
+
+	while (async_running) {
+		nanosleep(&period, NULL);
+		if (writer_wakeup)
+			writer_wakeup();
+		log_drain();
+	}
+	log_drain();
+
+	return NULL;
+}
+
+// Move logging to a writer thread on core (-1 to leave it unpinned).
+// wakeup, if not NULL, runs on the writer after each sleep.
+// Returns 0 on success, -1 on failure, logging then stays synchronous
+int log_async_start(int core, void (*wakeup)(void))
+{
+	if (async_running)
+		return 0;
+
+	writer_core = core;
+	writer_wakeup = wakeup;
+	async_running = 1;
+	if (pthread_create(&writer_thread, NULL, &log_writer_start, NULL) != 0) {
+		async_running = 0;
+		return -1;
+	}
+	atexit(log_async_stop);
+
+	return 0;
+}
+
+// Flush all queued messages and go back to synchronous logging
+void log_async_stop(void)
+{
+	if (!async_running || pthread_equal(pthread_self(), writer_thread))
+		return;
+
+	async_running = 0;
+	pthread_join(writer_thread, NULL);
+	// messages queued while the writer was stopping
+	log_drain();
 }
 
 /*
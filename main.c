@@ -26,6 +26,13 @@
 #include "sysdetect.h"
 #include "pcie.h"
 #include "user_api.h"
+#include "ctrl_socket.h"
+#include "metrics.h"
+#include "trace.h"
+#include "abtest.h"
+#include "uncore.h"
+#include "l2cat.h"
+#include "memtier.h"
 
 #include "json_parser.h"
 
@@ -48,6 +55,8 @@ int ddr_bw_target = DDR_BW_NOT_SET; //MB/s (yes, bytes). Max _achievable_
 float time_intervall = 1.0; //one second by default
 int core_first = -1;
 int core_last = -1;
+int pcore_first = -1; //P-cores of a hybrid client, -1 when not tuned
+int pcore_last = -1;
 float aggr = 1.0; //retuning aggressiveness
 int tunealg = 0;
 uint32_t rdt_enabled = 0;
@@ -56,6 +65,13 @@ int pmu_method = PMU_RAW;
 int kernel_mode = 0;
 int enable_pmu_msg = 0;
 int enable_msr_msg = 0;
+int hk_core = -1; //housekeeping core for background threads
+char ctrl_path[108] = {0}; //control socket, empty when disabled
+char metrics_path[256] = {0}; //metrics file, empty when disabled
+char trace_path[256] = {0}; //decision trace file, empty when disabled
+char events_string[256] = {0}; //extra core PMU events, empty for the base set
+int l2cat_ways = 0; //largest L2 partition of a streaming core, 0 when off
+char tierbw_string[256] = {0}; //node:MB/s targets per memory tier
 
 //global runtime
 volatile int quitflag = 0;
@@ -69,10 +85,23 @@ int core_count;
 struct ddr_s ddr;
 uint64_t ddr_bar = 0;
 
+static volatile sig_atomic_t quit_signal;
+
+// Only async-signal-safe work here, the threads see quitflag and main()
+// logs and cleans up once they are done
 void sigintHandler(int sig_num)
 {
-	//rework this to wake up the other threads and clean them up in a nice way
-	loga(TAG, "sig %d, terminating dPF... hold on a second...\n", sig_num);
+	quit_signal = sig_num;
+	quitflag = 1;
+}
+
+// Log the signal that ended the run and free what the tuner allocated,
+// after the tuning threads have returned
+static void quit_cleanup(void)
+{
+	if (quit_signal)
+		loga(TAG, "sig %d, terminating dPF... hold on a second...\n",
+		     (int)quit_signal);
 
 	if (tunealg == MAB && (mstate.dynamic_sd == ON ||
 		mstate.dynamic_sd == STEP)) {
@@ -81,12 +110,6 @@ void sigintHandler(int sig_num)
 		mstate.ipc_buffer = NULL;
 		mstate.sd_buffer = NULL;
 	}
-
-	quitflag = 1;
-	//sleep(time_intervall * 2);
-	if (rdt_enabled)
-		rdt_mbm_reset();
-//	exit(1);
 }
 
 uint64_t time_ms(void)
@@ -99,6 +122,15 @@ uint64_t time_ms(void)
 	+((uint64_t)time.tv_sec * 1000ull);
 }
 
+uint64_t time_ns(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return (uint64_t)time.tv_nsec + (uint64_t)time.tv_sec * 1000000000ull;
+}
+
 
 int calculate_settings(void)
 {
@@ -119,6 +151,7 @@ static void *thread_start(void *arg)
 	uint64_t instructions_new = 0, instructions_old = 0;
 	uint64_t cpu_cycles_new = 0, cpu_cycles_old = 0;
 	int event_fds[MAX_EVENTS];
+	struct pmu_mux_s mux = {0};
 
 	logd(TAG, "Thread running on core %d, this is #%d core in the module\n", tstate->core_id, CORE_IN_MODULE);
 
@@ -132,7 +165,8 @@ static void *thread_start(void *arg)
 	if (s != 0)
 		loge(TAG, "Could not set thread affinity for coreid %d, pthread_setaffinity_np()\n", tstate->core_id);
 
-	if (ddr_bw_target == DDR_BW_AUTOTEST) {
+	// the bandwidth test runs on the E-cores only
+	if (!tstate->pcore && ddr_bw_target == DDR_BW_AUTOTEST) {
 		if (tstate->core_id == core_first) {
 			if (ddrmembw_init() < 0)
 				exit(-1);
@@ -160,89 +194,158 @@ static void *thread_start(void *arg)
 	}
 
 
-	msr_file = msr_init(tstate->core_id, tstate->hwpf_msr_value);
+	if (tstate->pcore)
+		msr_file = msr_pcore_init(tstate->core_id,
+					  tstate->hwpf_msr_value);
+	else
+		msr_file = msr_init(tstate->core_id, tstate->hwpf_msr_value);
 
-	msr_hwpf_write(msr_file, tstate->hwpf_msr_value);
+	memcpy(tstate->hwpf_msr_boot, tstate->hwpf_msr_value,
+	       sizeof(tstate->hwpf_msr_boot));
+
+	if (!tstate->pcore)
+		msr_hwpf_write(msr_file, tstate->hwpf_msr_value);
+	memcpy(tstate->hwpf_msr_written, tstate->hwpf_msr_value,
+	       sizeof(tstate->hwpf_msr_written));
 
 	msr_enable_fixed(msr_file);
 
-	// Initialize based on PMU method
-	if (pmu_method == PMU_RAW) {
-		pmu_core_config(msr_file);
+	// Initialize based on PMU method, the P-cores always count raw
+	if (tstate->pcore) {
+		pmu_pcore_config(msr_file);
+		for (int i = 0; i < PMU_CORE_EVENT_COUNT; i++)
+			mux.duty[i] = 1.0f;
+	} else if (pmu_method == PMU_RAW) {
+		pmu_core_config(msr_file, &mux);
 	} else if (pmu_method == PMU_PERF) {
 		perf_init(event_attrs, event_fds, num_events, tstate->core_id);
 	}
 
 	// Run until end of world...
 	while (quitflag == 0) {
-		usleep(time_intervall * 1000000);
+		// multiplexed raw events rotate once per slice
+		int slices = pmu_method == PMU_RAW ? pmu_mux_groups() : 1;
+
+		for (int i = 1; i < slices; i++) {
+			usleep(time_intervall * 1000000 / slices);
+			OVH_WAKEUP();
+			if (!tstate->pcore)
+				pmu_core_rotate(msr_file, &mux);
+		}
+		usleep(time_intervall * 1000000 / slices);
+		OVH_WAKEUP();
+		overhead_thread_sample(&tstate->ovh);
 		//logd(TAG, "1. Read Core PMU counters and update stats\n");
 
-		if (tunealg != MAB) {
-			for (int i = 0; i < PMU_COUNTERS; i++)
+		if (tunealg != MAB || pmu_derived) {
+			for (int i = 0; i < pmu_num_events; i++)
 				pmu_old[i] = pmu_new[i];
-		} else {
-			instructions_old = instructions_new;
-			cpu_cycles_old = cpu_cycles_new;
 		}
+		instructions_old = instructions_new;
+		cpu_cycles_old = cpu_cycles_new;
 
 		// Read PMU counters based on method
-		if (pmu_method == PMU_RAW) {
-			pmu_core_read(msr_file, pmu_new, &instructions_new, &cpu_cycles_new);
+		if (tstate->pcore) {
+			pmu_pcore_read(msr_file, pmu_new, &instructions_new,
+				       &cpu_cycles_new);
+		} else if (pmu_method == PMU_RAW) {
+			pmu_core_read(msr_file, &mux, pmu_new, &instructions_new,
+				      &cpu_cycles_new);
 		} else if (pmu_method == PMU_PERF) {
-			perf_read(event_fds, pmu_new, num_events);
+			perf_read(event_fds, pmu_new, num_events, &mux);
 			// Extract instructions and cycles like PMU_RAW
 			instructions_new =
 			    pmu_new[PERF_INDEX_EVENT_INSTRUCTIONS];
 			cpu_cycles_new = pmu_new[PERF_INDEX_EVENT_CYCLES];
 		}
 
-		if (tunealg != MAB) {
-			for (int i = 0; i < PMU_COUNTERS; i++)
+		if (tunealg != MAB || pmu_derived) {
+			for (int i = 0; i < pmu_num_events; i++) {
 				tstate->pmu_result[i] =
 				    pmu_new[i] - pmu_old[i];
-		} else {
-			tstate->instructions_retired =
-			    instructions_new - instructions_old;
-			tstate->cpu_cycles =
-			    cpu_cycles_new - cpu_cycles_old;
+				tstate->pmu_duty[i] = mux.duty[i];
+			}
 		}
+		tstate->instructions_retired =
+		    instructions_new - instructions_old;
+		tstate->cpu_cycles = cpu_cycles_new - cpu_cycles_old;
+		pmu_derive(tstate->pmu_result, tstate->cpu_cycles, &tstate->pf);
 
 		atomic_fetch_add(&syncflag, 1); // sync by increasing syncflag
 
 		//select out the master core
 		if (tstate->core_id == core_first) {
 			//wait for all threads
-			while (syncflag < ACTIVE_THREADS);
+			while (syncflag < ALL_THREADS);
+
+			uint64_t decision_start = time_ns();
+
+			// package energy of the same interval as the counters
+			if (uncore.num_packages > 0)
+				uncore_energy_sample();
 
-			calculate_settings();
+			ctrl_apply();
 
+			int tune = ab_interval();
+
+			if (ctrl_state.settle > 0)
+				ctrl_state.settle--;
+			else if (!ctrl_state.paused && tune)
+				calculate_settings();
+
+			uint64_t decision_ns = time_ns() - decision_start;
+
+			overhead_account(decision_ns);
+			metrics_publish(decision_ns);
+			ctrl_publish();
+			trace_record(decision_ns);
 
 			syncflag = 0; //done, release threads
-		} else if (CORE_IN_MODULE == 0) {
+		} else if (tstate->pcore || CORE_IN_MODULE == 0) {
 			//only the primary core per module needs to sync,
-			// rest can run free
+			// rest can run free. P-cores have an L2 each.
 			while (syncflag != 0);
 				//wait for decission to be made by master
 		}
 
 		//logd(TAG, "3. Use decission to update MSRs\n");
-		if (CORE_IN_MODULE == 0 && tstate->hwpf_msr_dirty == 1) {
+		if (tstate->pcore) {
+			if (tstate->hwpf_msr_dirty == 1) {
+				tstate->hwpf_msr_dirty = 0;
+				msr_hwpf_write_changed(msr_file,
+					ab_control(tstate - gtinfo) ?
+					tstate->hwpf_msr_boot :
+					tstate->hwpf_msr_value,
+					tstate->hwpf_msr_written);
+			}
+		} else if (CORE_IN_MODULE == 0 && tstate->hwpf_msr_dirty == 1) {
 			tstate->hwpf_msr_dirty = 0;
 
-			if (tunealg == MAB)
-				msr_hwpf_write(msr_file,
-					arms.hwpf_msr_values[mstate.arm]);
+			if (ab_control(tstate->core_id - core_first))
+				msr_hwpf_write_changed(msr_file,
+					tstate->hwpf_msr_boot,
+					tstate->hwpf_msr_written);
+			else if (tunealg == MAB &&
+				 ctrl_state.profile == CTRL_PROFILE_NONE)
+				msr_hwpf_write_changed(msr_file,
+					arms.hwpf_msr_values[mstate.arm],
+					tstate->hwpf_msr_written);
 			else
-				msr_hwpf_write(msr_file,
-					tstate->hwpf_msr_value);
+				msr_hwpf_write_changed(msr_file,
+					tstate->hwpf_msr_value,
+					tstate->hwpf_msr_written);
 		}
 	}
 
         // Before pthread_exit or return
-	if (pmu_method == PMU_PERF) {
+	if (pmu_method == PMU_PERF && !tstate->pcore) {
 		perf_deinit(event_fds, num_events);
 	}
+
+	// hand the P-core prefetchers back as they were found
+	if (tstate->pcore)
+		msr_hwpf_write_changed(msr_file, tstate->hwpf_msr_boot,
+				       tstate->hwpf_msr_written);
 	close(msr_file);
 	logi(TAG, "Thread on core %d done\n", tstate->core_id);
 
@@ -259,6 +362,13 @@ void print_usage(void)
 	printf(" -c --core - set cores to use dPF. Starting from core id 0, eg."
 	       " 8-15 for the 9th to 16th core.\n");
 	printf("   --core 8-15\n");
+	printf(" -C --pcores - also tune the P-cores of a hybrid client, their "
+	       "L2, L2 adjacent line,\n");
+	printf("   DCU and DCU IP prefetchers, auto or a range. The bandwidth "
+	       "controller (--alg 0\n");
+	printf("   and 1) throttles whichever core type causes most DRAM "
+	       "traffic. Default off.\n");
+	printf("   --pcores auto\n");
 	printf("\nDDR Bandwith is by default auto-detected based on DMI/BIOS"
 	       "information and target is set to 70%% of\n");
 	printf("theorethical max bandwidth which is typically the achivable "
@@ -274,6 +384,10 @@ void print_usage(void)
 	printf(" -D --ddrbw-set - set DDR bandwidth target in MB/s. This should"
 	       "be the max achievable.\n");
 	printf("   --ddrbw-set 46000\n");
+	printf(" -X --tierbw - bandwidth target in MB/s per memory tier, by a "
+	       "NUMA node of the tier.\n");
+	printf("   Default: --ddrbw-* for DDR, HMAT bandwidth for CXL\n");
+	printf("   --tierbw 2:30000\n");
 	printf("The -w or --weight argument can be used to set the priority "
 	       "level of each core.\n");
 	printf(" -w --weight - set core priorities by providing a "
@@ -298,13 +412,66 @@ void print_usage(void)
 	printf(" -p --perf - use perf events for PMU monitoring (default: "
 		"raw PMU)\n");
 	printf("  --perf\n");
+	printf(" -E --events - extra core PMU events, catalog names or "
+	       "name=code (umask<<8|event).\n");
+	printf("   pf_issued, pf_useful, pf_late and xq_reject feed the derived "
+	       "prefetch metrics\n");
+	printf("   topdown adds the memory-bound stall events of the model\n");
+	printf("   --events xq_reject,topdown,pf_useful=0x0124\n");
 	printf(" -a --aggr - set retune aggressiveness (0.1 - 5.0), default 1."
 		"0\n");
 	printf("   --aggr 2.0\n");
+	printf(" -O --overhead-cap - max dPF CPU time in percent of one core, "
+	       "the interval is\n");
+	printf("   lengthened while above it. Default off.\n");
+	printf("   --overhead-cap 0.1\n");
+	printf(" -W --l2cat - confine the L2 allocation of streaming cores to "
+	       "at most this many\n");
+	printf("   ways of their module (L2 CAT), sized with the prefetch depth "
+	       "of alg 0/1.\n");
+	printf("   Default off.\n");
+	printf("   --l2cat 4\n");
+	printf(" -N --arms - print the number of MAB arms mab_config.json gives "
+	       "on this CPU, after\n");
+	printf("   removing the arms that are duplicates here, and exit\n");
+	printf("   --arms\n");
+
+	printf("\n*** Runtime control:\n");
+	printf(" -S --socket - serve JSON line control requests on a Unix "
+	       "socket, e.g. pause/resume,\n");
+	printf("   switching alg, intervall and aggr, pinning an arm and "
+	       "querying state. Default off.\n");
+	printf("   --socket %s\n", CTRL_SOCKET_PATH);
+	printf(" -M --metrics - write Prometheus metrics for the node_exporter "
+	       "textfile collector. Default off.\n");
+	printf("   --metrics %s\n", METRICS_PATH);
+	printf(" -T --trace - write one CSV record per interval with the "
+	       "decision made, reward,\n");
+	printf("   DDR bandwidth and MSR changes. Default off.\n");
+	printf("   --trace dpf_trace.csv\n");
+	printf(" -B --ab - compare the tuned policy against the startup MSR "
+	       "values on the running\n");
+	printf("   workload. time alternates all modules in randomized "
+	       "slices, split keeps half\n");
+	printf("   of the modules on the startup values, not with --pcores. "
+	       "Optional :N sets the\n");
+	printf("   slice length in intervals, default %d. Default off.\n",
+	       AB_SLICE_INTERVALS);
+	printf("   --ab time:20\n");
+	printf(" -H --hkcore - core for background threads, default: first "
+	       "core outside of --core\n");
+	printf("   --hkcore 0\n");
 
 	printf("\n*** Misc:\n");
 	printf(" -l --log - set loglevel 1 - 5 (5=debug), default: 3\n");
 	printf("   --log 3\n");
+	printf(" -L --logfmt - log line format text or kv (key=value), "
+	       "optionally with monotonic\n");
+	printf("   ns timestamps, default: text\n");
+	printf("   --logfmt kv,mono\n");
+	printf(" -R --lograte - max info/verbose/debug messages per second and "
+	       "thread, default: no limit\n");
+	printf("   --lograte 20\n");
 	printf(" -h --help - lists these arguments\n");
 }
 
@@ -374,6 +541,7 @@ int main(int argc, char *argv[])
 
 	char weight_string[MAX_WEIGHT_STR_LEN] = {0};
 	float ddr_bw_auto_utilization = 0.7;
+	int count_arms = 0; //--arms, print the arms and exit
 
 	for (int i = 0; i < MAX_THREADS; i++)
 		core_priority[i] = MIN_PRIORITY;
@@ -382,6 +550,7 @@ int main(int argc, char *argv[])
 	loga(TAG, "This is the main file for the UU Hardware Prefetch and Control project\n");
 
 	signal(SIGINT, sigintHandler);
+	signal(SIGTERM, sigintHandler);
 
 	pcie_init();
 
@@ -402,6 +571,7 @@ int main(int argc, char *argv[])
 	while (1) {
 		static struct option long_options[] = {
 		    {"core", required_argument, 0, 'c'},
+		    {"pcores", required_argument, 0, 'C'},
 		    {"ddrbw-auto", required_argument, 0, 'd'},
 		    {"ddrbw-test", no_argument, 0, 't'},
 		    {"ddrbw-set", required_argument, 0, 'D'},
@@ -412,8 +582,20 @@ int main(int argc, char *argv[])
 		    {"weight", required_argument, 0, 'w'},
 		    {"kernelmode", no_argument, 0, 'k'},
 		    {"perf", no_argument, 0, 'p'},
+		    {"events", required_argument, 0, 'E'},
 		    {"msr", no_argument, 0, 'm'},
 		    {"pmu", no_argument, 0, 'P'},
+		    {"socket", required_argument, 0, 'S'},
+		    {"hkcore", required_argument, 0, 'H'},
+		    {"metrics", required_argument, 0, 'M'},
+		    {"trace", required_argument, 0, 'T'},
+		    {"ab", required_argument, 0, 'B'},
+		    {"overhead-cap", required_argument, 0, 'O'},
+		    {"l2cat", required_argument, 0, 'W'},
+		    {"tierbw", required_argument, 0, 'X'},
+		    {"arms", no_argument, 0, 'N'},
+		    {"logfmt", required_argument, 0, 'L'},
+		    {"lograte", required_argument, 0, 'R'},
 		    {"help", no_argument, 0, 'h'},
 		    {NULL, no_argument, 0, 0},
 		};
@@ -422,9 +604,9 @@ int main(int argc, char *argv[])
 		int c;
 
 		if (json_argc > 0) {
-			c = getopt_long(json_argc, json_argv, "c:d:tD:i:A:a:l:w:ph:kPm", long_options, &option_index);
+			c = getopt_long(json_argc, json_argv, "c:C:d:tD:i:A:a:l:w:pE:h:kPmNS:H:M:O:L:R:T:B:W:X:", long_options, &option_index);
 		} else {
-			c = getopt_long(argc, argv, "c:d:tD:i:A:a:l:w:ph:kPm",
+			c = getopt_long(argc, argv, "c:C:d:tD:i:A:a:l:w:pE:h:kPmNS:H:M:O:L:R:T:B:W:X:",
 					long_options, &option_index);
 		}
 
@@ -450,6 +632,32 @@ int main(int argc, char *argv[])
 			}
 			break;
 
+		case 'C': // pcores
+			if (strcmp(optarg, "auto") == 0) {
+				struct p_cores_layout_s p_cores;
+
+				p_cores = get_performance_core_ids();
+				pcore_first = p_cores.first_performance_core;
+				pcore_last = p_cores.last_performance_core;
+				if (pcore_first == -1) {
+					loge(TAG, "Error, no P-cores found, "
+						  "is this a hybrid client?\n");
+					return -1;
+				}
+			} else {
+				pcore_first = strtol(optarg, 0, 10);
+				if (strstr(optarg, "-") == NULL)
+					pcore_last = pcore_first;
+				else
+					pcore_last = strtol(strstr(optarg, "-")
+							    + 1, 0, 10);
+			}
+
+			logi(TAG, "P-cores: %d -> %d = %d threads\n",
+			     pcore_first, pcore_last,
+			     pcore_last - pcore_first + 1);
+			break;
+
 		case 'd': // ddrbw-auto
 			// override the 70% utilization factor
 			ddr_bw_auto_utilization = strtof(optarg, NULL);
@@ -488,6 +696,17 @@ int main(int argc, char *argv[])
 			log_setlevel(strtol(optarg, 0, 10));
 			break;
 
+		case 'L': // logfmt
+			log_setformat(strncmp(optarg, "kv", 2) == 0 ?
+				      LOG_FMT_KV : LOG_FMT_TEXT,
+				      strstr(optarg, "mono") ?
+				      LOG_TS_MONO : LOG_TS_WALL);
+			break;
+
+		case 'R': // lograte
+			log_setrate(strtol(optarg, 0, 10));
+			break;
+
 		case 'w': // weight
 			strncpy(weight_string, optarg, MAX_WEIGHT_STR_LEN - 1);
 			weight_string[MAX_WEIGHT_STR_LEN - 1] = '\0';
@@ -495,7 +714,10 @@ int main(int argc, char *argv[])
 
 		case 'p':
 			pmu_method = PMU_PERF;
-			perf_configure_events(event_attrs, &num_events);
+			break;
+
+		case 'E': // events
+			strncpy(events_string, optarg, sizeof(events_string) - 1);
 			break;
 
 		case 'm': // MSR
@@ -508,6 +730,43 @@ int main(int argc, char *argv[])
 			logi(TAG, "PMU logging enabled\n");
 			break;
 
+		case 'S': // socket
+			strncpy(ctrl_path, optarg, sizeof(ctrl_path) - 1);
+			break;
+
+		case 'O': // overhead-cap
+			ovh_cap_pct = strtof(optarg, NULL);
+			break;
+
+		case 'X': // tierbw
+			strncpy(tierbw_string, optarg, sizeof(tierbw_string) - 1);
+			break;
+
+		case 'N': // arms
+			count_arms = 1;
+			break;
+
+		case 'W': // l2cat
+			l2cat_ways = strtol(optarg, 0, 10);
+			break;
+
+		case 'M': // metrics
+			strncpy(metrics_path, optarg, sizeof(metrics_path) - 1);
+			break;
+
+		case 'T': // trace
+			strncpy(trace_path, optarg, sizeof(trace_path) - 1);
+			break;
+
+		case 'B': // ab
+			if (ab_parse(optarg) < 0)
+				return -1;
+			break;
+
+		case 'H': // hkcore
+			hk_core = strtol(optarg, 0, 10);
+			break;
+
 		case '?': // getopt returns unknown argument
 		case 'h': // help
 			print_usage();
@@ -523,6 +782,16 @@ int main(int argc, char *argv[])
 	if (json_argc > 0)
 		json_deinit(json_argv);
 
+	msr_layout_init();
+	if (count_arms) {
+		printf("Arms: %zu\n", mab_count_arms());
+		return 0;
+	}
+	if (pmu_events_parse(strlen(events_string) ? events_string : NULL) < 0)
+		return -1;
+	if (pmu_method == PMU_PERF)
+		perf_configure_events(event_attrs, &num_events);
+
 	//--core has not been used, so let's autodetect
 	if (core_first == -1 || core_last == -1) {
 		// auto-detect Atom E-cores and set first/last core to max
@@ -541,6 +810,31 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (pcore_first != -1) {
+		if (pcore_last < pcore_first ||
+		    (pcore_first <= core_last && pcore_last >= core_first)) {
+			loge(TAG, "Error, P-cores %d-%d overlap the E-cores "
+				  "%d-%d\n", pcore_first, pcore_last,
+			     core_first, core_last);
+			return -1;
+		}
+		if (ALL_THREADS > MAX_THREADS) {
+			loge(TAG, "Too many cores, max is %d\n", MAX_THREADS);
+			return -1;
+		}
+		logi(TAG, "P-core MSR layout %s, PMU events %s\n",
+		     msr_pcore_layout->sku, pmu_pcore_catalog->uarch);
+	}
+
+	if (hk_core == -1)
+		hk_core = get_housekeeping_core(core_first, core_last,
+						pcore_first, pcore_last);
+
+	// From here on log I/O is done by a writer thread on the housekeeping
+	// core, never on the tuned cores
+	if (log_async_start(hk_core, overhead_helper_sample) < 0)
+		loge(TAG, "Could not start log writer, logging synchronously\n");
+
 	// If weight was provided, parse the values into array
 	// core_priority[MAX_THREADS]
 	if (strlen(weight_string) != 0) {
@@ -639,15 +933,39 @@ int main(int argc, char *argv[])
 		if (kernel_tuning_control(1, tunealg, aggr) < 0)
 			return -1;
 
+		if (ctrl_path[0] != '\0' &&
+		    ctrl_socket_start(ctrl_path, hk_core, kernel_mode) < 0)
+			return -1;
+
+		if (metrics_path[0] != '\0')
+			logi(TAG, "--metrics is not supported in kernel mode\n");
+		if (trace_path[0] != '\0')
+			logi(TAG, "--trace is not supported in kernel mode\n");
+		if (ab_state.mode != AB_OFF)
+			logi(TAG, "--ab is not supported in kernel mode\n");
+		if (pcore_first != -1)
+			logi(TAG, "--pcores is not supported in kernel mode\n");
+		if (l2cat_ways > 0)
+			logi(TAG, "--l2cat is not supported in kernel mode\n");
+		if (tierbw_string[0] != '\0')
+			logi(TAG, "--tierbw is not supported in kernel mode\n");
+
+		// Without a terminal, e.g. under systemd, the control socket
+		// and signals are the only controls
+		int tty = isatty(STDIN_FILENO);
 		struct termios oldt, newt;
-		tcgetattr(STDIN_FILENO, &oldt);
-		newt = oldt;
-		newt.c_lflag &= ~(ICANON | ECHO);
-		tcsetattr(STDIN_FILENO, TCSANOW, &newt);
 
-		while (1) {
+		if (tty) {
+			tcgetattr(STDIN_FILENO, &oldt);
+			newt = oldt;
+			newt.c_lflag &= ~(ICANON | ECHO);
+			tcsetattr(STDIN_FILENO, TCSANOW, &newt);
+		}
+
+		while (quitflag == 0) {
 			usleep(100000);
-			if (kbhit()) {
+			ctrl_apply();
+			if (tty && kbhit()) {
 				int ch = getchar();
 				if (ch == 'q' || ch == 'Q') {
 					break;
@@ -680,7 +998,10 @@ int main(int argc, char *argv[])
 
 		}
 
-		tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+		if (tty)
+			tcsetattr(STDIN_FILENO, TCSANOW, &oldt);
+		quit_cleanup();
+		ctrl_socket_stop();
 
 		if (kernel_tuning_control(0, tunealg, aggr) < 0)
 			return -1;
@@ -691,10 +1012,38 @@ int main(int argc, char *argv[])
 	}
 
 
+	// Bandwidth targets per memory tier, off with only DDR
+	if (memtier_init(tierbw_string[0] ? tierbw_string : NULL,
+			 ddr_bw_auto_utilization) < 0)
+		return -1;
+
 	// Algorithm init
 	if (tunealg == 2)
 		mab_init(&mstate, ACTIVE_THREADS);
 
+	if (ab_init(ACTIVE_THREADS) < 0)
+		return -1;
+
+	// The partition follows the prefetch depth the primitive tuners set
+	if (l2cat_ways > 0) {
+		if (tunealg != 0 && tunealg != 1)
+			logi(TAG, "--l2cat is only supported with --alg 0 and 1\n");
+		else if (l2cat_init(l2cat_ways) < 0)
+			return -1;
+	}
+
+	if (ctrl_path[0] != '\0' &&
+	    ctrl_socket_start(ctrl_path, hk_core, kernel_mode) < 0)
+		return -1;
+
+	if (metrics_path[0] != '\0' &&
+	    metrics_init(metrics_path, hk_core, ACTIVE_THREADS) < 0)
+		return -1;
+
+	if (trace_path[0] != '\0' &&
+	    trace_init(trace_path, hk_core, ACTIVE_THREADS) < 0)
+		return -1;
+
 	// Initialization done - let's start running...
 
 	for (int tnum = 0; tnum <= (core_last - core_first); tnum++) {
@@ -703,11 +1052,30 @@ int main(int argc, char *argv[])
 			       &thread_start, &gtinfo[tnum]);
 	}
 
+	for (int tnum = 0; tnum < PCORE_THREADS; tnum++) {
+		struct thread_state *tstate = &gtinfo[ACTIVE_THREADS + tnum];
+
+		tstate->core_id = pcore_first + tnum;
+		tstate->pcore = 1;
+		pthread_create(&tstate->thread_id, NULL, &thread_start,
+			       tstate);
+	}
+
 	// Run forever or until all threads are returning, then we wrap up
 
 	void *ret;
 
-	pthread_join(gtinfo[0].thread_id, &ret);
+	for (int tnum = 0; tnum < ALL_THREADS; tnum++)
+		pthread_join(gtinfo[tnum].thread_id, &ret);
+	quit_cleanup();
+
+	ctrl_socket_stop();
+	metrics_deinit();
+	trace_deinit();
+	ab_deinit();
+	uncore_deinit();
+	l2cat_deinit();
+	memtier_deinit();
 
 	close(ddr.mem_file);
 
@@ -0,0 +1,683 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "common.h"
+#include "pmu_core.h"
+#include "log.h"
+#include "sysdetect.h"
+#include "memtier.h"
+
+#define TAG "MEMTIER"
+
+// Memory tiers for the bandwidth controller. Each NUMA node with memory is
+// mapped to a tier, the kernel's memory_tiering tiers when there are any,
+// else the nodes with CPUs (DDR) and the CXL ones. A node is CXL when a CXL
+// region backs its DAX device, or when it is CPU-less and the kernel tiers
+// it below DDR by abstract distance (HBM is not); CPU-less alone decides
+// only without kernel tiers. The DDR tier is counted by pmu_ddr as before, CXL nodes are mapped through
+// their DAX device and CXL region to the memdevs behind them, whose CXL
+// PMUs count the CXL.mem data flits. Each tier has its own bandwidth
+// target, from --tierbw or the HMAT bandwidth the kernel reports.
+
+struct memtier_s memtier = {.num_tiers = 0, .ddr_tier = 0, .cxl_hit = -1};
+
+// CXL PMU counters, one read and one write per memdev PMU
+static struct {
+	int tier;
+	int fd_rd;
+	int fd_wr;
+	uint64_t rd_old;
+	uint64_t wr_old;
+} pmu[MEMTIER_MAX_PMUS];
+static int num_pmus;
+
+static int module_of[MAX_THREADS]; //module of each tuned core, by shared L2
+
+static int read_line(const char *path, char *buf, size_t len)
+{
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL)
+		return -1;
+	if (fgets(buf, len, f) == NULL) {
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
+
+	return 0;
+}
+
+static long read_long(const char *path)
+{
+	char buf[64];
+
+	if (read_line(path, buf, sizeof(buf)) < 0)
+		return -1;
+
+	return strtol(buf, NULL, 0);
+}
+
+// 1 if n is in a list like "0-3,8", 0 if not
+static int list_has(const char *list, int n)
+{
+	const char *p = list;
+
+	while (*p) {
+		char *end;
+		long lo = strtol(p, &end, 10), hi = lo;
+
+		if (end == p)
+			break;
+		if (*end == '-')
+			hi = strtol(end + 1, &end, 10);
+		if (n >= lo && n <= hi)
+			return 1;
+		p = *end == ',' ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+static int node_index(int node)
+{
+	for (int i = 0; i < memtier.num_nodes; i++) {
+		if (memtier.node[i].node == node)
+			return i;
+	}
+
+	return -1;
+}
+
+// Nodes with memory, and whether they have CPUs
+static int find_nodes(void)
+{
+	char path[PATH_MAX], list[1024];
+
+	if (read_line(MEMTIER_NODE_SYSFS "/has_memory", list, sizeof(list)) < 0)
+		return -1;
+
+	for (int n = 0; n < MEMTIER_MAX_NODES * 16 &&
+	     memtier.num_nodes < MEMTIER_MAX_NODES; n++) {
+		struct memtier_node_s *node;
+		char cpus[1024];
+
+		if (!list_has(list, n))
+			continue;
+		node = &memtier.node[memtier.num_nodes++];
+		node->node = n;
+		node->tier = -1;
+		snprintf(path, sizeof(path), MEMTIER_NODE_SYSFS "/node%d/cpulist",
+			 n);
+		node->cpuless = read_line(path, cpus, sizeof(cpus)) == 0 &&
+				cpus[0] == '\0';
+		node->cxl = 0;
+		strcpy(node->device, node->cpuless ? "" : "ddr");
+	}
+
+	return memtier.num_nodes;
+}
+
+// The memdev behind an endpoint decoder "decoderE.D", the uport of
+// endpoint port E
+static int decoder_memdev(const char *decoder, char *memdev, size_t len)
+{
+	char path[PATH_MAX], real[PATH_MAX];
+	int port;
+
+	if (sscanf(decoder, "decoder%d.", &port) != 1)
+		return -1;
+	snprintf(path, sizeof(path), MEMTIER_CXL_SYSFS "/endpoint%d/uport",
+		 port);
+	if (realpath(path, real) == NULL)
+		return -1;
+	snprintf(memdev, len, "%s", strrchr(real, '/') + 1);
+
+	return strncmp(memdev, "mem", 3) == 0 ? 0 : -1;
+}
+
+// Node -> DAX device -> CXL region -> endpoint decoders -> memdevs
+static void map_cxl_devices(void)
+{
+	DIR *dir = opendir(MEMTIER_DAX_SYSFS);
+	struct dirent *de;
+
+	if (dir == NULL)
+		return;
+
+	while ((de = readdir(dir)) != NULL) {
+		char path[PATH_MAX], real[PATH_MAX];
+		char *region;
+		int n;
+
+		if (strncmp(de->d_name, "dax", 3) != 0)
+			continue;
+		snprintf(path, sizeof(path), MEMTIER_DAX_SYSFS "/%s/target_node",
+			 de->d_name);
+		n = node_index(read_long(path));
+		if (n < 0)
+			continue;
+
+		snprintf(path, sizeof(path), MEMTIER_DAX_SYSFS "/%s", de->d_name);
+		if (realpath(path, real) == NULL)
+			continue;
+		region = strstr(real, "/region");
+		if (region == NULL)
+			continue; //not CXL, e.g. an HMEM range
+		region = strtok(region + 1, "/");
+
+		memtier.node[n].cxl = 1;
+		for (int t = 0; ; t++) {
+			char decoder[64], memdev[32];
+			struct memtier_node_s *node = &memtier.node[n];
+
+			snprintf(path, sizeof(path), MEMTIER_CXL_SYSFS "/%s/target%d",
+				 region, t);
+			if (read_line(path, decoder, sizeof(decoder)) < 0)
+				break;
+			if (decoder[0] == '\0' ||
+			    decoder_memdev(decoder, memdev, sizeof(memdev)) < 0)
+				continue;
+			if (strlen(node->device) + strlen(memdev) + 2 >
+			    sizeof(node->device))
+				break;
+			if (node->device[0] != '\0')
+				strcat(node->device, " ");
+			strcat(node->device, memdev);
+		}
+	}
+
+	closedir(dir);
+}
+
+// Kernel memory tier of a node, -1 if the kernel has not tiered it. The
+// tier id is the abstract distance in chunks, slower memory has a higher id.
+static int kernel_tier(int node)
+{
+	DIR *dir = opendir(MEMTIER_SYSFS);
+	struct dirent *de;
+	int id = -1;
+
+	while (dir != NULL && (de = readdir(dir)) != NULL) {
+		char path[PATH_MAX], list[1024];
+
+		if (strncmp(de->d_name, "memory_tier", 11) != 0)
+			continue;
+		snprintf(path, sizeof(path), MEMTIER_SYSFS "/%s/nodelist",
+			 de->d_name);
+		if (read_line(path, list, sizeof(list)) == 0 &&
+		    list_has(list, node)) {
+			id = atoi(de->d_name + 11);
+			break;
+		}
+	}
+	if (dir != NULL)
+		closedir(dir);
+
+	return id;
+}
+
+// CPU-less nodes without a CXL region, e.g. HBM or an HMEM range. They are
+// CXL when the kernel tiers them below the nodes with CPUs, by abstract
+// distance. Without kernel tiers, CPU-less is all there is to go on.
+static void classify_cpuless(void)
+{
+	int ddr_id = -1;
+
+	for (int i = 0; i < memtier.num_nodes; i++) {
+		if (!memtier.node[i].cpuless) {
+			ddr_id = kernel_tier(memtier.node[i].node);
+			break;
+		}
+	}
+
+	for (int i = 0; i < memtier.num_nodes; i++) {
+		struct memtier_node_s *node = &memtier.node[i];
+		int id;
+
+		if (!node->cpuless || node->cxl)
+			continue;
+		id = kernel_tier(node->node);
+		if (id >= 0 && ddr_id >= 0)
+			node->cxl = id > ddr_id;
+		else
+			node->cxl = 1;
+	}
+}
+
+static int add_tier(int id, int cxl)
+{
+	struct memtier_tier_s *t;
+
+	if (memtier.num_tiers == MEMTIER_MAX_TIERS)
+		return -1;
+	t = &memtier.tier[memtier.num_tiers];
+	memset(t, 0, sizeof(*t));
+	t->id = id;
+	t->cxl = cxl;
+
+	return memtier.num_tiers++;
+}
+
+// The kernel's memory tiers, else DDR and CXL. A tier is either DDR or
+// CXL, they are counted by different PMUs.
+static int group_tiers(void)
+{
+	DIR *dir = opendir(MEMTIER_SYSFS);
+	struct dirent *de;
+
+	while (dir != NULL && (de = readdir(dir)) != NULL) {
+		char path[PATH_MAX], list[1024];
+
+		if (strncmp(de->d_name, "memory_tier", 11) != 0)
+			continue;
+		snprintf(path, sizeof(path), MEMTIER_SYSFS "/%s/nodelist",
+			 de->d_name);
+		if (read_line(path, list, sizeof(list)) < 0)
+			continue;
+
+		// DDR and CXL are counted apart even in one kernel tier
+		for (int cxl = 0; cxl <= 1; cxl++) {
+			int tier = -1;
+
+			for (int i = 0; i < memtier.num_nodes; i++) {
+				struct memtier_node_s *node = &memtier.node[i];
+
+				if (!list_has(list, node->node) ||
+				    node->cxl != cxl)
+					continue;
+				if (tier < 0)
+					tier = add_tier(atoi(de->d_name + 11),
+							cxl);
+				if (tier < 0) {
+					closedir(dir);
+					return -1;
+				}
+				node->tier = tier;
+			}
+		}
+	}
+	if (dir != NULL)
+		closedir(dir);
+
+	// Nodes the kernel has not tiered
+	for (int cxl = 0; cxl <= 1; cxl++) {
+		int tier = -1;
+
+		for (int i = 0; i < memtier.num_nodes; i++) {
+			struct memtier_node_s *node = &memtier.node[i];
+
+			if (node->tier >= 0 || node->cxl != cxl)
+				continue;
+			if (tier < 0)
+				tier = add_tier(-1, cxl);
+			if (tier < 0)
+				return -1;
+			node->tier = tier;
+		}
+	}
+
+	// pmu_ddr counts the tier with the DDR nodes
+	for (int i = 0; i < memtier.num_nodes; i++) {
+		if (!memtier.node[i].cxl) {
+			memtier.ddr_tier = memtier.node[i].tier;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+// perf config for a named event of a PMU, from its sysfs event alias
+// (e.g. "vid=0x1e98,gid=0x10,mask=0x1") and format (e.g. "config:0-31")
+static int pmu_event_config(const char *pmu_name, const char *event,
+			    struct perf_event_attr *attr)
+{
+	char path[PATH_MAX], alias[256];
+	char *term, *save;
+
+	snprintf(path, sizeof(path), MEMTIER_PMU_SYSFS "/%s/events/%s",
+		 pmu_name, event);
+	if (read_line(path, alias, sizeof(alias)) < 0)
+		return -1;
+
+	for (term = strtok_r(alias, ",", &save); term != NULL;
+	     term = strtok_r(NULL, ",", &save)) {
+		char *eq = strchr(term, '=');
+		char format[64], *colon;
+		uint64_t value = 1, *config;
+		int lo, hi;
+
+		if (eq != NULL) {
+			*eq = '\0';
+			value = strtoull(eq + 1, NULL, 0);
+		}
+		snprintf(path, sizeof(path), MEMTIER_PMU_SYSFS "/%s/format/%s",
+			 pmu_name, term);
+		if (read_line(path, format, sizeof(format)) < 0)
+			return -1;
+		colon = strchr(format, ':');
+		if (colon == NULL)
+			return -1;
+		*colon = '\0';
+		if (sscanf(colon + 1, "%d-%d", &lo, &hi) == 1)
+			hi = lo;
+
+		if (strcmp(format, "config") == 0)
+			config = (uint64_t *)&attr->config;
+		else if (strcmp(format, "config1") == 0)
+			config = (uint64_t *)&attr->config1;
+		else if (strcmp(format, "config2") == 0)
+			config = (uint64_t *)&attr->config2;
+		else
+			return -1;
+		*config |= (value & (hi - lo == 63 ? ~0ULL :
+			    (1ULL << (hi - lo + 1)) - 1)) << lo;
+	}
+
+	return 0;
+}
+
+static int pmu_open(const char *pmu_name, const char *event)
+{
+	char path[PATH_MAX], cpus[64];
+	struct perf_event_attr attr;
+	long type;
+	int fd;
+
+	snprintf(path, sizeof(path), MEMTIER_PMU_SYSFS "/%s/type", pmu_name);
+	type = read_long(path);
+	snprintf(path, sizeof(path), MEMTIER_PMU_SYSFS "/%s/cpumask", pmu_name);
+	if (type < 0 || read_line(path, cpus, sizeof(cpus)) < 0)
+		return -1;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	if (pmu_event_config(pmu_name, event, &attr) < 0) {
+		logd(TAG, "%s has no %s event\n", pmu_name, event);
+		return -1;
+	}
+
+	fd = syscall(__NR_perf_event_open, &attr, -1, atoi(cpus), -1, 0);
+	if (fd < 0)
+		loge(TAG, "Could not open %s/%s/\n", pmu_name, event);
+
+	return fd;
+}
+
+// 0 and the count, or -1 if the counter could not be read
+static int pmu_count(int fd, uint64_t *count)
+{
+	int ret = 0;
+
+	*count = 0;
+	if (fd >= 0) {
+		ret = read(fd, count, sizeof(*count)) == sizeof(*count) ? 0 : -1;
+		OVH_SYSCALL(1);
+	}
+
+	return ret;
+}
+
+// CXL PMUs are named cxl_pmu_mem<memdev>.<instance>
+static void open_cxl_pmus(void)
+{
+	DIR *dir = opendir(MEMTIER_PMU_SYSFS);
+	struct dirent *de;
+
+	if (dir == NULL)
+		return;
+
+	while ((de = readdir(dir)) != NULL && num_pmus < MEMTIER_MAX_PMUS) {
+		char memdev[32];
+		int tier = -1;
+
+		if (strncmp(de->d_name, "cxl_pmu_", 8) != 0)
+			continue;
+		snprintf(memdev, sizeof(memdev), "%s", de->d_name + 8);
+		memdev[strcspn(memdev, ".")] = '\0';
+
+		for (int i = 0; i < memtier.num_nodes; i++) {
+			char devs[MEMTIER_DEVICE_LEN], *d, *save;
+
+			strcpy(devs, memtier.node[i].device);
+			for (d = strtok_r(devs, " ", &save); d != NULL;
+			     d = strtok_r(NULL, " ", &save)) {
+				if (strcmp(d, memdev) == 0)
+					tier = memtier.node[i].tier;
+			}
+		}
+		if (tier < 0)
+			continue;
+
+		pmu[num_pmus].tier = tier;
+		pmu[num_pmus].fd_rd = pmu_open(de->d_name, MEMTIER_CXL_RD_EVENT);
+		pmu[num_pmus].fd_wr = pmu_open(de->d_name, MEMTIER_CXL_WR_EVENT);
+		if (pmu[num_pmus].fd_rd < 0) {
+			if (pmu[num_pmus].fd_wr >= 0)
+				close(pmu[num_pmus].fd_wr);
+			continue;
+		}
+		pmu_count(pmu[num_pmus].fd_rd, &pmu[num_pmus].rd_old);
+		pmu_count(pmu[num_pmus].fd_wr, &pmu[num_pmus].wr_old);
+		memtier.tier[tier].num_pmus++;
+		logv(TAG, "%s counts tier %d\n", de->d_name, tier);
+		num_pmus++;
+	}
+
+	closedir(dir);
+}
+
+// HMAT read bandwidth of the tier's nodes from their local CPUs, MB/s
+static int hmat_bandwidth(int tier)
+{
+	int total = 0;
+
+	for (int i = 0; i < memtier.num_nodes; i++) {
+		char path[PATH_MAX];
+		long bw;
+
+		if (memtier.node[i].tier != tier)
+			continue;
+		snprintf(path, sizeof(path), MEMTIER_NODE_SYSFS
+			 "/node%d/access0/initiators/read_bandwidth",
+			 memtier.node[i].node);
+		bw = read_long(path);
+		if (bw <= 0)
+			return 0;
+		total += bw;
+	}
+
+	return total;
+}
+
+// "node:MB/s,..." sets the target of the tier holding node
+static int parse_targets(const char *targets)
+{
+	char buf[256];
+	char *tok, *save;
+
+	strncpy(buf, targets, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+
+	for (tok = strtok_r(buf, ",", &save); tok != NULL;
+	     tok = strtok_r(NULL, ",", &save)) {
+		int node, mbps, n;
+
+		if (sscanf(tok, "%d:%d", &node, &mbps) != 2 || mbps <= 0) {
+			loge(TAG, "Invalid tier target '%s', node:MB/s\n", tok);
+			return -1;
+		}
+		n = node_index(node);
+		if (n < 0) {
+			loge(TAG, "No memory on node %d\n", node);
+			return -1;
+		}
+		memtier.tier[memtier.node[n].tier].target = mbps;
+	}
+
+	return 0;
+}
+
+// Map the nodes to tiers and set a target per tier. The DDR tier keeps
+// ddr_bw_target unless targets sets it, the others get their HMAT bandwidth
+// times utilization. Tiering is off, and everything as before, with a
+// single tier.
+int memtier_init(const char *targets, float utilization)
+{
+	if (find_nodes() <= 0) {
+		logd(TAG, "No NUMA memory information\n");
+		return 0;
+	}
+	map_cxl_devices();
+	classify_cpuless();
+	if (group_tiers() < 0) {
+		loge(TAG, "Too many memory tiers, max is %d\n",
+		     MEMTIER_MAX_TIERS);
+		return -1;
+	}
+
+	if (memtier.num_tiers < 2) {
+		memtier.num_tiers = 0;
+		if (targets != NULL)
+			logi(TAG, "One memory tier, --tierbw ignored\n");
+		return 0;
+	}
+
+	memtier.tier[memtier.ddr_tier].target = ddr_bw_target;
+	for (int t = 0; t < memtier.num_tiers; t++) {
+		if (t != memtier.ddr_tier)
+			memtier.tier[t].target = hmat_bandwidth(t) * utilization;
+	}
+	if (targets != NULL && parse_targets(targets) < 0)
+		return -1;
+
+	open_cxl_pmus();
+	memtier.cxl_hit = pmu_event_index("cxl_hit");
+	get_core_modules(core_first, ACTIVE_THREADS, module_of);
+
+	for (int i = 0; i < memtier.num_nodes; i++) {
+		struct memtier_node_s *node = &memtier.node[i];
+
+		logi(TAG, "Node %d: tier %d (%s) on %s\n", node->node,
+		     node->tier, node->cxl ? "CXL" : "DDR",
+		     node->device[0] ? node->device : "unknown devices");
+	}
+	for (int t = 0; t < memtier.num_tiers; t++) {
+		struct memtier_tier_s *tier = &memtier.tier[t];
+
+		if (t != memtier.ddr_tier && tier->num_pmus == 0)
+			tier->target = 0;
+		logi(TAG, "Tier %d: target %d MB/s%s\n", t, tier->target,
+		     tier->target ? "" : ", no counters or target, not throttled on");
+	}
+	if (memtier.cxl_hit < 0)
+		logi(TAG, "No cxl_hit event, a saturated tier throttles all "
+			  "cores\n");
+
+	return 0;
+}
+
+// Bandwidth per tier over the last interval, the DDR tier from pmu_ddr
+void memtier_sample(double ddr_rd_percent, float time_delta)
+{
+	if (memtier.num_tiers == 0)
+		return;
+
+	for (int t = 0; t < memtier.num_tiers; t++) {
+		memtier.tier[t].rd_bytes = 0;
+		memtier.tier[t].wr_bytes = 0;
+		memtier.tier[t].rd_percent = 0;
+	}
+
+	for (int i = 0; i < num_pmus; i++) {
+		struct memtier_tier_s *tier = &memtier.tier[pmu[i].tier];
+		uint64_t rd, wr;
+
+		// A failed read keeps the old counts, the next sample spans both
+		// intervals rather than underflowing
+		if (pmu_count(pmu[i].fd_rd, &rd) < 0 ||
+		    pmu_count(pmu[i].fd_wr, &wr) < 0) {
+			logd(TAG, "Could not read CXL PMU %d, sample skipped\n", i);
+			continue;
+		}
+		tier->rd_bytes += (rd - pmu[i].rd_old) * 64;
+		tier->wr_bytes += (wr - pmu[i].wr_old) * 64;
+		pmu[i].rd_old = rd;
+		pmu[i].wr_old = wr;
+	}
+
+	for (int t = 0; t < memtier.num_tiers; t++) {
+		struct memtier_tier_s *tier = &memtier.tier[t];
+
+		if (t == memtier.ddr_tier)
+			tier->rd_percent = ddr_rd_percent;
+		else if (tier->target > 0 && time_delta > 0)
+			tier->rd_percent = (double)tier->rd_bytes / MEGABYTE /
+				tier->target / time_delta;
+		logd(TAG, "Tier %d: %.1f percent rd bw (%lu MB/s)\n", t,
+		     tier->rd_percent * 100,
+		     (uint64_t)(tier->rd_bytes / MEGABYTE / (time_delta > 0 ?
+								time_delta : 1)));
+	}
+}
+
+// Bandwidth use the tuner acts on for a core: that of the most saturated
+// tier its module loads from, so only modules that use a saturated tier
+// are throttled. The prefetchers are set per module.
+double memtier_core_percent(int thread, double ddr_rd_percent)
+{
+	uint64_t dram = 0, cxl = 0;
+	double percent = 0;
+	double cxl_share;
+
+	if (memtier.num_tiers == 0)
+		return ddr_rd_percent;
+
+	if (memtier.cxl_hit >= 0) {
+		for (int i = 0; i < ACTIVE_THREADS; i++) {
+			if (module_of[i] != module_of[thread])
+				continue;
+			dram += gtinfo[i].pmu_result[PMU_EV_DRAM_HIT];
+			cxl += gtinfo[i].pmu_result[memtier.cxl_hit];
+		}
+		if (dram == 0)
+			return ddr_rd_percent;
+	}
+	cxl_share = dram ? (double)cxl / dram : 0;
+	if (cxl_share > 1.0)
+		cxl_share = 1.0;
+
+	for (int t = 0; t < memtier.num_tiers; t++) {
+		struct memtier_tier_s *tier = &memtier.tier[t];
+		double share = tier->cxl ? cxl_share : 1.0 - cxl_share;
+
+		// unknown without cxl_hit, count the module on every tier
+		if (memtier.cxl_hit < 0)
+			share = 1.0;
+		if (share >= MEMTIER_MIN_SHARE && tier->rd_percent > percent)
+			percent = tier->rd_percent;
+	}
+
+	return percent;
+}
+
+void memtier_deinit(void)
+{
+	for (int i = 0; i < num_pmus; i++) {
+		close(pmu[i].fd_rd);
+		if (pmu[i].fd_wr >= 0)
+			close(pmu[i].fd_wr);
+	}
+	num_pmus = 0;
+	memtier.num_tiers = 0;
+}
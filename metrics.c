@@ -0,0 +1,507 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "common.h"
+#include "mab.h"
+#include "pmu_ddr.h"
+#include "ctrl_socket.h"
+#include "metrics.h"
+
+#define TAG "METRICS"
+
+// Prometheus text exporter, written as a node_exporter textfile collector
+// file. The master core copies its view of the tuner into a snapshot once
+// per interval (metrics_publish()), the exporter thread on the housekeeping
+// core does all formatting and file I/O. The two snapshot buffers are
+// sequence counted so neither side ever takes a lock.
+
+static struct metrics_snapshot_s *snap[2];
+static struct metrics_snapshot_s *snap_copy; //exporter private
+static size_t snap_size;
+static atomic_uint snap_gen; //number of published snapshots
+
+static char metrics_path[256];
+static char metrics_tmp_path[sizeof(metrics_path) + 4];
+static int metrics_hk_core = -1;
+static volatile int metrics_running;
+static pthread_t metrics_thread;
+
+// Master core side state between publishes
+static uint64_t last_time_ns;
+static uint64_t last_ddr_rd, last_ddr_wr;
+static double jitter_max;
+
+extern volatile int quitflag;
+
+// Decoded MSR fields exported next to the raw register values
+static const struct {
+	const char *name;
+	int (*get)(union msr_u msr[]);
+} msr_fields[] = {
+	{"l2xq", msr_get_l2xq},
+	{"l3xq", msr_get_l3xq},
+	{"l2maxdist", msr_get_l2maxdist},
+	{"l3maxdist", msr_get_l3maxdist},
+	{"l2dd", msr_get_l2dd},
+	{"l3dd", msr_get_l3dd},
+	{"l2llcxq", msr_get_l2llcxq},
+	{"llcoff", msr_get_llcoff},
+	{"nlpoff", msr_get_nlpoff},
+};
+
+static const char *msr_names[HWPF_MSR_FIELDS] = {
+	"0x1320", "0x1321", "0x1322", "0x1323", "0x1324", "0x1a4"
+};
+
+// Fill the unpublished snapshot from the master core.
+// decision_ns is the time calculate_settings() took this interval.
+void metrics_publish(uint64_t decision_ns)
+{
+	struct metrics_snapshot_s *s;
+	unsigned int gen;
+	uint64_t now, ddr_rd, ddr_wr;
+
+	if (snap[0] == NULL)
+		return;
+
+	gen = atomic_load_explicit(&snap_gen, memory_order_relaxed);
+	s = snap[(gen + 1) & 1];
+
+	atomic_fetch_add_explicit(&s->seq, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	now = time_ns();
+	s->time_ns = now;
+	s->intervals = gen + 1;
+	s->tunealg = tunealg;
+	s->paused = ctrl_state.paused;
+	s->intervall = time_intervall;
+	s->interval_s = last_time_ns ? (now - last_time_ns) / 1e9 : 0;
+	if (last_time_ns && s->interval_s - time_intervall > jitter_max)
+		jitter_max = s->interval_s - time_intervall;
+	s->jitter_max_s = jitter_max;
+	s->decision_s = decision_ns / 1e9;
+	s->overhead_pct = ovh_last.core_pct;
+
+	s->ddr_rd_bw = -1;
+	s->ddr_wr_bw = -1;
+	if (!rdt_enabled && ddr.ddr_interface_type != DDR_NONE) {
+		ddr_rd = pmu_ddr_total(&ddr, DDR_PMU_RD);
+		ddr_wr = pmu_ddr_total(&ddr, DDR_PMU_WR);
+		if (last_time_ns && s->interval_s > 0) {
+			s->ddr_rd_bw = (ddr_rd - last_ddr_rd) / s->interval_s;
+			s->ddr_wr_bw = (ddr_wr - last_ddr_wr) / s->interval_s;
+		}
+		last_ddr_rd = ddr_rd;
+		last_ddr_wr = ddr_wr;
+	}
+	last_time_ns = now;
+
+	s->num_arms = 0;
+	if (tunealg == MAB) {
+		s->arm = mstate.arm;
+		s->num_arms = mstate.num_arms;
+		memcpy(s->rewards, arms.rewards, sizeof(float) * s->num_arms);
+		memcpy(s->nums, arms.nums, sizeof(float) * s->num_arms);
+	}
+
+	s->ab_mode = ab_state.mode;
+	s->ab_slices = ab_state.slices;
+	for (int m = 0; m < AB_METRICS; m++)
+		ab_effect(m, &s->ab[m]);
+
+	for (int i = 0; i < s->num_cores; i++) {
+		struct metrics_core_s *c = &s->core[i];
+
+		c->core_id = gtinfo[i].core_id;
+		c->instructions = gtinfo[i].instructions_retired;
+		c->cycles = gtinfo[i].cpu_cycles;
+		memcpy(c->pmu, gtinfo[i].pmu_result, sizeof(c->pmu));
+		memcpy(c->pmu_duty, gtinfo[i].pmu_duty, sizeof(c->pmu_duty));
+		c->pf = gtinfo[i].pf;
+		c->ovh = gtinfo[i].ovh;
+		if (ab_control(i))
+			memcpy(c->msr, gtinfo[i].hwpf_msr_boot, sizeof(c->msr));
+		else if (tunealg == MAB &&
+			 ctrl_state.profile == CTRL_PROFILE_NONE)
+			memcpy(c->msr, arms.hwpf_msr_values[mstate.arm],
+			       sizeof(c->msr));
+		else
+			memcpy(c->msr, gtinfo[i].hwpf_msr_value, sizeof(c->msr));
+	}
+
+	atomic_thread_fence(memory_order_release);
+	atomic_fetch_add_explicit(&s->seq, 1, memory_order_relaxed);
+	atomic_store_explicit(&snap_gen, gen + 1, memory_order_release);
+}
+
+// Copy the latest published snapshot into snap_copy.
+// Returns 0 on success, -1 if nothing has been published yet
+static int snapshot_read(void)
+{
+	struct metrics_snapshot_s *s;
+	unsigned int gen, seq;
+
+	do {
+		gen = atomic_load_explicit(&snap_gen, memory_order_acquire);
+		if (gen == 0)
+			return -1;
+		s = snap[gen & 1];
+		seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+		if (seq & 1)
+			continue;
+		memcpy(snap_copy, s, snap_size);
+		atomic_thread_fence(memory_order_acquire);
+	} while (atomic_load_explicit(&s->seq, memory_order_relaxed) != seq);
+
+	return 0;
+}
+
+static void write_header(FILE *f, const char *name, const char *type,
+			 const char *help)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// One derived metric per core, cores without the events are left out
+static void write_pf_metric(FILE *f, struct metrics_snapshot_s *s,
+			    const char *name, const char *help, size_t offset)
+{
+	write_header(f, name, "gauge", help);
+	for (int i = 0; i < s->num_cores; i++) {
+		float v = *(float *)((char *)&s->core[i].pf + offset);
+
+		if (!isnan(v))
+			fprintf(f, "%s{core=\"%d\"} %f\n", name,
+				s->core[i].core_id, v);
+	}
+}
+
+static void write_metrics(FILE *f, struct metrics_snapshot_s *s)
+{
+	write_header(f, "dpf_intervals_total", "counter",
+		     "Tuning intervals completed");
+	fprintf(f, "dpf_intervals_total %lu\n", s->intervals);
+	write_header(f, "dpf_alg", "gauge", "Active tune algorithm");
+	fprintf(f, "dpf_alg %d\n", s->tunealg);
+	write_header(f, "dpf_paused", "gauge", "1 if tuning is paused");
+	fprintf(f, "dpf_paused %d\n", s->paused);
+	write_header(f, "dpf_interval_config_seconds", "gauge",
+		     "Configured tuning interval");
+	fprintf(f, "dpf_interval_config_seconds %f\n", s->intervall);
+	write_header(f, "dpf_interval_seconds", "gauge",
+		     "Measured length of the last interval");
+	fprintf(f, "dpf_interval_seconds %f\n", s->interval_s);
+	write_header(f, "dpf_interval_jitter_seconds", "gauge",
+		     "Measured minus configured length of the last interval");
+	fprintf(f, "dpf_interval_jitter_seconds %f\n",
+		s->interval_s ? s->interval_s - s->intervall : 0);
+	write_header(f, "dpf_interval_jitter_max_seconds", "gauge",
+		     "Largest interval overrun since start");
+	fprintf(f, "dpf_interval_jitter_max_seconds %f\n", s->jitter_max_s);
+	write_header(f, "dpf_decision_seconds", "gauge",
+		     "Time spent in the tuner during the last interval");
+	fprintf(f, "dpf_decision_seconds %.9f\n", s->decision_s);
+
+	write_header(f, "dpf_overhead_core_percent", "gauge",
+		     "dPF CPU time during the last interval in percent of one core");
+	fprintf(f, "dpf_overhead_core_percent %f\n", s->overhead_pct);
+	write_header(f, "dpf_overhead_syscalls", "gauge",
+		     "Syscalls made by the tuning thread during the last interval");
+	for (int i = 0; i < s->num_cores; i++)
+		fprintf(f, "dpf_overhead_syscalls{core=\"%d\"} %lu\n",
+			s->core[i].core_id, s->core[i].ovh.syscalls);
+	write_header(f, "dpf_overhead_msr_ops", "gauge",
+		     "MSR reads and writes during the last interval");
+	for (int i = 0; i < s->num_cores; i++)
+		fprintf(f, "dpf_overhead_msr_ops{core=\"%d\"} %lu\n",
+			s->core[i].core_id, s->core[i].ovh.msr_ops);
+	write_header(f, "dpf_overhead_ctx_switches", "gauge",
+		     "Context switches of the tuning thread during the last interval");
+	for (int i = 0; i < s->num_cores; i++)
+		fprintf(f, "dpf_overhead_ctx_switches{core=\"%d\"} %lu\n",
+			s->core[i].core_id, s->core[i].ovh.ctx_switches);
+
+	write_header(f, "dpf_tuner_cpu_seconds_total", "counter",
+		     "CPU time used by the tuning thread on each core");
+	for (int i = 0; i < s->num_cores; i++) {
+		// sampled by the thread itself while running, not read here
+		// from a thread that may have exited
+		if (s->core[i].ovh.cpu_total_ns == 0)
+			continue;
+		fprintf(f, "dpf_tuner_cpu_seconds_total{core=\"%d\"} %f\n",
+			s->core[i].core_id, s->core[i].ovh.cpu_total_ns / 1e9);
+	}
+
+	if (s->ddr_rd_bw >= 0) {
+		write_header(f, "dpf_ddr_read_bytes_per_second", "gauge",
+			     "DDR read bandwidth over the last interval");
+		fprintf(f, "dpf_ddr_read_bytes_per_second %.0f\n", s->ddr_rd_bw);
+		write_header(f, "dpf_ddr_write_bytes_per_second", "gauge",
+			     "DDR write bandwidth over the last interval");
+		fprintf(f, "dpf_ddr_write_bytes_per_second %.0f\n", s->ddr_wr_bw);
+		write_header(f, "dpf_ddr_utilization_ratio", "gauge",
+			     "DDR read + write bandwidth relative to the target");
+		fprintf(f, "dpf_ddr_utilization_ratio %f\n",
+			(s->ddr_rd_bw + s->ddr_wr_bw) / (1024 * 1024) /
+			ddr_bw_target);
+	}
+	write_header(f, "dpf_ddr_target_bytes_per_second", "gauge",
+		     "DDR bandwidth target");
+	fprintf(f, "dpf_ddr_target_bytes_per_second %.0f\n",
+		(double)ddr_bw_target * 1024 * 1024);
+
+	if (s->num_arms > 0) {
+		write_header(f, "dpf_mab_arm", "gauge", "Active MAB arm");
+		fprintf(f, "dpf_mab_arm %d\n", s->arm);
+		write_header(f, "dpf_mab_reward", "gauge",
+			     "Reward estimate per MAB arm");
+		for (int i = 0; i < s->num_arms; i++)
+			fprintf(f, "dpf_mab_reward{arm=\"%d\"} %f\n", i,
+				s->rewards[i]);
+		write_header(f, "dpf_mab_selections", "gauge",
+			     "Selection count per MAB arm");
+		for (int i = 0; i < s->num_arms; i++)
+			fprintf(f, "dpf_mab_selections{arm=\"%d\"} %f\n", i,
+				s->nums[i]);
+	}
+
+	if (s->ab_mode != AB_OFF) {
+		static const char *ab_metrics[AB_METRICS] = {"ipc",
+							     "throughput"};
+
+		write_header(f, "dpf_ab_slices_total", "counter",
+			     "A/B slices completed");
+		fprintf(f, "dpf_ab_slices_total %lu\n", s->ab_slices);
+		write_header(f, "dpf_ab_effect_ratio", "gauge",
+			     "Relative change of the tuned policy over the "
+			     "startup MSRs");
+		for (int m = 0; m < AB_METRICS; m++)
+			if (s->ab[m].valid)
+				fprintf(f, "dpf_ab_effect_ratio{metric=\"%s\"} "
+					"%f\n", ab_metrics[m], s->ab[m].effect);
+		write_header(f, "dpf_ab_effect_ci_low_ratio", "gauge",
+			     "Lower bound of the 95% confidence interval");
+		for (int m = 0; m < AB_METRICS; m++)
+			if (s->ab[m].valid)
+				fprintf(f, "dpf_ab_effect_ci_low_ratio{metric="
+					"\"%s\"} %f\n", ab_metrics[m],
+					s->ab[m].ci_low);
+		write_header(f, "dpf_ab_effect_ci_high_ratio", "gauge",
+			     "Upper bound of the 95% confidence interval");
+		for (int m = 0; m < AB_METRICS; m++)
+			if (s->ab[m].valid)
+				fprintf(f, "dpf_ab_effect_ci_high_ratio{metric="
+					"\"%s\"} %f\n", ab_metrics[m],
+					s->ab[m].ci_high);
+	}
+
+	write_header(f, "dpf_ipc", "gauge",
+		     "Instructions retired per unhalted core cycle over the last interval");
+	for (int i = 0; i < s->num_cores; i++) {
+		struct metrics_core_s *c = &s->core[i];
+
+		if (c->cycles)
+			fprintf(f, "dpf_ipc{core=\"%d\"} %f\n", c->core_id,
+				(double)c->instructions / c->cycles);
+	}
+
+	// PMU: 1 L2 hit, 2 L3 hit, 3 DRAM hit, as used by basicalg
+	write_header(f, "dpf_l2_hit_ratio", "gauge",
+		     "Demand loads served by L2 out of L2+L3+DRAM hits");
+	for (int i = 0; i < s->num_cores; i++) {
+		struct metrics_core_s *c = &s->core[i];
+		uint64_t total = c->pmu[1] + c->pmu[2] + c->pmu[3];
+
+		if (total)
+			fprintf(f, "dpf_l2_hit_ratio{core=\"%d\"} %f\n",
+				c->core_id, (double)c->pmu[1] / total);
+	}
+	write_header(f, "dpf_l3_hit_ratio", "gauge",
+		     "Demand loads served by L3 out of L3+DRAM hits");
+	for (int i = 0; i < s->num_cores; i++) {
+		struct metrics_core_s *c = &s->core[i];
+		uint64_t total = c->pmu[2] + c->pmu[3];
+
+		if (total)
+			fprintf(f, "dpf_l3_hit_ratio{core=\"%d\"} %f\n",
+				c->core_id, (double)c->pmu[2] / total);
+	}
+
+	write_header(f, "dpf_pmu_duty", "gauge",
+		     "Share of the last interval a PMU event was counted, "
+		     "below 1 when multiplexed");
+	for (int i = 0; i < s->num_cores; i++) {
+		for (int j = 0; j < pmu_num_events; j++)
+			fprintf(f, "dpf_pmu_duty{core=\"%d\",event=\"%s\"} %f\n",
+				s->core[i].core_id, pmu_events[j].name,
+				s->core[i].pmu_duty[j]);
+	}
+
+	write_pf_metric(f, s, "dpf_pf_accuracy",
+			"Useful out of issued L2 prefetches",
+			offsetof(struct pf_metrics_s, accuracy));
+	write_pf_metric(f, s, "dpf_pf_coverage",
+			"L2 demand misses removed by prefetching",
+			offsetof(struct pf_metrics_s, coverage));
+	write_pf_metric(f, s, "dpf_pf_lateness",
+			"Prefetches still in flight when demanded",
+			offsetof(struct pf_metrics_s, lateness));
+	write_pf_metric(f, s, "dpf_xq_pressure",
+			"L2 requests rejected by a full XQ per unhalted core cycle",
+			offsetof(struct pf_metrics_s, xq_pressure));
+	write_pf_metric(f, s, "dpf_mem_bound",
+			"Cycles stalled on loads that missed the L1",
+			offsetof(struct pf_metrics_s, mem_bound));
+	write_pf_metric(f, s, "dpf_l2_stall",
+			"Cycles stalled on loads served by the L2",
+			offsetof(struct pf_metrics_s, l2_stall));
+	write_pf_metric(f, s, "dpf_l3_stall",
+			"Cycles stalled on loads served by the L3",
+			offsetof(struct pf_metrics_s, l3_stall));
+	write_pf_metric(f, s, "dpf_dram_stall",
+			"Cycles stalled on loads served by memory",
+			offsetof(struct pf_metrics_s, dram_stall));
+	write_pf_metric(f, s, "dpf_mem_sched",
+			"Issue slots lost to a full memory scheduler",
+			offsetof(struct pf_metrics_s, mem_sched));
+
+	write_header(f, "dpf_msr_value", "gauge",
+		     "Raw hardware prefetch MSR value");
+	for (int i = 0; i < s->num_cores; i++) {
+		for (int j = 0; j < HWPF_MSR_FIELDS; j++)
+			fprintf(f, "dpf_msr_value{core=\"%d\",msr=\"%s\"} %lu\n",
+				s->core[i].core_id, msr_names[j],
+				s->core[i].msr[j].v);
+	}
+	write_header(f, "dpf_msr_field", "gauge",
+		     "Decoded hardware prefetch MSR field");
+	for (int i = 0; i < s->num_cores; i++) {
+		for (size_t j = 0; j < sizeof(msr_fields) / sizeof(msr_fields[0]); j++) {
+			int v = msr_fields[j].get(s->core[i].msr);
+
+			if (v < 0) //not on this SKU
+				continue;
+			fprintf(f, "dpf_msr_field{core=\"%d\",field=\"%s\"} %d\n",
+				s->core[i].core_id, msr_fields[j].name, v);
+		}
+	}
+}
+
+// Write the file next to the target and rename it in place so the collector
+// never sees a partial file.
+// Returns 0 on success, -1 on failure
+static int metrics_write(void)
+{
+	FILE *f;
+
+	if (snapshot_read() < 0)
+		return 0;
+
+	f = fopen(metrics_tmp_path, "w");
+	if (f == NULL) {
+		loge(TAG, "Could not open %s: %s\n", metrics_tmp_path,
+		     strerror(errno));
+		return -1;
+	}
+
+	write_metrics(f, snap_copy);
+
+	if (fclose(f) != 0 || rename(metrics_tmp_path, metrics_path) != 0) {
+		loge(TAG, "Could not write %s: %s\n", metrics_path,
+		     strerror(errno));
+		unlink(metrics_tmp_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *metrics_thread_start(void *arg)
+{
+	(void)arg;
+
+	if (metrics_hk_core >= 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(metrics_hk_core, &cpuset);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset),
+					   &cpuset) != 0)
+			loge(TAG, "Could not pin metrics thread to core %d\n",
+			     metrics_hk_core);
+	}
+
+	while (metrics_running && quitflag == 0) {
+		usleep(METRICS_PERIOD_MS * 1000);
+		overhead_helper_sample();
+		metrics_write();
+	}
+
+	return NULL;
+}
+
+// Allocate the snapshots for num_cores tuned cores and start the exporter
+// thread on the housekeeping core hk_core (-1 to leave it unpinned).
+// Returns 0 on success, -1 on failure
+int metrics_init(const char *path, int hk_core, int num_cores)
+{
+	if (strlen(path) >= sizeof(metrics_path)) {
+		loge(TAG, "Metrics path too long: %s\n", path);
+		return -1;
+	}
+	strcpy(metrics_path, path);
+	snprintf(metrics_tmp_path, sizeof(metrics_tmp_path), "%s.tmp", path);
+
+	snap_size = sizeof(struct metrics_snapshot_s) +
+		    num_cores * sizeof(struct metrics_core_s);
+	snap[0] = calloc(1, snap_size);
+	snap[1] = calloc(1, snap_size);
+	snap_copy = calloc(1, snap_size);
+	if (snap[0] == NULL || snap[1] == NULL || snap_copy == NULL) {
+		loge(TAG, "Could not allocate metrics snapshots\n");
+		goto err_free;
+	}
+	snap[0]->num_cores = num_cores;
+	snap[1]->num_cores = num_cores;
+
+	metrics_hk_core = hk_core;
+	metrics_running = 1;
+	if (pthread_create(&metrics_thread, NULL, &metrics_thread_start,
+			   NULL) != 0) {
+		metrics_running = 0;
+		goto err_free;
+	}
+
+	logi(TAG, "Writing metrics to %s\n", metrics_path);
+
+	return 0;
+
+err_free:
+	free(snap[0]);
+	free(snap[1]);
+	free(snap_copy);
+	snap[0] = snap[1] = snap_copy = NULL;
+
+	return -1;
+}
+
+void metrics_deinit(void)
+{
+	if (!metrics_running)
+		return;
+
+	metrics_running = 0;
+	pthread_join(metrics_thread, NULL);
+	unlink(metrics_path);
+}
@@ -17,9 +17,14 @@
 #include "log.h"
 #include "mab.h"
 #include "common.h"
+#include "sysdetect.h"
 
 #define TAG "MSR"
 
+const struct msr_layout_s *msr_layout = &msr_layouts[0];
+const struct msr_layout_s *msr_pcore_layout = &msr_pcore_layouts[0];
+static struct hwpf_mask_s default_mask; //the layout defaults, precomputed
+
 // Open MSR file
 int msr_open(int core)
 {
@@ -95,17 +100,12 @@ int msr_corepmu_setup(int msr_file, int nr_events, uint64_t *event)
 			loge(TAG, "Could not write MSR %d\n", PMU_PERFEVTSEL0 + i);
 			return -1;
 		}
+		OVH_MSR_OP();
 	}
 
 	return 0;
 }
 
-static inline uint64_t rdtsc(void) {
-    unsigned int lo, hi;
-    __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
-    return ((uint64_t)hi << 32) | lo;
-}
-
 int msr_corepmu_read(int msr_file, int nr_events, uint64_t *result, uint64_t *inst_retired, uint64_t *cpu_cycles)
 {
 	if(nr_events > PMU_COUNTERS){
@@ -113,12 +113,13 @@ int msr_corepmu_read(int msr_file, int nr_events, uint64_t *result, uint64_t *in
 		exit(-1);
 	}
 
-	if (tunealg != MAB) {
+	if (tunealg != MAB || pmu_derived) {
 		for(int i = 0; i < nr_events; i++){
 			if(pread(msr_file, &result[i], 8, PMU_PMC0 + i) != 8){
 				loge(TAG, "Could not read MSR 0x%x\n", PMU_PMC0 + i);
 				exit(-1);
 			}
+			OVH_MSR_OP();
 		}
 	}
 //	else {  //Should we only read instructions and cycles for MAB tuner?
@@ -128,13 +129,15 @@ int msr_corepmu_read(int msr_file, int nr_events, uint64_t *result, uint64_t *in
 			loge(TAG, "Could not read fixed counter for instructions retired\n");
 			return -1;
 		}
+		OVH_MSR_OP();
 
-		*cpu_cycles = rdtsc();
-
-		// if (pread(msr_file, cpu_cycles, sizeof(uint64_t), MSR_FIXED_CTR1) != sizeof(uint64_t)) {
-		//     loge(TAG, "Could not read fixed counter for CPU cycles\n");
-		//     return -1;
-		// }
+		// Unhalted core cycles like CPU_CLK_UNHALTED.CORE_P in perf
+		// mode, the TSC would count the halted cycles too
+		if (pread(msr_file, cpu_cycles, sizeof(uint64_t), MSR_FIXED_CTR1) != sizeof(uint64_t)) {
+			loge(TAG, "Could not read fixed counter for CPU cycles\n");
+			return -1;
+		}
+		OVH_MSR_OP();
 //	}
 
 	return 0;
@@ -175,454 +178,623 @@ int msr_hwpf_write(int msr_file, union msr_u msr[])
 			loge(TAG, "Could not write MSR %d\n", HWPF_MSR_BASE + i);
 			return -1;
 		}
+		OVH_MSR_OP();
 	}
 
     if(pwrite(msr_file, &msr[HWPF_MSR_FIELDS-1], 8, HWPF_MSR_0X1A4) != 8){
         loge(TAG, "Could not write MSR %d\n", HWPF_MSR_0X1A4);
         return -1;
 	}
+	OVH_MSR_OP();
 
 	return 0;
 }
 
-// Set value in MSR table
-int msr_set_mlc_disable(union msr_u msr[], int value)
+//
+// Write the HWPF MSRs that differ from what was last written, written is
+// updated. Most decisions change one or two registers.
+//
+int msr_hwpf_write_changed(int msr_file, union msr_u msr[],
+			   union msr_u written[])
+{
+	unsigned int regs = hwpf_diff_regs(written, msr);
+
+	for (int i = 0; regs; i++, regs >>= 1) {
+		uint32_t reg = i < HWPF_MSR_FIELDS - 1 ? HWPF_MSR_BASE + i :
+			HWPF_MSR_0X1A4;
+
+		if (!(regs & 1))
+			continue;
+		if (pwrite(msr_file, &msr[i], 8, reg) != 8) {
+			loge(TAG, "Could not write MSR %x\n", reg);
+			return -1;
+		}
+		OVH_MSR_OP();
+		written[i] = msr[i];
+	}
+
+	return 0;
+}
+
+// Select the MSR layout for the CPUID family/model we run on. Models not
+// in the table get the first one, the layout dPF was written for.
+void msr_layout_init(void)
+{
+	struct hwpf_setting_s defaults[HWPF_NUM_FIELDS];
+	unsigned int family = 0, model = 0;
+	int n = 0;
+
+	if (cpu_family_model(&family, &model) < 0) {
+		logi(TAG, "No CPUID, using the %s MSR layout\n",
+		     msr_layout->sku);
+	} else if (msr_layout_find(family, model) == NULL) {
+		logi(TAG, "CPU family %u model 0x%x not in the MSR layout table, "
+		     "using %s\n", family, model, msr_layout->sku);
+	} else {
+		msr_layout = msr_layout_find(family, model);
+		logi(TAG, "MSR layout %s (family %u model 0x%x)\n",
+		     msr_layout->sku, family, model);
+	}
+
+	if (msr_pcore_layout_find(family, model) != NULL)
+		msr_pcore_layout = msr_pcore_layout_find(family, model);
+
+	for (int f = 0; f < HWPF_FIRST_PCORE_FIELD; f++) {
+		if (!msr_field_supported(f))
+			logi(TAG, "%s not on %s\n", hwpf_field_names[f],
+			     msr_layout->sku);
+		else if (msr_layout->field[f].def >= 0)
+			defaults[n++] = (struct hwpf_setting_s){
+				f, msr_layout->field[f].def};
+	}
+
+	hwpf_mask_init(&default_mask);
+	hwpf_mask_add(msr_layout, &default_mask, defaults, n);
+}
+
+// Set a field in the MSR table, checked against the layout for this SKU.
+// Returns -1 if the field is not on this SKU or value is out of range.
+int msr_field_set(union msr_u msr[], int field, int value)
+{
+	if (hwpf_field_set(msr_layout, msr, field, value) < 0) {
+		logd(TAG, "%s=%d not valid on %s\n", hwpf_field_names[field],
+		     value, msr_layout->sku);
+		return -1;
+	}
+
+	return 0;
+}
+
+// Field value from the MSR table, -1 if the field is not on this SKU
+int msr_field_get(union msr_u msr[], int field)
+{
+	return hwpf_field_get(msr_layout, msr, field);
+}
+
+int msr_field_supported(int field)
+{
+	return msr_layout->field[field].width > 0;
+}
+
+int msr_field_max(int field)
+{
+	return msr_layout->field[field].max;
+}
+
+// Default values of this SKU, fields without a default are left as they are
+void msr_set_defaults(union msr_u msr[])
+{
+	hwpf_mask_apply(&default_mask, msr);
+}
+
+// Apply a set of field values to the MSR table in one pass. Settings not
+// valid on this SKU are skipped, returns how many were.
+int msr_fields_apply(union msr_u msr[], const struct hwpf_setting_s *set,
+		     int n)
 {
-	msr[5].msr1A4.L2_STREAM_DISABLED = value;
+	struct hwpf_mask_s m;
+	int rejected;
+
+	hwpf_mask_init(&m);
+	rejected = hwpf_mask_add(msr_layout, &m, set, n);
+	hwpf_mask_apply(&m, msr);
+
+	return rejected;
+}
+
+// Fields that differ from old to new, with the new values, see hwpf_diff()
+int msr_fields_diff(const union msr_u old[], const union msr_u new[],
+		    struct hwpf_setting_s *out, int max)
+{
+	return hwpf_diff(msr_layout, old, new, out, max);
+}
+
+//
+// Open and read the prefetcher MSR of a P-core, only 0x1A4 is there. The
+// rest of the table is zero and never written.
+//
+int msr_pcore_init(int core, union msr_u msr[])
+{
+	int msr_file;
+
+	if (msr_file_id[core])
+		msr_file = msr_file_id[core];
+	else
+		msr_file = msr_open(core);
+	msr_file_id[core] = msr_file;
+
+	memset(msr, 0, sizeof(union msr_u) * HWPF_MSR_FIELDS);
+	if (pread(msr_file, &msr[HWPF_MSR_FIELDS-1], 8, HWPF_MSR_0X1A4) != 8) {
+		loge(TAG, "Could not read MSR 0x1a4 on P-core %d\n", core);
+		exit(-1);
+	}
+
+	return msr_file;
+}
+
+// Set a field in a P-core MSR table, checked against the P-core layout
+int msr_pcore_field_set(union msr_u msr[], int field, int value)
+{
+	if (hwpf_field_set(msr_pcore_layout, msr, field, value) < 0) {
+		logd(TAG, "%s=%d not valid on %s\n", hwpf_field_names[field],
+		     value, msr_pcore_layout->sku);
+		return -1;
+	}
 
 	return 0;
 }
 
+int msr_pcore_field_get(union msr_u msr[], int field)
+{
+	return hwpf_field_get(msr_pcore_layout, msr, field);
+}
+
+// Set value in P-core MSR table
+int msr_set_pcore_l2_disable(union msr_u msr[], int value)
+{
+	return msr_pcore_field_set(msr, HWPF_L2_HW_PREFETCHER_DISABLE, value);
+}
+
+int msr_get_pcore_l2_disable(union msr_u msr[])
+{
+	return msr_pcore_field_get(msr, HWPF_L2_HW_PREFETCHER_DISABLE);
+}
+
+int msr_set_pcore_l2_adjacent_disable(union msr_u msr[], int value)
+{
+	return msr_pcore_field_set(msr, HWPF_L2_ADJACENT_LINE_DISABLE, value);
+}
+
+int msr_get_pcore_l2_adjacent_disable(union msr_u msr[])
+{
+	return msr_pcore_field_get(msr, HWPF_L2_ADJACENT_LINE_DISABLE);
+}
+
+int msr_set_pcore_dcu_disable(union msr_u msr[], int value)
+{
+	return msr_pcore_field_set(msr, HWPF_DCU_PREFETCHER_DISABLE, value);
+}
+
+int msr_get_pcore_dcu_disable(union msr_u msr[])
+{
+	return msr_pcore_field_get(msr, HWPF_DCU_PREFETCHER_DISABLE);
+}
+
+int msr_set_pcore_dcu_ip_disable(union msr_u msr[], int value)
+{
+	return msr_pcore_field_set(msr, HWPF_DCU_IP_PREFETCHER_DISABLE, value);
+}
+
+int msr_get_pcore_dcu_ip_disable(union msr_u msr[])
+{
+	return msr_pcore_field_get(msr, HWPF_DCU_IP_PREFETCHER_DISABLE);
+}
+
+// Set value in MSR table
+int msr_set_mlc_disable(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_DISABLED, value);
+}
+
 int msr_get_mlc_disable(union msr_u msr[])
 {
-	return msr[5].msr1A4.L2_STREAM_DISABLED;
+	return msr_field_get(msr, HWPF_L2_STREAM_DISABLED);
 }
 
 // Set value in MSR table
 int msr_set_l1_data_disable(union msr_u msr[], int value)
 {
-	msr[5].msr1A4.L1_DATA_STREAM_DISABLED = value;
-
-	return 0;
+	return msr_field_set(msr, HWPF_L1_DATA_STREAM_DISABLED, value);
 }
 
 int msr_get_l1_data_disable(union msr_u msr[])
 {
-	return msr[5].msr1A4.L1_DATA_STREAM_DISABLED;
+	return msr_field_get(msr, HWPF_L1_DATA_STREAM_DISABLED);
 }
 
 // Set value in MSR table
 int msr_set_l1_instruction_disable(union msr_u msr[], int value)
 {
-	msr[5].msr1A4.L1_INSTRUCTION_STREAM_DISABLED = value;
-
-	return 0;
+	return msr_field_set(msr, HWPF_L1_INSTRUCTION_STREAM_DISABLED, value);
 }
 
 int msr_get_l1_instruction_disable(union msr_u msr[])
 {
-	return msr[5].msr1A4.L1_INSTRUCTION_STREAM_DISABLED;
+	return msr_field_get(msr, HWPF_L1_INSTRUCTION_STREAM_DISABLED);
 }
 
 // Set value in MSR table
 int msr_set_l1_next_page_disable(union msr_u msr[], int value)
 {
-	msr[5].msr1A4.L1_NEXT_PAGE_DISABLED = value;
-
-	return 0;
+	return msr_field_set(msr, HWPF_L1_NEXT_PAGE_DISABLED, value);
 }
 
 int msr_get_l1_next_page_disable(union msr_u msr[])
 {
-	return msr[5].msr1A4.L1_NEXT_PAGE_DISABLED;
+	return msr_field_get(msr, HWPF_L1_NEXT_PAGE_DISABLED);
 }
 
 // Set value in MSR table
 int msr_set_amp_disable(union msr_u msr[], int value)
 {
-	msr[5].msr1A4.L2_AMP_DISABLED = value;
-
-	return 0;
+	return msr_field_set(msr, HWPF_L2_AMP_DISABLED, value);
 }
 
 int msr_get_amp_disable(union msr_u msr[])
 {
-	return msr[5].msr1A4.L2_AMP_DISABLED;
+	return msr_field_get(msr, HWPF_L2_AMP_DISABLED);
 }
 
 // Set value in MSR table
 int msr_set_l2xq(union msr_u msr[], int value)
 {
-	msr[0].msr1320.L2_STREAM_AMP_XQ_THRESHOLD = value;
-
-	return 0;
+	return msr_field_set(msr, HWPF_L2_STREAM_AMP_XQ_THRESHOLD, value);
 }
 
 int msr_get_l2xq(union msr_u msr[])
 {
-	return msr[0].msr1320.L2_STREAM_AMP_XQ_THRESHOLD;
+	return msr_field_get(msr, HWPF_L2_STREAM_AMP_XQ_THRESHOLD);
 }
 
 // Set value in MSR table
 int msr_set_l3xq(union msr_u msr[], int value)
 {
-	msr[0].msr1320.LLC_STREAM_XQ_THRESHOLD = value;
-
-	return 0;
+	return msr_field_set(msr, HWPF_LLC_STREAM_XQ_THRESHOLD, value);
 }
 
 int msr_get_l3xq(union msr_u msr[])
 {
-	return msr[0].msr1320.LLC_STREAM_XQ_THRESHOLD;
+	return msr_field_get(msr, HWPF_LLC_STREAM_XQ_THRESHOLD);
 }
 
 // Set value in MSR table
 int msr_set_l2maxdist(union msr_u msr[], int value)
 {
-	msr[0].msr1320.L2_STREAM_MAX_DISTANCE = value;
-
-	return 0;
+	return msr_field_set(msr, HWPF_L2_STREAM_MAX_DISTANCE, value);
 }
 
 int msr_get_l2maxdist(union msr_u msr[])
 {
-	return msr[0].msr1320.L2_STREAM_MAX_DISTANCE;
+	return msr_field_get(msr, HWPF_L2_STREAM_MAX_DISTANCE);
 }
 
 // Set value in MSR table
 int msr_set_l3maxdist(union msr_u msr[], int value)
 {
-	msr[0].msr1320.LLC_STREAM_MAX_DISTANCE = value;
-
-	return 0;
+	return msr_field_set(msr, HWPF_LLC_STREAM_MAX_DISTANCE, value);
 }
 
 int msr_get_l3maxdist(union msr_u msr[])
 {
-	return msr[0].msr1320.LLC_STREAM_MAX_DISTANCE;
+	return msr_field_get(msr, HWPF_LLC_STREAM_MAX_DISTANCE);
 }
 
 // Set value in MSR table
-int msr_set_l2adr(union msr_u msr[], int value) {
-    msr[0].msr1320.L2_AMP_DISABLE_RECURSION = value;
-    return 0;
+int msr_set_l2adr(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_AMP_DISABLE_RECURSION, value);
 }
 
-int msr_get_l2adr(union msr_u msr[]) {
-    return msr[0].msr1320.L2_AMP_DISABLE_RECURSION;
+int msr_get_l2adr(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_AMP_DISABLE_RECURSION);
 }
 
 // Set value in MSR table
-int msr_set_llcoff(union msr_u msr[], int value) {
-    msr[0].msr1320.LLC_STREAM_DISABLE = value;
-    return 0;
+int msr_set_llcoff(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_LLC_STREAM_DISABLE, value);
 }
 
-int msr_get_llcoff(union msr_u msr[]) {
-    return msr[0].msr1320.LLC_STREAM_DISABLE;
+int msr_get_llcoff(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_LLC_STREAM_DISABLE);
 }
 
 // Set value in MSR table
-int msr_set_l2sacil1(union msr_u msr[], int value) {
-    msr[1].msr1321.L2_STREAM_AMP_CREATE_IL1 = value;
-    return 0;
+int msr_set_l2sacil1(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_AMP_CREATE_IL1, value);
 }
 
-int msr_get_l2sacil1(union msr_u msr[]) {
-    return msr[1].msr1321.L2_STREAM_AMP_CREATE_IL1;
+int msr_get_l2sacil1(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_STREAM_AMP_CREATE_IL1);
 }
 
 // Set value in MSR table
-int msr_set_l2dd(union msr_u msr[], int value) {
-    msr[1].msr1321.L2_STREAM_DEMAND_DENSITY = value;
-    return 0;
+int msr_set_l2dd(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_DEMAND_DENSITY, value);
 }
 
-int msr_get_l2dd(union msr_u msr[]) {
-    return msr[1].msr1321.L2_STREAM_DEMAND_DENSITY;
+int msr_get_l2dd(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_STREAM_DEMAND_DENSITY);
 }
 
 // Set value in MSR table
-int msr_set_l2ddovr(union msr_u msr[], int value) {
-    msr[1].msr1321.L2_STREAM_DEMAND_DENSITY_OVR = value;
-    return 0;
+int msr_set_l2ddovr(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_DEMAND_DENSITY_OVR, value);
 }
 
-int msr_get_l2ddovr(union msr_u msr[]) {
-    return msr[1].msr1321.L2_STREAM_DEMAND_DENSITY_OVR;
+int msr_get_l2ddovr(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_STREAM_DEMAND_DENSITY_OVR);
 }
 
 // Set value in MSR table
-int msr_set_nlpoff(union msr_u msr[], int value) {
-    msr[1].msr1321.L2_DISABLE_NEXT_LINE_PREFETCH = value;
-    return 0;
+int msr_set_nlpoff(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_DISABLE_NEXT_LINE_PREFETCH, value);
 }
 
-int msr_get_nlpoff(union msr_u msr[]) {
-    return msr[1].msr1321.L2_DISABLE_NEXT_LINE_PREFETCH;
+int msr_get_nlpoff(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_DISABLE_NEXT_LINE_PREFETCH);
 }
 
 // Set value in MSR table
-int msr_set_l2llcxq(union msr_u msr[], int value) {
-    msr[1].msr1321.L2_LLC_STREAM_AMP_XQ_THRESHOLD = value;
-    return 0;
+int msr_set_l2llcxq(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_LLC_STREAM_AMP_XQ_THRESHOLD, value);
 }
 
-int msr_get_l2llcxq(union msr_u msr[]) {
-    return msr[1].msr1321.L2_LLC_STREAM_AMP_XQ_THRESHOLD;
+int msr_get_l2llcxq(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_LLC_STREAM_AMP_XQ_THRESHOLD);
 }
 
 // Set value in MSR table
-int msr_set_l3dd(union msr_u msr[], int value) {
-    msr[2].msr1322.LLC_STREAM_DEMAND_DENSITY = value;
-    return 0;
+int msr_set_l3dd(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_LLC_STREAM_DEMAND_DENSITY, value);
 }
 
-int msr_get_l3dd(union msr_u msr[]) {
-    return msr[2].msr1322.LLC_STREAM_DEMAND_DENSITY;
+int msr_get_l3dd(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_LLC_STREAM_DEMAND_DENSITY);
 }
 
 // Set value in MSR table
-int msr_set_l3ddovr(union msr_u msr[], int value) {
-    msr[2].msr1322.LLC_STREAM_DEMAND_DENSITY_OVR = value;
-    return 0;
+int msr_set_l3ddovr(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_LLC_STREAM_DEMAND_DENSITY_OVR, value);
 }
 
-int msr_get_l3ddovr(union msr_u msr[]) {
-    return msr[2].msr1322.LLC_STREAM_DEMAND_DENSITY_OVR;
+int msr_get_l3ddovr(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_LLC_STREAM_DEMAND_DENSITY_OVR);
 }
 
 // Set value in MSR table
-int msr_set_ampconf0(union msr_u msr[], int value) {
-    msr[2].msr1322.L2_AMP_CONFIDENCE_DPT0 = value;
-    return 0;
+int msr_set_ampconf0(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_AMP_CONFIDENCE_DPT0, value);
 }
 
-int msr_get_ampconf0(union msr_u msr[]) {
-    return msr[2].msr1322.L2_AMP_CONFIDENCE_DPT0;
+int msr_get_ampconf0(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_AMP_CONFIDENCE_DPT0);
 }
 
 // Set value in MSR table
-int msr_set_ampconf1(union msr_u msr[], int value) {
-    msr[2].msr1322.L2_AMP_CONFIDENCE_DPT1 = value;
-    return 0;
+int msr_set_ampconf1(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_AMP_CONFIDENCE_DPT1, value);
 }
 
-int msr_get_ampconf1(union msr_u msr[]) {
-    return msr[2].msr1322.L2_AMP_CONFIDENCE_DPT1;
+int msr_get_ampconf1(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_AMP_CONFIDENCE_DPT1);
 }
 
 // Set value in MSR table
-int msr_set_ampconf2(union msr_u msr[], int value) {
-    msr[2].msr1322.L2_AMP_CONFIDENCE_DPT2 = value;
-    return 0;
+int msr_set_ampconf2(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_AMP_CONFIDENCE_DPT2, value);
 }
 
-int msr_get_ampconf2(union msr_u msr[]) {
-    return msr[2].msr1322.L2_AMP_CONFIDENCE_DPT2;
+int msr_get_ampconf2(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_AMP_CONFIDENCE_DPT2);
 }
 
 // Set value in MSR table
-int msr_set_ampconf3(union msr_u msr[], int value) {
-    msr[2].msr1322.L2_AMP_CONFIDENCE_DPT3 = value;
-    return 0;
+int msr_set_ampconf3(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_AMP_CONFIDENCE_DPT3, value);
 }
 
-int msr_get_ampconf3(union msr_u msr[]) {
-    return msr[2].msr1322.L2_AMP_CONFIDENCE_DPT3;
+int msr_get_ampconf3(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_AMP_CONFIDENCE_DPT3);
 }
 
 // Set value in MSR table
-int msr_set_l2llcddxq(union msr_u msr[], int value) {
-    msr[2].msr1322.L2_LLC_STREAM_DEMAND_DENSITY_XQ = value;
-    return 0;
+int msr_set_l2llcddxq(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_LLC_STREAM_DEMAND_DENSITY_XQ, value);
 }
 
-int msr_get_l2llcddxq(union msr_u msr[]) {
-    return msr[2].msr1322.L2_LLC_STREAM_DEMAND_DENSITY_XQ;
+int msr_get_l2llcddxq(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_LLC_STREAM_DEMAND_DENSITY_XQ);
 }
 
 // Set value in MSR table
-int msr_set_ampcswpfrfo(union msr_u msr[], int value) {
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_SWPFRFO = value;
-    return 0;
+int msr_set_ampcswpfrfo(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_AMP_CREATE_SWPFRFO, value);
 }
 
-int msr_get_ampcswpfrfo(union msr_u msr[]) {
-    return msr[3].msr1323.L2_STREAM_AMP_CREATE_SWPFRFO;
+int msr_get_ampcswpfrfo(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_STREAM_AMP_CREATE_SWPFRFO);
 }
 
 // Set value in MSR table
-int msr_set_ampcswpfrd(union msr_u msr[], int value) {
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_SWPFRD = value;
-    return 0;
+int msr_set_ampcswpfrd(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_AMP_CREATE_SWPFRD, value);
 }
 
-int msr_get_ampcswpfrd(union msr_u msr[]) {
-    return msr[3].msr1323.L2_STREAM_AMP_CREATE_SWPFRD;
+int msr_get_ampcswpfrd(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_STREAM_AMP_CREATE_SWPFRD);
 }
 
 // Set value in MSR table
-int msr_set_ampchwpfd(union msr_u msr[], int value) {
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_HWPFD = value;
-    return 0;
+int msr_set_ampchwpfd(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_AMP_CREATE_HWPFD, value);
 }
 
-int msr_get_ampchwpfd(union msr_u msr[]) {
-    return msr[3].msr1323.L2_STREAM_AMP_CREATE_HWPFD;
+int msr_get_ampchwpfd(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_STREAM_AMP_CREATE_HWPFD);
 }
 
 // Set value in MSR table
-int msr_set_ampcdrfo(union msr_u msr[], int value) {
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_DRFO = value;
-    return 0;
+int msr_set_ampcdrfo(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_AMP_CREATE_DRFO, value);
 }
 
-int msr_get_ampcdrfo(union msr_u msr[]) {
-    return msr[3].msr1323.L2_STREAM_AMP_CREATE_DRFO;
+int msr_get_ampcdrfo(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_STREAM_AMP_CREATE_DRFO);
 }
 
 // Set value in MSR table
-int msr_set_stabswpfrfo(union msr_u msr[], int value) {
-    msr[3].msr1323.STABILIZE_PREF_ON_SWPFRFO = value;
-    return 0;
+int msr_set_stabswpfrfo(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_STABILIZE_PREF_ON_SWPFRFO, value);
 }
 
-int msr_get_stabswpfrfo(union msr_u msr[]) {
-    return msr[3].msr1323.STABILIZE_PREF_ON_SWPFRFO;
+int msr_get_stabswpfrfo(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_STABILIZE_PREF_ON_SWPFRFO);
 }
 
 // Set value in MSR table
-int msr_set_stabswpfrd(union msr_u msr[], int value) {
-    msr[3].msr1323.STABILIZE_PREF_ON_SWPFRD = value;
-    return 0;
+int msr_set_stabswpfrd(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_STABILIZE_PREF_ON_SWPFRD, value);
 }
 
-int msr_get_stabswpfrd(union msr_u msr[]) {
-    return msr[3].msr1323.STABILIZE_PREF_ON_SWPFRD;
+int msr_get_stabswpfrd(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_STABILIZE_PREF_ON_SWPFRD);
 }
 
 // Set value in MSR table
-int msr_set_stabil1(union msr_u msr[], int value) {
-    msr[3].msr1323.STABILIZE_PREF_ON_IL1 = value;
-    return 0;
+int msr_set_stabil1(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_STABILIZE_PREF_ON_IL1, value);
 }
 
-int msr_get_stabil1(union msr_u msr[]) {
-    return msr[3].msr1323.STABILIZE_PREF_ON_IL1;
+int msr_get_stabil1(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_STABILIZE_PREF_ON_IL1);
 }
 
 // Set value in MSR table
-int msr_set_stabhwpfd(union msr_u msr[], int value) {
-    msr[3].msr1323.STABILIZE_PREF_ON_HWPFD = value;
-    return 0;
+int msr_set_stabhwpfd(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_STABILIZE_PREF_ON_HWPFD, value);
 }
 
-int msr_get_stabhwpfd(union msr_u msr[]) {
-    return msr[3].msr1323.STABILIZE_PREF_ON_HWPFD;
+int msr_get_stabhwpfd(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_STABILIZE_PREF_ON_HWPFD);
 }
 
 // Set value in MSR table
-int msr_set_stabdrfo(union msr_u msr[], int value) {
-    msr[3].msr1323.STABILIZE_PREF_ON_DRFO = value;
-    return 0;
+int msr_set_stabdrfo(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_STABILIZE_PREF_ON_DRFO, value);
 }
 
-int msr_get_stabdrfo(union msr_u msr[]) {
-    return msr[3].msr1323.STABILIZE_PREF_ON_DRFO;
+int msr_get_stabdrfo(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_STABILIZE_PREF_ON_DRFO);
 }
 
 // Set value in MSR table
-int msr_set_ampcpfnpp(union msr_u msr[], int value) {
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_PFNPP = value;
-    return 0;
+int msr_set_ampcpfnpp(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_AMP_CREATE_PFNPP, value);
 }
 
-int msr_get_ampcpfnpp(union msr_u msr[]) {
-    return msr[3].msr1323.L2_STREAM_AMP_CREATE_PFNPP;
+int msr_get_ampcpfnpp(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_STREAM_AMP_CREATE_PFNPP);
 }
 
 // Set value in MSR table
-int msr_set_ampcpfipp(union msr_u msr[], int value) {
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_PFIPP = value;
-    return 0;
+int msr_set_ampcpfipp(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L2_STREAM_AMP_CREATE_PFIPP, value);
 }
 
-int msr_get_ampcpfipp(union msr_u msr[]) {
-    return msr[3].msr1323.L2_STREAM_AMP_CREATE_PFIPP;
+int msr_get_ampcpfipp(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L2_STREAM_AMP_CREATE_PFIPP);
 }
 
 // Set value in MSR table
-int msr_set_stabpfnpp(union msr_u msr[], int value) {
-    msr[3].msr1323.STABILIZE_PREF_ON_PFNPP = value;
-    return 0;
+int msr_set_stabpfnpp(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_STABILIZE_PREF_ON_PFNPP, value);
 }
 
-int msr_get_stabpfnpp(union msr_u msr[]) {
-    return msr[3].msr1323.STABILIZE_PREF_ON_PFNPP;
+int msr_get_stabpfnpp(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_STABILIZE_PREF_ON_PFNPP);
 }
 
 // Set value in MSR table
-int msr_set_stabpfipp(union msr_u msr[], int value) {
-    msr[3].msr1323.STABILIZE_PREF_ON_PFIPP = value;
-    return 0;
+int msr_set_stabpfipp(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_STABILIZE_PREF_ON_PFIPP, value);
 }
 
-int msr_get_stabpfipp(union msr_u msr[]) {
-    return msr[3].msr1323.STABILIZE_PREF_ON_PFIPP;
+int msr_get_stabpfipp(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_STABILIZE_PREF_ON_PFIPP);
 }
 
 // Set value in MSR table
-int msr_set_l1ht(union msr_u msr[], int value) {
-    msr[4].msr1324.L1_HOMELESS_THRESHOLD = value;
-    return 0;
-}
-
-int msr_get_l1ht(union msr_u msr[]) {
-    return msr[4].msr1324.L1_HOMELESS_THRESHOLD;
-}
-
-void populate_msr1320(union msr_u msr[]) {
-    msr[0].msr1320.L2_STREAM_AMP_XQ_THRESHOLD = L2_STREAM_AMP_XQ_THRESHOLD_1320;
-    msr[0].msr1320.L2_STREAM_MAX_DISTANCE = L2_STREAM_MAX_DISTANCE_1320;
-    msr[0].msr1320.L2_AMP_DISABLE_RECURSION = L2_AMP_DISABLE_RECURSION_1320;
-    msr[0].msr1320.LLC_STREAM_MAX_DISTANCE = LLC_STREAM_MAX_DISTANCE_1320;
-    msr[0].msr1320.LLC_STREAM_DISABLE = LLC_STREAM_DISABLE_1320;
-    msr[0].msr1320.LLC_STREAM_XQ_THRESHOLD = LLC_STREAM_XQ_THRESHOLD_1320;
-}
-
-void populate_msr1321(union msr_u msr[]) {
-    msr[1].msr1321.L2_STREAM_AMP_CREATE_IL1 = L2_STREAM_AMP_CREATE_IL1_1321;
-    msr[1].msr1321.L2_STREAM_DEMAND_DENSITY = L2_STREAM_DEMAND_DENSITY_1321;
-    msr[1].msr1321.L2_STREAM_DEMAND_DENSITY_OVR = L2_STREAM_DEMAND_DENSITY_OVR_1321;
-    msr[1].msr1321.L2_DISABLE_NEXT_LINE_PREFETCH = L2_DISABLE_NEXT_LINE_PREFETCH_1321;
-    msr[1].msr1321.L2_LLC_STREAM_AMP_XQ_THRESHOLD = L2_LLC_STREAM_AMP_XQ_THRESHOLD_1321;
-}
-
-void populate_msr1322(union msr_u msr[]) {
-    msr[2].msr1322.LLC_STREAM_DEMAND_DENSITY = LLC_STREAM_DEMAND_DENSITY_1322;
-    msr[2].msr1322.LLC_STREAM_DEMAND_DENSITY_OVR = LLC_STREAM_DEMAND_DENSITY_OVR_1322;
-    msr[2].msr1322.L2_AMP_CONFIDENCE_DPT0 = L2_AMP_CONFIDENCE_DPT0_1322;
-    msr[2].msr1322.L2_AMP_CONFIDENCE_DPT1 = L2_AMP_CONFIDENCE_DPT1_1322;
-    msr[2].msr1322.L2_AMP_CONFIDENCE_DPT2 = L2_AMP_CONFIDENCE_DPT2_1322;
-    msr[2].msr1322.L2_AMP_CONFIDENCE_DPT3 = L2_AMP_CONFIDENCE_DPT3_1322;
-    msr[2].msr1322.L2_LLC_STREAM_DEMAND_DENSITY_XQ = L2_LLC_STREAM_DEMAND_DENSITY_XQ_1322;
+int msr_set_l1ht(union msr_u msr[], int value)
+{
+	return msr_field_set(msr, HWPF_L1_HOMELESS_THRESHOLD, value);
 }
 
-void populate_msr1323(union msr_u msr[]) {
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_SWPFRFO = L2_STREAM_AMP_CREATE_SWPFRFO_1323;
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_SWPFRD = L2_STREAM_AMP_CREATE_SWPFRD_1323;
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_HWPFD = L2_STREAM_AMP_CREATE_HWPFD_1323;
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_DRFO = L2_STREAM_AMP_CREATE_DRFO_1323;
-    msr[3].msr1323.STABILIZE_PREF_ON_SWPFRFO = STABILIZE_PREF_ON_SWPFRFO_1323;
-    msr[3].msr1323.STABILIZE_PREF_ON_SWPFRD = STABILIZE_PREF_ON_SWPFRD_1323;
-    msr[3].msr1323.STABILIZE_PREF_ON_IL1 = STABILIZE_PREF_ON_IL1_1323;
-    msr[3].msr1323.STABILIZE_PREF_ON_HWPFD = STABILIZE_PREF_ON_HWPFD_1323;
-    msr[3].msr1323.STABILIZE_PREF_ON_DRFO = STABILIZE_PREF_ON_DRFO_1323;
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_PFNPP = L2_STREAM_AMP_CREATE_PFNPP_1323;
-    msr[3].msr1323.L2_STREAM_AMP_CREATE_PFIPP = L2_STREAM_AMP_CREATE_PFIPP_1323;
-    msr[3].msr1323.STABILIZE_PREF_ON_PFNPP = STABILIZE_PREF_ON_PFNPP_1323;
-    msr[3].msr1323.STABILIZE_PREF_ON_PFIPP = STABILIZE_PREF_ON_PFIPP_1323;
+int msr_get_l1ht(union msr_u msr[])
+{
+	return msr_field_get(msr, HWPF_L1_HOMELESS_THRESHOLD);
 }
 
 // Get RMID from PQOS ASSOC MSR
@@ -642,6 +814,7 @@ int msr_get_rmid(int core, uint64_t *val)
 		}
 	}
 
+	OVH_MSR_OP();
 	*val = data;
 	return 0;
 }
@@ -662,6 +835,7 @@ int msr_set_rmid(unsigned core, uint64_t rmid)
 		}
 	}
 
+	OVH_MSR_OP();
 	return 0;
 }
 
@@ -681,6 +855,7 @@ int msr_get_evtsel(unsigned core, uint64_t *event)
 		}
 	}
 
+	OVH_MSR_OP();
 	*event = data;
 	return 0;
 }
@@ -700,6 +875,7 @@ int msr_set_evtsel(unsigned core, uint64_t event)
 		}
 	}
 
+	OVH_MSR_OP();
 	return 0;
 }
 
@@ -719,6 +895,7 @@ int msr_get_mon_count(int core, uint64_t *val)
 		}
 	}
 
+	OVH_MSR_OP();
 	*val = data;
 	return 0;
 }
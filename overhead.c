@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+
+#include "common.h"
+#include "overhead.h"
+
+#define TAG "OVERHEAD"
+
+// Accounting of dPF's own cost. Every tuning thread samples its CPU time,
+// context switches and counted syscalls once per interval, the master core
+// sums them up into a budget relative to one core and, if a cap is set,
+// backs off the interval until dPF is within it. The helper threads on the
+// housekeeping core run on their own periods, they publish running totals
+// after each sleep and the master core adds what they used since its last
+// look.
+
+__thread uint64_t ovh_syscalls;
+__thread uint64_t ovh_msr_ops;
+__thread uint64_t ovh_wakeups;
+
+struct overhead_total_s ovh_last;
+float ovh_cap_pct = OVH_CAP_OFF;
+
+// Values at the previous sample of the calling thread
+static __thread struct overhead_s ovh_prev;
+static __thread int ovh_sampled;
+
+static uint64_t ovh_last_account_ns;
+
+// Running totals of a helper thread, written by it, read by the master core
+struct ovh_helper_s {
+	_Atomic uint64_t cpu_ns;
+	_Atomic uint64_t syscalls;
+	_Atomic uint64_t msr_ops;
+	_Atomic uint64_t wakeups;
+	_Atomic uint64_t ctx_switches;
+};
+
+static struct ovh_helper_s helpers[OVH_MAX_HELPERS];
+static atomic_int num_helpers;
+static __thread int helper_slot = -1;
+static struct overhead_s helper_prev[OVH_MAX_HELPERS]; //master core private
+
+static void thread_totals(struct overhead_s *now)
+{
+	struct timespec ts;
+	struct rusage ru;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	getrusage(RUSAGE_THREAD, &ru);
+	OVH_SYSCALL(2);
+
+	now->cpu_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	now->syscalls = ovh_syscalls;
+	now->msr_ops = ovh_msr_ops;
+	now->wakeups = ovh_wakeups;
+	now->ctx_switches = ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+// Store the calling thread's cost since its previous call in ovh.
+// Called once per interval right after the interval sleep.
+void overhead_thread_sample(struct overhead_s *ovh)
+{
+	struct overhead_s now;
+
+	thread_totals(&now);
+
+	if (ovh_sampled) {
+		ovh->cpu_ns = now.cpu_ns - ovh_prev.cpu_ns;
+		ovh->syscalls = now.syscalls - ovh_prev.syscalls;
+		ovh->msr_ops = now.msr_ops - ovh_prev.msr_ops;
+		ovh->ctx_switches = now.ctx_switches - ovh_prev.ctx_switches;
+		ovh->wakeups = now.wakeups - ovh_prev.wakeups;
+	} else {
+		//first sample includes the thread setup, skip it
+		memset(ovh, 0, sizeof(*ovh));
+		ovh_sampled = 1;
+	}
+
+	ovh->cpu_total_ns = now.cpu_ns;
+	ovh_prev = now;
+}
+
+// Publish the calling helper thread's totals, called by the threads on the
+// housekeeping core after each sleep. The first call takes a slot.
+void overhead_helper_sample(void)
+{
+	struct overhead_s now;
+	struct ovh_helper_s *h;
+
+	OVH_WAKEUP();
+
+	if (helper_slot < 0) {
+		int slot = atomic_fetch_add(&num_helpers, 1);
+
+		if (slot >= OVH_MAX_HELPERS) {
+			atomic_fetch_sub(&num_helpers, 1);
+			return;
+		}
+		helper_slot = slot;
+	}
+
+	thread_totals(&now);
+	h = &helpers[helper_slot];
+	atomic_store_explicit(&h->cpu_ns, now.cpu_ns, memory_order_relaxed);
+	atomic_store_explicit(&h->syscalls, now.syscalls, memory_order_relaxed);
+	atomic_store_explicit(&h->msr_ops, now.msr_ops, memory_order_relaxed);
+	atomic_store_explicit(&h->wakeups, now.wakeups, memory_order_relaxed);
+	atomic_store_explicit(&h->ctx_switches, now.ctx_switches,
+			      memory_order_relaxed);
+}
+
+// Add what the helper threads used since the previous call to t
+static void helpers_account(struct overhead_total_s *t)
+{
+	int n = atomic_load(&num_helpers);
+
+	if (n > OVH_MAX_HELPERS)
+		n = OVH_MAX_HELPERS;
+
+	for (int i = 0; i < n; i++) {
+		struct ovh_helper_s *h = &helpers[i];
+		struct overhead_s now = {
+			.cpu_ns = atomic_load_explicit(&h->cpu_ns,
+						       memory_order_relaxed),
+			.syscalls = atomic_load_explicit(&h->syscalls,
+							 memory_order_relaxed),
+			.msr_ops = atomic_load_explicit(&h->msr_ops,
+							memory_order_relaxed),
+			.wakeups = atomic_load_explicit(&h->wakeups,
+							memory_order_relaxed),
+			.ctx_switches = atomic_load_explicit(&h->ctx_switches,
+							     memory_order_relaxed),
+		};
+
+		t->helpers.cpu_ns += now.cpu_ns - helper_prev[i].cpu_ns;
+		t->helpers.syscalls += now.syscalls - helper_prev[i].syscalls;
+		t->helpers.msr_ops += now.msr_ops - helper_prev[i].msr_ops;
+		t->helpers.wakeups += now.wakeups - helper_prev[i].wakeups;
+		t->helpers.ctx_switches +=
+			now.ctx_switches - helper_prev[i].ctx_switches;
+		helper_prev[i] = now;
+	}
+
+	t->sum.cpu_ns += t->helpers.cpu_ns;
+	t->sum.syscalls += t->helpers.syscalls;
+	t->sum.msr_ops += t->helpers.msr_ops;
+	t->sum.wakeups += t->helpers.wakeups;
+	t->sum.ctx_switches += t->helpers.ctx_switches;
+}
+
+// Sum up the last interval over all threads, E- and P-core tuning threads
+// and the helpers, report it and enforce
+// the cap. Called by the master core once per interval.
+// decision_ns: time spent in calculate_settings() this interval
+void overhead_account(uint64_t decision_ns)
+{
+	struct overhead_total_s t;
+	uint64_t now = time_ns();
+
+	memset(&t, 0, sizeof(t));
+
+	if (ovh_last_account_ns == 0) {
+		ovh_last_account_ns = now;
+		helpers_account(&t); //start of the helpers' first interval
+		return;
+	}
+
+	for (int i = 0; i < ALL_THREADS; i++) {
+		t.sum.cpu_ns += gtinfo[i].ovh.cpu_ns;
+		t.sum.syscalls += gtinfo[i].ovh.syscalls;
+		t.sum.msr_ops += gtinfo[i].ovh.msr_ops;
+		t.sum.wakeups += gtinfo[i].ovh.wakeups;
+		t.sum.ctx_switches += gtinfo[i].ovh.ctx_switches;
+	}
+	helpers_account(&t);
+	t.wall_ns = now - ovh_last_account_ns;
+	t.decision_ns = decision_ns;
+	t.core_pct = 100.0f * t.sum.cpu_ns / t.wall_ns;
+	ovh_last_account_ns = now;
+	ovh_last = t;
+
+	logv(TAG, "cpu %.4f%% of a core (%lu us, helpers %lu us), syscalls %lu, "
+	     "msr ops %lu, wakeups %lu, ctx switches %lu, decision %lu us\n",
+	     t.core_pct, t.sum.cpu_ns / 1000, t.helpers.cpu_ns / 1000,
+	     t.sum.syscalls, t.sum.msr_ops, t.sum.wakeups, t.sum.ctx_switches,
+	     t.decision_ns / 1000);
+
+	if (ovh_cap_pct > OVH_CAP_OFF && t.core_pct > ovh_cap_pct &&
+	    time_intervall < OVH_MAX_INTERVALL) {
+		time_intervall *= OVH_BACKOFF;
+		if (time_intervall > OVH_MAX_INTERVALL)
+			time_intervall = OVH_MAX_INTERVALL;
+		logi(TAG, "Overhead %.4f%% above cap %.4f%%, interval now %.4f s\n",
+		     t.core_pct, ovh_cap_pct, time_intervall);
+	}
+}
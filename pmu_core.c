@@ -1,5 +1,6 @@
 #define _GNU_SOURCE
 #include <errno.h>
+#include <math.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <linux/perf_event.h>
@@ -18,10 +19,42 @@
 #include "log.h"
 #include "msr.h"
 #include "pmu_core.h"
+#include "overhead.h"
+#include "common.h"
+#include "sysdetect.h"
 
 #define TAG "PMU_CORE"
 
-#define PMU_CORE_EVENT_COUNT (7)
+struct pmu_event_s pmu_events[PMU_MAX_EVENTS];
+int pmu_num_events = PMU_CORE_EVENT_COUNT;
+int pmu_derived = 0;
+const struct pmu_catalog_s *pmu_catalog = &pmu_catalogs[0];
+const struct pmu_catalog_s *pmu_pcore_catalog = &pmu_pcore_catalogs[0];
+
+// Raw mode multiplexing. With more events than PMU_GP_COUNTERS, dram_hit
+// keeps counter 0 and the other events take turns on the rest, one group
+// per slice of the interval. Instructions and cycles are fixed counters.
+static int mux_groups = 1;
+static int mux_used[PMU_MAX_GROUPS];
+static int mux_event[PMU_MAX_GROUPS][PMU_GP_COUNTERS];
+
+// Indexes of the events the derived metrics use, -1 if not programmed
+static struct {
+	int pf_issued;
+	int pf_useful;
+	int pf_late;
+	int xq_reject;
+	int be_mem_sched;
+	int ld_head_l1_miss;
+	int stall[3]; //L2, L3 and DRAM hits
+} role = {-1, -1, -1, -1, -1, -1, {-1, -1, -1}};
+
+// Event select for a code, 0 leaves the counter off for events the model
+// does not have
+static uint64_t event_select(uint64_t code)
+{
+	return code ? code | EVENT_USR_OS_EN : 0;
+}
 
 static long open_perf_event(struct perf_event_attr *attr, pid_t pid, int cpu,
 			    int group_fd, unsigned long flags)
@@ -32,17 +65,16 @@ static long open_perf_event(struct perf_event_attr *attr, pid_t pid, int cpu,
 // Configure perf events
 int perf_configure_events(struct perf_event_attr *event_attrs, int *num_events)
 {
-	*num_events = PMU_CORE_EVENT_COUNT;
+	uint64_t event_configs[MAX_EVENTS];
 
-	// Array of event configurations
-	static const uint64_t event_configs[] = {
-	    PERF_MEM_UOPS_RETIRED_ALL_LOADS,
-	    PERF_MEM_LOAD_UOPS_RETIRED_L2_HIT,
-	    PERF_MEM_LOAD_UOPS_RETIRED_L3_HIT,
-	    PERF_MEM_LOAD_UOPS_RETIRED_DRAM_HIT,
-	    PERF_XQ_PROMOTION_ALL,
-	    PERF_CPU_CLK_UNHALTED_THREAD,
-	    PERF_INST_RETIRED_ANY_P};
+	// The event set, then cycles and instructions at
+	// PERF_INDEX_EVENT_CYCLES and PERF_INDEX_EVENT_INSTRUCTIONS
+	for (int i = 0; i < pmu_num_events; i++)
+		event_configs[i] = pmu_events[i].code;
+	event_configs[PERF_INDEX_EVENT_CYCLES] = pmu_catalog->code[PMU_EV_CYCLES];
+	event_configs[PERF_INDEX_EVENT_INSTRUCTIONS] =
+		pmu_catalog->code[PMU_EV_INSTRUCTIONS];
+	*num_events = pmu_num_events + 2;
 
 	// Configure each event
 	for (int i = 0; i < *num_events; i++) {
@@ -54,8 +86,15 @@ int perf_configure_events(struct perf_event_attr *event_attrs, int *num_events)
 		event_attrs[i].exclude_hv = 0;
 		event_attrs[i].exclude_idle = 0;
 		event_attrs[i].config = event_configs[i];
+		event_attrs[i].read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+			PERF_FORMAT_TOTAL_TIME_RUNNING;
 	}
 
+	// Keep these on a counter when perf has to multiplex
+	event_attrs[PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT].pinned = 1;
+	event_attrs[PERF_INDEX_EVENT_CYCLES].pinned = 1;
+	event_attrs[PERF_INDEX_EVENT_INSTRUCTIONS].pinned = 1;
+
 	return 0;
 }
 
@@ -72,6 +111,12 @@ int perf_init(struct perf_event_attr *event_attrs, int event_fds[MAX_EVENTS],
 	}
 
 	for (int i = 0; i < num_events; i++) {
+		// not on this model, reads as zero
+		if (event_attrs[i].config == 0) {
+			event_fds[i] = -1;
+			continue;
+		}
+
 		event_fds[i] = open_perf_event(&event_attrs[i], -1, core_id,
 					       group_fd, 0);
 		if (event_fds[i] == -1) {
@@ -108,16 +153,34 @@ int perf_init(struct perf_event_attr *event_attrs, int event_fds[MAX_EVENTS],
 	return 0;
 }
 
-// Read the performance counters
+// Read the performance counters, scaled up by the time each event was
+// actually counted when perf multiplexes them
 int perf_read(int event_fds[MAX_EVENTS], uint64_t *event_counts,
-	      int num_events) {
+	      int num_events, struct pmu_mux_s *mux) {
 	for (int i = 0; i < num_events; i++) {
-		if (read(event_fds[i], &event_counts[i],
-			 sizeof(uint64_t)) == -1) {
+		uint64_t val[3]; //value, time enabled, time running
+
+		if (event_fds[i] == -1) {
+			event_counts[i] = 0;
+			mux->duty[i] = 0.0f;
+			continue;
+		}
+
+		if (read(event_fds[i], val, sizeof(val)) == -1) {
 			loge(TAG, "Failed to read event %d: %s\n",
 			     i, strerror(errno));
 			return -1;
 		}
+		OVH_SYSCALL(1);
+
+		uint64_t enabled = val[1] - mux->perf_enabled[i];
+		uint64_t running = val[2] - mux->perf_running[i];
+
+		mux->duty[i] = enabled ? (float)running / enabled : 0.0f;
+		mux->perf_enabled[i] = val[1];
+		mux->perf_running[i] = val[2];
+		event_counts[i] = val[2] ? (uint64_t)((double)val[0] * val[1] /
+						      val[2]) : 0;
 	}
 
 	return 0;
@@ -152,29 +215,380 @@ int pmu_core_clear(int msr_file) {
 			     i);
 			return -1;
 		}
+		OVH_MSR_OP();
 	}
 
 	return 0;
 }
 
-int pmu_core_config(int msr_file) {
-	uint64_t events[PMU_CORE_EVENT_COUNT] = {
-	    EVENT_MEM_UOPS_RETIRED_ALL_LOADS,
-	    EVENT_MEM_LOAD_UOPS_RETIRED_L2_HIT,
-	    EVENT_MEM_LOAD_UOPS_RETIRED_L3_HIT,
-	    EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT,
-	    EVENT_XQ_PROMOTION_ALL};
+int pmu_mux_groups(void)
+{
+	return mux_groups;
+}
+
+// Split the events in groups for the counters, see mux_groups
+static void mux_setup(void)
+{
+	int dram = PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT;
+	int g = 0;
+
+	memset(mux_used, 0, sizeof(mux_used));
+
+	if (pmu_num_events <= PMU_GP_COUNTERS) {
+		mux_groups = 1;
+		for (int i = 0; i < pmu_num_events; i++)
+			mux_event[0][mux_used[0]++] = i;
+		return;
+	}
+
+	for (int i = 0; i < pmu_num_events; i++) {
+		if (i == dram)
+			continue;
+		if (mux_used[g] == PMU_GP_COUNTERS)
+			g++;
+		if (mux_used[g] == 0)
+			mux_event[g][mux_used[g]++] = dram;
+		mux_event[g][mux_used[g]++] = i;
+	}
+	mux_groups = g + 1;
+
+	logi(TAG, "%d PMU events on %d counters, multiplexed in %d groups\n",
+	     pmu_num_events, PMU_GP_COUNTERS, mux_groups);
+}
+
+// Program the current group and restart its counters from zero
+static void mux_program(int msr_file, struct pmu_mux_s *mux)
+{
+	uint64_t events[PMU_GP_COUNTERS];
+	int g = mux->group;
+
+	for (int s = 0; s < mux_used[g]; s++)
+		events[s] = event_select(pmu_events[mux_event[g][s]].code);
+
+	pmu_core_clear(msr_file);
+	msr_corepmu_setup(msr_file, mux_used[g], events);
+	mux->start_ns = time_ns();
+}
+
+// Add what the current group counted since it was programmed
+static void mux_collect(int msr_file, struct pmu_mux_s *mux,
+			uint64_t *inst_retired, uint64_t *cpu_cycles)
+{
+	uint64_t val[PMU_GP_COUNTERS];
+	int g = mux->group;
+
+	msr_corepmu_read(msr_file, mux_used[g], val, inst_retired, cpu_cycles);
+
+	uint64_t ns = time_ns() - mux->start_ns;
+
+	for (int s = 0; s < mux_used[g]; s++) {
+		mux->count[mux_event[g][s]] += val[s];
+		mux->enabled_ns[mux_event[g][s]] += ns;
+	}
+}
+
+int pmu_core_config(int msr_file, struct pmu_mux_s *mux) {
+	uint64_t events[PMU_COUNTERS];
+
+	memset(mux, 0, sizeof(*mux));
+	for (int i = 0; i < pmu_num_events; i++)
+		mux->duty[i] = 1.0f;
+
+	if (mux_groups > 1) {
+		mux->interval_start_ns = time_ns();
+		mux_program(msr_file, mux);
+		return 0;
+	}
+
+	for (int i = 0; i < pmu_num_events; i++)
+		events[i] = event_select(pmu_events[i].code);
 
 	pmu_core_clear(msr_file); // reset
+	msr_corepmu_setup(msr_file, pmu_num_events, events);
+
+	return 0;
+}
+
+// Called at each slice boundary inside an interval, moves the next group
+// onto the counters
+int pmu_core_rotate(int msr_file, struct pmu_mux_s *mux) {
+	uint64_t inst_retired, cpu_cycles;
+
+	if (mux_groups == 1)
+		return 0;
+
+	mux_collect(msr_file, mux, &inst_retired, &cpu_cycles);
+	mux->group = (mux->group + 1) % mux_groups;
+	mux_program(msr_file, mux);
+
+	return 0;
+}
+
+// Running totals per event. Multiplexed events are scaled by the interval
+// length over the time they were counted.
+int pmu_core_read(int msr_file, struct pmu_mux_s *mux, uint64_t *result_p,
+		  uint64_t *inst_retired, uint64_t *cpu_cycles) {
+	if (mux_groups == 1) {
+		msr_corepmu_read(msr_file, pmu_num_events, result_p,
+				 inst_retired, cpu_cycles);
+		return 0;
+	}
+
+	mux_collect(msr_file, mux, inst_retired, cpu_cycles);
+
+	uint64_t now = time_ns();
+	uint64_t interval_ns = now - mux->interval_start_ns;
+
+	for (int i = 0; i < pmu_num_events; i++) {
+		if (mux->enabled_ns[i])
+			mux->total[i] += (uint64_t)((double)mux->count[i] *
+				interval_ns / mux->enabled_ns[i]);
+		mux->duty[i] = interval_ns ?
+			(float)mux->enabled_ns[i] / interval_ns : 0.0f;
+		mux->count[i] = 0;
+		mux->enabled_ns[i] = 0;
+		result_p[i] = mux->total[i];
+	}
+	mux->interval_start_ns = now;
+
+	mux->group = (mux->group + 1) % mux_groups;
+	mux_program(msr_file, mux);
+
+	return 0;
+}
+
+// P-cores count the load events of the base set from their own catalog, on
+// the GP counters without multiplexing. Events not on the P-cores, like the
+// XQ promotions, are left off and read as zero.
+int pmu_pcore_config(int msr_file)
+{
+	uint64_t events[PMU_CORE_EVENT_COUNT];
+
+	for (int i = 0; i < PMU_CORE_EVENT_COUNT; i++)
+		events[i] = event_select(pmu_pcore_catalog->code[i]);
+
+	pmu_core_clear(msr_file);
 	msr_corepmu_setup(msr_file, PMU_CORE_EVENT_COUNT, events);
 
 	return 0;
 }
 
-int pmu_core_read(int msr_file, uint64_t *result_p, uint64_t *inst_retired,
-		  uint64_t *cpu_cycles) {
-	msr_corepmu_read(msr_file, PMU_CORE_EVENT_COUNT, result_p,
-			 inst_retired, cpu_cycles);
+int pmu_pcore_read(int msr_file, uint64_t *result_p, uint64_t *inst_retired,
+		   uint64_t *cpu_cycles)
+{
+	return msr_corepmu_read(msr_file, PMU_CORE_EVENT_COUNT, result_p,
+				inst_retired, cpu_cycles);
+}
+
+int pmu_event_index(const char *name)
+{
+	for (int i = 0; i < pmu_num_events; i++) {
+		if (strcmp(pmu_events[i].name, name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+// Pick the event catalog for the CPUID family/model we run on. Models not
+// in the catalog get the first one, the encodings dPF always used.
+static void pmu_catalog_select(void)
+{
+	unsigned int family, model;
+
+	if (cpu_family_model(&family, &model) < 0) {
+		logi(TAG, "No CPUID, using the %s PMU events\n",
+		     pmu_catalog->uarch);
+		return;
+	}
+
+	if (pmu_pcore_catalog_find(family, model) != NULL)
+		pmu_pcore_catalog = pmu_pcore_catalog_find(family, model);
+
+	pmu_catalog = pmu_catalog_find(family, model);
+	if (pmu_catalog == NULL) {
+		pmu_catalog = &pmu_catalogs[0];
+		logi(TAG, "CPU family %u model 0x%x not in the event catalog, "
+		     "using the %s events\n", family, model,
+		     pmu_catalog->uarch);
+		return;
+	}
+
+	logi(TAG, "PMU events for %s (family %u model 0x%x)\n",
+	     pmu_catalog->uarch, family, model);
+}
+
+static int event_add(const char *name, uint64_t code)
+{
+	if (pmu_event_index(name) >= 0)
+		return 0;
+	if (pmu_num_events >= PMU_MAX_EVENTS) {
+		loge(TAG, "Too many PMU events, max is %d\n", PMU_MAX_EVENTS);
+		return -1;
+	}
+
+	strcpy(pmu_events[pmu_num_events].name, name);
+	pmu_events[pmu_num_events++].code = code;
+	logi(TAG, "PMU event %d: %s 0x%04lx\n", pmu_num_events - 1, name, code);
+
+	return 0;
+}
+
+// Set up the base events plus a comma separated list of extra ones, either
+// catalog names or name=code with code as umask << 8 | event, e.g.
+// "llc_miss,pf_issued=0x0124". The names pf_issued, pf_useful, pf_late and
+// xq_reject feed the derived prefetch metrics, cxl_hit the memory tiers.
+// "topdown" adds the memory-bound events this model has. list may be NULL.
+// Must run before perf_configure_events() and the core threads.
+int pmu_events_parse(const char *list)
+{
+	char buf[256];
+	char *tok, *save;
+
+	pmu_catalog_select();
+
+	for (int i = 0; i < PMU_CORE_EVENT_COUNT; i++) {
+		strcpy(pmu_events[i].name, pmu_event_names[i]);
+		pmu_events[i].code = pmu_catalog->code[i];
+	}
+	pmu_num_events = PMU_CORE_EVENT_COUNT;
+
+	if (list != NULL) {
+		strncpy(buf, list, sizeof(buf) - 1);
+		buf[sizeof(buf) - 1] = '\0';
+
+		for (tok = strtok_r(buf, ",", &save); tok != NULL;
+		     tok = strtok_r(NULL, ",", &save)) {
+			struct pmu_event_s ev = {0};
+			char *code = strchr(tok, '=');
+
+			if (strcmp(tok, "topdown") == 0) {
+				for (int id = PMU_EV_BE_MEM_SCHED;
+				     id <= PMU_EV_STALL_DRAM; id++) {
+					if (pmu_catalog->code[id] &&
+					    event_add(pmu_event_names[id],
+						      pmu_catalog->code[id]) < 0)
+						return -1;
+				}
+				continue;
+			}
+
+			if (code != NULL) {
+				*code++ = '\0';
+				ev.code = strtoull(code, NULL, 0);
+			} else {
+				int id = pmu_event_lookup(tok);
+
+				// cycles and instructions are always counted
+				if (id >= 0 && id != PMU_EV_CYCLES &&
+				    id != PMU_EV_INSTRUCTIONS)
+					ev.code = pmu_catalog->code[id];
+			}
+
+			if (ev.code == 0 || strlen(tok) == 0 ||
+			    strlen(tok) >= PMU_EVENT_NAME_LEN) {
+				loge(TAG, "Unknown PMU event '%s'\n", tok);
+				return -1;
+			}
+			if (event_add(tok, ev.code) < 0)
+				return -1;
+		}
+	}
+
+	role.pf_issued = pmu_event_index("pf_issued");
+	role.pf_useful = pmu_event_index("pf_useful");
+	role.pf_late = pmu_event_index("pf_late");
+	role.xq_reject = pmu_event_index("xq_reject");
+	role.be_mem_sched = pmu_event_index("be_mem_sched");
+	role.ld_head_l1_miss = pmu_event_index("ld_head_l1_miss");
+	role.stall[0] = pmu_event_index("stall_l2_hit");
+	role.stall[1] = pmu_event_index("stall_l3_hit");
+	role.stall[2] = pmu_event_index("stall_dram");
+	pmu_derived = pmu_num_events > PMU_CORE_EVENT_COUNT;
+	mux_setup();
 
 	return 0;
 }
+
+static float ratio(uint64_t num, uint64_t den)
+{
+	if (den == 0)
+		return NAN;
+
+	return num > den ? 1.0f : (float)num / den;
+}
+
+// 1 when events for the memory-bound stall fraction are programmed
+int pmu_mem_bound_events(void)
+{
+	return role.stall[0] >= 0 || role.stall[1] >= 0 || role.stall[2] >= 0 ||
+	       role.ld_head_l1_miss >= 0 || role.be_mem_sched >= 0;
+}
+
+// Share of the cycles a core is stalled on memory. The load stalls by the
+// level that served the load come first, their sum is the memory-bound
+// fraction. Without them the cycles the load at the head of the ROB missed
+// the L1, and last the slots the memory scheduler was full.
+static void pmu_derive_mem(const uint64_t *delta, uint64_t cycles,
+			   struct pf_metrics_s *pf)
+{
+	float *level[3] = {&pf->l2_stall, &pf->l3_stall, &pf->dram_stall};
+	uint64_t stalled = 0;
+	int stall_events = 0;
+
+	pf->mem_bound = NAN;
+	pf->mem_sched = NAN;
+
+	for (int l = 0; l < 3; l++) {
+		*level[l] = NAN;
+		if (role.stall[l] < 0)
+			continue;
+		*level[l] = ratio(delta[role.stall[l]], cycles);
+		stalled += delta[role.stall[l]];
+		stall_events++;
+	}
+
+	if (role.be_mem_sched >= 0)
+		pf->mem_sched = ratio(delta[role.be_mem_sched],
+				      cycles * pmu_catalog->slots);
+
+	if (stall_events)
+		pf->mem_bound = ratio(stalled, cycles);
+	else if (role.ld_head_l1_miss >= 0)
+		pf->mem_bound = ratio(delta[role.ld_head_l1_miss], cycles);
+	else
+		pf->mem_bound = pf->mem_sched;
+}
+
+// Prefetch accuracy, coverage, lateness and XQ pressure from one interval
+// of event deltas, cycles are unhalted core cycles. Without pf_late,
+// lateness falls back on XQ promotions, demand misses that found their line
+// still in flight from a prefetch.
+void pmu_derive(const uint64_t *delta, uint64_t cycles, struct pf_metrics_s *pf)
+{
+	uint64_t misses = delta[PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_L3_HIT] +
+		delta[PERF_INDEX_EVENT_MEM_LOAD_UOPS_RETIRED_DRAM_HIT];
+
+	pf->accuracy = NAN;
+	pf->coverage = NAN;
+	pf->xq_pressure = NAN;
+
+	if (role.pf_useful >= 0) {
+		uint64_t useful = delta[role.pf_useful];
+
+		if (role.pf_issued >= 0)
+			pf->accuracy = ratio(useful, delta[role.pf_issued]);
+		pf->coverage = ratio(useful, useful + misses);
+	}
+
+	if (role.pf_late >= 0 && role.pf_useful >= 0)
+		pf->lateness = ratio(delta[role.pf_late], delta[role.pf_useful]);
+	else
+		pf->lateness = ratio(delta[PERF_INDEX_EVENT_XQ_PROMOTION_ALL],
+				     misses);
+
+	if (role.xq_reject >= 0)
+		pf->xq_pressure = ratio(delta[role.xq_reject], cycles);
+
+	pmu_derive_mem(delta, cycles, pf);
+}
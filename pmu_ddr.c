@@ -252,3 +252,28 @@ uint64_t pmu_ddr(struct ddr_s *ddr, int type)
 
 	return -1;
 }
+
+// Reads the free running DDR counters summed over all controllers without
+// touching the last values kept for pmu_ddr(), so it can be sampled next to a
+// tuner without stealing its deltas.
+// type: DDR_PMU_RD or DDR_PMU_WR
+// returns counter value in bytes, -1 if error
+uint64_t pmu_ddr_total(struct ddr_s *ddr, int type)
+{
+	uint64_t total = 0;
+	int offset;
+
+	if (ddr_interface_type == DDR_CLIENT)
+		offset = (type == DDR_PMU_RD) ? CLIENT_DDR_RD_BW :
+						CLIENT_DDR_WR_BW;
+	else if (ddr_interface_type == DDR_GRR_SRF)
+		offset = (type == DDR_PMU_RD) ? GRR_SRF_FREE_RUN_CNTR_READ :
+						GRR_SRF_FREE_RUN_CNTR_WRITE;
+	else
+		return -1;
+
+	for (int i = 0; i < num_ddr_controllers; i++)
+		total += *((uint64_t *)(ddr->mmap[i] + offset));
+
+	return total * 64;
+}
@@ -62,6 +62,27 @@ static int get_core_type(int core_number)
 }
 
 
+// Function to get the CPUID display family and model.
+// Arguments: Pointers for the family and model.
+// Returns 0, or -1 without CPUID leaf 1.
+int cpu_family_model(unsigned int *family, unsigned int *model)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return -1;
+
+	*family = (eax >> 8) & 0xf;
+	*model = (eax >> 4) & 0xf;
+	if (*family == 0xf)
+		*family += (eax >> 20) & 0xff;
+	if (*family == 0x6 || *family >= 0xf)
+		*model |= ((eax >> 16) & 0xf) << 4;
+
+	return 0;
+}
+
+
 // Function to detect the processor is a hybrid or not.
 // Arguments: No arguments.
 // Returns 1 if hybrid.
@@ -147,6 +168,40 @@ struct e_cores_layout_s get_efficient_core_ids(void)
 
 
 
+// Function to get the first and the last performance core id's of a hybrid
+// client. The P-cores are expected to be contiguous like the E-cores.
+// Arguments: No arguments.
+// Returns a struct containing the first and last p-core id's, -1 if the
+// processor is not a hybrid.
+struct p_cores_layout_s get_performance_core_ids(void)
+{
+	struct p_cores_layout_s core_locations;
+
+	core_locations.first_performance_core = -1;
+	core_locations.last_performance_core = -1;
+
+	if (get_hybridflag() != 1) {
+		logv(TAG, "Non-hybrid processor, no P-cores to tune.\n");
+		return core_locations;
+	}
+
+	for (int i = 0; i < get_nprocs(); i++) {
+		//If get_core_type returns 0x40, core is a p-core.
+		if (get_core_type(i) == 0x40) {
+			if (core_locations.first_performance_core == -1)
+				core_locations.first_performance_core = i;
+			core_locations.last_performance_core = i;
+		}
+	}
+
+	logv(TAG, "First P-Core: CPU(%d)\n",
+		core_locations.first_performance_core);
+	logv(TAG, "Last P-Core: CPU(%d)\n",
+		core_locations.last_performance_core);
+
+	return core_locations;
+}
+
 
 
 // DDR BANDWIDTH FROM BIOS/DMI SETTINGS
@@ -580,4 +635,82 @@ int ddrmembw_measurement(void) {
 	}
 
 	return bandwidth;
-}
\ No newline at end of file
+}
+
+// Function to pick a core for background work such as the control socket.
+// Arguments: first and last E-core and P-core being tuned, pfirst is -1
+// without P-cores.
+// Returns the first core we are allowed to run on outside of the tuned ranges,
+// or -1 if there is none.
+int get_housekeeping_core(int first, int last, int pfirst, int plast)
+{
+	cpu_set_t allowed;
+
+	if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) == -1) {
+		loge(TAG, "Error getting current CPU affinity\n");
+		return -1;
+	}
+
+	for (int i = 0; i < CPU_SETSIZE; i++) {
+		if (i >= first && i <= last)
+			continue;
+		if (pfirst >= 0 && i >= pfirst && i <= plast)
+			continue;
+		if (CPU_ISSET(i, &allowed))
+			return i;
+	}
+
+	return -1;
+}
+
+static int read_topology(int core, const char *name)
+{
+	char path[128];
+	FILE *f;
+	int value;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/topology/%s", core, name);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	if (fscanf(f, "%d", &value) != 1)
+		value = -1;
+	fclose(f);
+
+	return value;
+}
+
+// Function to group the cores first .. first + count - 1 by the L2 they
+// share, from the sysfs cluster_id of each package. Kernels without it get
+// groups of MODULE_CORES counted from first.
+// Arguments: the cores, module receives the module of each core, 0 for the
+// module of the first core and numbered in order of their first core.
+// Returns the number of modules.
+int get_core_modules(int first, int count, int *module)
+{
+	int key[count];
+	int num_modules = 0;
+
+	for (int i = 0; i < count; i++) {
+		int package = read_topology(first + i, "physical_package_id");
+		int cluster = read_topology(first + i, "cluster_id");
+
+		if (cluster < 0 || cluster >= 0xffff)
+			key[i] = -1 - i / MODULE_CORES;
+		else
+			key[i] = (package < 0 ? 0 : package) * 0x10000 + cluster;
+
+		module[i] = -1;
+		for (int j = 0; j < i; j++) {
+			if (key[j] == key[i]) {
+				module[i] = module[j];
+				break;
+			}
+		}
+		if (module[i] < 0)
+			module[i] = num_modules++;
+	}
+
+	return num_modules;
+}
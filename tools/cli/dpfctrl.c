@@ -20,20 +20,6 @@ static size_t entries_to_bytes(size_t entries) {
     return entries * PMU_ENTRY_SIZE_BYTES;
 }
 
-// Get PMU counter name by index
-static const char *get_pmu_counter_name(int index) {
-    static const char *names[] = {
-        "cycles",
-        "instructions",
-        "mem_load_uops",
-        "l2_hit",
-        "l3_hit",
-        "drm_hit",
-        "xq_promotion"
-    };
-    return (index >= 0 && index < PMU_COUNTERS) ? names[index] : "unknown";
-}
-
 // Parse command string to command type
 static enum cmd_type parse_command(const char *cmd) {
     if (!cmd) {
@@ -199,7 +185,7 @@ void dump_data_csv(FILE *fp, const char *buffer, uint64_t buffer_size) {
     // Write CSV header
     fprintf(fp, "timestamp,core_id");
     for (int i = 0; i < PMU_COUNTERS; i++) {
-        fprintf(fp, ",%s", get_pmu_counter_name(i));
+        fprintf(fp, ",%s", pmu_event_name(i));
     }
     fprintf(fp, "\n");
 
@@ -6,8 +6,19 @@
 // NCurses interface for CPU performance monitoring
 // .......................................................
 
+#define CONSOLE_REFRESH_MS (1000) // snapshot and redraw period
+
+// Views
+#define VIEW_PMU (0)
+#define VIEW_MSR (1)
+#define VIEW_TOPOLOGY (2)
+#define VIEW_HEATMAP (3)
+#define VIEW_DDR (4)
+
 // Global state
-extern int current_view;	// 0=PMU view, 1=MSR view
+extern int current_view;	// VIEW_*
+extern int scroll_offset;
+extern int tree_depth;		// topology levels shown, TOPO_LEVELS + 1 for cores
 extern int core_first;
 extern int core_last;
 
@@ -24,6 +35,11 @@ int title_bar(const char *titles[], size_t size, int pos_x, int space);
 int header(void);
 int pmu_view(void);
 int msr_view(void);
+int topology_view(void);
+int heatmap_view(void);
+int heatmap_next_metric(void);
+int ddr_view(void);
+int redraw(void);
 void handle_resize(int sig);
 int scrollable(int ch);
 int update_metrics(void);
@@ -1,12 +1,16 @@
 #ifndef __SNAPSHOT_H
 #define __SNAPSHOT_H
 
+#include <stdint.h>
+
+#include "pmu_events.h"
+#include "topology.h"
+
 extern int core_first;
 extern int core_last;
 
-#define NUM_PMU (7)
-#define NUM_MSR (6)
-#define MAX_CORES (64)
+#define NUM_PMU (PMU_EV_BASE_COUNT)
+#define MAX_DDR_CHANNELS (16)
 
 
 enum tuning_state_t {
@@ -19,20 +23,51 @@ struct core_metrics {
 	int core_id;
 	uint64_t pmu_values[NUM_PMU];
 	uint64_t msr_values[NUM_MSR];
+	double pmu_rates[NUM_PMU]; // per second since the previous snapshot
+	double ipc;
+	int groups[TOPO_LEVELS]; // socket, die and module group index
 };
 
 // hold all core and system metrics
 // including PMU and MSR values
 struct dpf_console_snapshot_s {
-	struct core_metrics cores[MAX_CORES];
+	struct core_metrics *cores; // core_capacity entries, sized from topology
+	int core_capacity;
 	int core_count;
 
-	uint64_t ddr_read_bw;
+	struct dpf_console_group_s *groups; // in tree order
+	int group_count;
+	int level_count[TOPO_LEVELS]; // number of sockets, dies and modules
+
+	uint64_t timestamp; // kernel time of the snapshot, ns
+	double interval; // seconds since the previous snapshot, 0 on the first
+
+	uint64_t ddr_read_total; // bytes since the DDR counters started
+	uint64_t ddr_write_total;
+	uint64_t ddr_read_bw; // bytes since the previous snapshot
 	uint64_t ddr_write_bw;
+	double ddr_read_rate; // bytes per second
+	double ddr_write_rate;
 
-	int tuning_enabled;
+	// per DDR controller, ddr_channel_count entries
+	int ddr_channel_count;
+	double ddr_ch_read_rate[MAX_DDR_CHANNELS]; // bytes per second
+	double ddr_ch_write_rate[MAX_DDR_CHANNELS];
+	int ddr_bw_target; // MB/s as set in the kernel, 0 if not set
+	double ddr_imbalance; // busiest channel / channel mean, 1 is balanced
+	int ddr_hot_channel; // busiest channel
+
+	int tuning_enabled; // as reported by the kernel
+
+	// system wide sparkline history
+	struct history_s ipc_hist;
+	struct history_s ddr_read_hist; // MB/s
+	struct history_s ddr_write_hist;
 };
 
+// sizes the snapshot for the core range and builds the topology groups
+int console_snapshot_init(struct dpf_console_snapshot_s *snapshot);
+
 // populates the snapshot struct with all core and system metrics
 int update_console_snapshot(struct dpf_console_snapshot_s *snapshot);
 
@@ -0,0 +1,63 @@
+#ifndef __TOPOLOGY_H
+#define __TOPOLOGY_H
+
+#include <stdint.h>
+
+#define NUM_MSR (6)
+#define CORES_PER_MODULE (4) // used when sysfs has no cluster_id
+#define HISTORY_LEN (120) // samples kept for sparklines
+
+// aggregation levels, in tree order
+enum topo_level_t {
+	TOPO_SOCKET = 0,
+	TOPO_DIE = 1,
+	TOPO_MODULE = 2,
+	TOPO_LEVELS = 3
+};
+
+// in-memory ring of the most recent samples of one value
+struct history_s {
+	float values[HISTORY_LEN];
+	int head; // next slot to write
+	int count;
+};
+
+// location of one core
+struct core_topo_s {
+	int core_id;
+	int socket;
+	int die;
+	int module;
+};
+
+// one socket, die or module with its cores aggregated
+struct dpf_console_group_s {
+	int level; // topo_level_t
+	int socket;
+	int die;
+	int module;
+	int first_core; // lowest and highest core id, for labels
+	int last_core;
+	int core_count;
+
+	double ipc; // instructions / cycles over the group
+	double dram_bw; // DRAM hit loads * 64 B, per second
+	double l2_hit; // L2 hits out of all loads
+	uint64_t msr_values[NUM_MSR]; // of the first core
+	int msr_mixed; // 1 if the cores do not share the same MSR values
+
+	// sums over the cores, rebuilt every snapshot
+	double instr, cycles, loads, l2_hits, dram_hits;
+
+	struct history_s ipc_hist;
+};
+
+int topology_read(int core_id, int first_core, struct core_topo_s *topo);
+int topology_build_groups(struct core_topo_s *topo, int count,
+			  struct dpf_console_group_s **groups,
+			  int (*core_groups)[TOPO_LEVELS]);
+
+void history_push(struct history_s *hist, float value);
+float history_get(const struct history_s *hist, int age);
+
+#endif /* __TOPOLOGY_H */
@@ -61,8 +61,8 @@ int read_msr(int core_id, uint64_t *msr_values)
 	return 0;
 }
 
-// read DDR bandwidth values
-// accepts the read and write bandwidth values as pointers
+// read the free running DDR byte counters
+// accepts the read and write byte counts as pointers
 // returns 0 on success, -1 on failure
 int read_ddr_bw(uint64_t *read_bw, uint64_t *write_bw)
 {
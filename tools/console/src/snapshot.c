@@ -1,83 +1,278 @@
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "kernel_api.h"
 #include "log.h"
-#include "metrics.h"
 #include "snapshot.h"
-#include "tuning.h"
+#include "user_api.h"
 
-// populate the snapshot struct with all core and system metrics
+#define CACHE_LINE (64) // bytes per DRAM hit load
+
+// kernel response buffer and previous per core values, sized for the
+// core range by console_snapshot_init()
+static struct dpf_resp_snapshot_read_s *resp;
+static struct core_metrics *prev;
+// group index per level for every core in the range, by core_id - core_first
+static int (*core_groups)[TOPO_LEVELS];
+
+// size the snapshot for the core range, look up the topology of every core
+// and build the socket, die and module groups
 // accepts a pointer to a dpf_console_snapshot_s struct
 // returns 0 on success, -1 on failure
-int update_console_snapshot(struct dpf_console_snapshot_s *snapshot)
+int console_snapshot_init(struct dpf_console_snapshot_s *snapshot)
 {
-	enum tuning_state_t tuning_state;
-	struct core_metrics *core_data;
-	int core;
-	int core_index = 0;
+	struct core_topo_s *topo;
+	int count;
 
 	if (!snapshot) {
 		fprintf(stderr, "Snapshot pointer is NULL\n");
 		return -1;
 	}
 
-	if (core_first < 0 || core_last >= MAX_CORES || core_first > core_last) {
+	if (core_first < 0 || core_first > core_last) {
 		fprintf(stderr, "Invalid core range: %d to %d\n", core_first,
 			core_last);
 		return -1;
 	}
 
-	if ((core_last - core_first + 1) > MAX_CORES) {
-		fprintf(stderr, "Core range exceeds MAX_CORES\n");
+	count = core_last - core_first + 1;
+
+	memset(snapshot, 0, sizeof(*snapshot));
+	snapshot->cores = calloc(count, sizeof(*snapshot->cores));
+	prev = calloc(count, sizeof(*prev));
+	core_groups = calloc(count, sizeof(*core_groups));
+	resp = malloc(DPF_SNAPSHOT_SIZE(count));
+	topo = calloc(count, sizeof(*topo));
+	if (!snapshot->cores || !prev || !core_groups || !resp || !topo) {
+		fprintf(stderr, "Failed to allocate snapshot for %d cores\n",
+			count);
+		free(topo);
 		return -1;
 	}
+	snapshot->core_capacity = count;
 
-	for (core = core_first; core <= core_last; core++) {
-		if (core_index >= MAX_CORES) {
-			fprintf(stderr, "core index exceeded MAX_CORES\n");
-			break;
-		}
+	for (int i = 0; i < count; i++)
+		topology_read(core_first + i, core_first, &topo[i]);
+
+	snapshot->group_count = topology_build_groups(topo, count,
+						      &snapshot->groups,
+						      core_groups);
+	free(topo);
+	if (snapshot->group_count < 0) {
+		fprintf(stderr, "Failed to build topology groups\n");
+		return -1;
+	}
+
+	for (int i = 0; i < snapshot->group_count; i++)
+		snapshot->level_count[snapshot->groups[i].level]++;
+
+	return 0;
+}
+
+// derive the per channel rates from the difference to the previous
+// free running counts and how far the busiest channel is above the
+// channel mean
+static void update_ddr_channels(struct dpf_console_snapshot_s *snapshot,
+				struct dpf_ddr_channels_s *ddr)
+{
+	static uint64_t prev_timestamp;
+	static uint64_t prev_read[MAX_DDR_CHANNELS];
+	static uint64_t prev_write[MAX_DDR_CHANNELS];
+	double interval = 0;
+	double total = 0, hot = 0;
+	int n;
+
+	if (prev_timestamp && ddr->timestamp > prev_timestamp)
+		interval = (ddr->timestamp - prev_timestamp) / 1e9;
+	prev_timestamp = ddr->timestamp;
+
+	n = ddr->num_channels;
+	if (n > MAX_DDR_CHANNELS)
+		n = MAX_DDR_CHANNELS;
+
+	snapshot->ddr_channel_count = n;
+	snapshot->ddr_bw_target = ddr->bw_target;
+	snapshot->ddr_imbalance = 1;
+	snapshot->ddr_hot_channel = 0;
 
-		// the next core_metrics struct and set core_id
-		core_data = &snapshot->cores[core_index];
-		core_data->core_id = core;
+	for (int i = 0; i < n; i++) {
+		uint64_t read = ddr->read_bytes[i] - prev_read[i];
+		uint64_t write = ddr->write_bytes[i] - prev_write[i];
+		double rate;
 
-		if (read_pmu(core, core_data->pmu_values) != 0) {
-			fprintf(stderr, "Skipping core %d due to PMU read error\n", core);
+		prev_read[i] = ddr->read_bytes[i];
+		prev_write[i] = ddr->write_bytes[i];
+		snapshot->ddr_ch_read_rate[i] = 0;
+		snapshot->ddr_ch_write_rate[i] = 0;
+		if (interval <= 0)
 			continue;
+
+		snapshot->ddr_ch_read_rate[i] = read / interval;
+		snapshot->ddr_ch_write_rate[i] = write / interval;
+
+		rate = snapshot->ddr_ch_read_rate[i] +
+		       snapshot->ddr_ch_write_rate[i];
+		total += rate;
+		if (rate > hot) {
+			hot = rate;
+			snapshot->ddr_hot_channel = i;
 		}
+	}
 
-		if (read_msr(core, core_data->msr_values) != 0) {
-			fprintf(stderr, "Skipping core %d due to MSR read error\n", core);
-			continue;
+	if (total > 0)
+		snapshot->ddr_imbalance = hot / (total / n);
+}
+
+// aggregate the cores into their socket, die and module groups
+// and extend the sparkline history
+static void update_groups(struct dpf_console_snapshot_s *snapshot)
+{
+	double instr = 0, cycles = 0;
+
+	for (int i = 0; i < snapshot->group_count; i++) {
+		struct dpf_console_group_s *g = &snapshot->groups[i];
+
+		g->instr = g->cycles = g->loads = 0;
+		g->l2_hits = g->dram_hits = 0;
+		g->msr_mixed = 0;
+		g->core_count = 0;
+	}
+
+	for (int i = 0; i < snapshot->core_count; i++) {
+		struct core_metrics *core = &snapshot->cores[i];
+
+		for (int level = 0; level < TOPO_LEVELS; level++) {
+			struct dpf_console_group_s *g =
+				&snapshot->groups[core->groups[level]];
+
+			if (g->core_count == 0)
+				memcpy(g->msr_values, core->msr_values,
+				       sizeof(g->msr_values));
+			else if (memcmp(g->msr_values, core->msr_values,
+					sizeof(g->msr_values)))
+				g->msr_mixed = 1;
+
+			g->core_count++;
+			g->instr += core->pmu_rates[PERF_INST_RETIRED_ANY_P];
+			g->cycles += core->pmu_rates[PERF_CPU_CLK_UNHALTED_THREAD];
+			g->loads += core->pmu_rates[PERF_MEM_UOPS_RETIRED_ALL_LOADS];
+			g->l2_hits += core->pmu_rates[PERF_MEM_LOAD_UOPS_RETIRED_L2_HIT];
+			g->dram_hits += core->pmu_rates[PERF_MEM_LOAD_UOPS_RETIRED_DRAM_HIT];
 		}
 
-		core_index++;
+		instr += core->pmu_rates[PERF_INST_RETIRED_ANY_P];
+		cycles += core->pmu_rates[PERF_CPU_CLK_UNHALTED_THREAD];
 	}
 
-	snapshot->core_count = core_index;
+	if (snapshot->interval <= 0)
+		return;
 
-	if (core_index == 0) {
-		fprintf(stderr, "No valid core data collected\n");
+	for (int i = 0; i < snapshot->group_count; i++) {
+		struct dpf_console_group_s *g = &snapshot->groups[i];
+
+		g->ipc = g->cycles ? g->instr / g->cycles : 0;
+		g->l2_hit = g->loads ? g->l2_hits / g->loads : 0;
+		g->dram_bw = g->dram_hits * CACHE_LINE;
+		history_push(&g->ipc_hist, g->ipc);
+	}
+
+	history_push(&snapshot->ipc_hist, cycles ? instr / cycles : 0);
+	history_push(&snapshot->ddr_read_hist,
+		     snapshot->ddr_read_rate / (1024 * 1024));
+	history_push(&snapshot->ddr_write_hist,
+		     snapshot->ddr_write_rate / (1024 * 1024));
+}
+
+// populate the snapshot struct with all core and system metrics
+// with a single kernel request and derive per second rates from the
+// previous snapshot
+// accepts a pointer to a dpf_console_snapshot_s struct
+// returns 0 on success, -1 on failure
+int update_console_snapshot(struct dpf_console_snapshot_s *snapshot)
+{
+	uint64_t prev_timestamp;
+	int prev_count;
+	int count;
+
+	if (!snapshot || !snapshot->cores) {
+		fprintf(stderr, "Snapshot not initialized\n");
 		return -1;
 	}
 
-	if (read_ddr_bw(&snapshot->ddr_read_bw, &snapshot->ddr_write_bw) != 0) {
-		fprintf(stderr, "Error reading DDR bandwidth\n");
-		// set to zero if read fails
-		snapshot->ddr_read_bw = 0;
-		snapshot->ddr_write_bw = 0;
+	count = kernel_snapshot_read(core_first, snapshot->core_capacity,
+				     resp);
+	if (count <= 0 || count > snapshot->core_capacity) {
+		fprintf(stderr, "No valid core data collected\n");
 		return -1;
 	}
 
-	tuning_state = snapshot->tuning_enabled;
-	if (tuning_state == 1) {
-		start_tuning(1);
-		return 0;
-	} else if (tuning_state == 0) {
-		stop_tuning(0);
-		return 0;
+	prev_count = snapshot->core_count;
+	prev_timestamp = snapshot->timestamp;
+	memcpy(prev, snapshot->cores, prev_count * sizeof(prev[0]));
+
+	snapshot->timestamp = resp->timestamp;
+	snapshot->interval = prev_timestamp ?
+		(resp->timestamp - prev_timestamp) / 1e9 : 0;
+	snapshot->tuning_enabled = resp->tuning;
+	snapshot->ddr_read_bw = 0;
+	snapshot->ddr_write_bw = 0;
+	if (prev_timestamp) {
+		snapshot->ddr_read_bw = resp->read_bytes -
+					snapshot->ddr_read_total;
+		snapshot->ddr_write_bw = resp->write_bytes -
+					 snapshot->ddr_write_total;
+	}
+	snapshot->ddr_read_total = resp->read_bytes;
+	snapshot->ddr_write_total = resp->write_bytes;
+	snapshot->ddr_read_rate = 0;
+	snapshot->ddr_write_rate = 0;
+	if (snapshot->interval > 0) {
+		snapshot->ddr_read_rate = snapshot->ddr_read_bw /
+					  snapshot->interval;
+		snapshot->ddr_write_rate = snapshot->ddr_write_bw /
+					   snapshot->interval;
+	}
+
+	for (int i = 0; i < count; i++) {
+		struct core_metrics *core = &snapshot->cores[i];
+		struct core_metrics *old = NULL;
+		uint64_t cycles, instr;
+
+		core->core_id = resp->cores[i].core_id;
+		memcpy(core->pmu_values, resp->cores[i].pmu_values,
+		       sizeof(core->pmu_values));
+		memcpy(core->msr_values, resp->cores[i].msr_values,
+		       sizeof(core->msr_values));
+		memcpy(core->groups, core_groups[core->core_id - core_first],
+		       sizeof(core->groups));
+
+		// the core list only changes with the core range
+		if (i < prev_count && prev[i].core_id == core->core_id)
+			old = &prev[i];
+
+		memset(core->pmu_rates, 0, sizeof(core->pmu_rates));
+		core->ipc = 0;
+		if (!old || snapshot->interval <= 0)
+			continue;
+
+		for (int j = 0; j < NUM_PMU; j++)
+			core->pmu_rates[j] = (core->pmu_values[j] -
+					      old->pmu_values[j]) /
+					     snapshot->interval;
+
+		cycles = core->pmu_values[PERF_CPU_CLK_UNHALTED_THREAD] -
+			 old->pmu_values[PERF_CPU_CLK_UNHALTED_THREAD];
+		instr = core->pmu_values[PERF_INST_RETIRED_ANY_P] -
+			old->pmu_values[PERF_INST_RETIRED_ANY_P];
+		if (cycles)
+			core->ipc = (double)instr / cycles;
 	}
 
+	snapshot->core_count = count;
+	update_ddr_channels(snapshot, &resp->ddr);
+	update_groups(snapshot);
+
 	return 0;
 }
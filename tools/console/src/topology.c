@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "topology.h"
+
+// read a single integer from a sysfs topology file of a core
+// returns the value, -1 if the file does not exist or can't be parsed
+static int read_topology_value(int core_id, const char *name)
+{
+	char path[128];
+	FILE *f;
+	int value;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/topology/%s", core_id, name);
+
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	if (fscanf(f, "%d", &value) != 1)
+		value = -1;
+	fclose(f);
+
+	return value;
+}
+
+// look up socket, die and module of a core
+// modules are the L2 clusters reported as cluster_id, on kernels without
+// it groups of CORES_PER_MODULE counted from first_core are used
+// returns 0 on success, -1 on failure
+int topology_read(int core_id, int first_core, struct core_topo_s *topo)
+{
+	if (!topo)
+		return -1;
+
+	topo->core_id = core_id;
+
+	topo->socket = read_topology_value(core_id, "physical_package_id");
+	if (topo->socket < 0)
+		topo->socket = 0;
+
+	topo->die = read_topology_value(core_id, "die_id");
+	if (topo->die < 0)
+		topo->die = 0;
+
+	topo->module = read_topology_value(core_id, "cluster_id");
+	if (topo->module < 0 || topo->module >= 0xffff)
+		topo->module = (core_id - first_core) / CORES_PER_MODULE;
+
+	return 0;
+}
+
+static int topo_compare(const void *a, const void *b)
+{
+	const struct core_topo_s *x = a;
+	const struct core_topo_s *y = b;
+
+	if (x->socket != y->socket)
+		return x->socket - y->socket;
+	if (x->die != y->die)
+		return x->die - y->die;
+	if (x->module != y->module)
+		return x->module - y->module;
+
+	return x->core_id - y->core_id;
+}
+
+// build the socket, die and module groups of count cores in tree order,
+// each socket followed by its dies, each die followed by its modules
+// accepts the core topology indexed by core position, returns the groups
+// through groups and the group index per level of every core position
+// through core_groups
+// returns the number of groups, -1 on failure
+int topology_build_groups(struct core_topo_s *topo, int count,
+			  struct dpf_console_group_s **groups,
+			  int (*core_groups)[TOPO_LEVELS])
+{
+	struct dpf_console_group_s *g;
+	struct core_topo_s *sorted;
+	int current[TOPO_LEVELS];
+	int n = 0;
+
+	if (!topo || count <= 0 || !groups || !core_groups)
+		return -1;
+
+	sorted = malloc(count * sizeof(*sorted));
+	// at most one group per level and core
+	g = calloc(count * TOPO_LEVELS, sizeof(*g));
+	if (!sorted || !g) {
+		free(sorted);
+		free(g);
+		return -1;
+	}
+
+	memcpy(sorted, topo, count * sizeof(*sorted));
+	qsort(sorted, count, sizeof(*sorted), topo_compare);
+
+	for (int i = 0; i < count; i++) {
+		struct core_topo_s *t = &sorted[i];
+		struct core_topo_s *p = i ? &sorted[i - 1] : NULL;
+		int new_level = TOPO_LEVELS;
+
+		if (!p || p->socket != t->socket)
+			new_level = TOPO_SOCKET;
+		else if (p->die != t->die)
+			new_level = TOPO_DIE;
+		else if (p->module != t->module)
+			new_level = TOPO_MODULE;
+
+		// a change on one level starts a new group on all levels below
+		for (int level = new_level; level < TOPO_LEVELS; level++) {
+			g[n].level = level;
+			g[n].socket = t->socket;
+			g[n].die = t->die;
+			g[n].module = t->module;
+			g[n].first_core = t->core_id;
+			current[level] = n++;
+		}
+
+		for (int level = 0; level < TOPO_LEVELS; level++) {
+			struct dpf_console_group_s *grp = &g[current[level]];
+
+			grp->core_count++;
+			if (t->core_id < grp->first_core)
+				grp->first_core = t->core_id;
+			if (t->core_id > grp->last_core)
+				grp->last_core = t->core_id;
+		}
+
+		// map back to the position of the core in topo
+		for (int j = 0; j < count; j++) {
+			if (topo[j].core_id == t->core_id) {
+				memcpy(core_groups[j], current, sizeof(current));
+				break;
+			}
+		}
+	}
+
+	free(sorted);
+	*groups = g;
+
+	return n;
+}
+
+// add the latest sample, replacing the oldest when the ring is full
+void history_push(struct history_s *hist, float value)
+{
+	hist->values[hist->head] = value;
+	hist->head = (hist->head + 1) % HISTORY_LEN;
+	if (hist->count < HISTORY_LEN)
+		hist->count++;
+}
+
+// sample age steps back, 0 is the latest
+float history_get(const struct history_s *hist, int age)
+{
+	return hist->values[(hist->head - 1 - age + 2 * HISTORY_LEN) %
+			    HISTORY_LEN];
+}
@@ -46,26 +46,39 @@ int detect_cores(void)
 	return 0;
 }
 
+// Monotonic time in ms
+static uint64_t now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 // Main application entry
 //
 // Initializes:
 // 1. Kernel interface
 // 2. NCurses UI
-// 3. Event loop
+// 3. Event loop, sleeping in getch() until a key is pressed or the next
+//    snapshot is due. Tuning control messages are only sent on key presses.
 //
 // Key controls:
 // - s: Start tuning
 // - t: Terminate tuning
 // - p: PMU view
 // - m: MSR view
+// - g: Topology view, +/- to expand or collapse levels
+// - h: Module heatmap view, n for the next metric
+// - d: DDR bandwidth per channel
 // - q: Quit
 // - ↑/↓: Scroll
 int main(void)
 {
 	int rows, cols, ch, ret;
-	time_t last_update = 0;
-	time_t now;
-	bool needs_refresh = true; // Flag to force initial refresh
+	uint64_t next_update = 0;
+	uint64_t now;
 
 	log_setlevel(2);
 
@@ -87,6 +100,11 @@ int main(void)
 		exit(1);
 	}
 
+	if (console_snapshot_init(&snapshot) < 0) {
+		fprintf(stderr, "Error: Failed to allocate snapshot.\n");
+		exit(1);
+	}
+
 	update_metrics();
 
 	// initialize ncurses
@@ -94,7 +112,6 @@ int main(void)
 	cbreak();
 	noecho();
 	keypad(stdscr, TRUE);
-	nodelay(stdscr, TRUE);
 	signal(SIGWINCH, handle_resize);
 	curs_set(0);
 
@@ -109,58 +126,85 @@ int main(void)
 	titlebar_win = derwin(main_win, 1, cols - 2, 3, 1);
 
 	while (1) {
-		if (update_console_snapshot(&snapshot) == 0) {
-			now = time(NULL);
-
-			// Check if 1 sec has passed or we need forced refresh
-			if (needs_refresh || difftime(now, last_update) >= 1.0) {
-				header();
-				if (current_view == 0)
-					pmu_view();
-				else
-					msr_view();
-
-				last_update = now;
-				needs_refresh = false;
+		now = now_ms();
+		if (now >= next_update) {
+			if (update_console_snapshot(&snapshot) == 0) {
+				redraw();
+			} else {
+				mvwprintw(main_win, 4, 2,
+					  "Failed to read PMU metrics.");
+				wnoutrefresh(main_win);
+				doupdate();
 			}
+			next_update = now + CONSOLE_REFRESH_MS;
+		}
 
-			ch = getch();
-
-			if (ch != ERR) {
-				if (ch == 'q')
-					break;
-
-				switch (ch) {
-				case 's':
-					snapshot.tuning_enabled = 1;
-					break;
-
-				case 't':
-					snapshot.tuning_enabled = 0;
-					break;
-
-				case 'p':
-					current_view = 0;
-					needs_refresh = true;
-					break;
-
-				case 'm':
-					current_view = 1;
-					needs_refresh = true;
-					break;
-
-				default:
-					break;
-				}
-
-				scrollable(ch);
-			}
-		} else {
-			mvwprintw(main_win, 4, 2,
-				  "Failed to read PMU metrics.");
+		// block until a key press or the next snapshot
+		timeout(next_update - now);
+		ch = getch();
+		if (ch == ERR)
+			continue;
+
+		if (ch == 'q')
+			break;
+
+		switch (ch) {
+		case 's':
+			if (start_tuning(1) == 0)
+				snapshot.tuning_enabled = 1;
+			break;
+
+		case 't':
+			if (stop_tuning(0) == 0)
+				snapshot.tuning_enabled = 0;
+			break;
+
+		case 'p':
+			current_view = VIEW_PMU;
+			scroll_offset = 0;
+			break;
+
+		case 'm':
+			current_view = VIEW_MSR;
+			scroll_offset = 0;
+			break;
+
+		case 'g':
+			current_view = VIEW_TOPOLOGY;
+			scroll_offset = 0;
+			break;
+
+		case 'h':
+			current_view = VIEW_HEATMAP;
+			scroll_offset = 0;
+			break;
+
+		case 'd':
+			current_view = VIEW_DDR;
+			scroll_offset = 0;
+			break;
+
+		case '+':
+			if (tree_depth <= TOPO_LEVELS)
+				tree_depth++;
+			break;
+
+		case '-':
+			if (tree_depth > 1)
+				tree_depth--;
+			scroll_offset = 0;
+			break;
+
+		case 'n':
+			heatmap_next_metric();
+			break;
+
+		default:
+			scrollable(ch);
+			break;
 		}
 
-		napms(50);
+		redraw();
 	}
 
 	delwin(main_win);
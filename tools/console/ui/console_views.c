@@ -1,18 +1,112 @@
 #include <ncurses.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "atom_msr.h"
+#include "msr_layout.h"
+#include "sysdetect.h"
+#include "kernel_common.h"
 #include "metrics_interface.h"
 #include "console.h"
 
 #define TITLEBAR_COLOR (1)
+#define HEAT_COLOR (2) // first of HEAT_LEVELS pairs, cold to hot
+#define HEAT_LEVELS (6)
+#define SPARK_WIDTH (30)
+#define GAUGE_WIDTH (30)
+#define DDR_IMBALANCE_WARN (1.2) // busiest channel vs channel mean
 
 int num_metrics = 50;
 int scroll_offset;
+int tree_depth = TOPO_LEVELS; // levels shown in the topology view, +1 for cores
+int heat_metric;
+
+// sparkline characters from lowest to highest
+static const char spark_chars[] = " .:-=+*#%@";
+
+// prefetcher MSR layout of the E-cores, the first one for unknown models
+static const struct msr_layout_s *heat_layout;
+
+// Values the heatmap can show per module
+static double heat_ipc(struct dpf_console_group_s *g)
+{
+	return g->ipc;
+}
+
+static double heat_dram(struct dpf_console_group_s *g)
+{
+	return g->dram_bw / (1024 * 1024);
+}
+
+static double heat_l2hit(struct dpf_console_group_s *g)
+{
+	return g->l2_hit * 100;
+}
+
+// select the MSR layout of the CPU we run on, once
+static const struct msr_layout_s *layout_get(void)
+{
+	unsigned int family, model;
+
+	if (heat_layout)
+		return heat_layout;
+
+	if (cpu_family_model(&family, &model) == 0)
+		heat_layout = msr_layout_find(family, model);
+	if (!heat_layout)
+		heat_layout = &msr_layouts[0];
+
+	return heat_layout;
+}
+
+// value of a prefetcher field of the module's first core, by the layout
+static double heat_field(struct dpf_console_group_s *g, int field)
+{
+	union msr_u msr[HWPF_MSR_REGS];
+
+	for (int i = 0; i < HWPF_MSR_REGS && i < NUM_MSR; i++)
+		msr[i].v = g->msr_values[i];
+
+	return hwpf_field_get(layout_get(), msr, field);
+}
+
+// field is the prefetcher field shown, -1 for the counter based values
+static const struct {
+	const char *name;
+	double (*get)(struct dpf_console_group_s *g);
+	int field;
+} heat_metrics[] = {
+	{"IPC", heat_ipc, -1},
+	{"DRAM MB/s", heat_dram, -1},
+	{"L2 hit %", heat_l2hit, -1},
+	{"L2 XQ threshold", NULL, HWPF_L2_STREAM_AMP_XQ_THRESHOLD},
+	{"L2 max distance", NULL, HWPF_L2_STREAM_MAX_DISTANCE},
+	{"LLC max distance", NULL, HWPF_LLC_STREAM_MAX_DISTANCE},
+	{"L2 demand density", NULL, HWPF_L2_STREAM_DEMAND_DENSITY},
+};
+
+#define NUM_HEAT_METRICS (sizeof(heat_metrics) / sizeof(heat_metrics[0]))
+
+// 1 if heatmap metric m can be shown, its field is in the active layout
+static int heat_metric_shown(int m)
+{
+	int field = heat_metrics[m].field;
+
+	return field < 0 || layout_get()->field[field].width != 0;
+}
+
+static double heat_value(struct dpf_console_group_s *g)
+{
+	if (heat_metrics[heat_metric].get)
+		return heat_metrics[heat_metric].get(g);
+
+	return heat_field(g, heat_metrics[heat_metric].field);
+}
 
 // Update system metrics from kernel
 // Return 0 on success
@@ -22,7 +116,7 @@ int update_metrics(void)
 {
 	if ((collect_sysinfo(&sysinfo) == 0) &&
 	    (update_console_snapshot(&snapshot) == 0)) {
-		num_metrics = sysinfo.last_core - sysinfo.first_core + 1;
+		num_metrics = snapshot.core_count;
 	};
 
 	return 0;
@@ -31,10 +125,16 @@ int update_metrics(void)
 // Initialize color pairs for UI
 // Color Scheme:
 // - TITLEBAR_COLOR: Black on White
+// - HEAT_COLOR...: Black on blue (cold) to red (hot)
 int init_colors(void)
 {
+	const short heat[HEAT_LEVELS] = {COLOR_BLUE, COLOR_CYAN, COLOR_GREEN,
+					 COLOR_YELLOW, COLOR_MAGENTA, COLOR_RED};
+
 	start_color();
 	init_pair(TITLEBAR_COLOR, COLOR_BLACK, COLOR_WHITE);
+	for (int i = 0; i < HEAT_LEVELS; i++)
+		init_pair(HEAT_COLOR + i, COLOR_BLACK, heat[i]);
 
 	return 0;
 }
@@ -51,26 +151,88 @@ int title_bar(const char *titles[], size_t size, int pos_x, int space)
 
 	// print titles in bold style
 	wattron(titlebar_win, A_BOLD);
-	mvwprintw(titlebar_win, 0, 2, "Core");
+	mvwprintw(titlebar_win, 0, 2, "%s", titles[0]);
 	for (int i = 1; i < size; i++) {
 		mvwprintw(titlebar_win, 0, pos_x, "%s", titles[i]);
 		pos_x += space;
 	}
 	wattroff(titlebar_win, A_BOLD);
 
-	wrefresh(titlebar_win);
+	wnoutrefresh(titlebar_win);
 
 	return 0;
 }
 
+// Draws the last width samples of hist, oldest left, scaled between the
+// smallest and largest of them
+static void sparkline(WINDOW *win, int y, int x,
+		      const struct history_s *hist, int width)
+{
+	int levels = sizeof(spark_chars) - 2;
+	int n = hist->count < width ? hist->count : width;
+	float min, max;
+
+	if (n == 0)
+		return;
+
+	min = max = history_get(hist, 0);
+	for (int age = 1; age < n; age++) {
+		float v = history_get(hist, age);
+
+		if (v < min)
+			min = v;
+		if (v > max)
+			max = v;
+	}
+
+	for (int age = n - 1; age >= 0; age--) {
+		float v = history_get(hist, age);
+		int level = max > min ? (v - min) / (max - min) * levels : 0;
+
+		mvwaddch(win, y, x++, spark_chars[level + 1]);
+	}
+}
+
+// Prints the key guide on the last line of main_win with the
+// key of the current view highlighted
+static void usage_bar(int max_rows)
+{
+	const struct {
+		int view;
+		const char *key;
+		const char *name;
+	} keys[] = {
+		{-1, "s", "Start tuning"}, {-1, "t", "Stop tuning"},
+		{VIEW_PMU, "p", "PMU"}, {VIEW_MSR, "m", "MSR"},
+		{VIEW_TOPOLOGY, "g", "Topology"}, {VIEW_HEATMAP, "h", "Heatmap"},
+		{VIEW_DDR, "d", "DDR"},
+		{-1, "q", "quit"},
+	};
+	int x = 2;
+
+	mvwprintw(main_win, max_rows - 1, x, " Press");
+	x += 6;
+	for (size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+		mvwprintw(main_win, max_rows - 1, x, " [%s] ", keys[i].key);
+		x += 5;
+		if (keys[i].view == current_view)
+			wattron(main_win, A_BOLD | COLOR_PAIR(TITLEBAR_COLOR));
+		mvwprintw(main_win, max_rows - 1, x, "%s", keys[i].name);
+		wattroff(main_win, A_BOLD | COLOR_PAIR(TITLEBAR_COLOR));
+		x += strlen(keys[i].name);
+		if (i + 1 < sizeof(keys) / sizeof(keys[0]))
+			mvwprintw(main_win, max_rows - 1, x++, ",");
+	}
+}
+
 // Displays system information.
 int header(void)
 {
 	double ddr_write_mbps;
 	double ddr_read_mbps;
 
-	ddr_write_mbps = (double)snapshot.ddr_write_bw / (1024 * 1024);
-	ddr_read_mbps = (double)snapshot.ddr_read_bw / (1024 * 1024);
+	ddr_write_mbps = snapshot.ddr_write_rate / (1024 * 1024);
+	ddr_read_mbps = snapshot.ddr_read_rate / (1024 * 1024);
 
 	werase(header_win);
 	box(header_win, 0, 0);
@@ -78,16 +240,17 @@ int header(void)
 	mvwprintw(header_win, 1, 2, "dPF Monitor");
 	wattroff(header_win, A_BOLD | A_UNDERLINE);
 
-	mvwprintw(header_win, 2, 2, "Active Cores: %d",
-		sysinfo.last_core - sysinfo.first_core + 1);
+	mvwprintw(header_win, 2, 2,
+		  "Active Cores: %d  (%d sockets, %d dies, %d modules)",
+		  snapshot.core_count, snapshot.level_count[TOPO_SOCKET],
+		  snapshot.level_count[TOPO_DIE],
+		  snapshot.level_count[TOPO_MODULE]);
 
 	mvwprintw(header_win, 3, 2, "Tuning: %-3s",
 		  snapshot.tuning_enabled ? "ON" : "OFF");
 
-	mvwprintw(header_win, 4, 2, "DDR BW: Read=%lu bytes( %.2f MB/s),"
-				    " Write=%lu bytes ( %.2f MB/s)",
-		  snapshot.ddr_read_bw,
-		  ddr_read_mbps, snapshot.ddr_write_bw, ddr_write_mbps);
+	mvwprintw(header_win, 4, 2, "DDR BW: Read=%.2f MB/s, Write=%.2f MB/s",
+		  ddr_read_mbps, ddr_write_mbps);
 
 	mvwprintw(header_win, 5, 2, "DDR Config: BAR=%lx, Type=%s",
 		  sysinfo.confirmed_bar, sysinfo.confirmed_ddr_type == -1 ?
@@ -104,9 +267,24 @@ int header(void)
 
 	mvwprintw(header_win, 8, 2, "Total memory BW: %d MB/s",
 		  sysinfo.theoretical_bw);
-
-	refresh();
-	wrefresh(header_win);
+	if (snapshot.ddr_bw_target > 0)
+		wprintw(header_win, ", target %d MB/s (%.0f%% used)",
+			snapshot.ddr_bw_target, (ddr_read_mbps + ddr_write_mbps) *
+			100 / snapshot.ddr_bw_target);
+	if (snapshot.ddr_channel_count > 1)
+		wprintw(header_win, ", channel imbalance %.2f",
+			snapshot.ddr_imbalance);
+
+	mvwprintw(header_win, 9, 2, "IPC");
+	sparkline(header_win, 9, 6, &snapshot.ipc_hist, SPARK_WIDTH);
+	mvwprintw(header_win, 9, 8 + SPARK_WIDTH, "DDR Read");
+	sparkline(header_win, 9, 17 + SPARK_WIDTH, &snapshot.ddr_read_hist,
+		  SPARK_WIDTH);
+	mvwprintw(header_win, 9, 19 + 2 * SPARK_WIDTH, "DDR Write");
+	sparkline(header_win, 9, 29 + 2 * SPARK_WIDTH, &snapshot.ddr_write_hist,
+		  SPARK_WIDTH);
+
+	wnoutrefresh(header_win);
 
 	return 0;
 }
@@ -126,8 +304,17 @@ int pmu_view(void)
 	size_t size;
 	struct core_metrics *core;
 
-	const char *pmu_headers[] = {"Core", "All Loads", "L2 Hit", "L3 Hit",
-				"DRAM Hit", "XQ Promo", "Cycles", "Instr"};
+	static char labels[NUM_PMU][16];
+	const char *pmu_headers[NUM_PMU + 2];
+
+	// Column per kernel PMU event, labels from the event catalog
+	pmu_headers[0] = "Core";
+	for (int j = 0; j < NUM_PMU; j++) {
+		snprintf(labels[j], sizeof(labels[j]), "%s/s",
+			 pmu_event_labels[j]);
+		pmu_headers[j + 1] = labels[j];
+	}
+	pmu_headers[NUM_PMU + 1] = "IPC";
 
 	size = sizeof(pmu_headers) / sizeof(pmu_headers[0]);
 
@@ -143,24 +330,27 @@ int pmu_view(void)
 	wattroff(main_win, A_BOLD);
 
 	pos_x = 12;
-	space = 16;
+	space = 14;
 
 	title_bar(pmu_headers, size, pos_x, space);
 
+	num_metrics = snapshot.core_count;
+
 	// Print pmu values
-	for (int i = 0; i < snapshot.core_count && i < viewable_rows;
-	     ++i) {
-		core = &snapshot.cores[i];
+	for (int i = 0; scroll_offset + i < snapshot.core_count &&
+	     i < viewable_rows; ++i) {
+		core = &snapshot.cores[scroll_offset + i];
 
 		mvwprintw(main_win, 4 + i, 2, "Core %-2d",
 			  core->core_id);
 
 		pos_x = 12;
 		for (int j = 0; j < NUM_PMU; j++) {
-			mvwprintw(main_win, 4 + i, pos_x, "%-15lu",
-				  core->pmu_values[j]);
+			mvwprintw(main_win, 4 + i, pos_x, "%-13.0f",
+				  core->pmu_rates[j]);
 			pos_x += space;
 		}
+		mvwprintw(main_win, 4 + i, pos_x, "%.3f", core->ipc);
 	}
 
 	mvwprintw(main_win, max_rows - 2, 2, "Showing %d-%d of %d",
@@ -169,17 +359,9 @@ int pmu_view(void)
 		viewable_rows, num_metrics);
 
 	// usage guide
-	mvwprintw(main_win, max_rows - 1, 2,
-		  " Press [s] Start tuning, [t] Stop tuning, [p] ");
-	wattron(main_win, A_BOLD);
-	wattron(main_win, COLOR_PAIR(TITLEBAR_COLOR));
-	mvwprintw(main_win, max_rows - 1, 48, "PMU");
-	wattroff(main_win, A_BOLD);
-	wattroff(main_win, COLOR_PAIR(TITLEBAR_COLOR));
-	mvwprintw(main_win, max_rows - 1, 51, ", [m] MSR, [q] quit ");
+	usage_bar(max_rows);
 
-	refresh();
-	wrefresh(main_win);
+	wnoutrefresh(main_win);
 
 	return 0;
 }
@@ -219,10 +401,12 @@ int msr_view(void)
 
 	title_bar(msr_headers, size, pos_x, space);
 
+	num_metrics = snapshot.core_count;
+
 	// Print msr values
-	for (int i = 0; i < snapshot.core_count && i < viewable_rows;
-	     ++i) {
-		core = &snapshot.cores[i];
+	for (int i = 0; scroll_offset + i < snapshot.core_count &&
+	     i < viewable_rows; ++i) {
+		core = &snapshot.cores[scroll_offset + i];
 		mvwprintw(main_win, 4 + i, 2, "Core %-2d",
 			  core->core_id);
 
@@ -240,17 +424,375 @@ int msr_view(void)
 			viewable_rows, num_metrics);
 
 	// usage guide
-	mvwprintw(main_win, max_rows - 1, 2,
-		  " Press [s] Start tuning, [t] Stop tuning, [p] PMU, [m] ");
-	wattron(main_win, COLOR_PAIR(TITLEBAR_COLOR));
+	usage_bar(max_rows);
+
+	wnoutrefresh(main_win);
+
+	return 0;
+}
+
+// Prints one group row of the topology view
+static void group_row(int y, struct dpf_console_group_s *g)
+{
+	static const char *level_names[TOPO_LEVELS] = {"Socket", "Die",
+						       "Module"};
+	char label[32];
+
+	snprintf(label, sizeof(label), "%*s%s %d", g->level * 2, "",
+		 level_names[g->level], g->level == TOPO_SOCKET ? g->socket :
+		 g->level == TOPO_DIE ? g->die : g->module);
+
+	if (g->level < TOPO_MODULE)
+		wattron(main_win, A_BOLD);
+	mvwprintw(main_win, y, 2, "%-16s", label);
+	wattroff(main_win, A_BOLD);
+
+	mvwprintw(main_win, y, 18, "%d-%d", g->first_core, g->last_core);
+	mvwprintw(main_win, y, 28, "%.3f", g->ipc);
+	sparkline(main_win, y, 36, &g->ipc_hist, SPARK_WIDTH);
+	mvwprintw(main_win, y, 38 + SPARK_WIDTH, "%.1f",
+		  g->dram_bw / (1024 * 1024));
+	mvwprintw(main_win, y, 50 + SPARK_WIDTH, "%.1f", g->l2_hit * 100);
+	if (g->msr_mixed)
+		mvwprintw(main_win, y, 60 + SPARK_WIDTH, "mixed");
+	else
+		mvwprintw(main_win, y, 60 + SPARK_WIDTH, "%lx",
+			  g->msr_values[0]);
+}
+
+// Display socket -> die -> module -> core tree
+// Return 0 on success
+//
+// Shows per group aggregates:
+// - IPC with its sparkline history
+// - Bandwidth from DRAM hit loads
+// - L2 hit ratio and MSR 0x1320 (if all cores agree)
+// [+]/[-] change how many levels are expanded
+int topology_view(void)
+{
+	int max_rows, cols;
+	int viewable_rows;
+	int row = 0;
+
+	const char *topo_headers[] = {"Group", "Cores", "IPC", "IPC history",
+				      "DRAM MB/s", "L2 Hit %", "0x1320"};
+	const int topo_pos[] = {2, 17, 27, 35, 37 + SPARK_WIDTH,
+				49 + SPARK_WIDTH, 59 + SPARK_WIDTH};
+
+	werase(main_win);
+	box(main_win, 0, 0);
+
+	getmaxyx(main_win, max_rows, cols);
+	(void)cols;
+	viewable_rows = max_rows - 8;
+
 	wattron(main_win, A_BOLD);
-	mvwprintw(main_win, max_rows - 1, 57, "MSR");
+	mvwprintw(main_win, 1, 2, "Topology (depth %d, [+]/[-] to change)",
+		  tree_depth);
 	wattroff(main_win, A_BOLD);
-	wattroff(main_win, COLOR_PAIR(TITLEBAR_COLOR));
-	mvwprintw(main_win, max_rows - 1, 60, ", [q] quit ");
 
-	refresh();
-	wrefresh(main_win);
+	werase(titlebar_win);
+	wbkgd(titlebar_win, COLOR_PAIR(TITLEBAR_COLOR));
+	wattron(titlebar_win, A_BOLD);
+	for (size_t i = 0; i < sizeof(topo_pos) / sizeof(topo_pos[0]); i++)
+		mvwprintw(titlebar_win, 0, topo_pos[i], "%s", topo_headers[i]);
+	wattroff(titlebar_win, A_BOLD);
+	wnoutrefresh(titlebar_win);
+
+	for (int i = 0; i < snapshot.group_count; i++) {
+		struct dpf_console_group_s *g = &snapshot.groups[i];
+
+		if (g->level >= tree_depth)
+			continue;
+
+		if (row >= scroll_offset && row - scroll_offset < viewable_rows)
+			group_row(4 + row - scroll_offset, g);
+		row++;
+
+		if (g->level != TOPO_MODULE || tree_depth <= TOPO_LEVELS)
+			continue;
+
+		for (int c = 0; c < snapshot.core_count; c++) {
+			struct core_metrics *core = &snapshot.cores[c];
+			int y = 4 + row - scroll_offset;
+
+			if (core->groups[TOPO_MODULE] != i)
+				continue;
+			if (row >= scroll_offset &&
+			    row - scroll_offset < viewable_rows) {
+				mvwprintw(main_win, y, 2, "%*sCore %d",
+					  TOPO_LEVELS * 2, "", core->core_id);
+				mvwprintw(main_win, y, 28, "%.3f", core->ipc);
+				mvwprintw(main_win, y, 38 + SPARK_WIDTH, "%.1f",
+					  core->pmu_rates[PERF_MEM_LOAD_UOPS_RETIRED_DRAM_HIT] *
+					  64 / (1024 * 1024));
+				mvwprintw(main_win, y, 60 + SPARK_WIDTH, "%lx",
+					  core->msr_values[0]);
+			}
+			row++;
+		}
+	}
+
+	num_metrics = row;
+
+	mvwprintw(main_win, max_rows - 2, 2, "Showing %d-%d of %d",
+		  scroll_offset + 1, (scroll_offset + viewable_rows >
+			num_metrics) ? num_metrics : scroll_offset +
+			viewable_rows, num_metrics);
+
+	// usage guide
+	usage_bar(max_rows);
+
+	wnoutrefresh(main_win);
+
+	return 0;
+}
+
+// Display one colored cell per module, a row of modules per die
+// Return 0 on success
+//
+// The metric is scaled between the lowest and highest module,
+// [n] selects the next metric
+int heatmap_view(void)
+{
+	int max_rows, cols;
+	int viewable_rows;
+	int row = -1, x = 0;
+	double min = 0, max = 0, v;
+	int first = 1;
+
+	double (*get)(struct dpf_console_group_s *g) = heat_value;
+
+	werase(main_win);
+	box(main_win, 0, 0);
+
+	getmaxyx(main_win, max_rows, cols);
+	viewable_rows = max_rows - 8;
+
+	wattron(main_win, A_BOLD);
+	mvwprintw(main_win, 1, 2, "Module heatmap: %s ([n] next metric)",
+		  heat_metrics[heat_metric].name);
+	wattroff(main_win, A_BOLD);
+
+	werase(titlebar_win);
+	wnoutrefresh(titlebar_win);
+
+	for (int i = 0; i < snapshot.group_count; i++) {
+		struct dpf_console_group_s *g = &snapshot.groups[i];
+
+		if (g->level != TOPO_MODULE || g->core_count == 0)
+			continue;
+		v = get(g);
+		if (first || v < min)
+			min = v;
+		if (first || v > max)
+			max = v;
+		first = 0;
+	}
+
+	// 3 columns per module after the die label, wrapped at the border
+	for (int i = 0; i < snapshot.group_count; i++) {
+		struct dpf_console_group_s *g = &snapshot.groups[i];
+		int level;
+
+		if (g->level == TOPO_SOCKET)
+			continue;
+
+		if (g->level == TOPO_DIE || x + 3 > cols - 2) {
+			row++;
+			x = 12;
+			if (g->level == TOPO_DIE && row >= scroll_offset &&
+			    row - scroll_offset < viewable_rows)
+				mvwprintw(main_win, 4 + row - scroll_offset, 2,
+					  "S%d D%d", g->socket, g->die);
+		}
+
+		if (g->level != TOPO_MODULE)
+			continue;
+
+		if (row >= scroll_offset && row - scroll_offset < viewable_rows) {
+			level = max > min ? (get(g) - min) / (max - min) *
+				(HEAT_LEVELS - 1) : 0;
+			if (g->core_count == 0)
+				mvwprintw(main_win, 4 + row - scroll_offset, x,
+					  " - ");
+			else {
+				wattron(main_win, COLOR_PAIR(HEAT_COLOR + level));
+				mvwprintw(main_win, 4 + row - scroll_offset, x,
+					  "   ");
+				wattroff(main_win, COLOR_PAIR(HEAT_COLOR + level));
+			}
+		}
+		x += 3;
+	}
+
+	num_metrics = row + 1;
+
+	// legend
+	mvwprintw(main_win, max_rows - 3, 2, "min %.2f ", min);
+	for (int i = 0; i < HEAT_LEVELS; i++) {
+		wattron(main_win, COLOR_PAIR(HEAT_COLOR + i));
+		wprintw(main_win, "   ");
+		wattroff(main_win, COLOR_PAIR(HEAT_COLOR + i));
+	}
+	wprintw(main_win, " max %.2f", max);
+
+	mvwprintw(main_win, max_rows - 2, 2, "Showing %d-%d of %d",
+		  scroll_offset + 1, (scroll_offset + viewable_rows >
+			num_metrics) ? num_metrics : scroll_offset +
+			viewable_rows, num_metrics);
+
+	// usage guide
+	usage_bar(max_rows);
+
+	wnoutrefresh(main_win);
+
+	return 0;
+}
+
+// Select the next heatmap metric
+int heatmap_next_metric(void)
+{
+	// fields this SKU does not have are skipped, IPC always is
+	do {
+		heat_metric = (heat_metric + 1) % NUM_HEAT_METRICS;
+	} while (!heat_metric_shown(heat_metric));
+
+	return 0;
+}
+
+// Draws a bar of GAUGE_WIDTH cells filled by used / limit, green up to
+// 70%, yellow up to the limit and red above
+static void gauge(WINDOW *win, int y, int x, double used, double limit)
+{
+	double fraction = limit > 0 ? used / limit : 0;
+	int fill = fraction * GAUGE_WIDTH;
+	int color = fraction < 0.7 ? HEAT_COLOR + 2 :
+		    fraction < 1 ? HEAT_COLOR + 3 : HEAT_COLOR + 5;
+
+	if (fill > GAUGE_WIDTH)
+		fill = GAUGE_WIDTH;
+
+	mvwaddch(win, y, x, '[');
+	wattron(win, COLOR_PAIR(color));
+	for (int i = 0; i < fill; i++)
+		waddch(win, ' ');
+	wattroff(win, COLOR_PAIR(color));
+	for (int i = fill; i < GAUGE_WIDTH; i++)
+		waddch(win, '.');
+	wprintw(win, "] %3.0f%%", fraction * 100);
+}
+
+// Display DDR bandwidth per memory controller
+// Return 0 on success
+//
+// Every channel is compared against its share of ddr_bw_target (or of
+// the theoretical bandwidth if no target is set). The busiest channel is
+// marked when it is more than DDR_IMBALANCE_WARN above the channel mean.
+int ddr_view(void)
+{
+	int max_rows, cols;
+	int n = snapshot.ddr_channel_count;
+	int imbalanced = n > 1 && snapshot.ddr_imbalance > DDR_IMBALANCE_WARN;
+	double limit, ch_limit;
+	double read = 0, write = 0;
+
+	const char *ddr_headers[] = {"Channel", "Read MB/s", "Write MB/s",
+				     "Total MB/s", "Use of limit"};
+	const int ddr_pos[] = {2, 12, 24, 36, 48};
+
+	werase(main_win);
+	box(main_win, 0, 0);
+
+	getmaxyx(main_win, max_rows, cols);
+	(void)cols;
+
+	limit = snapshot.ddr_bw_target > 0 ? snapshot.ddr_bw_target :
+		sysinfo.theoretical_bw;
+	ch_limit = n > 0 ? limit / n : 0;
+
+	wattron(main_win, A_BOLD);
+	mvwprintw(main_win, 1, 2, "DDR bandwidth per channel, limit %.0f MB/s "
+		  "(%s), %.0f MB/s per channel", limit,
+		  snapshot.ddr_bw_target > 0 ? "target" : "theoretical",
+		  ch_limit);
+	wattroff(main_win, A_BOLD);
+
+	werase(titlebar_win);
+	wbkgd(titlebar_win, COLOR_PAIR(TITLEBAR_COLOR));
+	wattron(titlebar_win, A_BOLD);
+	for (size_t i = 0; i < sizeof(ddr_pos) / sizeof(ddr_pos[0]); i++)
+		mvwprintw(titlebar_win, 0, ddr_pos[i], "%s", ddr_headers[i]);
+	wattroff(titlebar_win, A_BOLD);
+	wnoutrefresh(titlebar_win);
+
+	if (n == 0)
+		mvwprintw(main_win, 4, 2, "No DDR controllers configured");
+
+	for (int i = 0; i < n && 4 + i < max_rows - 5; i++) {
+		double rd = snapshot.ddr_ch_read_rate[i] / (1024 * 1024);
+		double wr = snapshot.ddr_ch_write_rate[i] / (1024 * 1024);
+		int hot = imbalanced && i == snapshot.ddr_hot_channel;
+
+		read += rd;
+		write += wr;
+
+		if (hot)
+			wattron(main_win, A_BOLD);
+		mvwprintw(main_win, 4 + i, 2, "%d", i);
+		mvwprintw(main_win, 4 + i, 12, "%.1f", rd);
+		mvwprintw(main_win, 4 + i, 24, "%.1f", wr);
+		mvwprintw(main_win, 4 + i, 36, "%.1f", rd + wr);
+		gauge(main_win, 4 + i, 48, rd + wr, ch_limit);
+		if (hot)
+			wprintw(main_win, "  <- busiest");
+		wattroff(main_win, A_BOLD);
+	}
+
+	if (n > 0) {
+		wattron(main_win, A_BOLD);
+		mvwprintw(main_win, max_rows - 4, 2, "Total");
+		wattroff(main_win, A_BOLD);
+		mvwprintw(main_win, max_rows - 4, 12, "%.1f", read);
+		mvwprintw(main_win, max_rows - 4, 24, "%.1f", write);
+		mvwprintw(main_win, max_rows - 4, 36, "%.1f", read + write);
+		gauge(main_win, max_rows - 4, 48, read + write, limit);
+
+		mvwprintw(main_win, max_rows - 3, 2,
+			  "Imbalance (busiest / mean): %.2f", snapshot.ddr_imbalance);
+		if (imbalanced) {
+			wattron(main_win, A_BOLD | COLOR_PAIR(HEAT_COLOR + 5));
+			wprintw(main_win, " channel %d is the bottleneck",
+				snapshot.ddr_hot_channel);
+			wattroff(main_win, A_BOLD | COLOR_PAIR(HEAT_COLOR + 5));
+		}
+	}
+
+	// usage guide
+	usage_bar(max_rows);
+
+	wnoutrefresh(main_win);
+
+	return 0;
+}
+
+// Redraw header and current view from the last snapshot.
+// All windows are staged with wnoutrefresh() and sent in one doupdate(),
+// so only the cells that changed since the last redraw reach the terminal.
+int redraw(void)
+{
+	header();
+	if (current_view == VIEW_PMU)
+		pmu_view();
+	else if (current_view == VIEW_MSR)
+		msr_view();
+	else if (current_view == VIEW_TOPOLOGY)
+		topology_view();
+	else if (current_view == VIEW_DDR)
+		ddr_view();
+	else
+		heatmap_view();
+	doupdate();
 
 	return 0;
 }
@@ -264,12 +806,6 @@ void handle_resize(int sig)
 {
 	int rows, cols;
 	(void)sig;
-	const char *pmu_headers[] = {"Core", "All Loads", "L2 Hit",
-				     "L3 Hit", "DRAM Hit", "XQ Promo",
-				     "Cycles", "Instr"};
-
-	const char *msr_headers[] = {"Core", "0x1320", "0x1321", "0x1322",
-				     "0x1323", "0x1324", "0x1a4"};
 
 	endwin();
 	refresh();
@@ -289,18 +825,7 @@ void handle_resize(int sig)
 	titlebar_win = derwin(main_win, 1, cols - 2, 3, 1);
 	box(main_win, 0, 0);
 
-	header();
-
-	if (current_view == 0) {
-		title_bar(pmu_headers,
-			  sizeof(pmu_headers) / sizeof(pmu_headers[0]), 12, 16);
-		pmu_view();
-
-	} else {
-		title_bar(msr_headers,
-			  sizeof(msr_headers) / sizeof(msr_headers[0]), 12, 18);
-		msr_view();
-	}
+	redraw();
 }
 
 // Handles content scrolling
@@ -1,21 +1,6 @@
-echo "MSR 0x1320"
-OUTPUT="$(sudo rdmsr 0x1320)"
-./msr2settings a 0x1320 "${OUTPUT}"
-
-echo "\nMSR 0x1321"
-OUTPUT="$(sudo rdmsr 0x1321)"
-./msr2settings a 0x1321 "${OUTPUT}"
-
-echo "\nMSR 0x1322"
-OUTPUT="$(sudo rdmsr 0x1322)"
-./msr2settings a 0x1322 "${OUTPUT}"
-
-echo "\nMSR 0x1323"
-OUTPUT="$(sudo rdmsr 0x1323)"
-./msr2settings a 0x1323 "${OUTPUT}"
-
-echo "\nMSR 0x1324"
-OUTPUT="$(sudo rdmsr 0x1324)"
-./msr2settings a 0x1324 "${OUTPUT}"
-
+# Decode the HWPF MSRs of the cpus in a cpulist (default 0), eg.
+# ./dumpmsr.sh 0-143 json
+CPUS="${1:-0}"
+FORMAT="${2:-text}"
 
+sudo ./msr2settings d "${CPUS}" "${FORMAT}" ${3}
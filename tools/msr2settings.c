@@ -1,20 +1,614 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cpuid.h>
 
 #include "../include/atom_msr.h"
+#include "../include/msr_layout.h"
+
+#define SELFTEST_ROUNDS (100000)
+#define MAX_CPUS (1024)
+
+static const uint32_t hwpf_msr_addr[HWPF_MSR_REGS] = {
+	0x1320, 0x1321, 0x1322, 0x1323, 0x1324, 0x1a4
+};
+
+// Field value decoded by the msr_u bitfields, -1 for the P-core fields
+static int bitfield_get(const union msr_u msr[], int f)
+{
+	switch(f){
+		case HWPF_L2_STREAM_AMP_XQ_THRESHOLD: return msr[0].msr1320.L2_STREAM_AMP_XQ_THRESHOLD;
+		case HWPF_L2_STREAM_MAX_DISTANCE: return msr[0].msr1320.L2_STREAM_MAX_DISTANCE;
+		case HWPF_L2_AMP_DISABLE_RECURSION: return msr[0].msr1320.L2_AMP_DISABLE_RECURSION;
+		case HWPF_LLC_STREAM_MAX_DISTANCE: return msr[0].msr1320.LLC_STREAM_MAX_DISTANCE;
+		case HWPF_LLC_STREAM_DISABLE: return msr[0].msr1320.LLC_STREAM_DISABLE;
+		case HWPF_LLC_STREAM_XQ_THRESHOLD: return msr[0].msr1320.LLC_STREAM_XQ_THRESHOLD;
+
+		case HWPF_L2_STREAM_AMP_CREATE_IL1: return msr[1].msr1321.L2_STREAM_AMP_CREATE_IL1;
+		case HWPF_L2_STREAM_DEMAND_DENSITY: return msr[1].msr1321.L2_STREAM_DEMAND_DENSITY;
+		case HWPF_L2_STREAM_DEMAND_DENSITY_OVR: return msr[1].msr1321.L2_STREAM_DEMAND_DENSITY_OVR;
+		case HWPF_L2_DISABLE_NEXT_LINE_PREFETCH: return msr[1].msr1321.L2_DISABLE_NEXT_LINE_PREFETCH;
+		case HWPF_L2_LLC_STREAM_AMP_XQ_THRESHOLD: return msr[1].msr1321.L2_LLC_STREAM_AMP_XQ_THRESHOLD;
+
+		case HWPF_LLC_STREAM_DEMAND_DENSITY: return msr[2].msr1322.LLC_STREAM_DEMAND_DENSITY;
+		case HWPF_LLC_STREAM_DEMAND_DENSITY_OVR: return msr[2].msr1322.LLC_STREAM_DEMAND_DENSITY_OVR;
+		case HWPF_L2_AMP_CONFIDENCE_DPT0: return msr[2].msr1322.L2_AMP_CONFIDENCE_DPT0;
+		case HWPF_L2_AMP_CONFIDENCE_DPT1: return msr[2].msr1322.L2_AMP_CONFIDENCE_DPT1;
+		case HWPF_L2_AMP_CONFIDENCE_DPT2: return msr[2].msr1322.L2_AMP_CONFIDENCE_DPT2;
+		case HWPF_L2_AMP_CONFIDENCE_DPT3: return msr[2].msr1322.L2_AMP_CONFIDENCE_DPT3;
+		case HWPF_L2_LLC_STREAM_DEMAND_DENSITY_XQ: return msr[2].msr1322.L2_LLC_STREAM_DEMAND_DENSITY_XQ;
+
+		case HWPF_L2_STREAM_AMP_CREATE_SWPFRFO: return msr[3].msr1323.L2_STREAM_AMP_CREATE_SWPFRFO;
+		case HWPF_L2_STREAM_AMP_CREATE_SWPFRD: return msr[3].msr1323.L2_STREAM_AMP_CREATE_SWPFRD;
+		case HWPF_L2_STREAM_AMP_CREATE_HWPFD: return msr[3].msr1323.L2_STREAM_AMP_CREATE_HWPFD;
+		case HWPF_L2_STREAM_AMP_CREATE_DRFO: return msr[3].msr1323.L2_STREAM_AMP_CREATE_DRFO;
+		case HWPF_STABILIZE_PREF_ON_SWPFRFO: return msr[3].msr1323.STABILIZE_PREF_ON_SWPFRFO;
+		case HWPF_STABILIZE_PREF_ON_SWPFRD: return msr[3].msr1323.STABILIZE_PREF_ON_SWPFRD;
+		case HWPF_STABILIZE_PREF_ON_IL1: return msr[3].msr1323.STABILIZE_PREF_ON_IL1;
+		case HWPF_STABILIZE_PREF_ON_HWPFD: return msr[3].msr1323.STABILIZE_PREF_ON_HWPFD;
+		case HWPF_STABILIZE_PREF_ON_DRFO: return msr[3].msr1323.STABILIZE_PREF_ON_DRFO;
+		case HWPF_L2_STREAM_AMP_CREATE_PFNPP: return msr[3].msr1323.L2_STREAM_AMP_CREATE_PFNPP;
+		case HWPF_L2_STREAM_AMP_CREATE_PFIPP: return msr[3].msr1323.L2_STREAM_AMP_CREATE_PFIPP;
+		case HWPF_STABILIZE_PREF_ON_PFNPP: return msr[3].msr1323.STABILIZE_PREF_ON_PFNPP;
+		case HWPF_STABILIZE_PREF_ON_PFIPP: return msr[3].msr1323.STABILIZE_PREF_ON_PFIPP;
+
+		case HWPF_L1_HOMELESS_THRESHOLD: return msr[4].msr1324.L1_HOMELESS_THRESHOLD;
+
+		case HWPF_L2_STREAM_DISABLED: return msr[5].msr1A4.L2_STREAM_DISABLED;
+		case HWPF_L1_DATA_STREAM_DISABLED: return msr[5].msr1A4.L1_DATA_STREAM_DISABLED;
+		case HWPF_L1_INSTRUCTION_STREAM_DISABLED: return msr[5].msr1A4.L1_INSTRUCTION_STREAM_DISABLED;
+		case HWPF_L1_NEXT_PAGE_DISABLED: return msr[5].msr1A4.L1_NEXT_PAGE_DISABLED;
+		case HWPF_L2_AMP_DISABLED: return msr[5].msr1A4.L2_AMP_DISABLED;
+	}
+
+	return -1;
+}
+
+static uint64_t rand64(void)
+{
+	return (uint64_t)rand() << 62 ^ (uint64_t)rand() << 31 ^ rand();
+}
+
+// Checks the field descriptors of every layout against the msr_u bitfields,
+// and that a compiled field set and a diff give the same result as setting
+// the fields one by one. Returns the number of mismatches.
+static int selftest(void)
+{
+	int errors = 0;
+
+	srand(1);
+
+	for(unsigned int l = 0; l < MSR_NUM_LAYOUTS + MSR_NUM_PCORE_LAYOUTS; l++){
+		const struct msr_layout_s *layout = l < MSR_NUM_LAYOUTS ?
+			&msr_layouts[l] : &msr_pcore_layouts[l - MSR_NUM_LAYOUTS];
+
+		for(int round = 0; round < SELFTEST_ROUNDS; round++){
+			union msr_u a[HWPF_MSR_REGS], b[HWPF_MSR_REGS], c[HWPF_MSR_REGS];
+			struct hwpf_setting_s set[HWPF_NUM_FIELDS], diff[HWPF_NUM_FIELDS];
+			struct hwpf_mask_s mask;
+			int n = 0, rejected;
+
+			for(int r = 0; r < HWPF_MSR_REGS; r++)
+				a[r].v = rand64();
+			memcpy(b, a, sizeof(b));
+			memcpy(c, a, sizeof(c));
+
+			for(int f = 0; f < HWPF_NUM_FIELDS; f++){
+				const struct hwpf_field_s *d = &layout->field[f];
+
+				//the P-core fields have no bitfields
+				if(d->width != 0 && bitfield_get(a, f) >= 0 && hwpf_field_get(layout, a, f) != bitfield_get(a, f)){
+					printf(" %s %s: get 0x%x, bitfield 0x%x\n", layout->sku, hwpf_field_names[f],
+					       hwpf_field_get(layout, a, f), bitfield_get(a, f));
+					errors++;
+				}
+
+				//about one in four fields changed, some out of range
+				if(rand() % 4)
+					continue;
+				set[n].field = f;
+				set[n].value = rand() % (d->max + 2);
+				if(hwpf_field_set(layout, b, f, set[n].value) == 0 && hwpf_field_get(layout, b, f) != set[n].value){
+					printf(" %s %s: set 0x%x, got 0x%x\n", layout->sku, hwpf_field_names[f],
+					       set[n].value, hwpf_field_get(layout, b, f));
+					errors++;
+				}
+				n++;
+			}
+
+			hwpf_mask_init(&mask);
+			rejected = hwpf_mask_add(layout, &mask, set, n);
+			hwpf_mask_apply(&mask, c);
+			if(hwpf_diff_regs(b, c) != 0){
+				printf(" %s: field set differs from setting the fields one by one\n", layout->sku);
+				errors++;
+			}
+
+			//every accepted setting that changed a field is in the diff
+			n -= rejected;
+			for(int i = 0, m = hwpf_diff(layout, a, c, diff, HWPF_NUM_FIELDS); i < m; i++){
+				if(hwpf_field_get(layout, c, diff[i].field) != diff[i].value){
+					printf(" %s %s: diff 0x%x\n", layout->sku, hwpf_field_names[diff[i].field], diff[i].value);
+					errors++;
+				}
+				if(--n < 0){
+					printf(" %s: diff has fields that were not set\n", layout->sku);
+					errors++;
+					break;
+				}
+			}
+		}
+
+		printf(" %s: %d rounds\n", layout->sku, SELFTEST_ROUNDS);
+	}
+
+	return errors;
+}
+
+enum dump_format { DUMP_TEXT, DUMP_JSON, DUMP_CSV };
+
+struct dump_group_s {
+	const struct msr_layout_s *layout; //E-core or P-core
+	union msr_u msr[HWPF_MSR_REGS];
+	int ncpus;
+	struct hwpf_setting_s diff[HWPF_NUM_FIELDS];
+	int ndiff;
+};
+
+// Parse a cpulist like 0-3,8,10-11, returns the number of cpus or -1
+static int parse_cpulist(const char *list, int cpus[], int max)
+{
+	int n = 0;
+
+	while(*list){
+		char *end;
+		long first = strtol(list, &end, 10), last = first;
+
+		if(end == list)
+			return -1;
+		if(*end == '-'){
+			list = end + 1;
+			last = strtol(list, &end, 10);
+			if(end == list)
+				return -1;
+		}
+		if(first < 0 || last < first || last >= MAX_CPUS)
+			return -1;
+		for(long c = first; c <= last && n < max; c++)
+			cpus[n++] = c;
+		if(*end == ',')
+			end++;
+		else if(*end)
+			return -1;
+		list = end;
+	}
+
+	return n;
+}
+
+// Layouts for the CPU this runs on, like msr_layout_init() in the daemon
+static const struct msr_layout_s *layout_detect(const struct msr_layout_s **pcore)
+{
+	unsigned int eax, ebx, ecx, edx, family, model;
+	const struct msr_layout_s *layout;
+
+	*pcore = &msr_pcore_layouts[0];
+	if(!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return &msr_layouts[0];
+
+	family = (eax >> 8) & 0xf;
+	model = (eax >> 4) & 0xf;
+	if(family == 0xf)
+		family += (eax >> 20) & 0xff;
+	if(family == 0x6 || family >= 0xf)
+		model |= ((eax >> 16) & 0xf) << 4;
+
+	if(msr_pcore_layout_find(family, model))
+		*pcore = msr_pcore_layout_find(family, model);
+	layout = msr_layout_find(family, model);
+	return layout ? layout : &msr_layouts[0];
+}
+
+// Read all HWPF MSRs of a cpu, one open and one pread per register.
+// Returns 1 for a P-core of a hybrid client, which only has 0x1A4.
+static int read_hwpf_msrs(int cpu, union msr_u msr[])
+{
+	char filename[64];
+	int fd;
+
+	sprintf(filename, "/dev/cpu/%d/msr", cpu);
+	fd = open(filename, O_RDONLY);
+	if(fd < 0){
+		fprintf(stderr, "Could not open %s, running as root/sudo?\n", filename);
+		return -1;
+	}
+
+	for(int r = 0; r < HWPF_MSR_REGS; r++){
+		if(pread(fd, &msr[r], 8, hwpf_msr_addr[r]) == 8)
+			continue;
+		if(r == 0){
+			memset(msr, 0, sizeof(union msr_u) * HWPF_MSR_REGS);
+			if(pread(fd, &msr[HWPF_MSR_REGS-1], 8, 0x1a4) == 8){
+				close(fd);
+				return 1;
+			}
+		}
+		fprintf(stderr, "Could not read MSR 0x%x on cpu %d\n", hwpf_msr_addr[r], cpu);
+		close(fd);
+		return -1;
+	}
+
+	close(fd);
+	return 0;
+}
+
+// Only the bits of fields known on this SKU count when grouping
+static int same_config(const struct msr_layout_s *layout, const union msr_u a[], const union msr_u b[])
+{
+	struct hwpf_setting_s diff[HWPF_NUM_FIELDS];
+
+	return hwpf_diff(layout, a, b, diff, HWPF_NUM_FIELDS) == 0;
+}
+
+// Print a group's cpus as a cpulist
+static void print_cpulist(const int cpus[], const int group[], int ncpus, int g)
+{
+	int first = -1, prev = -2, sep = 0;
+
+	for(int i = 0; i <= ncpus; i++){
+		int cpu = i < ncpus && group[i] == g ? cpus[i] : -1;
+
+		if(cpu >= 0 && cpu == prev + 1){
+			prev = cpu;
+			continue;
+		}
+		if(first >= 0){
+			printf(sep++ ? "," : "");
+			if(prev > first)
+				printf("%d-%d", first, prev);
+			else
+				printf("%d", first);
+		}
+		first = prev = cpu;
+	}
+}
+
+// Decode the HWPF MSRs of every cpu in a cpulist, group the cpus with the
+// same configuration and show how each group differs from the reference,
+// the layout defaults or the configuration of one cpu.
+static int dump(const char *cpulist, enum dump_format format, const char *reference)
+{
+	static int cpus[MAX_CPUS], group[MAX_CPUS];
+	static struct dump_group_s groups[MAX_CPUS];
+	const struct msr_layout_s *pcore_layout, *ref_layout = NULL;
+	const struct msr_layout_s *ecore_layout = layout_detect(&pcore_layout);
+	union msr_u ref[HWPF_MSR_REGS], msr[HWPF_MSR_REGS];
+	int ncpus, ngroups = 0, type;
+
+	ncpus = parse_cpulist(cpulist, cpus, MAX_CPUS);
+	if(ncpus <= 0){
+		fprintf(stderr, "Invalid cpulist %s\n", cpulist);
+		return -1;
+	}
+
+	for(int i = 0; i < ncpus; i++){
+		int g;
+
+		const struct msr_layout_s *layout;
+
+		type = read_hwpf_msrs(cpus[i], msr);
+		if(type < 0)
+			return -1;
+		layout = type ? pcore_layout : ecore_layout;
+
+		for(g = 0; g < ngroups; g++){
+			if(groups[g].layout == layout && same_config(layout, groups[g].msr, msr))
+				break;
+		}
+		if(g == ngroups){
+			groups[g].layout = layout;
+			memcpy(groups[g].msr, msr, sizeof(msr));
+			groups[g].ncpus = 0;
+			ngroups++;
+		}
+		groups[g].ncpus++;
+		group[i] = g;
+	}
+
+	if(strcmp(reference, "defaults") != 0){
+		char *end;
+		long cpu = strtol(reference, &end, 10);
+
+		if(*end || end == reference || cpu < 0 || cpu >= MAX_CPUS || (type = read_hwpf_msrs(cpu, ref)) < 0){
+			fprintf(stderr, "Invalid reference %s, use defaults or a cpu id\n", reference);
+			return -1;
+		}
+		ref_layout = type ? pcore_layout : ecore_layout;
+	}
+
+	// Groups of the other core type than the reference cpu are compared
+	// with their defaults. Fields without a default are compared to
+	// themselves, so they never differ from the defaults.
+	for(int g = 0; g < ngroups; g++){
+		const struct msr_layout_s *layout = groups[g].layout;
+		union msr_u cmp[HWPF_MSR_REGS];
+
+		memcpy(cmp, groups[g].msr, sizeof(cmp));
+		if(layout == ref_layout)
+			memcpy(cmp, ref, sizeof(cmp));
+		else
+			hwpf_set_defaults(layout, cmp);
+
+		groups[g].ndiff = hwpf_diff(layout, cmp, groups[g].msr, groups[g].diff, HWPF_NUM_FIELDS);
+		for(int d = 0; d < groups[g].ndiff; d++)
+			groups[g].diff[d].value = hwpf_field_get(layout, cmp, groups[g].diff[d].field);
+	}
+
+	if(format == DUMP_CSV){
+		printf("cpu,group,field,value,reference\n");
+		for(int i = 0; i < ncpus; i++){
+			struct dump_group_s *grp = &groups[group[i]];
+
+			if(grp->ndiff == 0)
+				printf("%d,%d,,,\n", cpus[i], group[i]);
+			for(int d = 0; d < grp->ndiff; d++){
+				int f = grp->diff[d].field;
+
+				printf("%d,%d,%s,%d,%d\n", cpus[i], group[i], hwpf_field_names[f],
+				       hwpf_field_get(grp->layout, grp->msr, f), grp->diff[d].value);
+			}
+		}
+	}
+	else if(format == DUMP_JSON){
+		printf("{\n  \"sku\": \"%s\",\n  \"reference\": \"%s\",\n  \"groups\": [", ecore_layout->sku, reference);
+		for(int g = 0; g < ngroups; g++){
+			printf("%s\n    {\n      \"cpus\": \"", g ? "," : "");
+			print_cpulist(cpus, group, ncpus, g);
+			printf("\",\n      \"layout\": \"%s\",\n      \"reference\": \"%s\",\n      \"registers\": {",
+			       groups[g].layout->sku, groups[g].layout == ref_layout ? reference : "defaults");
+			for(int r = 0; r < HWPF_MSR_REGS; r++)
+				printf("%s\"0x%x\": \"0x%lx\"", r ? ", " : "", hwpf_msr_addr[r], groups[g].msr[r].v);
+			printf("},\n      \"diff\": {");
+			for(int d = 0; d < groups[g].ndiff; d++){
+				int f = groups[g].diff[d].field;
+
+				printf("%s\n        \"%s\": {\"value\": %d, \"reference\": %d}", d ? "," : "",
+				       hwpf_field_names[f], hwpf_field_get(groups[g].layout, groups[g].msr, f), groups[g].diff[d].value);
+			}
+			printf("%s}\n    }", groups[g].ndiff ? "\n      " : "");
+		}
+		printf("\n  ]\n}\n");
+	}
+	else{
+		printf("%d cpus, %d configurations, %s layout, reference %s\n", ncpus, ngroups, ecore_layout->sku, reference);
+		for(int g = 0; g < ngroups; g++){
+			printf("\nCpus ");
+			print_cpulist(cpus, group, ncpus, g);
+			printf(" (%s, reference %s):\n", groups[g].layout->sku,
+			       groups[g].layout == ref_layout ? reference : "defaults");
+			for(int r = 0; r < HWPF_MSR_REGS; r++)
+				printf(" 0x%x: 0x%016lx\n", hwpf_msr_addr[r], groups[g].msr[r].v);
+			if(groups[g].ndiff == 0)
+				printf(" same as the reference\n");
+			for(int d = 0; d < groups[g].ndiff; d++){
+				int f = groups[g].diff[d].field;
+
+				printf(" %s: 0x%02x (reference 0x%02x)\n", hwpf_field_names[f],
+				       hwpf_field_get(groups[g].layout, groups[g].msr, f), groups[g].diff[d].value);
+			}
+		}
+	}
+
+	return 0;
+}
+
+// 1 if cpu is a P-core of a hybrid client, from the cpus of the core PMU
+static int is_pcore(int cpu)
+{
+	static int cpus[MAX_CPUS], ncpus = -1;
+	char list[4096];
+	FILE *f;
+
+	if(ncpus < 0){
+		ncpus = 0;
+		f = fopen("/sys/devices/cpu_core/cpus", "r");
+		if(f){
+			if(fgets(list, sizeof(list), f)){
+				list[strcspn(list, "\n")] = '\0';
+				ncpus = parse_cpulist(list, cpus, MAX_CPUS);
+				if(ncpus < 0)
+					ncpus = 0;
+			}
+			fclose(f);
+		}
+	}
+
+	for(int i = 0; i < ncpus; i++){
+		if(cpus[i] == cpu)
+			return 1;
+	}
+	return 0;
+}
+
+// Column of name in a CSV header line, -1 if it has none
+static int csv_column(char *header, const char *name)
+{
+	int col = 0;
+
+	for(char *p = header; p; p = strchr(p, ','), col++){
+		if(*p == ',')
+			p++;
+		if(strncmp(p, name, strlen(name)) == 0 && strchr(",\r\n", p[strlen(name)]))
+			return col;
+	}
+	return -1;
+}
+
+// Field col of a CSV line, cut at its end
+static char *csv_field(char *line, int col)
+{
+	char *p = line;
+
+	while(col-- > 0 && p)
+		p = strchr(p, ',') ? strchr(p, ',') + 1 : NULL;
+	if(!p)
+		return NULL;
+	p[strcspn(p, ",\r\n")] = '\0';
+	return p;
+}
+
+// The reverse of dump(): read cpu, field and value columns, as in the csv
+// dump, and print the register values of every cpu. Each cpu starts from
+// the defaults of its layout, bits of fields without a default are 0.
+static int encode(const char *file)
+{
+	static union msr_u regs[MAX_CPUS][HWPF_MSR_REGS];
+	static const struct msr_layout_s *layouts[MAX_CPUS];
+	const struct msr_layout_s *pcore_layout;
+	const struct msr_layout_s *ecore_layout = layout_detect(&pcore_layout);
+	char line[512], header[512];
+	int cpu_col, field_col, value_col, lineno = 1, err = 0;
+	FILE *in = strcmp(file, "-") ? fopen(file, "r") : stdin;
+
+	if(!in){
+		fprintf(stderr, "Could not open %s\n", file);
+		return -1;
+	}
+
+	if(!fgets(header, sizeof(header), in)){
+		fprintf(stderr, "%s is empty\n", file);
+		err = -1;
+		goto out;
+	}
+	cpu_col = csv_column(header, "cpu");
+	field_col = csv_column(header, "field");
+	value_col = csv_column(header, "value");
+	if(cpu_col < 0 || field_col < 0 || value_col < 0){
+		fprintf(stderr, "%s needs the columns cpu, field and value\n", file);
+		err = -1;
+		goto out;
+	}
+
+	while(fgets(line, sizeof(line), in)){
+		// csv_field() cuts the line, so every column gets its own copy
+		char cpu_buf[512], field_buf[512], value_buf[512], *end = "";
+		char *cpu_str = csv_field(strcpy(cpu_buf, line), cpu_col);
+		char *field_str = csv_field(strcpy(field_buf, line), field_col);
+		char *value_str = csv_field(strcpy(value_buf, line), value_col);
+		int cpus[MAX_CPUS], ncpus, f = HWPF_NUM_FIELDS;
+		long value = 0;
+
+		lineno++;
+		if(line[strspn(line, " \r\n")] == '\0')
+			continue;
+
+		ncpus = cpu_str ? parse_cpulist(cpu_str, cpus, MAX_CPUS) : -1;
+		if(ncpus <= 0 || !field_str){
+			fprintf(stderr, "Line %d: invalid cpu or missing field\n", lineno);
+			err = -1;
+			goto out;
+		}
+
+		// a cpu without fields, as in the dump of a cpu at the reference
+		if(*field_str){
+			for(f = 0; f < HWPF_NUM_FIELDS; f++){
+				if(strcmp(hwpf_field_names[f], field_str) == 0)
+					break;
+			}
+			if(value_str)
+				value = strtol(value_str, &end, 0);
+			if(f == HWPF_NUM_FIELDS || !value_str || !*value_str || *end){
+				fprintf(stderr, "Line %d: unknown field %s or invalid value\n", lineno, field_str);
+				err = -1;
+				goto out;
+			}
+		}
+
+		for(int i = 0; i < ncpus; i++){
+			int c = cpus[i];
+
+			if(!layouts[c]){
+				layouts[c] = is_pcore(c) ? pcore_layout : ecore_layout;
+				hwpf_set_defaults(layouts[c], regs[c]);
+			}
+			if(f < HWPF_NUM_FIELDS && hwpf_field_set(layouts[c], regs[c], f, value) < 0){
+				fprintf(stderr, "Line %d: %s is not on %s or %ld is out of range\n",
+				        lineno, field_str, layouts[c]->sku, value);
+				err = -1;
+				goto out;
+			}
+		}
+	}
+
+	// only the registers the layout has fields in
+	printf("cpu,layout,msr,value\n");
+	for(int c = 0; c < MAX_CPUS; c++){
+		unsigned int used = 0;
+
+		if(!layouts[c])
+			continue;
+		for(int f = 0; f < HWPF_NUM_FIELDS; f++){
+			if(layouts[c]->field[f].width)
+				used |= 1 << layouts[c]->field[f].reg;
+		}
+		for(int r = 0; r < HWPF_MSR_REGS; r++){
+			if(used & 1 << r)
+				printf("%d,%s,0x%x,0x%016lx\n", c, layouts[c]->sku, hwpf_msr_addr[r], regs[c][r].v);
+		}
+	}
+
+out:
+	if(in != stdin)
+		fclose(in);
+	return err;
+}
 
 int main(int argc, char *argv[])
 {
 	uint32_t msr_id = 0;
 	union msr_u msr_value;
 
+	//machine readable output, no banner
+	if(argc >= 3 && argv[1][0] == 'd'){
+		enum dump_format format = DUMP_TEXT;
+
+		if(argc >= 4 && strcmp(argv[3], "json") == 0)
+			format = DUMP_JSON;
+		else if(argc >= 4 && strcmp(argv[3], "csv") == 0)
+			format = DUMP_CSV;
+		else if(argc >= 4 && strcmp(argv[3], "text") != 0){
+			printf("Unknown format %s, use text, json or csv\n", argv[3]);
+			return -1;
+		}
+
+		return dump(argv[2], format, argc >= 5 ? argv[4] : "defaults") ? -1 : 0;
+	}
+	if(argc == 3 && argv[1][0] == 'e')
+		return encode(argv[2]) ? -1 : 0;
+
 	printf("dPF MSR2setting\n");
 
+	if(argc == 2 && argv[1][0] == 't'){
+		int errors = selftest();
+
+		printf("%d errors\n", errors);
+		return errors ? -1 : 0;
+	}
+
 	if(argc < 4){
-		printf("Error, call with <a/b> <MSR> <MSR value> <...>\n");
+		printf("Error, call with <a/b> <MSR> <MSR value> <...>, or d <cpulist>, or e <csv>, or t\n");
 		printf(" a: convert msr value to settings, ./msr2settings a 0x1320 0x700007e041000018\n");
 		printf(" b: convert settings to msr value, ./msr2settings b 0x1320 0x18 0x10 0x01 0x3f 0x00 0x1c\n");
+		printf(" d: decode all HWPF MSRs of a cpulist, group identical configurations and show\n");
+		printf("    the differences from the SKU defaults or a reference cpu,\n");
+		printf("    ./msr2settings d <cpulist> [text/json/csv] [defaults/<cpu>], ./msr2settings d 0-143 json\n");
+		printf(" e: encode the settings of a csv with cpu, field and value columns, as d writes\n");
+		printf("    them, to the MSR values of every cpu from the SKU defaults, - reads stdin,\n");
+		printf("    ./msr2settings e settings.csv\n");
+		printf(" t: check the field layouts against the MSR bitfields, ./msr2settings t\n");
 
 		return -1;
 	}
@@ -0,0 +1,367 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#include "common.h"
+#include "mab.h"
+#include "pmu_ddr.h"
+#include "ctrl_socket.h"
+#include "abtest.h"
+#include "trace.h"
+#include "uncore.h"
+
+#define TAG "TRACE"
+
+// Per interval decision trace as CSV. The master core fills a preallocated
+// record buffer (trace_record()), a full or old enough buffer is handed to
+// the writer thread on the housekeeping core which formats it to the file
+// while the master continues in the other buffer. If both buffers are busy
+// records are dropped and counted, the tuning loop never waits for I/O.
+
+static struct trace_rec_s *buf[2];
+static int buf_count[2];
+static atomic_int buf_full[2]; //handed to the writer
+static int fill; //buffer the master core appends to
+static uint64_t fill_start_ns;
+static uint64_t dropped;
+
+static FILE *trace_file;
+static int trace_hk_core = -1;
+static volatile int trace_running;
+static pthread_t trace_thread;
+
+// Master core side state between records
+static union msr_u (*prev_msr)[HWPF_MSR_FIELDS];
+static int prev_valid;
+static int trace_cores;
+static uint64_t intervals;
+static uint64_t last_time_ns;
+static uint64_t last_ddr_rd, last_ddr_wr;
+
+extern volatile int quitflag;
+
+static const char *msr_names[HWPF_MSR_FIELDS] = {
+	"0x1320", "0x1321", "0x1322", "0x1323", "0x1324", "0x1a4"
+};
+
+static const char *mode_name(int mode)
+{
+	switch (mode) {
+	case TRACE_MODE_BASIC: return "BASIC";
+	case TRACE_MODE_PAUSED: return "PAUSED";
+	case TRACE_MODE_SETTLE: return "SETTLE";
+	case TRACE_MODE_AB_CONTROL: return "AB_CONTROL";
+	case ROUND_ROBIN: return "RR";
+	case MAIN_LOOP: return "MAIN_LOOP";
+	case MAIN_LOOP_TRANSITION: return "TRANSITION";
+	case RR_RESTART: return "RR_RESTART";
+	case SLEEP: return "SLEEP";
+	}
+
+	return "UNKNOWN";
+}
+
+// The MSR image the primary core of tstate's module writes
+static union msr_u *msr_image(struct thread_state *tstate)
+{
+	if (ab_control(tstate->core_id - core_first))
+		return tstate->hwpf_msr_boot;
+	if (tunealg == MAB && ctrl_state.profile == CTRL_PROFILE_NONE)
+		return arms.hwpf_msr_values[mstate.arm];
+
+	return tstate->hwpf_msr_value;
+}
+
+static void record_diffs(struct trace_rec_s *r)
+{
+	r->num_diffs = 0;
+	r->diffs_dropped = 0;
+
+	for (int i = 0; i < trace_cores; i++) {
+		struct thread_state *tstate = &gtinfo[i];
+		union msr_u *msr;
+
+		if (CORE_IN_MODULE != 0)
+			continue;
+
+		msr = msr_image(tstate);
+		//the first record shows the changes from the boot values
+		if (!prev_valid)
+			memcpy(prev_msr[i], tstate->hwpf_msr_boot,
+			       sizeof(prev_msr[i]));
+
+		for (int j = 0; j < HWPF_MSR_FIELDS; j++) {
+			struct trace_diff_s *d;
+
+			if (msr[j].v == prev_msr[i][j].v)
+				continue;
+			if (r->num_diffs == TRACE_MAX_DIFFS) {
+				r->diffs_dropped++;
+				continue;
+			}
+			d = &r->diff[r->num_diffs++];
+			d->core_id = tstate->core_id;
+			d->field = j;
+			d->old_value = prev_msr[i][j].v;
+			d->new_value = msr[j].v;
+		}
+		memcpy(prev_msr[i], msr, sizeof(prev_msr[i]));
+	}
+	prev_valid = 1;
+}
+
+// Append one record for the interval just decided. Called by the master
+// core after calculate_settings(), decision_ns is the time it took.
+void trace_record(uint64_t decision_ns)
+{
+	struct trace_rec_s *r;
+	uint64_t now, ddr_rd, ddr_wr;
+	double interval_s;
+
+	if (trace_file == NULL)
+		return;
+
+	now = time_ns();
+	interval_s = last_time_ns ? (now - last_time_ns) / 1e9 : 0;
+
+	//hand a full or old buffer to the writer if it is done with the other
+	if (buf_count[fill] > 0 &&
+	    (buf_count[fill] == TRACE_BUF_RECORDS ||
+	     now - fill_start_ns >= TRACE_FLUSH_MS * 1000000ull) &&
+	    !atomic_load_explicit(&buf_full[fill ^ 1], memory_order_acquire)) {
+		atomic_store_explicit(&buf_full[fill], 1, memory_order_release);
+		fill ^= 1;
+		buf_count[fill] = 0;
+	}
+	if (buf_count[fill] == 0)
+		fill_start_ns = now;
+
+	if (buf_count[fill] == TRACE_BUF_RECORDS) {
+		dropped++;
+		r = NULL;
+	} else {
+		r = &buf[fill][buf_count[fill]];
+	}
+
+	ddr_rd = ddr_wr = 0;
+	if (!rdt_enabled && ddr.ddr_interface_type != DDR_NONE) {
+		ddr_rd = pmu_ddr_total(&ddr, DDR_PMU_RD);
+		ddr_wr = pmu_ddr_total(&ddr, DDR_PMU_WR);
+	}
+
+	if (r) {
+		r->time_ns = now;
+		r->interval = ++intervals;
+		r->tunealg = tunealg;
+		r->decision_ns = decision_ns;
+
+		r->instructions = 0;
+		r->cycles = 0;
+		for (int i = 0; i < trace_cores; i++) {
+			r->instructions += gtinfo[i].instructions_retired;
+			r->cycles += gtinfo[i].cpu_cycles;
+		}
+		r->uncore_ratio = uncore.ratio;
+		r->pkg_joules = uncore.num_packages > 0 ? uncore.joules : -1;
+
+		r->ddr_rd_bw = -1;
+		r->ddr_wr_bw = -1;
+		if (interval_s > 0 && (ddr_rd || ddr_wr)) {
+			r->ddr_rd_bw = (ddr_rd - last_ddr_rd) / interval_s;
+			r->ddr_wr_bw = (ddr_wr - last_ddr_wr) / interval_s;
+		}
+
+		r->arm = -1;
+		r->reward = 0;
+		r->norm_reward = 0;
+		r->sd_mean = 0;
+		if (tunealg == MAB) {
+			r->mode = mstate.mode;
+			if (mstate.dynamic_sd == ON &&
+			    mstate.current_sd_mean > mstate.sd_mean_threshold)
+				r->mode = SLEEP;
+			r->arm = mstate.arm;
+			r->reward = mstate.last_reward;
+			if (mstate.avg_reward > 0)
+				r->norm_reward = mstate.last_reward /
+						 mstate.avg_reward;
+			r->sd_mean = mstate.current_sd_mean;
+		} else {
+			r->mode = TRACE_MODE_BASIC;
+		}
+		if (ctrl_state.paused)
+			r->mode = TRACE_MODE_PAUSED;
+		else if (ctrl_state.settle > 0)
+			r->mode = TRACE_MODE_SETTLE;
+		else if (ab_state.mode == AB_TIME &&
+			 ab_state.arm == AB_CONTROL)
+			r->mode = TRACE_MODE_AB_CONTROL;
+
+		record_diffs(r);
+		buf_count[fill]++;
+	} else {
+		intervals++;
+		prev_valid = 0; //diff the next record against the boot values
+	}
+
+	last_time_ns = now;
+	last_ddr_rd = ddr_rd;
+	last_ddr_wr = ddr_wr;
+}
+
+static void write_records(struct trace_rec_s *recs, int count)
+{
+	for (int i = 0; i < count; i++) {
+		struct trace_rec_s *r = &recs[i];
+
+		fprintf(trace_file, "%lu,%lu,%d,%s,%d,%f,%f,%f,", r->time_ns,
+			r->interval, r->tunealg, mode_name(r->mode), r->arm,
+			r->reward, r->norm_reward, r->sd_mean);
+		if (r->ddr_rd_bw >= 0)
+			fprintf(trace_file, "%.0f,%.0f,", r->ddr_rd_bw,
+				r->ddr_wr_bw);
+		else
+			fprintf(trace_file, ",,");
+		fprintf(trace_file, "%lu,%lu,", r->instructions, r->cycles);
+		if (r->uncore_ratio >= 0)
+			fprintf(trace_file, "%d,", r->uncore_ratio);
+		else
+			fprintf(trace_file, ",");
+		if (r->pkg_joules >= 0)
+			fprintf(trace_file, "%f,", r->pkg_joules);
+		else
+			fprintf(trace_file, ",");
+		fprintf(trace_file, "%lu,%d,", r->decision_ns, r->num_diffs +
+			r->diffs_dropped);
+		for (int j = 0; j < r->num_diffs; j++) {
+			struct trace_diff_s *d = &r->diff[j];
+
+			fprintf(trace_file, "%s%d:%s=0x%lx>0x%lx", j ? ";" : "",
+				d->core_id, msr_names[d->field], d->old_value,
+				d->new_value);
+		}
+		fprintf(trace_file, "\n");
+	}
+	fflush(trace_file);
+}
+
+// Write the buffers handed over by the master core.
+// Returns number of records written
+static int trace_drain(void)
+{
+	int written = 0;
+
+	for (int i = 0; i < 2; i++) {
+		if (!atomic_load_explicit(&buf_full[i], memory_order_acquire))
+			continue;
+		write_records(buf[i], buf_count[i]);
+		written += buf_count[i];
+		atomic_store_explicit(&buf_full[i], 0, memory_order_release);
+	}
+
+	return written;
+}
+
+static void *trace_thread_start(void *arg)
+{
+	(void)arg;
+
+	if (trace_hk_core >= 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(trace_hk_core, &cpuset);
+		if (pthread_setaffinity_np(pthread_self(), sizeof(cpuset),
+					   &cpuset) != 0)
+			loge(TAG, "Could not pin trace thread to core %d\n",
+			     trace_hk_core);
+	}
+
+	while (trace_running && quitflag == 0) {
+		usleep(TRACE_FLUSH_MS * 1000 / 4);
+		overhead_helper_sample();
+		trace_drain();
+	}
+
+	return NULL;
+}
+
+// Open the trace file, allocate the record buffers for num_cores tuned
+// cores and start the writer thread on hk_core (-1 to leave it unpinned).
+// Returns 0 on success, -1 on failure
+int trace_init(const char *path, int hk_core, int num_cores)
+{
+	buf[0] = calloc(TRACE_BUF_RECORDS, sizeof(struct trace_rec_s));
+	buf[1] = calloc(TRACE_BUF_RECORDS, sizeof(struct trace_rec_s));
+	prev_msr = calloc(num_cores, sizeof(*prev_msr));
+	if (buf[0] == NULL || buf[1] == NULL || prev_msr == NULL) {
+		loge(TAG, "Could not allocate trace buffers\n");
+		goto err_free;
+	}
+	trace_cores = num_cores;
+
+	trace_file = fopen(path, "w");
+	if (trace_file == NULL) {
+		loge(TAG, "Could not open %s: %s\n", path, strerror(errno));
+		goto err_free;
+	}
+	fprintf(trace_file, "time_ns,interval,alg,mode,arm,reward,norm_reward,"
+		"sd_mean,ddr_rd_bw,ddr_wr_bw,instructions,cycles,uncore_ratio,"
+		"pkg_joules,decision_ns,"
+		"msr_changes,msr_diff\n");
+
+	trace_hk_core = hk_core;
+	trace_running = 1;
+	if (pthread_create(&trace_thread, NULL, &trace_thread_start,
+			   NULL) != 0) {
+		trace_running = 0;
+		fclose(trace_file);
+		trace_file = NULL;
+		goto err_free;
+	}
+
+	logi(TAG, "Writing decision trace to %s\n", path);
+
+	return 0;
+
+err_free:
+	free(buf[0]);
+	free(buf[1]);
+	free(prev_msr);
+	buf[0] = buf[1] = NULL;
+	prev_msr = NULL;
+
+	return -1;
+}
+
+// Stop the writer and flush everything recorded. Call after the tuning
+// threads are joined.
+void trace_deinit(void)
+{
+	if (trace_file == NULL)
+		return;
+
+	trace_running = 0;
+	pthread_join(trace_thread, NULL);
+
+	//handed over buffers first, they hold the older records
+	trace_drain();
+	write_records(buf[fill], buf_count[fill]);
+
+	if (dropped)
+		logi(TAG, "%lu trace records dropped\n", dropped);
+
+	fclose(trace_file);
+	trace_file = NULL;
+	free(buf[0]);
+	free(buf[1]);
+	free(prev_msr);
+	buf[0] = buf[1] = NULL;
+	prev_msr = NULL;
+}
@@ -10,6 +10,7 @@
 #include "pmu_ddr.h"
 #include "log.h"
 #include "common.h"
+#include "uncore.h"
 
 #define TAG "MAB"
 
@@ -107,9 +108,49 @@ void update_selections_none(mab_state *mstate) {
 
 // Update Reward Functions
 
+// Throughput per watt, instructions of all tuned cores per package joule,
+// in instructions per nanojoule to keep the raw reward near IPC magnitudes
+static float ipj_reward(void) {
+    uint64_t instructions = 0;
+
+    if (uncore.joules <= 0)
+        return mstate.last_reward;
+
+    for (int i = 0; i < ALL_THREADS; i++)
+        instructions += gtinfo[i].instructions_retired;
+
+    return (double)instructions / uncore.joules * 1e-9;
+}
+
+// Share of the cycles the tuned E-cores were not stalled on memory, so the
+// arm that removes the most memory-bound stalls wins whatever the code
+// does with the cycles it gets back
+static float mem_bound_reward(void) {
+    double stalled = 0;
+    uint64_t cycles = 0;
+
+    for (int i = 0; i < ACTIVE_THREADS; i++) {
+        if (isnan(gtinfo[i].pf.mem_bound))
+            continue;
+        stalled += gtinfo[i].pf.mem_bound * gtinfo[i].cpu_cycles;
+        cycles += gtinfo[i].cpu_cycles;
+    }
+
+    if (cycles == 0)
+        return mstate.last_reward;
+
+    return 1.0 - stalled / cycles;
+}
+
 float get_reward(int arm_num) {
-    (void)arm_num; // Explicitly unused
-    float reward = (double) gtinfo[1].instructions_retired / (double) gtinfo[1].cpu_cycles;
+    float reward;
+
+    if (mstate.reward == REWARD_IPJ)
+        reward = ipj_reward();
+    else if (mstate.reward == REWARD_MEM_BOUND)
+        reward = mem_bound_reward();
+    else
+        reward = (double) gtinfo[1].instructions_retired / (double) gtinfo[1].cpu_cycles;
 
     if (mstate.mode == RR_RESTART || MAIN_LOOP_TRANSITION) {
         arms.ipcs[arm_num] = reward;
@@ -119,6 +160,7 @@ float get_reward(int arm_num) {
         arms.ipcs[arm_num] = (arms.ipcs[arm_num] * (arms.nums[arm_num] - 1) + reward) / arms.nums[arm_num];
     }
 
+    mstate.last_reward = reward;
     return reward;
 }
 
@@ -140,6 +182,8 @@ void set_msrs(mab_state *mstate, size_t arm_num) {
         for(size_t i = 0; i < mstate->num_threads; i++){
             gtinfo[i].hwpf_msr_dirty = 1;
         }
+        if (mstate->num_uncore_ratios > 0)
+            uncore_set_ratio(arms.uncore_ratio[mstate->arm]);
         logv(TAG, "Switching to Arm %d\n", mstate->arm);
     }
 }
@@ -241,6 +285,13 @@ int check_dynamic_sd(mab_state *mstate) {
 
 int mab(mab_state *mstate) {
 
+    if (mstate->pinned_arm >= 0) { // Arm pinned through the control socket
+        size_t prev_arm = mstate->arm;
+        mstate->arm = mstate->pinned_arm;
+        set_msrs(mstate, prev_arm);
+        return 0;
+    }
+
     if (check_dynamic_sd(mstate)) { // Is Dynamic SD filtering active?
         setup_arm(mstate, next_arm_default, update_selections_none);
         return 0;
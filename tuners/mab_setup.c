@@ -68,6 +68,9 @@ void setup_mab_state_from_json(mab_state* mstate, const char* config_file) {
     const cJSON* ipc_window_size = cJSON_GetObjectItemCaseSensitive(json, "ipc_window_size");
     const cJSON* sd_window_size = cJSON_GetObjectItemCaseSensitive(json, "sd_window_size");
     const cJSON* sd_mean_threshold = cJSON_GetObjectItemCaseSensitive(json, "sd_mean_threshold");
+    const cJSON* pinned_arm = cJSON_GetObjectItemCaseSensitive(json, "pinned_arm");
+    const cJSON* reward = cJSON_GetObjectItemCaseSensitive(json, "reward");
+    const cJSON* uncore_ratios = cJSON_GetObjectItemCaseSensitive(json, "uncore_ratios");
 
     // Ensure all configuration parameters are valid
     if (cJSON_IsString(algorithm) && algorithm->valuestring != NULL) {
@@ -121,16 +124,50 @@ void setup_mab_state_from_json(mab_state* mstate, const char* config_file) {
         mstate->sd_mean_threshold = (float)sd_mean_threshold->valuedouble;
     }
 
+    // Static mode, hold one arm for the whole run (checked against num_arms in mab_init)
+    if (cJSON_IsNumber(pinned_arm) && pinned_arm->valueint >= 0) {
+        mstate->pinned_arm = pinned_arm->valueint;
+    }
+
+    if (cJSON_IsString(reward) && reward->valuestring != NULL) {
+        if (strcmp(reward->valuestring, "IPC") == 0) {
+            mstate->reward = REWARD_IPC;
+        } else if (strcmp(reward->valuestring, "IPJ") == 0) {
+            mstate->reward = REWARD_IPJ;
+        } else if (strcmp(reward->valuestring, "MEM_BOUND") == 0) {
+            mstate->reward = REWARD_MEM_BOUND;
+        } else {
+            fprintf(stderr, "Invalid reward specified: %s\n", reward->valuestring);
+            exit(-1);
+        }
+    }
+
+    // Uncore ratios (100 MHz steps) to co-tune, checked against the
+    // packages' limits in mab_init
+    if (uncore_ratios != NULL) {
+        const cJSON* ratio;
+
+        if (!cJSON_IsArray(uncore_ratios) ||
+            cJSON_GetArraySize(uncore_ratios) > UNCORE_MAX_RATIOS) {
+            fprintf(stderr, "Invalid uncore ratios, up to %d numbers\n", UNCORE_MAX_RATIOS);
+            exit(-1);
+        }
+        cJSON_ArrayForEach(ratio, uncore_ratios) {
+            if (!cJSON_IsNumber(ratio) || ratio->valueint <= 0) {
+                fprintf(stderr, "Invalid uncore ratio specified.\n");
+                exit(-1);
+            }
+            mstate->uncore_ratios[mstate->num_uncore_ratios++] = ratio->valueint;
+        }
+    }
+
     cJSON_Delete(json);
     free(data);
 }
 
 
 void populate_msr_u(union msr_u msr[]) {
-    populate_msr1320(&msr[0]);
-    populate_msr1321(&msr[0]);
-    populate_msr1322(&msr[0]);
-    populate_msr1323(&msr[0]);
+    msr_set_defaults(&msr[0]);
 }
 
 
@@ -140,15 +177,14 @@ void populate_msr_u(union msr_u msr[]) {
 void create_16_arms(arms_t *arms) {
     for (int i = 0; i < 16; i++) {
         // Use the bits of 'i' to decide the on/off state of each prefetcher
-        int mlc_disable = (i & 0x1) > 0; // Least significant bit
-        int amp_disable = (i & 0x2) > 0; // Second least significant bit
-        int llcoff = (i & 0x4) > 0;      // Third bit
-        int nlpoff = (i & 0x8) > 0;      // Most significant bit of the 4 bits
-
-        msr_set_mlc_disable(&arms->hwpf_msr_values[i][0], mlc_disable);
-        msr_set_amp_disable(&arms->hwpf_msr_values[i][0], amp_disable);
-        msr_set_llcoff(&arms->hwpf_msr_values[i][0], llcoff);
-        msr_set_nlpoff(&arms->hwpf_msr_values[i][0], nlpoff);
+        struct hwpf_setting_s set[] = {
+            {HWPF_L2_STREAM_DISABLED, (i & 0x1) > 0},           // MLC, least significant bit
+            {HWPF_L2_AMP_DISABLED, (i & 0x2) > 0},              // AMP, second bit
+            {HWPF_LLC_STREAM_DISABLE, (i & 0x4) > 0},           // LLC, third bit
+            {HWPF_L2_DISABLE_NEXT_LINE_PREFETCH, (i & 0x8) > 0}, // NLP, most significant bit
+        };
+
+        msr_fields_apply(&arms->hwpf_msr_values[i][0], set, 4);
     }
 }
 
@@ -156,11 +192,12 @@ void create_16_arms(arms_t *arms) {
 void create_4_arms(arms_t *arms) {
     for (int i = 0; i < 4; i++) {
         // Use the bits of 'i' to decide the on/off state of MLC and AMP
-        int mlc_disable = (i & 0x1) > 0; // MLC disable is determined by the second bit (more significant)
-        int amp_disable = (i & 0x2) > 0; // AMP disable is determined by the first bit (less significant)
+        struct hwpf_setting_s set[] = {
+            {HWPF_L2_STREAM_DISABLED, (i & 0x1) > 0},
+            {HWPF_L2_AMP_DISABLED, (i & 0x2) > 0},
+        };
 
-        msr_set_mlc_disable(&arms->hwpf_msr_values[i][0], mlc_disable);
-        msr_set_amp_disable(&arms->hwpf_msr_values[i][0], amp_disable);
+        msr_fields_apply(&arms->hwpf_msr_values[i][0], set, 2);
     }
 }
 
@@ -201,7 +238,66 @@ void create_6_combos_l2xq(arms_t *arms) {
 
 
 
+// Drops arms with the same MSR values as an earlier arm. Setting a field
+// this SKU does not have, or a value out of its range, leaves the default,
+// so such arms collapse into others and are removed here.
+static void remove_duplicate_arms(arms_t *arms, mab_state *mstate) {
+    size_t n = 0;
+
+    for (size_t i = 0; i < mstate->num_arms; i++) {
+        size_t j;
+
+        for (j = 0; j < n; j++) {
+            if (memcmp(arms->hwpf_msr_values[j], arms->hwpf_msr_values[i],
+                       sizeof(arms->hwpf_msr_values[i])) == 0)
+                break;
+        }
+        if (j < n) {
+            logi(TAG, "Arm %zu is arm %zu on %s, removed\n", i, j, msr_layout->sku);
+            continue;
+        }
+        if (n != i)
+            memcpy(arms->hwpf_msr_values[n], arms->hwpf_msr_values[i],
+                   sizeof(arms->hwpf_msr_values[i]));
+        n++;
+    }
+
+    if (n < mstate->num_arms)
+        logi(TAG, "%zu of %zu arms left on %s\n", n, mstate->num_arms, msr_layout->sku);
+    mstate->num_arms = n;
+}
+
+// Joint action space, every prefetch arm at every uncore ratio. Arm
+// r * n + i is prefetch arm i at ratio r, so round robin steps through all
+// prefetch arms before the uncore frequency changes.
+static void expand_uncore_arms(arms_t *arms, mab_state *mstate) {
+    size_t n = mstate->num_arms;
+
+    if (n * mstate->num_uncore_ratios > MAX_ARMS) {
+        fprintf(stderr, "%zu arms at %zu uncore ratios, max is %d arms\n",
+                n, mstate->num_uncore_ratios, MAX_ARMS);
+        exit(-1);
+    }
+
+    for (size_t r = 0; r < mstate->num_uncore_ratios; r++) {
+        for (size_t i = 0; i < n; i++) {
+            if (r > 0)
+                memcpy(arms->hwpf_msr_values[r * n + i], arms->hwpf_msr_values[i],
+                       sizeof(arms->hwpf_msr_values[i]));
+            arms->uncore_ratio[r * n + i] = mstate->uncore_ratios[r];
+        }
+    }
+
+    mstate->num_arms = n * mstate->num_uncore_ratios;
+    logi(TAG, "%zu prefetch arms x %zu uncore ratios = %zu arms\n",
+         n, mstate->num_uncore_ratios, mstate->num_arms);
+}
+
 void create_arms(arms_t *arms, mab_state *mstate) {
+    // Defaults of this SKU first, the arm configuration sets its fields on top
+    for (size_t i = 0; i < MAX_ARMS; i++)
+        populate_msr_u(&arms->hwpf_msr_values[i][0]);
+
     switch (mstate->arm_configuration) {
         case 0:
             create_16_arms(arms);
@@ -228,8 +324,14 @@ void create_arms(arms_t *arms, mab_state *mstate) {
             exit(-1);
     }
 
+    remove_duplicate_arms(arms, mstate);
+
+    for (size_t i = 0; i < mstate->num_arms; i++)
+        arms->uncore_ratio[i] = UNCORE_RATIO_NONE;
+    if (mstate->num_uncore_ratios > 0)
+        expand_uncore_arms(arms, mstate);
+
     for (size_t i = 0; i < mstate->num_arms; i++) {
-        populate_msr_u(&arms->hwpf_msr_values[i][0]);
         arms->rewards[i] = 0.0;
         arms->nums[i] = 0;
         arms->ipcs[i] = 1;
@@ -275,6 +377,16 @@ void allocate_buffers(size_t ipc_window_size, size_t sd_window_size) {
     mstate.sd_n = 0;
 }
 
+// Arms mab_init builds from mab_config.json on this SKU, after the
+// duplicates are removed, for scripts that pin arms by index
+size_t mab_count_arms(void) {
+    mab_state probe = {0};
+
+    setup_mab_state_from_json(&probe, MAB_CONFIG_FILE);
+    create_arms(&arms, &probe);
+    return probe.num_arms;
+}
+
 void mab_init(mab_state *mstate, size_t active_threads) {
     mstate->num_total = 0;
     mstate->arm = 0;
@@ -283,14 +395,37 @@ void mab_init(mab_state *mstate, size_t active_threads) {
     mstate->normalise = ONCE;
     mstate->avg_reward = 1;
     mstate->iterations = 0;
+    mstate->pinned_arm = -1;
     mstate->dynamic_sd = OFF;
     mstate->norm_freq = 1000;
     mstate->sd_mean_threshold = 0;
     mstate->sd_mean_min_threshold = 0.3;
+    mstate->reward = REWARD_IPC;
+    mstate->num_uncore_ratios = 0;
 
     const char *config_file = MAB_CONFIG_FILE;
     setup_mab_state_from_json(mstate, config_file);
 
+    // Package energy for the reward and the uncore limits to co-tune
+    if (mstate->reward == REWARD_IPJ || mstate->num_uncore_ratios > 0) {
+        if (uncore_init(core_first, core_last) < 0)
+            exit(-1);
+    }
+    // The stall fraction comes from the top-down events, read with MAB
+    // only when the event set is extended
+    if (mstate->reward == REWARD_MEM_BOUND && !pmu_mem_bound_events()) {
+        fprintf(stderr, "The MEM_BOUND reward needs the memory-bound events, --events topdown\n");
+        exit(-1);
+    }
+    for (size_t i = 0; i < mstate->num_uncore_ratios; i++) {
+        if (mstate->uncore_ratios[i] < uncore.min_ratio ||
+            mstate->uncore_ratios[i] > uncore.max_ratio) {
+            fprintf(stderr, "Invalid uncore ratio %d, the packages allow %d-%d\n",
+                    mstate->uncore_ratios[i], uncore.min_ratio, uncore.max_ratio);
+            exit(-1);
+        }
+    }
+
     if (mstate->dynamic_sd == ON || mstate->dynamic_sd == STEP) {
         allocate_buffers(mstate->ipc_window_size, mstate->sd_window_size);
     }
@@ -298,6 +433,16 @@ void mab_init(mab_state *mstate, size_t active_threads) {
     init_mab_strategies(mstate);
 
     create_arms(&arms, mstate); // Pass the mstate to use arm_configuration
+
+    if (mstate->pinned_arm >= (int)mstate->num_arms) {
+        fprintf(stderr, "Invalid pinned arm %d, arm configuration %d has %zu arms\n",
+                mstate->pinned_arm, mstate->arm_configuration, mstate->num_arms);
+        exit(-1);
+    }
+    if (mstate->pinned_arm >= 0)
+        logi(TAG, "Static mode, arm %d pinned\n", mstate->pinned_arm);
+    if (mstate->num_uncore_ratios > 0)
+        uncore_set_ratio(arms.uncore_ratio[mstate->arm]);
     
     srand((unsigned int)time(NULL)); // Initialise for random functions used in certain MAB algorithms
 }
\ No newline at end of file
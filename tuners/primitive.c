@@ -20,9 +20,68 @@
 #include "rdt_mbm.h"
 #include "log.h"
 #include "sysdetect.h"
+#include "l2cat.h"
+#include "memtier.h"
 
 #define TAG "PRIMITIVE"
 
+// P-core prefetchers are switched off in this order while the P-cores are
+// the bandwidth hog, and back on in the reverse order when there is room
+static const int pcore_ladder[] = {
+	HWPF_L2_ADJACENT_LINE_DISABLE,
+	HWPF_DCU_IP_PREFETCHER_DISABLE,
+	HWPF_L2_HW_PREFETCHER_DISABLE,
+	HWPF_DCU_PREFETCHER_DISABLE,
+};
+#define PCORE_LADDER_STEPS (sizeof(pcore_ladder) / sizeof(pcore_ladder[0]))
+
+// Throttle the P-cores one prefetcher at a time above 90% of the bandwidth
+// target when they cause more DRAM traffic than the E-cores, release below
+// 80%. Between the two the P-cores are left as they are.
+static void pcore_tune(float ddr_rd_percent, int pcore_hog)
+{
+	static int level; //prefetchers switched off
+	int old_level = level;
+
+	if (ddr_rd_percent >= 0.90 && pcore_hog && level < (int)PCORE_LADDER_STEPS)
+		level++;
+	else if (ddr_rd_percent < 0.80 && level > 0)
+		level--;
+
+	if (level == old_level)
+		return;
+
+	for (int i = ACTIVE_THREADS; i < ALL_THREADS; i++) {
+		for (int s = 0; s < (int)PCORE_LADDER_STEPS; s++)
+			msr_pcore_field_set(gtinfo[i].hwpf_msr_value,
+					    pcore_ladder[s], s < level);
+		gtinfo[i].hwpf_msr_dirty = 1;
+	}
+
+	logv(TAG, "P-cores: %d of %d prefetchers off\n", level,
+	     (int)PCORE_LADDER_STEPS);
+}
+
+// Modules whose cores spend less of their cycles stalled on memory gain
+// nothing from prefetching and are left as they are
+#define MEM_BOUND_MIN (0.10)
+
+// Largest memory-bound stall fraction of the cores in a module, NAN
+// without the top-down events
+static float module_mem_bound(int thread)
+{
+	int first = thread - thread % 4;
+	float bound = NAN;
+
+	for (int i = first; i < first + 4 && i < ACTIVE_THREADS; i++) {
+		if (isnan(gtinfo[i].pf.mem_bound))
+			continue;
+		if (isnan(bound) || gtinfo[i].pf.mem_bound > bound)
+			bound = gtinfo[i].pf.mem_bound;
+	}
+
+	return bound;
+}
 
 int basicalg(int tunealg)
 {
@@ -65,6 +124,10 @@ int basicalg(int tunealg)
 
 	loga(TAG, "Time delta %f, Running at %.1f percent wr bw (%ld MB/s)\n", time_delta, ddr_wr_percent * 100, ddr_wr_bw / (1024 * 1024));
 
+	// With CXL or other memory tiers each core is tuned on the tier it
+	// loads from
+	memtier_sample(ddr_rd_percent, time_delta);
+
 	//	float l2_l3_ddr_hits[ACTIVE_THREADS];
 
 	float l2_hitr[ACTIVE_THREADS];
@@ -78,6 +141,23 @@ int basicalg(int tunealg)
 	for (int i = 0; i < ACTIVE_THREADS; i++)
 		total_ddr_hit += gtinfo[i].pmu_result[3];
 
+	// Which core type causes most of the DRAM traffic, that one is
+	// throttled when the bandwidth runs out
+	uint64_t pcore_ddr_hit = 0;
+
+	for (int i = ACTIVE_THREADS; i < ALL_THREADS; i++)
+		pcore_ddr_hit += gtinfo[i].pmu_result[PMU_EV_DRAM_HIT];
+
+	int pcore_hog = PCORE_THREADS > 0 &&
+		pcore_ddr_hit > (uint64_t)total_ddr_hit;
+
+	if (PCORE_THREADS > 0) {
+		logd(TAG, "DRAM hits E-cores: %d  P-cores: %lu, throttling %s\n",
+		     total_ddr_hit, pcore_ddr_hit,
+		     pcore_hog ? "P-cores" : "E-cores");
+		pcore_tune(ddr_rd_percent, pcore_hog);
+	}
+
 	for (int i = 0; i < ACTIVE_THREADS; i++) {
 		l2_hitr[i] = ((float)gtinfo[i].pmu_result[1])
 			/ ((float)(gtinfo[i].pmu_result[1]
@@ -99,6 +179,11 @@ int basicalg(int tunealg)
 
 		logd(TAG, "core %02d PMU delta LD: %10ld  HIT(L2: %.2f  L3: %.2f) DDRpressure: %.2f  GOODPF: %.2f\n", i, gtinfo[i].pmu_result[0],
 			l2_hitr[i], l3_hitr[i], core_contr_to_ddr[i], good_pf[i]);
+		logd(TAG, "core %02d PF accuracy: %.2f  coverage: %.2f  lateness: %.2f  XQ pressure: %.2f\n", i,
+			gtinfo[i].pf.accuracy, gtinfo[i].pf.coverage, gtinfo[i].pf.lateness, gtinfo[i].pf.xq_pressure);
+		logd(TAG, "core %02d Memory bound: %.2f  (L2: %.2f  L3: %.2f  DRAM: %.2f)  mem sched: %.2f\n", i,
+			gtinfo[i].pf.mem_bound, gtinfo[i].pf.l2_stall, gtinfo[i].pf.l3_stall, gtinfo[i].pf.dram_stall,
+			gtinfo[i].pf.mem_sched);
 
 //		logd(TAG, "   LD: %ld  HIT(L2: %ld  L3: %ld  DDR: %ld)  GOODPF: %ld\n", gtinfo[i].pmu_result[0], gtinfo[i].pmu_result[1],
 //			gtinfo[i].pmu_result[2], gtinfo[i].pmu_result[3], gtinfo[i].pmu_result[4]);
@@ -116,36 +201,45 @@ int basicalg(int tunealg)
 
 		for (int i = 0; i < ACTIVE_THREADS; i++) {
 			int l2xq = msr_get_l2xq(&gtinfo[i].hwpf_msr_value[0]);
+			float rd_percent = memtier_core_percent(i, ddr_rd_percent);
 			int old_l2xq = l2xq;
 
-			if (ddr_rd_percent < 0.10) {
+			// the P-cores are throttled instead
+			if (ddr_rd_percent >= 0.80 && pcore_hog)
+				continue;
+
+			// not held up by memory, nothing to tune
+			if (module_mem_bound(i) < MEM_BOUND_MIN)
+				continue;
+
+			if (rd_percent < 0.10) {
 				//idle system
-			} else if (ddr_rd_percent < 0.20)
+			} else if (rd_percent < 0.20)
 				l2xq += lround(-8 * aggr);
-			else if (ddr_rd_percent < 0.30)
+			else if (rd_percent < 0.30)
 				l2xq += lround(-4 * aggr);
-			else if (ddr_rd_percent < 0.40)
+			else if (rd_percent < 0.40)
 				l2xq += lround(-2 * aggr);
-			else if (ddr_rd_percent < 0.50)
+			else if (rd_percent < 0.50)
 				l2xq += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.60)
+			else if (rd_percent < 0.60)
 				l2xq += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.70)
+			else if (rd_percent < 0.70)
 				l2xq += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.80)
+			else if (rd_percent < 0.80)
 				l2xq += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.90)
+			else if (rd_percent < 0.90)
 				l2xq += lround(1 * aggr);
-			else if (ddr_rd_percent < 0.93)
+			else if (rd_percent < 0.93)
 				l2xq += lround(2 * aggr);
-			else if (ddr_rd_percent < 0.96)
+			else if (rd_percent < 0.96)
 				l2xq += lround(4 * aggr);
 			else
 				l2xq += lround(8 * aggr);
 			if (l2xq <= 0)
 				l2xq = 1;
-			if (l2xq > L2XQ_MAX)
-				l2xq = L2XQ_MAX;
+			if (l2xq > msr_field_max(HWPF_L2_STREAM_AMP_XQ_THRESHOLD))
+				l2xq = msr_field_max(HWPF_L2_STREAM_AMP_XQ_THRESHOLD);
 			if (old_l2xq != l2xq) {
 				msr_set_l2xq(&gtinfo[i].hwpf_msr_value[0], l2xq);
 				gtinfo[i].hwpf_msr_dirty = 1;
@@ -153,39 +247,43 @@ int basicalg(int tunealg)
 					logv(TAG, "l2xq %d\n", l2xq);
 			}
 
+			// no LLC prefetcher on this SKU
+			if (!msr_field_supported(HWPF_LLC_STREAM_XQ_THRESHOLD))
+				continue;
+
 			int l3xq = msr_get_l3xq(
 				&gtinfo[i].hwpf_msr_value[0]);
 			int old_l3xq = l3xq;
 
-			if (ddr_rd_percent < 0.10);
+			if (rd_percent < 0.10);
 				//idle system
-			else if (ddr_rd_percent < 0.20)
+			else if (rd_percent < 0.20)
 				l3xq += lround(-8 * aggr);
-			else if (ddr_rd_percent < 0.30)
+			else if (rd_percent < 0.30)
 				l3xq += lround(-4 * aggr);
-			else if (ddr_rd_percent < 0.40)
+			else if (rd_percent < 0.40)
 				l3xq += lround(-2 * aggr);
-			else if (ddr_rd_percent < 0.50)
+			else if (rd_percent < 0.50)
 				l3xq += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.60)
+			else if (rd_percent < 0.60)
 				l3xq += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.70)
+			else if (rd_percent < 0.70)
 				l3xq += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.80)
+			else if (rd_percent < 0.80)
 				l3xq += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.90)
+			else if (rd_percent < 0.90)
 				l3xq += lround(1 * aggr);
-			else if (ddr_rd_percent < 0.93)
+			else if (rd_percent < 0.93)
 				l3xq += lround(2 * aggr);
-			else if (ddr_rd_percent < 0.96)
+			else if (rd_percent < 0.96)
 				l3xq += lround(4 * aggr);
 			else
 				l3xq += lround(8 * aggr);
 
 			if (l3xq <= 0)
 				l3xq = 1;
-			if (l3xq > L3XQ_MAX)
-				l3xq = L3XQ_MAX;
+			if (l3xq > msr_field_max(HWPF_LLC_STREAM_XQ_THRESHOLD))
+				l3xq = msr_field_max(HWPF_LLC_STREAM_XQ_THRESHOLD);
 
 			if (old_l3xq != l3xq) {
 				msr_set_l3xq(&gtinfo[i].hwpf_msr_value[0], l3xq);
@@ -203,36 +301,45 @@ int basicalg(int tunealg)
 
 		for (int i = 0; i < ACTIVE_THREADS; i++) {
 			int l2maxdist = msr_get_l2maxdist(&gtinfo[i].hwpf_msr_value[0]);
+			float rd_percent = memtier_core_percent(i, ddr_rd_percent);
 			int old_l2maxdist = l2maxdist;
 
-			if (ddr_rd_percent < 0.10); //idle system
-			else if (ddr_rd_percent < 0.20)
+			// the P-cores are throttled instead
+			if (ddr_rd_percent >= 0.80 && pcore_hog)
+				continue;
+
+			// not held up by memory, nothing to tune
+			if (module_mem_bound(i) < MEM_BOUND_MIN)
+				continue;
+
+			if (rd_percent < 0.10); //idle system
+			else if (rd_percent < 0.20)
 				l2maxdist += lround(+8 * aggr);
-			else if (ddr_rd_percent < 0.30)
+			else if (rd_percent < 0.30)
 				l2maxdist += lround(+4 * aggr);
-			else if (ddr_rd_percent < 0.40)
+			else if (rd_percent < 0.40)
 				l2maxdist += lround(+2 * aggr);
-			else if (ddr_rd_percent < 0.50)
+			else if (rd_percent < 0.50)
 				l2maxdist += lround(+1 * aggr);
-			else if (ddr_rd_percent < 0.60)
+			else if (rd_percent < 0.60)
 				l2maxdist += lround(+1 * aggr);
-			else if (ddr_rd_percent < 0.70)
+			else if (rd_percent < 0.70)
 				l2maxdist += lround(+1 * aggr);
-			else if (ddr_rd_percent < 0.80)
+			else if (rd_percent < 0.80)
 				l2maxdist += lround(+1 * aggr);
-			else if (ddr_rd_percent < 0.90)
+			else if (rd_percent < 0.90)
 				l2maxdist += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.93)
+			else if (rd_percent < 0.93)
 				l2maxdist += lround(-2 * aggr);
-			else if (ddr_rd_percent < 0.96)
+			else if (rd_percent < 0.96)
 				l2maxdist += lround(-4 * aggr);
 			else
 				l2maxdist += lround(-8 * aggr);
 
 			if (l2maxdist <= 0)
 				l2maxdist = 1;
-			if (l2maxdist > L2MAXDIST_MAX)
-				l2maxdist = L2MAXDIST_MAX;
+			if (l2maxdist > msr_field_max(HWPF_L2_STREAM_MAX_DISTANCE))
+				l2maxdist = msr_field_max(HWPF_L2_STREAM_MAX_DISTANCE);
 
 			if (old_l2maxdist != l2maxdist) {
 				msr_set_l2maxdist(
@@ -244,37 +351,41 @@ int basicalg(int tunealg)
 						l2maxdist);
 			}
 
+			// no LLC prefetcher on this SKU
+			if (!msr_field_supported(HWPF_LLC_STREAM_MAX_DISTANCE))
+				continue;
+
 			int l3maxdist = msr_get_l3maxdist(&gtinfo[i].hwpf_msr_value[0]);
 			int old_l3maxdist = l3maxdist;
 
-			if (ddr_rd_percent < 0.10); //idle system
-			else if (ddr_rd_percent < 0.20)
+			if (rd_percent < 0.10); //idle system
+			else if (rd_percent < 0.20)
 				l3maxdist += lround(+8 * aggr);
-			else if (ddr_rd_percent < 0.30)
+			else if (rd_percent < 0.30)
 				l3maxdist += lround(+4 * aggr);
-			else if (ddr_rd_percent < 0.40)
+			else if (rd_percent < 0.40)
 				l3maxdist += lround(+2 * aggr);
-			else if (ddr_rd_percent < 0.50)
+			else if (rd_percent < 0.50)
 				l3maxdist += lround(+1 * aggr);
-			else if (ddr_rd_percent < 0.60)
+			else if (rd_percent < 0.60)
 				l3maxdist += lround(+1 * aggr);
-			else if (ddr_rd_percent < 0.70)
+			else if (rd_percent < 0.70)
 				l3maxdist += lround(+1 * aggr);
-			else if (ddr_rd_percent < 0.80)
+			else if (rd_percent < 0.80)
 				l3maxdist += lround(+1 * aggr);
-			else if (ddr_rd_percent < 0.90)
+			else if (rd_percent < 0.90)
 				l3maxdist += lround(-1 * aggr);
-			else if (ddr_rd_percent < 0.93)
+			else if (rd_percent < 0.93)
 				l3maxdist += lround(-2 * aggr);
-			else if (ddr_rd_percent < 0.96)
+			else if (rd_percent < 0.96)
 				l3maxdist += lround(-4 * aggr);
 			else
 				l3maxdist += lround(-8 * aggr);
 
 			if (l3maxdist <= 0)
 				l3maxdist = 1;
-			if (l3maxdist > L3MAXDIST_MAX)
-				l3maxdist = L3MAXDIST_MAX;
+			if (l3maxdist > msr_field_max(HWPF_LLC_STREAM_MAX_DISTANCE))
+				l3maxdist = msr_field_max(HWPF_LLC_STREAM_MAX_DISTANCE);
 
 			if (old_l3maxdist != l3maxdist) {
 				msr_set_l3maxdist(&gtinfo[i].hwpf_msr_value[0], l3maxdist);
@@ -286,6 +397,9 @@ int basicalg(int tunealg)
 		}
 	}
 
+	// L2 partitions follow the prefetch depth set above
+	l2cat_tune(tunealg);
+
 	return 0;
 }
 
@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "msr.h"
+#include "log.h"
+#include "overhead.h"
+#include "uncore.h"
+
+#define TAG "UNCORE"
+
+// Uncore (mesh/ring) frequency and package energy of the packages the tuned
+// cores are on. A ratio pins both the min and max uncore limit, so an arm
+// of the tuners is a defined uncore frequency rather than a range the
+// hardware picks from. The limits found at startup are written back on exit.
+
+struct uncore_s uncore = {.ratio = UNCORE_RATIO_NONE};
+
+static int package_id[UNCORE_MAX_PACKAGES];
+static long boot_min_khz[UNCORE_MAX_PACKAGES]; //sysfs, die 0 of each package
+static long boot_max_khz[UNCORE_MAX_PACKAGES];
+
+static long sysfs_read(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	long value = -1;
+
+	if (f == NULL)
+		return -1;
+	if (fscanf(f, "%ld", &value) != 1)
+		value = -1;
+	fclose(f);
+
+	return value;
+}
+
+static int sysfs_write(const char *path, long value)
+{
+	FILE *f = fopen(path, "w");
+	int ret = 0;
+
+	if (f == NULL)
+		return -1;
+	if (fprintf(f, "%ld\n", value) < 0)
+		ret = -1;
+	if (fclose(f) != 0)
+		ret = -1;
+
+	return ret;
+}
+
+static long sysfs_die_read(int pkg, int die, const char *file)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), UNCORE_SYSFS "/package_%02d_die_%02d/%s",
+		 package_id[pkg], die, file);
+
+	return sysfs_read(path);
+}
+
+static int sysfs_die_write(int pkg, int die, const char *file, long value)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path), UNCORE_SYSFS "/package_%02d_die_%02d/%s",
+		 package_id[pkg], die, file);
+
+	return sysfs_write(path, value);
+}
+
+// Write min and max of every die of a package, in the order that keeps
+// min <= max at all times, the driver rejects anything else
+static int sysfs_limits_write(int pkg, long min_khz, long max_khz)
+{
+	for (int die = 0; sysfs_die_read(pkg, die, "max_freq_khz") >= 0; die++) {
+		long cur_max = sysfs_die_read(pkg, die, "max_freq_khz");
+		int ret;
+
+		if (min_khz > cur_max)
+			ret = sysfs_die_write(pkg, die, "max_freq_khz", max_khz) |
+			      sysfs_die_write(pkg, die, "min_freq_khz", min_khz);
+		else
+			ret = sysfs_die_write(pkg, die, "min_freq_khz", min_khz) |
+			      sysfs_die_write(pkg, die, "max_freq_khz", max_khz);
+		OVH_SYSCALL(6);
+		if (ret < 0) {
+			loge(TAG, "Could not set uncore limits of package %d "
+				  "die %d\n", package_id[pkg], die);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int cpu_package(int core)
+{
+	char path[128];
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+		 core);
+
+	return sysfs_read(path);
+}
+
+// Packages of cores first..last, their uncore limits and RAPL units
+int uncore_init(int first, int last)
+{
+	uint64_t unit;
+
+	uncore.num_packages = 0;
+	uncore.ratio = UNCORE_RATIO_NONE;
+	uncore.min_ratio = 0;
+	uncore.max_ratio = 0x7f;
+	uncore.sysfs = access(UNCORE_SYSFS, F_OK) == 0;
+
+	for (int core = first; core <= last; core++) {
+		int pkg = cpu_package(core);
+		int i;
+
+		if (pkg < 0) {
+			loge(TAG, "No package id for core %d\n", core);
+			return -1;
+		}
+		for (i = 0; i < uncore.num_packages; i++) {
+			if (package_id[i] == pkg)
+				break;
+		}
+		if (i < uncore.num_packages)
+			continue;
+		if (uncore.num_packages == UNCORE_MAX_PACKAGES) {
+			loge(TAG, "Too many packages, max is %d\n",
+			     UNCORE_MAX_PACKAGES);
+			return -1;
+		}
+		package_id[i] = pkg;
+		uncore.package_core[i] = core;
+		uncore.msr_file[i] = msr_open(core);
+		uncore.num_packages++;
+	}
+
+	for (int i = 0; i < uncore.num_packages; i++) {
+		int min, max;
+
+		if (uncore.sysfs) {
+			long lo = sysfs_die_read(i, 0, "initial_min_freq_khz");
+			long hi = sysfs_die_read(i, 0, "initial_max_freq_khz");
+
+			boot_min_khz[i] = sysfs_die_read(i, 0, "min_freq_khz");
+			boot_max_khz[i] = sysfs_die_read(i, 0, "max_freq_khz");
+			if (lo < 0 || hi < 0 || boot_min_khz[i] < 0 ||
+			    boot_max_khz[i] < 0) {
+				loge(TAG, "No uncore frequency limits for "
+					  "package %d\n", package_id[i]);
+				return -1;
+			}
+			min = (lo + UNCORE_RATIO_KHZ - 1) / UNCORE_RATIO_KHZ;
+			max = hi / UNCORE_RATIO_KHZ;
+		} else {
+			if (pread(uncore.msr_file[i], &uncore.ratio_boot[i], 8,
+				  MSR_UNCORE_RATIO_LIMIT) != 8) {
+				loge(TAG, "Could not read MSR 0x%x on core %d\n",
+				     MSR_UNCORE_RATIO_LIMIT,
+				     uncore.package_core[i]);
+				return -1;
+			}
+			min = (uncore.ratio_boot[i] >> 8) & 0x7f;
+			max = uncore.ratio_boot[i] & 0x7f;
+		}
+
+		if (min > uncore.min_ratio)
+			uncore.min_ratio = min;
+		if (max < uncore.max_ratio)
+			uncore.max_ratio = max;
+	}
+
+	if (pread(uncore.msr_file[0], &unit, 8, MSR_RAPL_POWER_UNIT) != 8) {
+		loge(TAG, "Could not read RAPL units on core %d\n",
+		     uncore.package_core[0]);
+		return -1;
+	}
+	uncore.energy_unit = 1.0 / (double)(1ULL << ((unit >> 8) & 0x1f));
+	uncore_energy_sample(); //starting point of the first interval
+
+	logi(TAG, "%d packages, uncore ratio %d-%d through %s\n",
+	     uncore.num_packages, uncore.min_ratio, uncore.max_ratio,
+	     uncore.sysfs ? "intel_uncore_frequency" : "MSR 0x620");
+
+	return 0;
+}
+
+// Pin the uncore of all packages to ratio, UNCORE_RATIO_NONE restores the
+// limits found at startup
+int uncore_set_ratio(int ratio)
+{
+	if (ratio == uncore.ratio)
+		return 0;
+
+	for (int i = 0; i < uncore.num_packages; i++) {
+		int ret;
+
+		if (uncore.sysfs) {
+			if (ratio == UNCORE_RATIO_NONE)
+				ret = sysfs_limits_write(i, boot_min_khz[i],
+							 boot_max_khz[i]);
+			else
+				ret = sysfs_limits_write(i,
+					(long)ratio * UNCORE_RATIO_KHZ,
+					(long)ratio * UNCORE_RATIO_KHZ);
+		} else {
+			uint64_t v = uncore.ratio_boot[i];
+
+			if (ratio != UNCORE_RATIO_NONE)
+				v = (v & ~0x7f7fULL) | (uint64_t)ratio << 8 |
+				    (uint64_t)ratio;
+			ret = pwrite(uncore.msr_file[i], &v, 8,
+				     MSR_UNCORE_RATIO_LIMIT) == 8 ? 0 : -1;
+			OVH_MSR_OP();
+			if (ret < 0)
+				loge(TAG, "Could not write MSR 0x%x on core "
+					  "%d\n", MSR_UNCORE_RATIO_LIMIT,
+				     uncore.package_core[i]);
+		}
+		if (ret < 0)
+			return -1;
+	}
+
+	logv(TAG, "Uncore ratio %d\n", ratio);
+	uncore.ratio = ratio;
+
+	return 0;
+}
+
+// Package energy of all packages since the previous call, in joules
+double uncore_energy_sample(void)
+{
+	double joules = 0;
+
+	for (int i = 0; i < uncore.num_packages; i++) {
+		uint64_t v;
+		uint32_t count;
+
+		OVH_MSR_OP();
+		if (pread(uncore.msr_file[i], &v, 8, MSR_PKG_ENERGY_STATUS) != 8) {
+			loge(TAG, "Could not read package energy on core %d\n",
+			     uncore.package_core[i]);
+			continue;
+		}
+		count = (uint32_t)v;
+		joules += (uint32_t)(count - uncore.energy_old[i]) *
+			  uncore.energy_unit;
+		uncore.energy_old[i] = count;
+	}
+
+	uncore.joules = joules;
+
+	return joules;
+}
+
+void uncore_deinit(void)
+{
+	if (uncore.num_packages == 0)
+		return;
+
+	uncore_set_ratio(UNCORE_RATIO_NONE);
+	for (int i = 0; i < uncore.num_packages; i++)
+		close(uncore.msr_file[i]);
+	uncore.num_packages = 0;
+}
@@ -512,10 +512,67 @@ int kernel_pmu_read(uint32_t core_id, uint64_t *pmu_values)
 	return 0;
 }
 
-// Read DDR bandwidth values
-// accept: Pointers to read_bw and write_bw
+// Read every PMU event of a core, scaled when the kernel multiplexes them
+// accept: core id, arrays of PMU_MAX_EVENTS values and duty cycles in percent
+// Returns: number of events, -1 on failure. groups is set to the number of
+// multiplexed groups, 1 when all events fit the counters
+int kernel_pmu_mux_read(uint32_t core_id, uint64_t *pmu_values,
+			uint32_t *duty_pct, uint32_t *groups)
+{
+	int fd;
+	ssize_t ret;
+	struct dpf_pmu_mux_read_s req;
+	struct dpf_resp_pmu_mux_read_s resp;
+
+	req.header.type = DPF_MSG_PMU_MUX_READ;
+	req.header.payload_size = sizeof(struct dpf_pmu_mux_read_s);
+	req.core_id = core_id;
+
+	fd = open(PROC_DEVICE, O_RDWR);
+	if (fd < 0) {
+		loge(TAG, "Failed to open %s for PMU read\n", PROC_DEVICE);
+		return -1;
+	}
+
+	ret = write(fd, &req, sizeof(req));
+	if (ret < 0) {
+		loge(TAG, "Failed to write PMU mux read request for core %u\n", core_id);
+		close(fd);
+		return -1;
+	}
+
+	ret = read(fd, &resp, sizeof(resp));
+	if (ret != sizeof(resp) || resp.num_events > PMU_MAX_EVENTS) {
+		loge(TAG, "Failed to read PMU events for core %u (ret = %zd)\n", core_id, ret);
+		close(fd);
+		return -1;
+	}
+
+	memcpy(pmu_values, resp.pmu_values, resp.num_events * sizeof(uint64_t));
+	memcpy(duty_pct, resp.duty_pct, resp.num_events * sizeof(uint32_t));
+	*groups = resp.groups;
+	close(fd);
+
+	return resp.num_events;
+}
+
+// Read the free running DDR byte counters, the bandwidth is the difference
+// of two reads
+// accept: Pointers to read_bytes and write_bytes
+// Returns: 0 on success, -1 on failure
+int kernel_ddr_bw_read(uint64_t *read_bytes, uint64_t *write_bytes)
+{
+	struct dpf_ddr_channels_s channels;
+
+	return kernel_ddr_channels_read(&channels, read_bytes, write_bytes);
+}
+
+// Read the free running DDR byte counters in total and per controller
+// accept: Pointer to the per controller result and pointers to read_bytes
+// and write_bytes
 // Returns: 0 on success, -1 on failure
-int kernel_ddr_bw_read(uint64_t *read_bw, uint64_t *write_bw)
+int kernel_ddr_channels_read(struct dpf_ddr_channels_s *channels,
+			     uint64_t *read_bytes, uint64_t *write_bytes)
 {
 	int fd;
 	ssize_t ret;
@@ -546,13 +603,56 @@ int kernel_ddr_bw_read(uint64_t *read_bw, uint64_t *write_bw)
 		return -1;
 	}
 
-	*read_bw = resp.read_bw;
-	*write_bw = resp.write_bw;
+	*read_bytes = resp.read_bytes;
+	*write_bytes = resp.write_bytes;
+	memcpy(channels, &resp.channels, sizeof(*channels));
 
 	close(fd);
 	return 0;
 }
 
+// Read PMU and MSR values of all enabled cores in a range and the DDR
+// bandwidth with a single request
+// accept: first core, number of cores and a response buffer of at least
+// DPF_SNAPSHOT_SIZE(core_count) bytes
+// Returns: number of cores in the snapshot, -1 on failure
+int kernel_snapshot_read(uint32_t core_start, uint32_t core_count,
+			 struct dpf_resp_snapshot_read_s *resp)
+{
+	int fd;
+	ssize_t ret;
+	struct dpf_snapshot_read_s req;
+
+	req.header.type = DPF_MSG_SNAPSHOT_READ;
+	req.header.payload_size = sizeof(struct dpf_snapshot_read_s);
+	req.core_start = core_start;
+	req.core_count = core_count;
+
+	fd = open(PROC_DEVICE, O_RDWR);
+	if (fd < 0) {
+		loge(TAG, "Failed to open %s for snapshot read\n", PROC_DEVICE);
+		return -1;
+	}
+
+	ret = write(fd, &req, sizeof(req));
+	if (ret < 0) {
+		loge(TAG, "Failed to write snapshot read request\n");
+		close(fd);
+		return -1;
+	}
+
+	ret = read(fd, resp, DPF_SNAPSHOT_SIZE(core_count));
+	if (ret < (ssize_t)sizeof(*resp) ||
+	    ret != (ssize_t)DPF_SNAPSHOT_SIZE(resp->core_count)) {
+		loge(TAG, "Failed to read snapshot (ret = %zd)\n", ret);
+		close(fd);
+		return -1;
+	}
+
+	close(fd);
+	return resp->core_count;
+}
+
 // Logs MSR values for a specific core
 // core_id: The CPU core to read from
 // Returns: 0 on success, -1 on failure
@@ -590,6 +690,16 @@ int kernel_log_pmu_values(uint32_t core_id)
 	for (int i = 0; i < PMU_COUNTERS; i++)
 		logi(TAG, "PMU %d: %llu\n", i, pmu_values[i]);
 
+	// with extra_events the kernel multiplexes, show all with duty cycle
+	uint64_t mux_values[PMU_MAX_EVENTS];
+	uint32_t duty_pct[PMU_MAX_EVENTS];
+	uint32_t groups;
+	int n = kernel_pmu_mux_read(core_id, mux_values, duty_pct, &groups);
+
+	for (int i = 0; groups > 1 && i < n; i++)
+		logi(TAG, "PMU %d: %lu (counted %u%% of the interval)\n", i,
+		     mux_values[i], duty_pct[i]);
+
 	return 0;
 }
 
@@ -597,25 +707,33 @@ int kernel_log_pmu_values(uint32_t core_id)
 // Returns: 0 on success, -1 on failure
 int kernel_log_ddr_bw(void)
 {
-	uint64_t read_bw, write_bw;
+	uint64_t read_bytes, write_bytes;
+	static uint64_t read_old, write_old;
 	static uint64_t time_old = 0;
+	uint64_t time_now;
 
-	if (kernel_ddr_bw_read(&read_bw, &write_bw) < 0) {
+	if (kernel_ddr_bw_read(&read_bytes, &write_bytes) < 0) {
 		loge(TAG, "Failed to read DDR bandwidth values\n");
 		return -1;
 	}
 
+	time_now = get_time_ms();
+
 	//  first call - initialize timing and show values in MB
 	if (time_old == 0) {
-		time_old = get_time_ms();
-		double read_mb = (double)read_bw / (1024 * 1024);
-		double write_mb = (double)write_bw / (1024 * 1024);
+		double read_mb = (double)read_bytes / (1024 * 1024);
+		double write_mb = (double)write_bytes / (1024 * 1024);
 		logi(TAG, "DDR Bandwidth Initialization: Read=%.2f MB, Write=%.2f MB\n", read_mb, write_mb);
-		return 0;
+	} else if (time_now > time_old) {
+		double secs = (time_now - time_old) / 1000.0;
+		double read_mbs = (double)(read_bytes - read_old) / (1024 * 1024) / secs;
+		double write_mbs = (double)(write_bytes - write_old) / (1024 * 1024) / secs;
+		logd(TAG, "DDR Bandwidth: Read=%.2f MB/s, Write=%.2f MB/s\n", read_mbs, write_mbs);
 	}
 
-	// subsequent calls
-	time_old = get_time_ms();
+	read_old = read_bytes;
+	write_old = write_bytes;
+	time_old = time_now;
 
 	return 0;
 }